@@ -0,0 +1,292 @@
+#pragma once
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include "../ImageHandling/Image.h"
+#include "../fonts/colors.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+// POSIX file mapping
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// decoded image assets, shared across the process and persisted to disk
+	// - first request for a path decodes the source image, writes the raw pixels to a page aligned file in the cache
+	//   directory, and hands out a shared, read only copy
+	// - later runs check the source's modification time and size against the header of the cached file, and only hash
+	//   the source when those differ - if the hash still matches, the header is refreshed and the cached file is mapped
+	// - requests for a path that is in flight wait on the same shared future, and requests for one that's still held
+	//   somewhere get the same copy, so there's only ever one decode and one copy in memory
+	// - the cache itself only holds weak references to finished loads, so an image is freed once its last user drops it
+
+constexpr const char * assetCacheDirectory = ".assetCache/";
+constexpr uint32_t assetCacheVersion = 2;
+constexpr size_t assetCachePageSize = 4096;
+
+struct assetCacheHeader {
+	char magic[ 8 ] = { 'S', 'I', 'R', 'E', 'N', 'A', 'C', '\0' };
+	uint32_t version = assetCacheVersion;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t bytesPerPixel = 4;
+	uint64_t contentHash = 0;	// hash of the source file, invalidates the entry when the source changes
+	int64_t sourceModified = 0;	// source modification time and size when last validated, so an unchanged source isn't hashed
+	uint64_t sourceSize = 0;
+	uint64_t dataSize = 0;		// bytes of pixel data, starting at assetCachePageSize
+};
+static_assert( sizeof( assetCacheHeader ) <= assetCachePageSize, "asset cache header must fit in the first page" );
+
+struct assetLoadRecord {
+	std::string path;
+	bool cacheHit;
+	float milliseconds;
+};
+
+// read only view of a whole file, through mmap
+class mappedFile {
+public:
+	mappedFile ( const std::string & path ) {
+		int fd = open( path.c_str(), O_RDONLY );
+		if ( fd < 0 ) return;
+		struct stat s;
+		if ( fstat( fd, &s ) == 0 && s.st_size > 0 ) {
+			void * mapping = mmap( nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+			if ( mapping != MAP_FAILED ) {
+				base = ( const uint8_t * ) mapping;
+				size = s.st_size;
+			}
+		}
+		close( fd ); // the mapping holds its own reference
+	}
+	~mappedFile () { if ( base ) munmap( ( void * ) base, size ); }
+	mappedFile ( const mappedFile & ) = delete;
+	mappedFile & operator = ( const mappedFile & ) = delete;
+
+	bool Valid () const { return base != nullptr; }
+
+	const uint8_t * base = nullptr;
+	size_t size = 0;
+};
+
+// modification time and size, false if the file isn't there
+inline bool StatFile ( const std::string & path, int64_t & modified, uint64_t & size ) {
+	std::error_code ec;
+	const auto time = std::filesystem::last_write_time( path, ec );
+	if ( ec ) return false;
+	size = std::filesystem::file_size( path, ec );
+	if ( ec ) return false;
+	modified = int64_t( time.time_since_epoch().count() );
+	return true;
+}
+
+// 64-bit FNV-1a variant, eight bytes per step - not cryptographic, only needs to catch edits to the source file
+inline uint64_t HashBytes ( const uint8_t * bytes, size_t count ) {
+	constexpr uint64_t prime = 0x100000001B3ull;
+	uint64_t hash = 0xCBF29CE484222325ull;
+	size_t i = 0;
+	for ( ; i + 8 <= count; i += 8 ) {
+		uint64_t word;
+		std::memcpy( &word, bytes + i, 8 );
+		hash = ( hash ^ word ) * prime;
+		hash ^= hash >> 29;
+	}
+	for ( ; i < count; i++ ) {
+		hash = ( hash ^ bytes[ i ] ) * prime;
+	}
+	return hash;
+}
+
+class AssetCache {
+public:
+	// one cache for the whole process
+	static AssetCache & Get () {
+		static AssetCache instance;
+		return instance;
+	}
+
+	// returns the shared, decoded image - blocks until it's available
+	std::shared_ptr< const Image > LoadImage ( const std::string & path ) {
+		std::shared_ptr< const Image > image = Prefetch( path ).get();
+		std::lock_guard< std::mutex > lock( entriesMutex );
+		Settle();
+		return image;
+	}
+
+	// starts the load on another thread unless this path is already in flight or still held, returns immediately
+	std::shared_future< std::shared_ptr< const Image > > Prefetch ( const std::string & path ) {
+		std::lock_guard< std::mutex > lock( entriesMutex );
+		Settle();
+		entry & e = entries[ path ];
+		if ( e.pending.valid() ) {
+			return e.pending;
+		}
+		if ( std::shared_ptr< const Image > image = e.image.lock() ) {
+			std::promise< std::shared_ptr< const Image > > ready;
+			ready.set_value( image );
+			return ready.get_future().share();
+		}
+		e.pending = std::async( std::launch::async, [ this, path ] () {
+			return std::shared_ptr< const Image >( LoadUncached( path ) );
+		} ).share();
+		return e.pending;
+	}
+
+	// prints the loads since the last report, in the style of the startup log
+	void Report () {
+		std::lock_guard< std::mutex > lock( recordsMutex );
+		for ( auto & record : records ) {
+			std::cout << T_RED << "      Asset : " << T_CYAN << record.path << RESET
+				<< ( record.cacheHit ? " mapped from cache in " : " decoded in " )
+				<< std::fixed << std::setprecision( 2 ) << record.milliseconds << "ms" << std::endl;
+		}
+		records.clear();
+	}
+
+private:
+	AssetCache () {
+		std::error_code ec; // failure here just means we can't persist, loads still work
+		std::filesystem::create_directories( assetCacheDirectory, ec );
+	}
+
+	std::string CachePathFor ( const std::string & path ) {
+		std::stringstream ss;
+		ss << assetCacheDirectory << std::hex << std::setw( 16 ) << std::setfill( '0' )
+			<< HashBytes( ( const uint8_t * ) path.data(), path.size() ) << ".raw";
+		return ss.str();
+	}
+
+	// finished loads drop to weak references, and entries nobody holds anymore are forgotten - caller holds entriesMutex
+	void Settle () {
+		for ( auto it = entries.begin(); it != entries.end(); ) {
+			entry & e = it->second;
+			if ( e.pending.valid() && e.pending.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready ) {
+				e.image = e.pending.get();
+				e.pending = std::shared_future< std::shared_ptr< const Image > >();
+			}
+			if ( !e.pending.valid() && e.image.expired() ) {
+				it = entries.erase( it );
+			} else {
+				++it;
+			}
+		}
+	}
+
+	std::shared_ptr< Image > LoadUncached ( const std::string & path ) {
+		auto tStart = std::chrono::high_resolution_clock::now();
+		std::shared_ptr< Image > result = std::make_shared< Image >();
+
+		assetCacheHeader source;
+		const bool sourceExists = StatFile( path, source.sourceModified, source.sourceSize );
+
+		const std::string cachePath = CachePathFor( path );
+		bool cacheHit = sourceExists && LoadFromCacheFile( cachePath, path, source, *result );
+		if ( !cacheHit ) {
+			result->Load( path );
+			if ( source.contentHash == 0 ) {
+				source.contentHash = HashSource( path );
+			}
+			if ( source.contentHash != 0 && !result->data.empty() ) {
+				WriteCacheFile( cachePath, source, *result );
+			}
+		}
+
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		std::lock_guard< std::mutex > lock( recordsMutex );
+		records.push_back( { path, cacheHit, std::chrono::duration_cast< std::chrono::microseconds >( tEnd - tStart ).count() / 1000.0f } );
+		return result;
+	}
+
+	uint64_t HashSource ( const std::string & path ) {
+		mappedFile file( path );
+		return file.Valid() ? HashBytes( file.base, file.size ) : 0;
+	}
+
+	// source carries the modification time and size from StatFile - the hash is filled in here, if it was needed
+	bool LoadFromCacheFile ( const std::string & cachePath, const std::string & path, assetCacheHeader & source, Image & image ) {
+		mappedFile cached( cachePath );
+		if ( !cached.Valid() || cached.size < assetCachePageSize ) return false;
+
+		assetCacheHeader header;
+		std::memcpy( &header, cached.base, sizeof( header ) );
+		if ( std::memcmp( header.magic, assetCacheHeader().magic, sizeof( header.magic ) ) != 0 ||
+			header.version != assetCacheVersion ||
+			header.dataSize != size_t( header.width ) * header.height * header.bytesPerPixel ||
+			cached.size < assetCachePageSize + header.dataSize ) {
+			return false;
+		}
+
+		// cheap check first, the hash only when that fails
+		if ( header.sourceSize != source.sourceSize ) return false;
+		if ( header.sourceModified != source.sourceModified ) {
+			source.contentHash = HashSource( path );
+			if ( source.contentHash != header.contentHash ) return false;
+			// same contents under a new timestamp - record it, so the next run takes the cheap path again
+			header.sourceModified = source.sourceModified;
+			RewriteHeader( cachePath, header );
+		}
+
+		image.width = header.width;
+		image.height = header.height;
+		image.data.resize( header.dataSize );
+		std::memcpy( image.data.data(), cached.base + assetCachePageSize, header.dataSize );
+		return true;
+	}
+
+	void WriteCacheFile ( const std::string & cachePath, const assetCacheHeader & source, const Image & image ) {
+		assetCacheHeader header = source;
+		header.width = image.width;
+		header.height = image.height;
+		header.bytesPerPixel = image.numChannels;
+		header.dataSize = image.data.size();
+
+		// header padded out to a full page, so the pixel data is page aligned in the mapping
+		std::vector< uint8_t > firstPage( assetCachePageSize, 0 );
+		std::memcpy( firstPage.data(), &header, sizeof( header ) );
+
+		// write to a temporary and rename, so a concurrent or interrupted run never maps a partial file
+		const std::string tempPath = cachePath + ".tmp" + std::to_string( getpid() );
+		std::ofstream file( tempPath, std::ios::binary );
+		file.write( ( const char * ) firstPage.data(), firstPage.size() );
+		file.write( ( const char * ) image.data.data(), image.data.size() );
+		file.close();
+		std::error_code ec;
+		if ( file.good() ) {
+			std::filesystem::rename( tempPath, cachePath, ec );
+		} else {
+			std::filesystem::remove( tempPath, ec );
+		}
+	}
+
+	// in place, the header is much smaller than a page - failure only costs a hash on the next run
+	void RewriteHeader ( const std::string & cachePath, const assetCacheHeader & header ) {
+		std::fstream file( cachePath, std::ios::binary | std::ios::in | std::ios::out );
+		if ( file.is_open() ) {
+			file.write( ( const char * ) &header, sizeof( header ) );
+		}
+	}
+
+	// a load in flight holds its future, a finished one is only a weak reference
+	struct entry {
+		std::shared_future< std::shared_ptr< const Image > > pending;
+		std::weak_ptr< const Image > image;
+	};
+
+	std::mutex entriesMutex;
+	std::unordered_map< std::string, entry > entries;
+
+	std::mutex recordsMutex;
+	std::vector< assetLoadRecord > records;
+};
+
+#endif
@@ -0,0 +1,485 @@
+#pragma once
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include "../ImageHandling/Image.h"
+#include "../Threading/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+// bloom as a convolution of the HDR image with a large kernel ( a loaded PSF, or the generated starburst below ), done
+// through a 2D FFT - the cost doesn't depend on the kernel size, so the kernel can be as big as the image
+	// - the image is zero padded to at least size + kernel radius on each axis, so nothing wraps around, rounded up to a
+	//   size with only 2, 3, 5 factors rather than a power of two - 3840 + radius would otherwise go to 8192
+	// - real to complex: rows go two at a time, as the real and imaginary parts of one complex row, and get separated
+	//   after the transform - only the half spectrum ( width / 2 + 1 columns ) is kept and sent through the column pass
+	// - both passes transform 16 signals at once, side by side in memory, so every butterfly is a flat loop over 16
+	//   floats that vectorizes - rows are gathered into that layout, columns are read as 16 wide strips of the spectrum
+	// - kernel spectra are cached until the kernel or the image size changes, so only the image is transformed per call,
+	//   and intensity is a mix with the convolved result, which doesn't touch either
+	// - alpha is left alone
+
+struct starburstSettings {
+	int radius = 256;			// kernel extent in pixels, the kernel image is 2 * radius + 1 square
+	int spikes = 6;				// number of streaks, from diffraction on that many aperture blades
+	float rotation = 0.0f;		// radians
+	float sharpness = 64.0f;	// exponent on the streak profile, higher is thinner
+	float coreWidth = 1.5f;		// gaussian sigma of the center, in pixels
+	float glow = 0.02f;			// weight of the wide halo, relative to the streaks
+	float dispersion = 0.08f;	// green and blue get smaller by this much each, for color fringing on the streaks
+};
+
+namespace bloomDetail {
+	constexpr int lanes = 16;
+	constexpr double pi = 3.14159265358979323846;
+
+	// smallest even size >= minimum with no prime factors past 5
+	inline int GoodSize ( int minimum ) {
+		for ( int n = std::max( minimum + ( minimum & 1 ), 2 );; n += 2 ) {
+			int m = n;
+			for ( int f : { 2, 3, 5 } ) while ( m % f == 0 ) m /= f;
+			if ( m == 1 ) return n;
+		}
+	}
+
+	// twiddles for each stage of a Stockham autosort FFT, radix 4 stages first, then 2, 3, 5
+	struct fftPlan {
+		int n = 0;
+		std::vector< int > radices;
+		std::vector< int > twiddleOffset;
+		std::vector< float > twiddleRe;
+		std::vector< float > twiddleIm;
+
+		fftPlan () {}
+		explicit fftPlan ( int size ) : n( size ) {
+			int m = n;
+			while ( m % 4 == 0 ) { radices.push_back( 4 ); m /= 4; }
+			for ( int f : { 2, 3, 5 } ) while ( m % f == 0 ) { radices.push_back( f ); m /= f; }
+			int length = n;
+			for ( int r : radices ) {
+				// stage at this length takes w^j, w = exp( -2 pi i p / length ), for p < length / r and j in [ 1, r )
+				twiddleOffset.push_back( int( twiddleRe.size() ) );
+				for ( int p = 0; p < length / r; p++ ) {
+					for ( int j = 1; j < r; j++ ) {
+						const double angle = -2.0 * pi * double( p ) * double( j ) / double( length );
+						twiddleRe.push_back( float( std::cos( angle ) ) );
+						twiddleIm.push_back( float( std::sin( angle ) ) );
+					}
+				}
+				length /= r;
+			}
+		}
+	};
+
+	// one radix r butterfly, applied to span floats side by side - x holds inputs k at x[ k * inStep ], outputs j go to
+	// y[ j * span ], times twiddle w^j. Goes through the stack 16 at a time: reading x and writing y in the same loop is
+	// up to twenty streams that might overlap, gcc gives up on checking that at runtime and doesn't vectorize at all -
+	// the stack copies can't overlap anything
+	template < int r >
+	inline void Butterfly ( const float * x0r, const float * x0i, float * y0r, float * y0i, size_t inStep, int span, const float * tr, const float * ti ) {
+		const float w1r = tr[ 0 ], w1i = ti[ 0 ];
+		const float w2r = ( r > 2 ) ? tr[ 1 ] : 0.0f, w2i = ( r > 2 ) ? ti[ 1 ] : 0.0f;
+		const float w3r = ( r > 3 ) ? tr[ 2 ] : 0.0f, w3i = ( r > 3 ) ? ti[ 2 ] : 0.0f;
+		const float w4r = ( r > 4 ) ? tr[ 3 ] : 0.0f, w4i = ( r > 4 ) ? ti[ 3 ] : 0.0f;
+		for ( int chunk = 0; chunk < span; chunk += lanes ) {
+			float xr[ r ][ lanes ], xi[ r ][ lanes ];
+			for ( int k = 0; k < r; k++ ) {
+				std::copy_n( x0r + k * inStep + chunk, lanes, xr[ k ] );
+				std::copy_n( x0i + k * inStep + chunk, lanes, xi[ k ] );
+			}
+			float yr[ r ][ lanes ], yi[ r ][ lanes ];
+			if constexpr ( r == 2 ) {
+				for ( int t = 0; t < lanes; t++ ) {
+					const float dr = xr[ 0 ][ t ] - xr[ 1 ][ t ], di = xi[ 0 ][ t ] - xi[ 1 ][ t ];
+					yr[ 0 ][ t ] = xr[ 0 ][ t ] + xr[ 1 ][ t ]; yi[ 0 ][ t ] = xi[ 0 ][ t ] + xi[ 1 ][ t ];
+					yr[ 1 ][ t ] = dr * w1r - di * w1i; yi[ 1 ][ t ] = dr * w1i + di * w1r;
+				}
+			}
+			if constexpr ( r == 3 ) {
+				constexpr float s60 = 0.86602540f;
+				for ( int t = 0; t < lanes; t++ ) {
+					const float sr = xr[ 1 ][ t ] + xr[ 2 ][ t ], si = xi[ 1 ][ t ] + xi[ 2 ][ t ];
+					const float dr = xr[ 1 ][ t ] - xr[ 2 ][ t ], di = xi[ 1 ][ t ] - xi[ 2 ][ t ];
+					const float mr = xr[ 0 ][ t ] - 0.5f * sr, mi = xi[ 0 ][ t ] - 0.5f * si;
+					const float c1r = mr + s60 * di, c1i = mi - s60 * dr;
+					const float c2r = mr - s60 * di, c2i = mi + s60 * dr;
+					yr[ 0 ][ t ] = xr[ 0 ][ t ] + sr; yi[ 0 ][ t ] = xi[ 0 ][ t ] + si;
+					yr[ 1 ][ t ] = c1r * w1r - c1i * w1i; yi[ 1 ][ t ] = c1r * w1i + c1i * w1r;
+					yr[ 2 ][ t ] = c2r * w2r - c2i * w2i; yi[ 2 ][ t ] = c2r * w2i + c2i * w2r;
+				}
+			}
+			if constexpr ( r == 4 ) {
+				for ( int t = 0; t < lanes; t++ ) {
+					const float s0r = xr[ 0 ][ t ] + xr[ 2 ][ t ], s0i = xi[ 0 ][ t ] + xi[ 2 ][ t ];
+					const float d0r = xr[ 0 ][ t ] - xr[ 2 ][ t ], d0i = xi[ 0 ][ t ] - xi[ 2 ][ t ];
+					const float s1r = xr[ 1 ][ t ] + xr[ 3 ][ t ], s1i = xi[ 1 ][ t ] + xi[ 3 ][ t ];
+					const float d1r = xr[ 1 ][ t ] - xr[ 3 ][ t ], d1i = xi[ 1 ][ t ] - xi[ 3 ][ t ];
+					// -i * d1 = ( d1i, -d1r )
+					const float c1r = d0r + d1i, c1i = d0i - d1r;
+					const float c2r = s0r - s1r, c2i = s0i - s1i;
+					const float c3r = d0r - d1i, c3i = d0i + d1r;
+					yr[ 0 ][ t ] = s0r + s1r; yi[ 0 ][ t ] = s0i + s1i;
+					yr[ 1 ][ t ] = c1r * w1r - c1i * w1i; yi[ 1 ][ t ] = c1r * w1i + c1i * w1r;
+					yr[ 2 ][ t ] = c2r * w2r - c2i * w2i; yi[ 2 ][ t ] = c2r * w2i + c2i * w2r;
+					yr[ 3 ][ t ] = c3r * w3r - c3i * w3i; yi[ 3 ][ t ] = c3r * w3i + c3i * w3r;
+				}
+			}
+			if constexpr ( r == 5 ) {
+				constexpr float c1 = 0.30901699f, c2 = -0.80901699f; // cos( 2 pi / 5 ), cos( 4 pi / 5 )
+				constexpr float s1 = 0.95105652f, s2 = 0.58778525f;  // sin( 2 pi / 5 ), sin( 4 pi / 5 )
+				for ( int t = 0; t < lanes; t++ ) {
+					const float s14r = xr[ 1 ][ t ] + xr[ 4 ][ t ], s14i = xi[ 1 ][ t ] + xi[ 4 ][ t ];
+					const float d14r = xr[ 1 ][ t ] - xr[ 4 ][ t ], d14i = xi[ 1 ][ t ] - xi[ 4 ][ t ];
+					const float s23r = xr[ 2 ][ t ] + xr[ 3 ][ t ], s23i = xi[ 2 ][ t ] + xi[ 3 ][ t ];
+					const float d23r = xr[ 2 ][ t ] - xr[ 3 ][ t ], d23i = xi[ 2 ][ t ] - xi[ 3 ][ t ];
+					const float m1r = xr[ 0 ][ t ] + c1 * s14r + c2 * s23r, m1i = xi[ 0 ][ t ] + c1 * s14i + c2 * s23i;
+					const float m2r = xr[ 0 ][ t ] + c2 * s14r + c1 * s23r, m2i = xi[ 0 ][ t ] + c2 * s14i + c1 * s23i;
+					// outputs 1 / 4 are m1 -/+ i n1, 2 / 3 are m2 -/+ i n2
+					const float n1r = s1 * d14r + s2 * d23r, n1i = s1 * d14i + s2 * d23i;
+					const float n2r = s2 * d14r - s1 * d23r, n2i = s2 * d14i - s1 * d23i;
+					const float c1r = m1r + n1i, c1i = m1i - n1r;
+					const float c4r = m1r - n1i, c4i = m1i + n1r;
+					const float c2r = m2r + n2i, c2i = m2i - n2r;
+					const float c3r = m2r - n2i, c3i = m2i + n2r;
+					yr[ 0 ][ t ] = xr[ 0 ][ t ] + s14r + s23r; yi[ 0 ][ t ] = xi[ 0 ][ t ] + s14i + s23i;
+					yr[ 1 ][ t ] = c1r * w1r - c1i * w1i; yi[ 1 ][ t ] = c1r * w1i + c1i * w1r;
+					yr[ 2 ][ t ] = c2r * w2r - c2i * w2i; yi[ 2 ][ t ] = c2r * w2i + c2i * w2r;
+					yr[ 3 ][ t ] = c3r * w3r - c3i * w3i; yi[ 3 ][ t ] = c3r * w3i + c3i * w3r;
+					yr[ 4 ][ t ] = c4r * w4r - c4i * w4i; yi[ 4 ][ t ] = c4r * w4i + c4i * w4r;
+				}
+			}
+			for ( int j = 0; j < r; j++ ) {
+				std::copy_n( yr[ j ], lanes, y0r + size_t( j ) * span + chunk );
+				std::copy_n( yi[ j ], lanes, y0i + size_t( j ) * span + chunk );
+			}
+		}
+	}
+
+	// forward transform of lanes signals at once, element e of signal l at [ e * lanes + l ] - true when the result
+	// landed in the scratch arrays instead of re / im. Inverse is conjugate in, transform, conjugate out
+	inline bool Transform ( const fftPlan & plan, float * re, float * im, float * scratchRe, float * scratchIm ) {
+		float * xr = re, * xi = im, * yr = scratchRe, * yi = scratchIm;
+		int length = plan.n;
+		int span = lanes; // stride between elements, times lanes - the butterflies run over it
+		for ( size_t stage = 0; stage < plan.radices.size(); stage++ ) {
+			const int r = plan.radices[ stage ];
+			const int m = length / r;
+			const size_t inStep = size_t( m ) * span;
+			const float * twRe = &plan.twiddleRe[ plan.twiddleOffset[ stage ] ];
+			const float * twIm = &plan.twiddleIm[ plan.twiddleOffset[ stage ] ];
+			for ( int p = 0; p < m; p++ ) {
+				// inputs p + k * m, outputs r * p + j
+				const size_t in = size_t( p ) * span, out = size_t( r * p ) * span;
+				const float * tr = twRe + p * ( r - 1 ), * ti = twIm + p * ( r - 1 );
+				switch ( r ) {
+					case 2: Butterfly< 2 >( xr + in, xi + in, yr + out, yi + out, inStep, span, tr, ti ); break;
+					case 3: Butterfly< 3 >( xr + in, xi + in, yr + out, yi + out, inStep, span, tr, ti ); break;
+					case 4: Butterfly< 4 >( xr + in, xi + in, yr + out, yi + out, inStep, span, tr, ti ); break;
+					case 5: Butterfly< 5 >( xr + in, xi + in, yr + out, yi + out, inStep, span, tr, ti ); break;
+					default: break;
+				}
+			}
+			length = m;
+			span *= r;
+			std::swap( xr, yr );
+			std::swap( xi, yi );
+		}
+		return ( plan.radices.size() % 2 ) == 1;
+	}
+
+	// per thread buffers for one 16 wide batch
+	struct scratch {
+		std::vector< float > re, im, tempRe, tempIm;
+		explicit scratch ( int n ) : re( size_t( n ) * lanes ), im( size_t( n ) * lanes ), tempRe( size_t( n ) * lanes ), tempIm( size_t( n ) * lanes ) {}
+		// after Transform, wherever the result is
+		float * ResultRe ( bool inScratch ) { return inScratch ? tempRe.data() : re.data(); }
+		float * ResultIm ( bool inScratch ) { return inScratch ? tempIm.data() : im.data(); }
+	};
+
+	// calls func( index, scratch ) for indices in [ 0, count ), one scratch per thread, allocated once per call
+	template < typename F >
+	inline void ParallelBatches ( int count, int n, F && func ) {
+		std::atomic< int > next( 0 );
+		ThreadPool::Get().RunOnAll( [ & ] ( int ) {
+			int index = next.fetch_add( 1 );
+			if ( index >= count ) return;
+			scratch s( n );
+			for ( ; index < count; index = next.fetch_add( 1 ) ) func( index, s );
+		} );
+	}
+}
+
+class FFTBloom {
+public:
+	// any size, centered on the middle pixel, channels normalized to sum to one each - so the mix keeps overall
+	// brightness the same, and intensity just moves energy out of the bright spots into the streaks and halo
+	void SetKernel ( const ImageF & psf ) {
+		kernel = psf;
+		for ( int c = 0; c < 3; c++ ) {
+			double sum = 0.0;
+			for ( size_t i = c; i < kernel.data.size(); i += 4 ) sum += kernel.data[ i ];
+			const float scale = ( sum > 0.0 ) ? float( 1.0 / sum ) : 0.0f;
+			for ( size_t i = c; i < kernel.data.size(); i += 4 ) kernel.data[ i ] *= scale;
+		}
+		spectrumWidth = spectrumHeight = 0; // rebuilt on the next call
+	}
+
+	bool HasKernel () const { return kernel.width > 0 && kernel.height > 0; }
+
+	// streaks from the aperture blades, a gaussian core and a wide halo, with the streaks slightly shorter for green and
+	// blue - not normalized, SetKernel does that
+	static ImageF Starburst ( const starburstSettings & s ) {
+		const int size = 2 * s.radius + 1;
+		ImageF result( size, size );
+		ThreadPool::Get().ParallelFor( 0, size, [ & ] ( int y ) {
+			for ( int x = 0; x < size; x++ ) {
+				const float dx = float( x - s.radius ), dy = float( y - s.radius );
+				const float r = std::sqrt( dx * dx + dy * dy );
+				const float angle = std::atan2( dy, dx ) - s.rotation;
+				// even blade counts put the streaks on top of each other in pairs
+				const float streakCount = ( s.spikes % 2 == 0 ) ? float( s.spikes ) / 2.0f : float( s.spikes );
+				const float streak = std::pow( std::abs( std::cos( angle * streakCount ) ), s.sharpness );
+				const float core = std::exp( -r * r / ( 2.0f * s.coreWidth * s.coreWidth ) );
+				for ( int c = 0; c < 3; c++ ) {
+					const float extent = float( s.radius ) * ( 1.0f - s.dispersion * float( c ) );
+					const float falloff = std::max( 1.0f - r / extent, 0.0f );
+					const float halo = s.glow / ( 1.0f + r * r / ( 0.01f * extent * extent ) );
+					result.data[ ( size_t( y ) * size + x ) * 4 + c ] = core + ( streak * falloff * falloff / ( 1.0f + r ) + halo ) * falloff;
+				}
+				result.data[ ( size_t( y ) * size + x ) * 4 + 3 ] = 1.0f;
+			}
+		}, 16 );
+		return result;
+	}
+
+	// out gets image convolved with the kernel, alpha copied through - sizes of in and out match after the call
+	void Convolve ( const ImageF & in, ImageF & out ) {
+		using namespace bloomDetail;
+		out.width = in.width;
+		out.height = in.height;
+		out.data.resize( in.data.size() );
+		if ( !HasKernel() || in.width == 0 || in.height == 0 ) {
+			out.data = in.data;
+			return;
+		}
+		Prepare( in.width, in.height );
+		for ( int c = 0; c < 3; c++ ) {
+			ForwardRows( in, c, in.width, in.height, spectrumRe.data(), spectrumIm.data() );
+			Columns( c, false );
+			InverseRows( out, c );
+		}
+		for ( size_t i = 3; i < out.data.size(); i += 4 ) out.data[ i ] = in.data[ i ];
+	}
+
+	// image = mix( image, image convolved with the kernel, intensity )
+	void Apply ( ImageF & image, float intensity ) {
+		ImageF convolved;
+		Convolve( image, convolved );
+		Mix( image, convolved, intensity );
+	}
+
+	static void Mix ( ImageF & image, const ImageF & convolved, float intensity ) {
+		if ( convolved.data.size() != image.data.size() ) return;
+		ThreadPool::Get().ParallelFor( 0, int( image.height ), [ & ] ( int y ) {
+			const size_t begin = size_t( y ) * image.width * 4;
+			for ( size_t i = begin; i < begin + size_t( image.width ) * 4; i++ ) {
+				if ( i % 4 != 3 ) image.data[ i ] += ( convolved.data[ i ] - image.data[ i ] ) * intensity;
+			}
+		}, 16 );
+	}
+
+private:
+	// padded transform size and cached kernel spectra for this image size
+	void Prepare ( int width, int height ) {
+		using namespace bloomDetail;
+		const int radiusX = std::min( int( kernel.width ) / 2, width - 1 );
+		const int radiusY = std::min( int( kernel.height ) / 2, height - 1 );
+		const int paddedWidth = GoodSize( width + radiusX );
+		const int paddedHeight = GoodSize( height + radiusY );
+		if ( paddedWidth == spectrumWidth && paddedHeight == spectrumHeight && width == imageWidth && height == imageHeight ) return;
+		imageWidth = width;
+		imageHeight = height;
+		spectrumWidth = paddedWidth;
+		spectrumHeight = paddedHeight;
+		halfWidth = paddedWidth / 2 + 1;
+		stride = ( halfWidth + lanes - 1 ) / lanes * lanes;
+		rowPlan = fftPlan( paddedWidth );
+		columnPlan = fftPlan( paddedHeight );
+		spectrumRe.assign( size_t( stride ) * paddedHeight, 0.0f );
+		spectrumIm.assign( size_t( stride ) * paddedHeight, 0.0f );
+
+		// kernel, wrapped around so its center lands on the origin, cropped to the radius that can reach the image
+		ImageF wrapped( paddedWidth, paddedHeight );
+		std::fill( wrapped.data.begin(), wrapped.data.end(), 0.0f );
+		const int centerX = kernel.width / 2, centerY = kernel.height / 2;
+		for ( int y = -radiusY; y <= radiusY; y++ ) {
+			for ( int x = -radiusX; x <= radiusX; x++ ) {
+				const int kx = centerX + x, ky = centerY + y;
+				if ( kx < 0 || ky < 0 || kx >= int( kernel.width ) || ky >= int( kernel.height ) ) continue;
+				const size_t from = ( size_t( ky ) * kernel.width + kx ) * 4;
+				const size_t to = ( size_t( ( y + paddedHeight ) % paddedHeight ) * paddedWidth + ( x + paddedWidth ) % paddedWidth ) * 4;
+				for ( int c = 0; c < 3; c++ ) wrapped.data[ to + c ] = kernel.data[ from + c ];
+			}
+		}
+
+		// whole padded kernel goes through the same passes, with the 1 / N of the inverse folded in
+		const float normalize = 1.0f / ( float( paddedWidth ) * float( paddedHeight ) );
+		for ( int c = 0; c < 3; c++ ) {
+			kernelRe[ c ].assign( size_t( stride ) * paddedHeight, 0.0f );
+			kernelIm[ c ].assign( size_t( stride ) * paddedHeight, 0.0f );
+			ForwardRows( wrapped, c, paddedWidth, paddedHeight, kernelRe[ c ].data(), kernelIm[ c ].data() );
+			Columns( c, true );
+			for ( size_t i = 0; i < kernelRe[ c ].size(); i++ ) {
+				kernelRe[ c ][ i ] *= normalize;
+				kernelIm[ c ][ i ] *= normalize;
+			}
+		}
+	}
+
+	// channel c of the source into the half spectrum, two rows per complex transform - rows past the source are zero
+	void ForwardRows ( const ImageF & source, int c, int width, int rows, float * outRe, float * outIm ) {
+		using namespace bloomDetail;
+		const int n = spectrumWidth;
+		const int pairs = ( rows + 1 ) / 2;
+		const int batches = ( pairs + lanes - 1 ) / lanes;
+		std::fill( outRe + size_t( pairs ) * 2 * stride, outRe + size_t( spectrumHeight ) * stride, 0.0f );
+		std::fill( outIm + size_t( pairs ) * 2 * stride, outIm + size_t( spectrumHeight ) * stride, 0.0f );
+		ParallelBatches( batches, n, [ & ] ( int batch, scratch & s ) {
+			std::fill( s.re.begin(), s.re.end(), 0.0f );
+			std::fill( s.im.begin(), s.im.end(), 0.0f );
+			for ( int l = 0; l < lanes; l++ ) {
+				const int y = ( batch * lanes + l ) * 2;
+				if ( y >= rows ) break;
+				const float * row0 = &source.data[ size_t( y ) * source.width * 4 + c ];
+				for ( int x = 0; x < width; x++ ) s.re[ size_t( x ) * lanes + l ] = row0[ x * 4 ];
+				if ( y + 1 < rows ) {
+					const float * row1 = &source.data[ size_t( y + 1 ) * source.width * 4 + c ];
+					for ( int x = 0; x < width; x++ ) s.im[ size_t( x ) * lanes + l ] = row1[ x * 4 ];
+				}
+			}
+			const bool inScratch = Transform( rowPlan, s.re.data(), s.im.data(), s.tempRe.data(), s.tempIm.data() );
+			const float * zr = s.ResultRe( inScratch );
+			const float * zi = s.ResultIm( inScratch );
+			// Z = X + iY for real rows X, Y - X[ k ] = ( Z[ k ] + conj( Z[ n - k ] ) ) / 2, Y[ k ] = ( Z[ k ] - conj( Z[ n - k ] ) ) / 2i
+			for ( int l = 0; l < lanes; l++ ) {
+				const int y = ( batch * lanes + l ) * 2;
+				if ( y >= rows ) break;
+				float * xRe = outRe + size_t( y ) * stride, * xIm = outIm + size_t( y ) * stride;
+				float * yRe = xRe + stride, * yIm = xIm + stride;
+				for ( int k = 0; k < halfWidth; k++ ) {
+					const size_t a = size_t( k ) * lanes + l, b = size_t( k ? n - k : 0 ) * lanes + l;
+					xRe[ k ] = 0.5f * ( zr[ a ] + zr[ b ] );
+					xIm[ k ] = 0.5f * ( zi[ a ] - zi[ b ] );
+					yRe[ k ] = 0.5f * ( zi[ a ] + zi[ b ] );
+					yIm[ k ] = 0.5f * ( zr[ b ] - zr[ a ] );
+				}
+			}
+		} );
+	}
+
+	// column transforms on 16 wide strips of the half spectrum - for the kernel, forward only, into the kernel spectrum.
+	// For the image, forward, multiply, and inverse, all while the strip is in the scratch buffers
+	void Columns ( int c, bool kernelPass ) {
+		using namespace bloomDetail;
+		const int n = spectrumHeight;
+		float * re = kernelPass ? kernelRe[ c ].data() : spectrumRe.data();
+		float * im = kernelPass ? kernelIm[ c ].data() : spectrumIm.data();
+		const float * kRe = kernelRe[ c ].data();
+		const float * kIm = kernelIm[ c ].data();
+		const int outputRows = kernelPass ? n : std::min( ( imageHeight + 1 ) / 2 * 2, n );
+		ParallelBatches( stride / lanes, n, [ & ] ( int strip, scratch & s ) {
+			const size_t column = size_t( strip ) * lanes;
+			for ( int y = 0; y < n; y++ ) {
+				std::copy_n( re + size_t( y ) * stride + column, lanes, &s.re[ size_t( y ) * lanes ] );
+				std::copy_n( im + size_t( y ) * stride + column, lanes, &s.im[ size_t( y ) * lanes ] );
+			}
+			bool inScratch = Transform( columnPlan, s.re.data(), s.im.data(), s.tempRe.data(), s.tempIm.data() );
+			float * ar = s.ResultRe( inScratch ), * ai = s.ResultIm( inScratch );
+			float * br = s.ResultRe( !inScratch ), * bi = s.ResultIm( !inScratch );
+			if ( !kernelPass ) {
+				// multiply, conjugated for the inverse
+				for ( int y = 0; y < n; y++ ) {
+					const float * kr = kRe + size_t( y ) * stride + column, * ki = kIm + size_t( y ) * stride + column;
+					float * vr = ar + size_t( y ) * lanes, * vi = ai + size_t( y ) * lanes;
+					for ( int l = 0; l < lanes; l++ ) {
+						const float r = vr[ l ] * kr[ l ] - vi[ l ] * ki[ l ];
+						const float i = vr[ l ] * ki[ l ] + vi[ l ] * kr[ l ];
+						vr[ l ] = r;
+						vi[ l ] = -i;
+					}
+				}
+				if ( Transform( columnPlan, ar, ai, br, bi ) ) {
+					std::swap( ar, br );
+					std::swap( ai, bi );
+				}
+				for ( int y = 0; y < n * lanes; y++ ) ai[ y ] = -ai[ y ];
+			}
+			for ( int y = 0; y < outputRows; y++ ) {
+				std::copy_n( &ar[ size_t( y ) * lanes ], lanes, re + size_t( y ) * stride + column );
+				std::copy_n( &ai[ size_t( y ) * lanes ], lanes, im + size_t( y ) * stride + column );
+			}
+		} );
+	}
+
+	// half spectrum rows back to real rows, two at a time - Z = X + iY rebuilt from the hermitian halves
+	void InverseRows ( ImageF & out, int c ) {
+		using namespace bloomDetail;
+		const int n = spectrumWidth;
+		const int rows = imageHeight;
+		const int pairs = ( rows + 1 ) / 2;
+		const int batches = ( pairs + lanes - 1 ) / lanes;
+		ParallelBatches( batches, n, [ & ] ( int batch, scratch & s ) {
+			std::fill( s.re.begin(), s.re.end(), 0.0f );
+			std::fill( s.im.begin(), s.im.end(), 0.0f );
+			for ( int l = 0; l < lanes; l++ ) {
+				const int y = ( batch * lanes + l ) * 2;
+				if ( y >= rows ) break;
+				const float * xRe = &spectrumRe[ size_t( y ) * stride ], * xIm = &spectrumIm[ size_t( y ) * stride ];
+				const float * yRe = xRe + stride, * yIm = xIm + stride;
+				// conjugated going in, the transform is forward only
+				for ( int k = 0; k < halfWidth; k++ ) {
+					s.re[ size_t( k ) * lanes + l ] = xRe[ k ] - yIm[ k ];
+					s.im[ size_t( k ) * lanes + l ] = -( xIm[ k ] + yRe[ k ] );
+				}
+				// past the middle, X[ k ] = conj( X[ n - k ] ), same for Y
+				for ( int k = halfWidth; k < n; k++ ) {
+					s.re[ size_t( k ) * lanes + l ] = xRe[ n - k ] + yIm[ n - k ];
+					s.im[ size_t( k ) * lanes + l ] = xIm[ n - k ] - yRe[ n - k ];
+				}
+			}
+			const bool inScratch = Transform( rowPlan, s.re.data(), s.im.data(), s.tempRe.data(), s.tempIm.data() );
+			const float * zr = s.ResultRe( inScratch );
+			const float * zi = s.ResultIm( inScratch );
+			for ( int l = 0; l < lanes; l++ ) {
+				const int y = ( batch * lanes + l ) * 2;
+				if ( y >= rows ) break;
+				float * row0 = &out.data[ size_t( y ) * out.width * 4 + c ];
+				for ( int x = 0; x < imageWidth; x++ ) row0[ x * 4 ] = zr[ size_t( x ) * lanes + l ];
+				if ( y + 1 < rows ) {
+					float * row1 = &out.data[ size_t( y + 1 ) * out.width * 4 + c ];
+					for ( int x = 0; x < imageWidth; x++ ) row1[ x * 4 ] = -zi[ size_t( x ) * lanes + l ];
+				}
+			}
+		} );
+	}
+
+	ImageF kernel;
+
+	// sizes the cached spectra are for
+	int imageWidth = 0, imageHeight = 0;
+	int spectrumWidth = 0, spectrumHeight = 0;
+	int halfWidth = 0;		// spectrumWidth / 2 + 1 columns kept
+	int stride = 0;			// halfWidth rounded up to a whole number of strips
+
+	bloomDetail::fftPlan rowPlan;
+	bloomDetail::fftPlan columnPlan;
+
+	// image spectrum, reused across channels and calls, and the kernel's, per channel
+	std::vector< float > spectrumRe, spectrumIm;
+	std::vector< float > kernelRe[ 3 ], kernelIm[ 3 ];
+};
+
+#endif
@@ -0,0 +1,433 @@
+#pragma once
+#ifndef DITHER_H
+#define DITHER_H
+
+#include "../ImageHandling/Image.h"
+#include "../ImageHandling/Oklab.h"
+#include "../Threading/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// CPU dithering / bitcrush stage, for values that are already display referred ( gamma, tonemap applied ), 0..1
+	// - the value is converted to one of a few color spaces, quantized there to 2^bits levels per channel, and
+	//   converted back. Signed channels ( chroma ) use an odd number of levels, so that neutral stays neutral. Oklch hue
+	//   is periodic, it wraps instead of clamping, and the error diffused across the wrap is the short way around
+	// - rows go to the dither space as a batch first ( Oklab.h, PixelFormat.h ), so the conversion loops vectorize
+	// - ordered / blue noise offsets are one quantization step wide, parallel over rows
+	// - error diffusion runs rows as a staggered wavefront: a row may work on column x once the row above has finished
+	//   far enough past x that nothing else will land there. Rows are handed out in order, each publishes its progress,
+	//   so every core stays busy and the result is identical to the serial raster order scan. Serpentine order is
+	//   available too, and also matches its serial scan, but a row there can only start once the one above is done
+
+enum class ditherColorspace {
+	RGB,		// the values as displayed
+	linearRGB,	// sRGB curve removed first
+	YCbCr,		// BT.601, full range
+	Oklab,
+	Oklch		// Oklab in polar form, lightness / chroma / hue
+};
+
+enum class ditherPattern {
+	none,				// plain bitcrush
+	bayer,				// 8x8 ordered matrix
+	blueNoise,			// tiling blue noise texture, one channel per color channel
+	floydSteinberg,
+	atkinson,			// only diffuses 3/4 of the error, higher contrast
+	jarvisJudiceNinke
+};
+
+// for the UI, in enum order
+inline const char * ditherColorspaceNames[] = { "RGB", "Linear RGB", "YCbCr", "Oklab", "Oklch" };
+inline const char * ditherPatternNames[] = { "None ( Bitcrush )", "Bayer 8x8", "Blue Noise", "Floyd-Steinberg", "Atkinson", "Jarvis-Judice-Ninke" };
+
+struct ditherParameters {
+	ditherColorspace colorspace = ditherColorspace::RGB;
+	ditherPattern pattern = ditherPattern::none;
+	int bits = 8;						// per channel, 1..8
+	float strength = 1.0f;				// scales the ordered offsets / diffused error
+	const Image * blueNoise = nullptr;	// required for ditherPattern::blueNoise, falls back to bayer without it
+};
+
+// ==== error diffusion =============================
+struct errorDiffusionTap {
+	int dx, dy;
+	float weight;
+};
+
+// error goes right on the current row ( dy = 0 ) and into the next one or two rows
+struct errorDiffusionKernel {
+	std::vector< errorDiffusionTap > taps;
+};
+
+inline const errorDiffusionKernel & FloydSteinbergKernel () {
+	static const errorDiffusionKernel k = { {
+		{ 1, 0, 7.0f / 16.0f },
+		{ -1, 1, 3.0f / 16.0f }, { 0, 1, 5.0f / 16.0f }, { 1, 1, 1.0f / 16.0f } } };
+	return k;
+}
+
+inline const errorDiffusionKernel & AtkinsonKernel () {
+	static const errorDiffusionKernel k = { {
+		{ 1, 0, 1.0f / 8.0f }, { 2, 0, 1.0f / 8.0f },
+		{ -1, 1, 1.0f / 8.0f }, { 0, 1, 1.0f / 8.0f }, { 1, 1, 1.0f / 8.0f },
+		{ 0, 2, 1.0f / 8.0f } } };
+	return k;
+}
+
+inline const errorDiffusionKernel & JarvisJudiceNinkeKernel () {
+	static const errorDiffusionKernel k = { {
+		{ 1, 0, 7.0f / 48.0f }, { 2, 0, 5.0f / 48.0f },
+		{ -2, 1, 3.0f / 48.0f }, { -1, 1, 5.0f / 48.0f }, { 0, 1, 7.0f / 48.0f }, { 1, 1, 5.0f / 48.0f }, { 2, 1, 3.0f / 48.0f },
+		{ -2, 2, 1.0f / 48.0f }, { -1, 2, 3.0f / 48.0f }, { 0, 2, 5.0f / 48.0f }, { 1, 2, 3.0f / 48.0f }, { 2, 2, 1.0f / 48.0f } } };
+	return k;
+}
+
+// runs error diffusion over a width x height image of C channel values, rows as a wavefront across the thread pool
+	// - loadRow( y, float * values ) fills width * C values for row y, called on whichever thread runs that row
+	// - quantize( x, y, float * value, float * quantized ) gets the value with the incoming error added, and writes the
+	//   quantized result - it may also adjust value ( e.g. clamp it ), the error diffused is value - quantized
+	// - error for the rows below goes into ring buffers with exactly one writer each ( errorFrom1[ y ] is only written
+	//   by row y - 1, errorFrom2[ y ] by row y - 2 ), so there are no atomics on the data, only on row progress
+	// - serpentine runs odd rows right to left with the kernel mirrored. Progress counts columns in each row's own
+	//   direction, so a row going the other way needs all of the row above before it starts - rows only overlap
+	//   their loads, not the diffusion itself
+template < int C, typename LoadRow, typename Quantize >
+void DiffuseErrorWavefront ( uint32_t width, uint32_t height, const errorDiffusionKernel & kernel, float strength, LoadRow && loadRow, Quantize && quantize, bool serpentine = false ) {
+	if ( width == 0 || height == 0 ) return;
+
+	// column x on row y takes error from column x - dx on the row dy above - the range of -dx, per dy
+	int reachMin[ 3 ] = { 0, 0, 0 }, reachMax[ 3 ] = { 0, 0, 0 };
+	for ( auto & t : kernel.taps ) {
+		reachMin[ t.dy ] = std::min( reachMin[ t.dy ], -t.dx );
+		reachMax[ t.dy ] = std::max( reachMax[ t.dy ], -t.dx );
+	}
+	auto Reversed = [ & ] ( int y ) { return serpentine && ( y & 1 ); };
+
+	const int ringRows = ThreadPool::Get().NumThreads() + 4; // rows in flight can't exceed the thread count
+	const size_t rowFloats = size_t( width ) * C;
+	std::vector< float > errorFrom1( rowFloats * ringRows );
+	std::vector< float > errorFrom2( rowFloats * ringRows );
+	std::vector< std::atomic< int > > progress( height ); // completed columns per row
+	for ( auto & p : progress ) p.store( 0, std::memory_order_relaxed );
+	std::atomic< int > nextRow( 0 );
+
+	auto WaitFor = [ & ] ( int row, int columns ) {
+		if ( row < 0 ) return;
+		columns = std::min( columns, int( width ) );
+		while ( progress[ row ].load( std::memory_order_acquire ) < columns ) std::this_thread::yield();
+	};
+
+	// before columns [ lo, hi ] of row y, the row dy above has to be done with everything that lands there
+	auto WaitForSources = [ & ] ( int y, int dy, int lo, int hi ) {
+		const int row = y - dy;
+		if ( row < 0 ) return;
+		// taps are mirrored on reversed rows, so the reach flips with them
+		const int first = lo + ( Reversed( row ) ? -reachMax[ dy ] : reachMin[ dy ] );
+		const int last = hi + ( Reversed( row ) ? -reachMin[ dy ] : reachMax[ dy ] );
+		WaitFor( row, Reversed( row ) ? int( width ) - std::max( first, 0 ) : last + 1 );
+	};
+
+	constexpr int chunk = 64; // columns between progress updates
+	ThreadPool::Get().RunOnAll( [ & ] ( int ) {
+		std::vector< float > row( rowFloats );
+		int y;
+		while ( ( y = nextRow.fetch_add( 1 ) ) < int( height ) ) {
+			// the buffers this row writes were last read by rows y + 1 - ringRows and y + 2 - ringRows
+			WaitFor( y + 2 - ringRows, width );
+			float * below1 = &errorFrom1[ size_t( ( y + 1 ) % ringRows ) * rowFloats ];
+			float * below2 = &errorFrom2[ size_t( ( y + 2 ) % ringRows ) * rowFloats ];
+			std::fill( below1, below1 + rowFloats, 0.0f );
+			std::fill( below2, below2 + rowFloats, 0.0f );
+			const float * from1 = &errorFrom1[ size_t( y % ringRows ) * rowFloats ];
+			const float * from2 = &errorFrom2[ size_t( y % ringRows ) * rowFloats ];
+
+			loadRow( y, row.data() );
+
+			const bool reversed = Reversed( y );
+			const int step = reversed ? -1 : 1;
+			for ( int done0 = 0; done0 < int( width ); done0 += chunk ) {
+				const int done1 = std::min( done0 + chunk, int( width ) );
+				// columns this chunk covers, in scan order and as a range
+				const int xFirst = reversed ? int( width ) - 1 - done0 : done0;
+				const int xEnd = reversed ? int( width ) - 1 - done1 : done1;
+				const int lo = std::min( xFirst, xEnd - step ), hi = std::max( xFirst, xEnd - step );
+				WaitForSources( y, 1, lo, hi );
+				WaitForSources( y, 2, lo, hi );
+				for ( int x = xFirst; x != xEnd; x += step ) {
+					float value[ C ], quantized[ C ], error[ C ];
+					for ( int c = 0; c < C; c++ ) {
+						value[ c ] = row[ x * C + c ] + ( y >= 1 ? from1[ x * C + c ] : 0.0f ) + ( y >= 2 ? from2[ x * C + c ] : 0.0f );
+					}
+					quantize( x, y, value, quantized );
+					for ( int c = 0; c < C; c++ ) error[ c ] = ( value[ c ] - quantized[ c ] ) * strength;
+					for ( auto & t : kernel.taps ) {
+						const int tx = x + t.dx * step;
+						if ( tx < 0 || tx >= int( width ) ) continue;
+						float * target = ( t.dy == 0 ) ? &row[ tx * C ] : ( t.dy == 1 ) ? &below1[ tx * C ] : &below2[ tx * C ];
+						for ( int c = 0; c < C; c++ ) target[ c ] += error[ c ] * t.weight;
+					}
+				}
+				progress[ y ].store( done1, std::memory_order_release );
+			}
+		}
+	} );
+}
+
+// ==== color spaces ================================
+namespace ditherDetail {
+	inline float BayerThreshold ( uint32_t x, uint32_t y ) {
+		static const uint8_t bayer[ 8 ][ 8 ] = {
+			{  0, 32,  8, 40,  2, 34, 10, 42 },
+			{ 48, 16, 56, 24, 50, 18, 58, 26 },
+			{ 12, 44,  4, 36, 14, 46,  6, 38 },
+			{ 60, 28, 52, 20, 62, 30, 54, 22 },
+			{  3, 35, 11, 43,  1, 33,  9, 41 },
+			{ 51, 19, 59, 27, 49, 17, 57, 25 },
+			{ 15, 47,  7, 39, 13, 45,  5, 37 },
+			{ 63, 31, 55, 23, 61, 29, 53, 21 }
+		};
+		return ( bayer[ y % 8 ][ x % 8 ] + 0.5f ) / 64.0f;
+	}
+
+	// display RGB to normalized coordinates in the dither space - unsigned channels 0..1, signed ones -1..1, and
+	// from there straight to 8-bit display RGB ( through the encode LUT, where the space is linear )
+	template < ditherColorspace S > inline void ToSpace ( const float * rgb, float * v );
+	template < ditherColorspace S > inline void FromSpace ( const float * v, uint8_t * rgb );
+	template < ditherColorspace S > constexpr bool SignedChannel ( int c );
+	template < ditherColorspace S > constexpr bool PeriodicChannel ( int c ) { return S == ditherColorspace::Oklch && c == 2; }
+
+	// a row of display RGBA to packed dither space values - per pixel unless the space has a batch path, below
+	template < ditherColorspace S > inline void ToSpaceRow ( const float * rgba, float * v, uint32_t count ) {
+		for ( uint32_t x = 0; x < count; x++ ) ToSpace< S >( rgba + 4 * x, v + 3 * x );
+	}
+
+	// and back to display RGBA, alpha not written - v is scratch, it may be overwritten
+	template < ditherColorspace S > inline void FromSpaceRow ( float * v, uint8_t * rgba, uint32_t count ) {
+		for ( uint32_t x = 0; x < count; x++ ) FromSpace< S >( v + 3 * x, rgba + 4 * x );
+	}
+
+	inline void EncodeLinearRow ( const float * linear, uint8_t * rgba, uint32_t count ) {
+		for ( uint32_t x = 0; x < count; x++ ) {
+			for ( int c = 0; c < 3; c++ ) rgba[ 4 * x + c ] = EncodeSRGB8( linear[ 3 * x + c ] );
+		}
+	}
+
+	// clamped and sRGB decoded, packed three to a pixel
+	inline void LinearRow ( const float * rgba, float * linear, uint32_t count ) {
+		for ( uint32_t x = 0; x < count; x++ ) {
+			for ( int c = 0; c < 3; c++ ) linear[ 3 * x + c ] = std::clamp( rgba[ 4 * x + c ], 0.0f, 1.0f );
+		}
+		SRGBToLinear( linear, linear, size_t( count ) * 3 );
+	}
+
+	template <> inline void ToSpace< ditherColorspace::RGB > ( const float * rgb, float * v ) {
+		v[ 0 ] = rgb[ 0 ]; v[ 1 ] = rgb[ 1 ]; v[ 2 ] = rgb[ 2 ];
+	}
+	template <> inline void FromSpace< ditherColorspace::RGB > ( const float * v, uint8_t * rgb ) {
+		for ( int c = 0; c < 3; c++ ) rgb[ c ] = EncodeUNorm8( v[ c ] );
+	}
+	template <> constexpr bool SignedChannel< ditherColorspace::RGB > ( int ) { return false; }
+
+	template <> inline void ToSpace< ditherColorspace::linearRGB > ( const float * rgb, float * v ) {
+		for ( int c = 0; c < 3; c++ ) v[ c ] = SRGBToLinear( std::clamp( rgb[ c ], 0.0f, 1.0f ) );
+	}
+	template <> inline void FromSpace< ditherColorspace::linearRGB > ( const float * v, uint8_t * rgb ) {
+		for ( int c = 0; c < 3; c++ ) rgb[ c ] = EncodeSRGB8( v[ c ] );
+	}
+	template <> constexpr bool SignedChannel< ditherColorspace::linearRGB > ( int ) { return false; }
+	template <> inline void ToSpaceRow< ditherColorspace::linearRGB > ( const float * rgba, float * v, uint32_t count ) {
+		LinearRow( rgba, v, count );
+	}
+
+	template <> inline void ToSpace< ditherColorspace::YCbCr > ( const float * rgb, float * v ) {
+		const float Y = 0.299f * rgb[ 0 ] + 0.587f * rgb[ 1 ] + 0.114f * rgb[ 2 ];
+		v[ 0 ] = Y;
+		v[ 1 ] = ( rgb[ 2 ] - Y ) * ( 2.0f / 1.772f ); // Cb, scaled from -0.5..0.5 to -1..1
+		v[ 2 ] = ( rgb[ 0 ] - Y ) * ( 2.0f / 1.402f ); // Cr
+	}
+	template <> inline void FromSpace< ditherColorspace::YCbCr > ( const float * v, uint8_t * rgb ) {
+		const float Cb = v[ 1 ] * 0.5f, Cr = v[ 2 ] * 0.5f;
+		rgb[ 0 ] = EncodeUNorm8( v[ 0 ] + 1.402f * Cr );
+		rgb[ 1 ] = EncodeUNorm8( v[ 0 ] - 0.344136f * Cb - 0.714136f * Cr );
+		rgb[ 2 ] = EncodeUNorm8( v[ 0 ] + 1.772f * Cb );
+	}
+	template <> constexpr bool SignedChannel< ditherColorspace::YCbCr > ( int c ) { return c != 0; }
+
+	// a and b stay within about +/- 0.32 for the sRGB gamut, normalized by 0.4
+	template <> inline void ToSpace< ditherColorspace::Oklab > ( const float * rgb, float * v ) {
+		float linear[ 3 ];
+		for ( int c = 0; c < 3; c++ ) linear[ c ] = SRGBToLinear( std::clamp( rgb[ c ], 0.0f, 1.0f ) );
+		LinearSRGBToOklab( linear, v );
+		v[ 1 ] *= 2.5f;
+		v[ 2 ] *= 2.5f;
+	}
+	template <> inline void FromSpace< ditherColorspace::Oklab > ( const float * v, uint8_t * rgb ) {
+		const float lab[ 3 ] = { v[ 0 ], v[ 1 ] * 0.4f, v[ 2 ] * 0.4f };
+		float linear[ 3 ];
+		OklabToLinearSRGB( lab, linear );
+		for ( int c = 0; c < 3; c++ ) rgb[ c ] = EncodeSRGB8( linear[ c ] );
+	}
+	template <> constexpr bool SignedChannel< ditherColorspace::Oklab > ( int c ) { return c != 0; }
+	template <> inline void ToSpaceRow< ditherColorspace::Oklab > ( const float * rgba, float * v, uint32_t count ) {
+		LinearRow( rgba, v, count );
+		LinearSRGBToOklab( v, 3, v, 3, count );
+		for ( uint32_t x = 0; x < count; x++ ) {
+			v[ 3 * x + 1 ] *= 2.5f;
+			v[ 3 * x + 2 ] *= 2.5f;
+		}
+	}
+	template <> inline void FromSpaceRow< ditherColorspace::Oklab > ( float * v, uint8_t * rgba, uint32_t count ) {
+		for ( uint32_t x = 0; x < count; x++ ) {
+			v[ 3 * x + 1 ] *= 0.4f;
+			v[ 3 * x + 2 ] *= 0.4f;
+		}
+		OklabToLinearSRGB( v, 3, v, 3, count );
+		EncodeLinearRow( v, rgba, count );
+	}
+
+	// chroma stays under about 0.32 for the sRGB gamut, normalized by 0.4 - hue goes to turns, 0..1
+	template <> inline void ToSpace< ditherColorspace::Oklch > ( const float * rgb, float * v ) {
+		float linear[ 3 ], lab[ 3 ];
+		for ( int c = 0; c < 3; c++ ) linear[ c ] = SRGBToLinear( std::clamp( rgb[ c ], 0.0f, 1.0f ) );
+		LinearSRGBToOklab( linear, lab );
+		OklabToOklch( lab, v );
+		v[ 1 ] *= 2.5f;
+		v[ 2 ] = v[ 2 ] * 0.159154943f + ( ( v[ 2 ] < 0.0f ) ? 1.0f : 0.0f );
+	}
+	template <> inline void FromSpace< ditherColorspace::Oklch > ( const float * v, uint8_t * rgb ) {
+		const float lch[ 3 ] = { v[ 0 ], v[ 1 ] * 0.4f, v[ 2 ] * 6.28318531f };
+		float lab[ 3 ], linear[ 3 ];
+		OklchToOklab( lch, lab );
+		OklabToLinearSRGB( lab, linear );
+		for ( int c = 0; c < 3; c++ ) rgb[ c ] = EncodeSRGB8( linear[ c ] );
+	}
+	template <> constexpr bool SignedChannel< ditherColorspace::Oklch > ( int ) { return false; }
+	template <> inline void ToSpaceRow< ditherColorspace::Oklch > ( const float * rgba, float * v, uint32_t count ) {
+		LinearRow( rgba, v, count );
+		LinearSRGBToOklab( v, 3, v, 3, count );
+		OklabToOklch( v, 3, v, 3, count );
+		for ( uint32_t x = 0; x < count; x++ ) {
+			v[ 3 * x + 1 ] *= 2.5f;
+			v[ 3 * x + 2 ] = v[ 3 * x + 2 ] * 0.159154943f + ( ( v[ 3 * x + 2 ] < 0.0f ) ? 1.0f : 0.0f );
+		}
+	}
+	template <> inline void FromSpaceRow< ditherColorspace::Oklch > ( float * v, uint8_t * rgba, uint32_t count ) {
+		for ( uint32_t x = 0; x < count; x++ ) {
+			v[ 3 * x + 1 ] *= 0.4f;
+			v[ 3 * x + 2 ] *= 6.28318531f;
+		}
+		OklchToOklab( v, 3, v, 3, count );
+		OklabToLinearSRGB( v, 3, v, 3, count );
+		EncodeLinearRow( v, rgba, count );
+	}
+
+	// round to the nearest of the levels, clamped to the channel's range - or for a periodic channel, wrapped into it.
+	// nearbyint rather than round, which is a call into libm per channel - ties go to even, which no dither can tell
+	struct channelQuantizer {
+		float scale;	// levels - 1 for unsigned channels, ( levels - 1 ) / 2 for signed ones, levels for periodic ones
+		float minimum;
+		bool periodic = false;
+		float Wrap ( float v ) const {
+			return v - std::floor( v );
+		}
+		float Quantize ( float v ) const {
+			if ( periodic ) return std::nearbyint( Wrap( v ) * scale ) / scale; // 1.0 is the same hue as 0.0
+			return std::clamp( std::nearbyint( v * scale ), minimum * scale, scale ) / scale;
+		}
+	};
+
+	template < ditherColorspace S >
+	void DitherImage ( const ImageF & in, Image & out, const ditherParameters & p ) {
+		const uint32_t width = in.width;
+		const uint32_t height = in.height;
+		const int bits = std::clamp( p.bits, 1, 8 );
+		channelQuantizer quantizers[ 3 ];
+		for ( int c = 0; c < 3; c++ ) {
+			if ( PeriodicChannel< S >( c ) ) {
+				quantizers[ c ] = { float( 1 << bits ), 0.0f, true };
+			} else if ( SignedChannel< S >( c ) ) {
+				quantizers[ c ] = { float( std::max( ( 1 << ( bits - 1 ) ) - 1, 1 ) ), -1.0f };
+			} else {
+				quantizers[ c ] = { float( ( 1 << bits ) - 1 ), 0.0f };
+			}
+		}
+
+		auto Store = [ & ] ( uint32_t x, uint32_t y, const float * quantized ) {
+			const size_t i = ( size_t( y ) * width + x ) * 4;
+			FromSpace< S >( quantized, &out.data[ i ] );
+			out.data[ i + 3 ] = EncodeUNorm8( in.data[ i + 3 ] );
+		};
+
+		ditherPattern pattern = p.pattern;
+		if ( pattern == ditherPattern::blueNoise && ( p.blueNoise == nullptr || p.blueNoise->width == 0 || p.blueNoise->height == 0 ) ) {
+			pattern = ditherPattern::bayer;
+		}
+
+		if ( pattern == ditherPattern::floydSteinberg || pattern == ditherPattern::atkinson || pattern == ditherPattern::jarvisJudiceNinke ) {
+			const errorDiffusionKernel & kernel = ( pattern == ditherPattern::floydSteinberg ) ? FloydSteinbergKernel() :
+				( pattern == ditherPattern::atkinson ) ? AtkinsonKernel() : JarvisJudiceNinkeKernel();
+			DiffuseErrorWavefront< 3 >( width, height, kernel, p.strength,
+				[ & ] ( int y, float * row ) {
+					ToSpaceRow< S >( &in.data[ size_t( y ) * width * 4 ], row, width );
+				},
+				[ & ] ( int x, int y, float * value, float * quantized ) {
+					for ( int c = 0; c < 3; c++ ) {
+						if ( quantizers[ c ].periodic ) {
+							// error is value - quantized, so it has to be measured from the wrapped value, and the
+							// quantized level that wraps to 0 stays at 1 here
+							value[ c ] = quantizers[ c ].Wrap( value[ c ] );
+							quantized[ c ] = std::nearbyint( value[ c ] * quantizers[ c ].scale ) / quantizers[ c ].scale;
+							continue;
+						}
+						// the error can't push a value further out than a step past the range, or it runs away at the edges
+						value[ c ] = std::clamp( value[ c ], quantizers[ c ].minimum - 1.0f / quantizers[ c ].scale, 1.0f + 1.0f / quantizers[ c ].scale );
+						quantized[ c ] = quantizers[ c ].Quantize( value[ c ] );
+					}
+					Store( x, y, quantized );
+				} );
+			return;
+		}
+
+		ParallelFor( 0, int( height ), [ & ] ( int y ) {
+			const uint8_t * noiseRow = ( pattern == ditherPattern::blueNoise ) ? &p.blueNoise->data[ size_t( y % p.blueNoise->height ) * p.blueNoise->width * 4 ] : nullptr;
+			thread_local std::vector< float > row;
+			row.resize( size_t( width ) * 3 );
+			ToSpaceRow< S >( &in.data[ size_t( y ) * width * 4 ], row.data(), width );
+			for ( uint32_t x = 0; x < width; x++ ) {
+				float * value = &row[ size_t( x ) * 3 ];
+				for ( int c = 0; c < 3; c++ ) {
+					float offset = 0.0f;
+					if ( pattern == ditherPattern::bayer ) {
+						offset = BayerThreshold( x, y ) - 0.5f;
+					} else if ( pattern == ditherPattern::blueNoise ) {
+						offset = ( noiseRow[ ( x % p.blueNoise->width ) * 4 + c ] + 0.5f ) / 256.0f - 0.5f;
+					}
+					value[ c ] = quantizers[ c ].Quantize( value[ c ] + offset * p.strength / quantizers[ c ].scale );
+				}
+			}
+			// quantized in place, back out as a batch too
+			uint8_t * outRow = &out.data[ size_t( y ) * width * 4 ];
+			FromSpaceRow< S >( row.data(), outRow, width );
+			for ( uint32_t x = 0; x < width; x++ ) outRow[ x * 4 + 3 ] = EncodeUNorm8( in.data[ ( size_t( y ) * width + x ) * 4 + 3 ] );
+		}, 8 );
+	}
+}
+
+// display referred values in, 8-bit out - alpha is passed through
+inline Image DitherImage ( const ImageF & in, const ditherParameters & parameters ) {
+	Image out( in.width, in.height );
+	switch ( parameters.colorspace ) {
+		case ditherColorspace::RGB:			ditherDetail::DitherImage< ditherColorspace::RGB >( in, out, parameters ); break;
+		case ditherColorspace::linearRGB:	ditherDetail::DitherImage< ditherColorspace::linearRGB >( in, out, parameters ); break;
+		case ditherColorspace::YCbCr:		ditherDetail::DitherImage< ditherColorspace::YCbCr >( in, out, parameters ); break;
+		case ditherColorspace::Oklab:		ditherDetail::DitherImage< ditherColorspace::Oklab >( in, out, parameters ); break;
+		case ditherColorspace::Oklch:		ditherDetail::DitherImage< ditherColorspace::Oklch >( in, out, parameters ); break;
+	}
+	return out;
+}
+
+#endif
@@ -0,0 +1,688 @@
+#pragma once
+#ifndef FASTPNG_H
+#define FASTPNG_H
+
+#include "../Threading/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+// PNG writer in the spirit of fpng - several times faster than lodepng's encoder, at a similar file size
+	// - rows are split into slices that are filtered and deflated independently, in parallel on the thread pool
+	// - each compressed slice ends with an empty stored block, which byte aligns it, so the slices concatenate into one zlib stream.
+	//   Adler32 is computed per slice and combined, and every slice is its own IDAT chunk, so the CRCs are parallel too
+	// - fast mode is a greedy single probe hash match finder with a dynamic huffman table per block, stored mode skips
+	//   compression entirely and is bound by memory bandwidth
+	// - RGBA input, 8 or 16 bits per channel - written as RGB when alpha is opaque everywhere, like lodepng does
+
+enum class pngCompression {
+	stored,	// no compression - zlib stored blocks
+	fast	// single probe LZ77 + dynamic huffman
+};
+
+namespace fastPNGDetail {
+	// rows are grouped into slices of about this many filtered bytes - smaller is more parallel, larger compresses better
+	constexpr size_t sliceTargetBytes = 256 * 1024;
+	constexpr int hashBits = 15;
+	constexpr int windowSize = 32768;
+	constexpr int minMatch = 4;		// match finder compares 4 bytes at a time - deflate allows 3, but those rarely pay off
+	constexpr int maxMatch = 258;
+	constexpr float matchBaseBits = 16.0f;	// rough cost of a length + distance symbol pair, before extra bits
+	constexpr size_t symbolsPerBlock = 65536; // new huffman tables after this many literals + matches
+
+	// ==== checksums =================================
+	// CRC32 with the PNG polynomial, slice by 8
+	struct crcTables {
+		uint32_t table[ 8 ][ 256 ];
+		crcTables () {
+			for ( uint32_t i = 0; i < 256; i++ ) {
+				uint32_t c = i;
+				for ( int k = 0; k < 8; k++ ) {
+					c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : ( c >> 1 );
+				}
+				table[ 0 ][ i ] = c;
+			}
+			for ( uint32_t i = 0; i < 256; i++ ) {
+				for ( int t = 1; t < 8; t++ ) {
+					table[ t ][ i ] = ( table[ t - 1 ][ i ] >> 8 ) ^ table[ 0 ][ table[ t - 1 ][ i ] & 0xFF ];
+				}
+			}
+		}
+	};
+
+	inline const crcTables & CRCTables () {
+		static const crcTables tables;
+		return tables;
+	}
+
+	inline uint32_t CRC32 ( const uint8_t * bytes, size_t count, uint32_t crc = 0 ) {
+		const auto & t = CRCTables().table;
+		crc = ~crc;
+		size_t i = 0;
+		for ( ; i + 8 <= count; i += 8 ) {
+			uint32_t lo, hi;
+			std::memcpy( &lo, bytes + i, 4 );
+			std::memcpy( &hi, bytes + i + 4, 4 );
+			lo ^= crc;
+			crc = t[ 7 ][ lo & 0xFF ] ^ t[ 6 ][ ( lo >> 8 ) & 0xFF ] ^ t[ 5 ][ ( lo >> 16 ) & 0xFF ] ^ t[ 4 ][ lo >> 24 ] ^
+				t[ 3 ][ hi & 0xFF ] ^ t[ 2 ][ ( hi >> 8 ) & 0xFF ] ^ t[ 1 ][ ( hi >> 16 ) & 0xFF ] ^ t[ 0 ][ hi >> 24 ];
+		}
+		for ( ; i < count; i++ ) {
+			crc = t[ 0 ][ ( crc ^ bytes[ i ] ) & 0xFF ] ^ ( crc >> 8 );
+		}
+		return ~crc;
+	}
+
+	constexpr uint32_t adlerBase = 65521;
+
+	inline uint32_t Adler32 ( const uint8_t * bytes, size_t count, uint32_t adler = 1 ) {
+		uint32_t a = adler & 0xFFFF;
+		uint32_t b = adler >> 16;
+		while ( count > 0 ) {
+			// 5552 is the most bytes that can be summed before b can overflow 32 bits
+			const size_t run = std::min( count, size_t( 5552 ) );
+			for ( size_t i = 0; i < run; i++ ) {
+				a += bytes[ i ];
+				b += a;
+			}
+			a %= adlerBase;
+			b %= adlerBase;
+			bytes += run;
+			count -= run;
+		}
+		return ( b << 16 ) | a;
+	}
+
+	// adler32 of the concatenation, given the adler32 of each part and the length of the second part
+	inline uint32_t Adler32Combine ( uint32_t first, uint32_t second, size_t secondLength ) {
+		const uint32_t remainder = uint32_t( secondLength % adlerBase );
+		uint32_t a = first & 0xFFFF;
+		uint32_t b = uint32_t( ( uint64_t( remainder ) * a ) % adlerBase );
+		a += ( second & 0xFFFF ) + adlerBase - 1;
+		b += ( first >> 16 ) + ( second >> 16 ) + adlerBase - remainder;
+		a %= adlerBase;
+		b %= adlerBase;
+		return ( b << 16 ) | a;
+	}
+
+	// ==== deflate ===================================
+	// bits go out least significant first, huffman codes are stored pre-reversed to match
+		// - writes whole 32-bit words into space made ahead of time with Reserve(), little endian ( x86 only, like the rest )
+	struct bitWriter {
+		std::vector< uint8_t > & out;
+		size_t position;
+		uint64_t bits = 0;
+		int count = 0;
+
+		bitWriter ( std::vector< uint8_t > & target ) : out( target ), position( target.size() ) {}
+		~bitWriter () { out.resize( position ); }
+
+		// make sure there's room for this many more bytes
+		void Reserve ( size_t bytes ) {
+			if ( out.size() < position + bytes + 8 ) out.resize( std::max( position + bytes + 8, out.size() * 3 / 2 ) );
+		}
+
+		void Put ( uint32_t value, int numBits ) {
+			bits |= uint64_t( value ) << count;
+			count += numBits;
+			if ( count >= 32 ) {
+				const uint32_t word = uint32_t( bits );
+				std::memcpy( out.data() + position, &word, 4 );
+				position += 4;
+				bits >>= 32;
+				count -= 32;
+			}
+		}
+
+		void AlignToByte () {
+			Reserve( 8 );
+			while ( count > 0 ) {
+				out[ position++ ] = bits & 0xFF;
+				bits >>= 8;
+				count = std::max( count - 8, 0 );
+			}
+			bits = 0;
+		}
+	};
+
+	struct deflateTables {
+		uint8_t lengthCode[ 259 ];		// match length -> index of the length symbol ( symbol - 257 )
+		uint16_t lengthBase[ 29 ];
+		uint8_t lengthExtra[ 29 ];
+		uint16_t distanceBase[ 30 ];
+		uint8_t distanceExtra[ 30 ];
+		uint8_t distanceCodeSmall[ 512 ];	// ( distance - 1 ) for distances up to 512
+		uint8_t distanceCodeLarge[ 256 ];	// ( distance - 1 ) >> 7 for the rest
+
+		deflateTables () {
+			int length = 3;
+			for ( int code = 0; code < 28; code++ ) {
+				lengthExtra[ code ] = ( code < 8 ) ? 0 : ( code - 4 ) / 4;
+				lengthBase[ code ] = length;
+				for ( int i = 0; i < ( 1 << lengthExtra[ code ] ); i++ ) {
+					lengthCode[ length++ ] = code;
+				}
+			}
+			// 258 gets its own code, even though 284 could also represent it
+			lengthExtra[ 28 ] = 0;
+			lengthBase[ 28 ] = 258;
+			lengthCode[ 258 ] = 28;
+
+			int distance = 1;
+			for ( int code = 0; code < 30; code++ ) {
+				distanceExtra[ code ] = ( code < 4 ) ? 0 : ( code - 2 ) / 2;
+				distanceBase[ code ] = distance;
+				distance += 1 << distanceExtra[ code ];
+			}
+			for ( int d = 0; d < 512; d++ ) {
+				int code = 0;
+				while ( code < 29 && distanceBase[ code + 1 ] <= d + 1 ) code++;
+				distanceCodeSmall[ d ] = code;
+			}
+			for ( int d = 0; d < 256; d++ ) {
+				int code = 0;
+				while ( code < 29 && distanceBase[ code + 1 ] <= ( d << 7 ) + 1 ) code++;
+				distanceCodeLarge[ d ] = code;
+			}
+		}
+
+		int DistanceCode ( int distance ) const {
+			return ( distance <= 512 ) ? distanceCodeSmall[ distance - 1 ] : distanceCodeLarge[ ( distance - 1 ) >> 7 ];
+		}
+	};
+
+	inline const deflateTables & DeflateTables () {
+		static const deflateTables tables;
+		return tables;
+	}
+
+	// a literal when distance is zero, otherwise a match
+	struct lzSymbol {
+		uint16_t value;
+		uint16_t distance;
+	};
+
+	struct huffmanCode {
+		uint16_t code[ 288 ];	// bit reversed, ready for bitWriter::Put
+		uint8_t length[ 288 ];
+	};
+
+	// code lengths for the given frequencies, no longer than maxLength - unused symbols get length zero
+	inline void BuildCodeLengths ( const uint32_t * frequencies, int numSymbols, int maxLength, uint8_t * lengths ) {
+		std::fill( lengths, lengths + numSymbols, 0 );
+		std::vector< std::pair< uint32_t, int > > used; // ( frequency, symbol ), sorted ascending
+		for ( int i = 0; i < numSymbols; i++ ) {
+			if ( frequencies[ i ] ) used.push_back( { frequencies[ i ], i } );
+		}
+		const int n = int( used.size() );
+		if ( n == 0 ) return;
+		if ( n == 1 ) { lengths[ used[ 0 ].second ] = 1; return; }
+		std::sort( used.begin(), used.end() );
+
+		// in place minimum redundancy code lengths ( Moffat and Katajainen ), on the sorted frequencies
+		std::vector< uint32_t > A( n );
+		for ( int i = 0; i < n; i++ ) A[ i ] = used[ i ].first;
+		A[ 0 ] += A[ 1 ];
+		int root = 0, leaf = 2;
+		for ( int next = 1; next < n - 1; next++ ) {
+			if ( leaf >= n || A[ root ] < A[ leaf ] ) { A[ next ] = A[ root ]; A[ root++ ] = next; }
+			else { A[ next ] = A[ leaf++ ]; }
+			if ( leaf >= n || ( root < next && A[ root ] < A[ leaf ] ) ) { A[ next ] += A[ root ]; A[ root++ ] = next; }
+			else { A[ next ] += A[ leaf++ ]; }
+		}
+		A[ n - 2 ] = 0;
+		for ( int next = n - 3; next >= 0; next-- ) A[ next ] = A[ A[ next ] ] + 1;
+		int available = 1, usedNodes = 0, depth = 0;
+		root = n - 2;
+		int next = n - 1;
+		while ( available > 0 ) {
+			while ( root >= 0 && int( A[ root ] ) == depth ) { usedNodes++; root--; }
+			while ( available > usedNodes ) { A[ next-- ] = depth; available--; }
+			available = 2 * usedNodes;
+			depth++;
+			usedNodes = 0;
+		}
+
+		// count codes per length, and squeeze anything too long back under the limit while keeping the code complete
+		int countPerLength[ 33 ] = { 0 };
+		for ( int i = 0; i < n; i++ ) countPerLength[ std::min( int( A[ i ] ), maxLength ) ]++;
+		uint32_t kraft = 0;
+		for ( int l = maxLength; l > 0; l-- ) kraft += uint32_t( countPerLength[ l ] ) << ( maxLength - l );
+		while ( kraft != ( 1u << maxLength ) ) {
+			countPerLength[ maxLength ]--;
+			for ( int l = maxLength - 1; l > 0; l-- ) {
+				if ( countPerLength[ l ] ) {
+					countPerLength[ l ]--;
+					countPerLength[ l + 1 ] += 2;
+					break;
+				}
+			}
+			kraft--;
+		}
+
+		// least frequent symbols get the longest codes
+		int index = 0;
+		for ( int l = maxLength; l > 0; l-- ) {
+			for ( int i = 0; i < countPerLength[ l ]; i++ ) {
+				lengths[ used[ index++ ].second ] = l;
+			}
+		}
+	}
+
+	// canonical codes from the lengths, bit reversed
+	inline void AssignCodes ( huffmanCode & h, int numSymbols ) {
+		int countPerLength[ 16 ] = { 0 };
+		for ( int i = 0; i < numSymbols; i++ ) countPerLength[ h.length[ i ] ]++;
+		countPerLength[ 0 ] = 0;
+		int nextCode[ 16 ] = { 0 };
+		int code = 0;
+		for ( int l = 1; l < 16; l++ ) {
+			code = ( code + countPerLength[ l - 1 ] ) << 1;
+			nextCode[ l ] = code;
+		}
+		for ( int i = 0; i < numSymbols; i++ ) {
+			const int l = h.length[ i ];
+			if ( l == 0 ) continue;
+			uint32_t c = nextCode[ l ]++;
+			uint32_t reversed = 0;
+			for ( int b = 0; b < l; b++ ) {
+				reversed = ( reversed << 1 ) | ( c & 1 );
+				c >>= 1;
+			}
+			h.code[ i ] = reversed;
+		}
+	}
+
+	// one BTYPE=10 block with tables built for this run of symbols
+	inline void WriteDynamicBlock ( bitWriter & writer, const lzSymbol * symbols, size_t count, bool final ) {
+		const deflateTables & t = DeflateTables();
+
+		uint32_t literalFrequency[ 286 ] = { 0 };
+		uint32_t distanceFrequency[ 30 ] = { 0 };
+		for ( size_t i = 0; i < count; i++ ) {
+			if ( symbols[ i ].distance == 0 ) {
+				literalFrequency[ symbols[ i ].value ]++;
+			} else {
+				literalFrequency[ 257 + t.lengthCode[ symbols[ i ].value ] ]++;
+				distanceFrequency[ t.DistanceCode( symbols[ i ].distance ) ]++;
+			}
+		}
+		literalFrequency[ 256 ] = 1; // end of block
+		// keep both trees at two or more codes, single code trees trip up some decoders
+		if ( std::count_if( literalFrequency, literalFrequency + 286, [] ( uint32_t f ) { return f != 0; } ) < 2 ) literalFrequency[ 0 ]++;
+		for ( int i = 0; std::count_if( distanceFrequency, distanceFrequency + 30, [] ( uint32_t f ) { return f != 0; } ) < 2; i++ ) {
+			distanceFrequency[ i ] = std::max( distanceFrequency[ i ], 1u );
+		}
+
+		huffmanCode literals, distances;
+		BuildCodeLengths( literalFrequency, 286, 15, literals.length );
+		BuildCodeLengths( distanceFrequency, 30, 15, distances.length );
+		AssignCodes( literals, 286 );
+		AssignCodes( distances, 30 );
+
+		int numLiteralCodes = 286;
+		while ( numLiteralCodes > 257 && literals.length[ numLiteralCodes - 1 ] == 0 ) numLiteralCodes--;
+		int numDistanceCodes = 30;
+		while ( numDistanceCodes > 1 && distances.length[ numDistanceCodes - 1 ] == 0 ) numDistanceCodes--;
+
+		// both sets of lengths go out as one run length coded sequence, using symbols 16 ( repeat previous ), 17 and 18 ( zeroes )
+		std::vector< uint8_t > lengths( literals.length, literals.length + numLiteralCodes );
+		lengths.insert( lengths.end(), distances.length, distances.length + numDistanceCodes );
+		std::vector< std::pair< uint8_t, uint8_t > > runs; // ( symbol, extra bits value )
+		uint32_t lengthFrequency[ 19 ] = { 0 };
+		for ( size_t i = 0; i < lengths.size(); ) {
+			const uint8_t value = lengths[ i ];
+			size_t run = 1;
+			while ( i + run < lengths.size() && lengths[ i + run ] == value ) run++;
+			size_t remaining = run;
+			if ( value == 0 ) {
+				while ( remaining >= 11 ) { const size_t r = std::min( remaining, size_t( 138 ) ); runs.push_back( { 18, uint8_t( r - 11 ) } ); remaining -= r; }
+				if ( remaining >= 3 ) { runs.push_back( { 17, uint8_t( remaining - 3 ) } ); remaining = 0; }
+			} else {
+				runs.push_back( { value, 0 } ); remaining--;
+				while ( remaining >= 3 ) { const size_t r = std::min( remaining, size_t( 6 ) ); runs.push_back( { 16, uint8_t( r - 3 ) } ); remaining -= r; }
+			}
+			while ( remaining-- ) runs.push_back( { value, 0 } );
+			i += run;
+		}
+		for ( auto & r : runs ) lengthFrequency[ r.first ]++;
+		if ( std::count_if( lengthFrequency, lengthFrequency + 19, [] ( uint32_t f ) { return f != 0; } ) < 2 ) {
+			lengthFrequency[ lengthFrequency[ 0 ] ? 1 : 0 ]++;
+		}
+
+		// worst case is every symbol at its longest code and most extra bits, plus the header
+		writer.Reserve( ( count * ( 15 + 5 + 15 + 13 ) + runs.size() * 14 ) / 8 + 512 );
+
+		huffmanCode lengthCodes;
+		BuildCodeLengths( lengthFrequency, 19, 7, lengthCodes.length );
+		AssignCodes( lengthCodes, 19 );
+		static const uint8_t lengthOrder[ 19 ] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+		int numLengthCodes = 19;
+		while ( numLengthCodes > 4 && lengthCodes.length[ lengthOrder[ numLengthCodes - 1 ] ] == 0 ) numLengthCodes--;
+
+		writer.Put( final ? 1 : 0, 1 );
+		writer.Put( 2, 2 );
+		writer.Put( numLiteralCodes - 257, 5 );
+		writer.Put( numDistanceCodes - 1, 5 );
+		writer.Put( numLengthCodes - 4, 4 );
+		for ( int i = 0; i < numLengthCodes; i++ ) writer.Put( lengthCodes.length[ lengthOrder[ i ] ], 3 );
+		for ( auto & r : runs ) {
+			writer.Put( lengthCodes.code[ r.first ], lengthCodes.length[ r.first ] );
+			if ( r.first == 16 ) writer.Put( r.second, 2 );
+			if ( r.first == 17 ) writer.Put( r.second, 3 );
+			if ( r.first == 18 ) writer.Put( r.second, 7 );
+		}
+
+		for ( size_t i = 0; i < count; i++ ) {
+			const lzSymbol s = symbols[ i ];
+			if ( s.distance == 0 ) {
+				writer.Put( literals.code[ s.value ], literals.length[ s.value ] );
+			} else {
+				const int lc = t.lengthCode[ s.value ];
+				writer.Put( literals.code[ 257 + lc ], literals.length[ 257 + lc ] );
+				writer.Put( s.value - t.lengthBase[ lc ], t.lengthExtra[ lc ] );
+				const int dc = t.DistanceCode( s.distance );
+				writer.Put( distances.code[ dc ], distances.length[ dc ] );
+				writer.Put( s.distance - t.distanceBase[ dc ], t.distanceExtra[ dc ] );
+			}
+		}
+		writer.Put( literals.code[ 256 ], literals.length[ 256 ] );
+	}
+
+	// greedy LZ77, one hash probe per position, no matches reaching outside this buffer
+	inline void FindMatches ( const uint8_t * data, size_t size, std::vector< lzSymbol > & symbols ) {
+		std::vector< int32_t > head( 1 << hashBits, -windowSize - 1 );
+		auto Hash = [] ( uint32_t v ) { return ( v * 2654435761u ) >> ( 32 - hashBits ); };
+		const deflateTables & t = DeflateTables();
+
+		// running estimate of what a literal costs, from the entropy of recent literals - on noisy images short matches
+		// cost more than the literals they replace, and taking them anyway is most of the size difference to lodepng
+		uint32_t literalCounts[ 256 ] = { 0 };
+		uint32_t literalsSinceUpdate = 0;
+		float literalBits = 8.0f;
+		auto EmitLiteral = [ & ] ( uint8_t value ) {
+			symbols.push_back( { value, 0 } );
+			literalCounts[ value ]++;
+			if ( ++literalsSinceUpdate == 4096 ) {
+				uint32_t total = 0;
+				for ( int v = 0; v < 256; v++ ) total += literalCounts[ v ];
+				float entropy = 0.0f;
+				for ( int v = 0; v < 256; v++ ) {
+					if ( literalCounts[ v ] ) {
+						const float p = float( literalCounts[ v ] ) / total;
+						entropy -= p * std::log2( p );
+					}
+					literalCounts[ v ] >>= 1; // decay, so the estimate follows the image
+				}
+				literalBits = std::max( entropy, 1.0f );
+				literalsSinceUpdate = 0;
+			}
+		};
+
+		size_t i = 0;
+		while ( i + minMatch <= size ) {
+			uint32_t current;
+			std::memcpy( &current, data + i, 4 );
+			const uint32_t h = Hash( current );
+			const int32_t candidate = head[ h ];
+			head[ h ] = int32_t( i );
+
+			const int32_t distance = int32_t( i ) - candidate;
+			uint32_t previous;
+			if ( distance <= windowSize && candidate >= 0 && ( std::memcpy( &previous, data + candidate, 4 ), previous == current ) ) {
+				const size_t limit = std::min( size - i, size_t( maxMatch ) );
+				// extend eight bytes at a time, the first differing byte comes from the trailing zeroes of the xor
+				size_t length = minMatch;
+				while ( length < limit ) {
+					if ( length + 8 <= limit ) {
+						uint64_t a, b;
+						std::memcpy( &a, data + i + length, 8 );
+						std::memcpy( &b, data + candidate + length, 8 );
+						if ( a != b ) { length += __builtin_ctzll( a ^ b ) >> 3; break; }
+						length += 8;
+					} else {
+						if ( data[ i + length ] != data[ candidate + length ] ) break;
+						length++;
+					}
+				}
+				const int lc = t.lengthCode[ length ];
+				const float matchBits = matchBaseBits + t.lengthExtra[ lc ] + t.distanceExtra[ t.DistanceCode( distance ) ];
+				if ( length * literalBits < matchBits ) {
+					EmitLiteral( data[ i ] );
+					i++;
+					continue;
+				}
+				symbols.push_back( { uint16_t( length ), uint16_t( distance ) } );
+				// only the tail of a match goes into the table, inserting every position costs more than it finds
+				const size_t end = i + length;
+				for ( size_t j = std::max( i + 1, end - std::min( length - 1, size_t( 3 ) ) ); j + minMatch <= size && j < end; j++ ) {
+					uint32_t v;
+					std::memcpy( &v, data + j, 4 );
+					head[ Hash( v ) ] = int32_t( j );
+				}
+				i = end;
+			} else {
+				EmitLiteral( data[ i ] );
+				i++;
+			}
+		}
+		for ( ; i < size; i++ ) EmitLiteral( data[ i ] );
+	}
+
+	// compresses one slice - not final slices end with an empty stored block, so the output is byte aligned
+	inline void DeflateSlice ( const uint8_t * data, size_t size, pngCompression mode, bool final, std::vector< uint8_t > & out ) {
+		if ( mode == pngCompression::stored ) {
+			size_t offset = 0;
+			do {
+				const size_t run = std::min( size - offset, size_t( 65535 ) );
+				const bool last = final && ( offset + run == size );
+				out.push_back( last ? 1 : 0 );
+				out.push_back( run & 0xFF ); out.push_back( run >> 8 );
+				out.push_back( ~run & 0xFF ); out.push_back( ( ~run >> 8 ) & 0xFF );
+				out.insert( out.end(), data + offset, data + offset + run );
+				offset += run;
+			} while ( offset < size );
+			return; // stored blocks are already byte aligned
+		}
+
+		std::vector< lzSymbol > symbols;
+		symbols.reserve( size / 2 );
+		FindMatches( data, size, symbols );
+
+		bitWriter writer( out );
+		for ( size_t first = 0; first < symbols.size() || first == 0; first += symbolsPerBlock ) {
+			const size_t count = std::min( symbols.size() - first, symbolsPerBlock );
+			const bool lastBlock = ( first + count == symbols.size() );
+			WriteDynamicBlock( writer, symbols.data() + first, count, final && lastBlock );
+			if ( lastBlock ) break;
+		}
+		if ( !final ) {
+			writer.Put( 0, 3 ); // empty stored block - not final, type 00, then aligned LEN / NLEN
+			writer.AlignToByte();
+			writer.Put( 0xFFFF0000u, 32 );
+		} else {
+			writer.AlignToByte();
+		}
+	}
+
+	// ==== filtering =================================
+	// picks whichever of none / sub / up / average / paeth has the smallest sum of absolute residuals as signed bytes - the
+	//  same heuristic as lodepng's default. Written as plain loops over bytes, which the compiler vectorizes at -O3
+	inline void FilterRow ( const uint8_t * row, const uint8_t * above, int rowBytes, int bpp, uint8_t * out, std::vector< uint8_t > & scratch ) {
+		scratch.resize( 5 * rowBytes );
+		uint8_t * residuals[ 5 ];
+		for ( int f = 0; f < 5; f++ ) residuals[ f ] = scratch.data() + f * rowBytes;
+		uint8_t * sub = residuals[ 1 ], * up = residuals[ 2 ], * average = residuals[ 3 ], * paeth = residuals[ 4 ];
+
+		std::memcpy( residuals[ 0 ], row, rowBytes );
+		for ( int i = 0; i < bpp; i++ ) { // no left neighbor - left and upper left are zero
+			sub[ i ] = row[ i ];
+			up[ i ] = row[ i ] - above[ i ];
+			average[ i ] = row[ i ] - ( above[ i ] >> 1 );
+			paeth[ i ] = row[ i ] - above[ i ];
+		}
+		for ( int i = bpp; i < rowBytes; i++ ) {
+			const int a = row[ i - bpp ], b = above[ i ], c = above[ i - bpp ];
+			sub[ i ] = row[ i ] - a;
+			up[ i ] = row[ i ] - b;
+			average[ i ] = row[ i ] - ( ( a + b ) >> 1 );
+			const int p = a + b - c;
+			const int pa = std::abs( p - a ), pb = std::abs( p - b ), pc = std::abs( p - c );
+			const int predicted = ( pa <= pb && pa <= pc ) ? a : ( pb <= pc ) ? b : c;
+			paeth[ i ] = row[ i ] - predicted;
+		}
+
+		int best = 0;
+		uint32_t bestCost = ~0u;
+		for ( int f = 0; f < 5; f++ ) {
+			uint32_t cost = 0;
+			for ( int i = 0; i < rowBytes; i++ ) {
+				cost += std::abs( int( int8_t( residuals[ f ][ i ] ) ) );
+			}
+			if ( cost < bestCost ) { bestCost = cost; best = f; }
+		}
+		out[ 0 ] = uint8_t( best ); // filter types are numbered in the same order
+		std::memcpy( out + 1, residuals[ best ], rowBytes );
+	}
+
+	inline void PutBigEndian ( std::vector< uint8_t > & out, uint32_t value ) {
+		out.push_back( value >> 24 ); out.push_back( ( value >> 16 ) & 0xFF );
+		out.push_back( ( value >> 8 ) & 0xFF ); out.push_back( value & 0xFF );
+	}
+
+	// length, type, data, crc
+	inline void PutChunk ( std::vector< uint8_t > & out, const char * type, const uint8_t * data, size_t size ) {
+		PutBigEndian( out, uint32_t( size ) );
+		const size_t typeStart = out.size();
+		out.insert( out.end(), type, type + 4 );
+		out.insert( out.end(), data, data + size );
+		PutBigEndian( out, CRC32( out.data() + typeStart, size + 4 ) );
+	}
+}
+
+// encodes a whole PNG in memory - getRow( y, bytes ) writes row y as big endian RGB or RGBA, channels * bitDepth / 8 bytes per pixel
+template < typename RowFunc >
+std::vector< uint8_t > EncodePNGRows ( uint32_t width, uint32_t height, int bitDepth, int channels, RowFunc getRow, pngCompression mode = pngCompression::fast ) {
+	using namespace fastPNGDetail;
+	const int bpp = channels * bitDepth / 8;
+	const int rowBytes = int( width ) * bpp;
+	const int rowsPerSlice = std::max( 1, int( sliceTargetBytes / ( rowBytes + 1 ) ) );
+	const int numSlices = std::max( 1, ( int( height ) + rowsPerSlice - 1 ) / rowsPerSlice );
+
+	std::vector< std::vector< uint8_t > > chunks( numSlices );
+	std::vector< uint32_t > adlers( numSlices );
+	std::vector< size_t > sliceSizes( numSlices );
+
+	ParallelFor( 0, numSlices, [ & ] ( int s ) {
+		const int firstRow = s * rowsPerSlice;
+		const int lastRow = std::min( firstRow + rowsPerSlice, int( height ) );
+
+		// filtered scanlines, each with its leading filter type byte
+		std::vector< uint8_t > filtered( size_t( lastRow - firstRow ) * ( rowBytes + 1 ) );
+		std::vector< uint8_t > above( rowBytes, 0 ), current( rowBytes ), scratch;
+		if ( firstRow > 0 ) getRow( firstRow - 1, above.data() );
+		for ( int y = firstRow; y < lastRow; y++ ) {
+			getRow( y, current.data() );
+			uint8_t * out = filtered.data() + size_t( y - firstRow ) * ( rowBytes + 1 );
+			if ( mode == pngCompression::stored ) {
+				out[ 0 ] = 0;
+				std::memcpy( out + 1, current.data(), rowBytes );
+			} else {
+				FilterRow( current.data(), above.data(), rowBytes, bpp, out, scratch );
+			}
+			std::swap( above, current );
+		}
+		adlers[ s ] = Adler32( filtered.data(), filtered.size() );
+		sliceSizes[ s ] = filtered.size();
+
+		// the slice becomes its own IDAT chunk - 8 bytes reserved for length and type, filled in once the size is known
+		std::vector< uint8_t > & chunk = chunks[ s ];
+		chunk.reserve( filtered.size() / ( mode == pngCompression::stored ? 1 : 3 ) + 64 );
+		chunk.resize( 8 );
+		DeflateSlice( filtered.data(), filtered.size(), mode, s == numSlices - 1, chunk );
+		const uint32_t dataSize = uint32_t( chunk.size() - 8 );
+		const uint8_t header[ 8 ] = { uint8_t( dataSize >> 24 ), uint8_t( dataSize >> 16 ), uint8_t( dataSize >> 8 ), uint8_t( dataSize ), 'I', 'D', 'A', 'T' };
+		std::memcpy( chunk.data(), header, 8 );
+		PutBigEndian( chunk, CRC32( chunk.data() + 4, dataSize + 4 ) );
+	} );
+
+	uint32_t adler = adlers[ 0 ];
+	for ( int s = 1; s < numSlices; s++ ) adler = Adler32Combine( adler, adlers[ s ], sliceSizes[ s ] );
+
+	std::vector< uint8_t > png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	size_t total = png.size() + 64;
+	for ( auto & c : chunks ) total += c.size();
+	png.reserve( total );
+
+	std::vector< uint8_t > header;
+	PutBigEndian( header, width );
+	PutBigEndian( header, height );
+	const uint8_t colorType = ( channels == 4 ) ? 6 : 2; // RGBA or RGB
+	header.insert( header.end(), { uint8_t( bitDepth ), colorType, 0, 0, 0 } ); // deflate, adaptive filtering, no interlace
+	PutChunk( png, "IHDR", header.data(), header.size() );
+
+	// zlib header and trailer ride in their own small IDAT chunks, so the slice chunks never wait on the combined adler
+	const uint8_t zlibHeader[ 2 ] = { 0x78, 0x01 };
+	PutChunk( png, "IDAT", zlibHeader, 2 );
+	for ( auto & c : chunks ) png.insert( png.end(), c.begin(), c.end() );
+	const uint8_t zlibTrailer[ 4 ] = { uint8_t( adler >> 24 ), uint8_t( adler >> 16 ), uint8_t( adler >> 8 ), uint8_t( adler ) };
+	PutChunk( png, "IDAT", zlibTrailer, 4 );
+	PutChunk( png, "IEND", nullptr, 0 );
+	return png;
+}
+
+// true if every alpha value is the max for the type - these images are written as RGB, a quarter less data to compress
+template < typename T >
+bool FullyOpaque ( const T * pixels, size_t numPixels ) {
+	constexpr T opaque = std::numeric_limits< T >::max();
+	bool result = true;
+	for ( size_t i = 0; i < numPixels; i++ ) {
+		result &= ( pixels[ 4 * i + 3 ] == opaque );
+	}
+	return result;
+}
+
+// 8 bit RGBA, rows top to bottom
+inline std::vector< uint8_t > EncodePNG ( const uint8_t * pixels, uint32_t width, uint32_t height, pngCompression mode = pngCompression::fast ) {
+	if ( FullyOpaque( pixels, size_t( width ) * height ) ) {
+		return EncodePNGRows( width, height, 8, 3, [ = ] ( int y, uint8_t * out ) {
+			const uint8_t * row = pixels + size_t( y ) * width * 4;
+			for ( uint32_t x = 0; x < width; x++ ) {
+				out[ 3 * x + 0 ] = row[ 4 * x + 0 ];
+				out[ 3 * x + 1 ] = row[ 4 * x + 1 ];
+				out[ 3 * x + 2 ] = row[ 4 * x + 2 ];
+			}
+		}, mode );
+	}
+	return EncodePNGRows( width, height, 8, 4, [ = ] ( int y, uint8_t * out ) {
+		std::memcpy( out, pixels + size_t( y ) * width * 4, size_t( width ) * 4 );
+	}, mode );
+}
+
+// 16 bit RGBA, native endian in memory
+inline std::vector< uint8_t > EncodePNG16 ( const uint16_t * pixels, uint32_t width, uint32_t height, pngCompression mode = pngCompression::fast ) {
+	const int channels = FullyOpaque( pixels, size_t( width ) * height ) ? 3 : 4;
+	return EncodePNGRows( width, height, 16, channels, [ = ] ( int y, uint8_t * out ) {
+		const uint16_t * row = pixels + size_t( y ) * width * 4;
+		for ( uint32_t x = 0; x < width; x++ ) {
+			for ( int c = 0; c < channels; c++ ) {
+				out[ 2 * ( channels * x + c ) + 0 ] = row[ 4 * x + c ] >> 8;
+				out[ 2 * ( channels * x + c ) + 1 ] = row[ 4 * x + c ] & 0xFF;
+			}
+		}
+	}, mode );
+}
+
+inline bool WritePNGFile ( const std::string & path, const std::vector< uint8_t > & png ) {
+	std::ofstream file( path, std::ios::binary );
+	file.write( ( const char * ) png.data(), png.size() );
+	return file.good();
+}
+
+#endif
@@ -0,0 +1,226 @@
+#pragma once
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include "../ImageHandling/QOI.h"
+#include "../Threading/SPSCRing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// records a sequence of frames to disk without holding up the frame that submits them
+	// - every writer thread owns a ring of preallocated frame buffers, and the render thread is the single producer for
+	//   all of them - Submit() copies into the next free slot, round robin across the writers, and returns right away
+	// - when every ring is full the frame is dropped and counted, rather than stalling the render thread
+	// - idle writers sleep on a condition variable, woken by Submit() and Stop()
+	// - writers encode QOI or dump raw RGBA, and an index.csv with frame numbers, times and sizes is written on Stop()
+
+enum class captureFormat { QOI, RAW };
+
+struct captureFrame {
+	std::vector< uint8_t > pixels;	// RGBA8, sized once at Start()
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint64_t frameNumber = 0;		// presented frame this came from, gaps are every-Nth skips or drops
+	double milliseconds = 0.0;		// since Start(), at submission
+	bool flipVertical = false;		// rows are bottom up ( GL readback )
+};
+
+struct captureIndexEntry {
+	uint64_t frameNumber;
+	double milliseconds;
+	std::string filename;
+	uint32_t width;
+	uint32_t height;
+};
+
+class FrameCapture {
+public:
+	~FrameCapture () { Stop(); }
+
+	// preallocates ringSize frames of width x height per writer, and starts the writers - output goes to a new
+	// timestamped directory under baseDirectory
+	void Start ( uint32_t width, uint32_t height, captureFormat outputFormat = captureFormat::QOI, int captureInterval = 1,
+		const std::string & baseDirectory = "capture/", int numWriters = 2, int ringSize = 4 ) {
+		Stop();
+		format = outputFormat;
+		interval = std::max( captureInterval, 1 );
+
+		auto now = std::chrono::system_clock::now();
+		auto inTimeT = std::chrono::system_clock::to_time_t( now );
+		std::stringstream ss;
+		ss << baseDirectory << std::put_time( std::localtime( &inTimeT ), "Capture-%Y-%m-%d-%H%M%S" ) << "/";
+		directory = ss.str();
+		std::error_code ec;
+		std::filesystem::create_directories( directory, ec );
+
+		presentedFrames = 0;
+		captured = 0;
+		dropped = 0;
+		nextWriter = 0;
+		index.clear();
+		tStart = std::chrono::steady_clock::now();
+
+		writers.clear();
+		for ( int i = 0; i < std::max( numWriters, 1 ); i++ ) {
+			writers.push_back( std::make_unique< writer >( ringSize ) );
+			for ( int s = 0; s < ringSize; s++ ) {
+				writers.back()->ring.Slot( s ).pixels.resize( size_t( width ) * height * 4 );
+			}
+		}
+		running = true;
+		for ( auto & w : writers ) {
+			writer * target = w.get();
+			w->thread = std::thread( [ this, target ] { WriterLoop( *target ); } );
+		}
+	}
+
+	// finishes everything already queued, then writes the index
+	void Stop () {
+		if ( !running ) return;
+		running = false;
+		for ( auto & w : writers ) Wake( *w );
+		for ( auto & w : writers ) w->thread.join();
+		writers.clear();
+
+		std::sort( index.begin(), index.end(), [] ( const captureIndexEntry & a, const captureIndexEntry & b ) {
+			return a.frameNumber < b.frameNumber;
+		} );
+		std::ofstream indexFile( directory + "index.csv" );
+		indexFile << "frame,milliseconds,file,width,height,format" << std::endl;
+		for ( auto & e : index ) {
+			indexFile << e.frameNumber << "," << e.milliseconds << "," << e.filename << "," << e.width << "," << e.height << ","
+				<< ( format == captureFormat::QOI ? "qoi" : "rgba8" ) << std::endl;
+		}
+	}
+
+	bool Active () const { return running; }
+
+	// call once per presented frame - true when this one should be captured ( every Nth ), so the caller can skip the readback
+	bool WantsFrame () {
+		return running && ( presentedFrames++ % uint64_t( interval ) ) == 0;
+	}
+
+	// number of the frame that the last WantsFrame() call was about, for callers that submit later than that
+	uint64_t FrameNumber () const { return presentedFrames - 1; }
+
+	// render thread only - copies the frame into a free slot, false if it had to be dropped
+	bool Submit ( const uint8_t * rgba, uint32_t width, uint32_t height, uint64_t frameNumber, bool flipVertical = false ) {
+		if ( !running ) return false;
+		for ( size_t attempt = 0; attempt < writers.size(); attempt++ ) {
+			writer & w = *writers[ ( nextWriter + attempt ) % writers.size() ];
+			captureFrame * frame = w.ring.BeginWrite();
+			if ( frame ) {
+				frame->pixels.resize( size_t( width ) * height * 4 ); // no-op unless the size changed since Start()
+				std::memcpy( frame->pixels.data(), rgba, frame->pixels.size() );
+				frame->width = width;
+				frame->height = height;
+				frame->frameNumber = frameNumber;
+				frame->milliseconds = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - tStart ).count();
+				frame->flipVertical = flipVertical;
+				w.ring.EndWrite();
+				Wake( w );
+				nextWriter = ( nextWriter + attempt + 1 ) % writers.size();
+				return true;
+			}
+		}
+		dropped++;
+		return false;
+	}
+
+	// counters for the ui
+	uint64_t Captured () const { return captured; }
+	uint64_t Dropped () const { return dropped; }
+	int QueueDepth () const {
+		size_t depth = 0;
+		for ( auto & w : writers ) depth += w->ring.Size();
+		return int( depth );
+	}
+	int QueueCapacity () const {
+		size_t capacity = 0;
+		for ( auto & w : writers ) capacity += w->ring.Capacity();
+		return int( capacity );
+	}
+	const std::string & Directory () const { return directory; }
+
+private:
+	struct writer {
+		writer ( int ringSize ) : ring( ringSize ) {}
+		spscRing< captureFrame > ring;
+		std::thread thread;
+		std::mutex wakeMutex;
+		std::condition_variable wake;
+	};
+
+	// taking the lock means the writer is either before its check of the ring, or already waiting - never in between
+	void Wake ( writer & w ) {
+		{ std::lock_guard< std::mutex > lock( w.wakeMutex ); }
+		w.wake.notify_one();
+	}
+
+	void WriterLoop ( writer & w ) {
+		while ( true ) {
+			// running is read before the ring - a frame submitted before Stop() is always in the ring by the time
+			// this sees running go false, so an empty ring after that means everything has been written
+			const bool stopping = !running;
+			captureFrame * frame = w.ring.BeginRead();
+			if ( !frame ) {
+				if ( stopping ) break;
+				std::unique_lock< std::mutex > lock( w.wakeMutex );
+				w.wake.wait( lock, [ & ] { return w.ring.Size() > 0 || !running; } );
+				continue;
+			}
+
+			std::stringstream ss;
+			ss << "frame" << std::setw( 6 ) << std::setfill( '0' ) << frame->frameNumber << ( format == captureFormat::QOI ? ".qoi" : ".rgba" );
+			const std::string filename = ss.str();
+			std::ofstream file( directory + filename, std::ios::binary );
+			if ( format == captureFormat::QOI ) {
+				std::vector< uint8_t > encoded = EncodeQOI( frame->pixels.data(), frame->width, frame->height, frame->flipVertical );
+				file.write( ( const char * ) encoded.data(), encoded.size() );
+			} else {
+				const size_t rowBytes = size_t( frame->width ) * 4;
+				for ( uint32_t y = 0; y < frame->height; y++ ) {
+					const uint32_t sourceRow = frame->flipVertical ? frame->height - 1 - y : y;
+					file.write( ( const char * ) frame->pixels.data() + sourceRow * rowBytes, rowBytes );
+				}
+			}
+			file.close();
+
+			{
+				std::lock_guard< std::mutex > lock( indexMutex ); // once per frame, never contended by the render thread
+				index.push_back( { frame->frameNumber, frame->milliseconds, filename, frame->width, frame->height } );
+			}
+			w.ring.EndRead();
+			captured++;
+		}
+	}
+
+	std::vector< std::unique_ptr< writer > > writers;
+	size_t nextWriter = 0;
+	std::atomic< bool > running{ false };
+	captureFormat format = captureFormat::QOI;
+	int interval = 1;
+	std::string directory;
+	std::chrono::steady_clock::time_point tStart;
+
+	uint64_t presentedFrames = 0;
+	std::atomic< uint64_t > captured{ 0 };
+	std::atomic< uint64_t > dropped{ 0 };
+
+	std::mutex indexMutex;
+	std::vector< captureIndexEntry > index;
+};
+
+#endif
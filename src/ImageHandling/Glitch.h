@@ -0,0 +1,465 @@
+#pragma once
+#ifndef GLITCH_H
+#define GLITCH_H
+
+#include "../ImageHandling/Image.h"
+#include "../ImageHandling/Dither.h"
+#include "../Threading/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+// glitch effects on float images ( the accumulator, pulled back from the GPU ) - a small graph of nodes, each one an
+// effect on the output of an earlier node, optionally limited to a mask that another node produces
+	// - every effect only looks at its own tile, so a tile of the output only depends on the same tile of the inputs:
+	//   Run() hands tiles out across the thread pool, and each one goes through the whole chain of nodes while it's
+	//   still in cache, instead of each node making a pass over the full image
+	// - nodes keep their last result, and a version hashed from their parameters and the versions of their inputs -
+	//   only nodes whose version changed, and that the output depends on, are evaluated again
+	// - random choices are seeded per node and per tile, so a tile comes out the same whichever thread runs it
+	// - the byte shuffle ( and blurs of what it leaves ) can produce NaN / Inf, which would stick in the accumulator
+	//   forever - the output tiles are scanned for them and they're zeroed, before anything goes back to the GPU
+
+enum class glitchOp {
+	input,			// the image from SetInput()
+	mask,			// 0 / 1 pattern, in all four channels - for the mask input of other nodes
+	glyphStamp,		// glyphs from the font atlas, added to or subtracted from the color
+	blur,			// box blur, within the tile
+	clear,			// color zeroed where the pattern is set
+	dither,			// bitcrush against a bayer matrix, levels relative to the brightest value in the tile
+	resetSamples,	// sample count ( accumulator alpha ) set to amount, so new samples replace what's there
+	byteShuffle		// bytes of the color floats shuffled, within spans of size bytes
+};
+
+enum class glitchPattern {
+	all,
+	checkerboard,		// cells of size pixels
+	rows,				// every other band of size rows
+	columns,
+	randomTiles,		// whole tiles, with probability amount
+	randomPixels		// single pixels, with probability amount
+};
+
+// for the UI, in enum order
+inline const char * glitchOpNames[] = { "Input", "Mask", "Glyph Stamp", "Blur", "Clear", "Dither", "Reset Samples", "Byte Shuffle" };
+inline const char * glitchPatternNames[] = { "All", "Checkerboard", "Rows", "Columns", "Random Tiles", "Random Pixels" };
+
+// parameters, not every op uses every field
+struct glitchNode {
+	glitchOp op = glitchOp::input;
+	int input = -1;						// index of an earlier node, the image this works on
+	int mask = -1;						// index of an earlier node, optional - the effect is mixed in by its red channel
+	glitchPattern pattern = glitchPattern::all;	// mask, clear
+	bool invert = false;				// mask, clear
+	int size = 1;						// pattern cell size, blur radius, glyph scale, dither bits, shuffle span
+	float amount = 1.0f;				// pattern probability, glyphs per tile, reset sample count, shuffled fraction
+	float color[ 3 ] = { 1.0f, 1.0f, 1.0f };	// glyph stamp
+	int stampMode = 0;					// glyph stamp - 0 additive, 1 subtractive, 2 either, per glyph
+	uint32_t seed = 0;
+};
+
+// ==== NaN / Inf scan ==============================
+// zeroes non-finite values in place, returns how many there were - integer compare on the exponent bits, no branches,
+// so it vectorizes. Anything with an all ones exponent is Inf or NaN
+inline size_t SanitizeNonFinite ( float * data, size_t count ) {
+	size_t found = 0;
+	for ( size_t i = 0; i < count; i++ ) {
+		uint32_t bits;
+		std::memcpy( &bits, &data[ i ], 4 );
+		const bool bad = ( bits & 0x7f800000u ) == 0x7f800000u;
+		bits = bad ? 0u : bits;
+		std::memcpy( &data[ i ], &bits, 4 );
+		found += bad;
+	}
+	return found;
+}
+
+namespace glitchDetail {
+	struct tile {
+		int x0, y0, x1, y1;
+		uint32_t index;
+		int Width () const { return x1 - x0; }
+		int Height () const { return y1 - y0; }
+	};
+
+	inline uint64_t Combine ( uint64_t h, uint64_t v ) {
+		// FNV-1a over the 8 bytes of v
+		for ( int i = 0; i < 8; i++ ) {
+			h ^= ( v >> ( i * 8 ) ) & 0xff;
+			h *= 0x100000001b3ull;
+		}
+		return h;
+	}
+
+	inline uint64_t FloatBits ( float f ) {
+		uint32_t bits;
+		std::memcpy( &bits, &f, 4 );
+		return bits;
+	}
+
+	inline bool PatternSet ( const glitchNode & n, int x, int y, bool tileSet, std::mt19937 & rng ) {
+		const int size = std::max( n.size, 1 );
+		bool set = true;
+		switch ( n.pattern ) {
+			case glitchPattern::all: break;
+			case glitchPattern::checkerboard: set = ( ( x / size + y / size ) & 1 ) != 0; break;
+			case glitchPattern::rows: set = ( ( y / size ) & 1 ) != 0; break;
+			case glitchPattern::columns: set = ( ( x / size ) & 1 ) != 0; break;
+			case glitchPattern::randomTiles: set = tileSet; break;
+			case glitchPattern::randomPixels: set = std::uniform_real_distribution< float >( 0.0f, 1.0f )( rng ) < n.amount; break;
+		}
+		return set != n.invert;
+	}
+}
+
+class GlitchGraph {
+public:
+	int tileSize = 64;
+
+	// returns the index of the new node - inputs that aren't earlier nodes are dropped
+	int Add ( const glitchNode & node ) {
+		nodeState added;
+		added.node = node;
+		nodes.push_back( added );
+		const int index = int( nodes.size() ) - 1;
+		Validate( index );
+		return index;
+	}
+	void RemoveLast () { if ( !nodes.empty() ) nodes.pop_back(); }
+	int Size () const { return int( nodes.size() ); }
+
+	// parameters can be edited in place, changes are picked up by the next Run()
+	glitchNode & Node ( int index ) { return nodes[ index ].node; }
+
+	void SetInput ( ImageF image ) {
+		input = std::move( image );
+		inputVersion++;
+	}
+	const ImageF & Input () const { return input; }
+
+	// 16 x 16 grid of glyphs, alpha is the coverage - the 128 x 256 atlas the text renderer uses, 8 x 16 glyphs. Held
+	// here, so the asset cache can't free it while the graph still stamps from it
+	void SetGlyphs ( std::shared_ptr< const Image > atlas ) { glyphs = std::move( atlas ); }
+
+	// true when Run() would evaluate anything for this output
+	bool Changed ( int output = -1 ) {
+		output = ( output < 0 ) ? Size() - 1 : output;
+		if ( output < 0 || output >= Size() ) return false;
+		UpdateVersions();
+		const std::vector< bool > needed = Needed( output );
+		for ( int i = 0; i <= output; i++ ) {
+			if ( needed[ i ] && nodes[ i ].version != nodes[ i ].evaluatedVersion ) return true;
+		}
+		return false;
+	}
+
+	// result of the output node ( by default the last one ), with NaN / Inf zeroed
+	const ImageF & Run ( int output = -1 ) {
+		using namespace glitchDetail;
+		output = ( output < 0 ) ? Size() - 1 : output;
+		evaluated = 0;
+		nonFinite = 0;
+		if ( output < 0 || output >= Size() ) return input;
+		for ( int i = 0; i < Size(); i++ ) Validate( i );
+		UpdateVersions();
+
+		// dirty nodes the output depends on, in order - inputs are always earlier, so this is a valid evaluation order
+		const std::vector< bool > needed = Needed( output );
+		std::vector< int > dirty;
+		for ( int i = 0; i <= output; i++ ) {
+			if ( needed[ i ] && nodes[ i ].version != nodes[ i ].evaluatedVersion ) dirty.push_back( i );
+		}
+		evaluated = int( dirty.size() );
+		if ( dirty.empty() ) return Result( output );
+
+		const int width = int( input.width ), height = int( input.height );
+		for ( int i : dirty ) {
+			ImageF & r = nodes[ i ].result;
+			if ( nodes[ i ].node.op != glitchOp::input && ( int( r.width ) != width || int( r.height ) != height ) ) {
+				r.width = width;
+				r.height = height;
+				r.data.assign( size_t( width ) * height * 4, 0.0f );
+			}
+		}
+
+		const int size = std::max( tileSize, 8 );
+		const int tilesX = ( width + size - 1 ) / size;
+		const int tilesY = ( height + size - 1 ) / size;
+		const bool outputDirty = nodes[ output ].version != nodes[ output ].evaluatedVersion;
+		std::atomic< size_t > found( 0 );
+		ParallelFor( 0, tilesX * tilesY, [ & ] ( int t ) {
+			const tile region = { ( t % tilesX ) * size, ( t / tilesX ) * size,
+				std::min( ( t % tilesX + 1 ) * size, width ), std::min( ( t / tilesX + 1 ) * size, height ), uint32_t( t ) };
+			for ( int i : dirty ) EvaluateTile( i, region );
+
+			// the scan runs on each output tile right after it's made, so it's still in cache
+			if ( outputDirty ) {
+				ImageF & out = ( nodes[ output ].node.op == glitchOp::input ) ? input : nodes[ output ].result;
+				size_t count = 0;
+				for ( int y = region.y0; y < region.y1; y++ ) {
+					count += SanitizeNonFinite( &out.data[ ( size_t( y ) * width + region.x0 ) * 4 ], size_t( region.Width() ) * 4 );
+				}
+				if ( count ) found += count;
+			}
+		}, 1 );
+		nonFinite = found.load();
+
+		for ( int i : dirty ) nodes[ i ].evaluatedVersion = nodes[ i ].version;
+		return Result( output );
+	}
+
+	// from the last Run()
+	int Evaluated () const { return evaluated; }
+	size_t NonFinite () const { return nonFinite; }
+
+private:
+	struct nodeState {
+		glitchNode node;
+		uint64_t version = 0;
+		uint64_t evaluatedVersion = ~0ull;
+		ImageF result;
+	};
+
+	void Validate ( int i ) {
+		glitchNode & n = nodes[ i ].node;
+		if ( n.input >= i || n.input < -1 ) n.input = -1;
+		if ( n.mask >= i || n.mask < -1 ) n.mask = -1;
+	}
+
+	const ImageF & Result ( int i ) const {
+		return ( nodes[ i ].node.op == glitchOp::input ) ? input : nodes[ i ].result;
+	}
+
+	std::vector< bool > Needed ( int output ) const {
+		std::vector< bool > needed( nodes.size(), false );
+		needed[ output ] = true;
+		for ( int i = output; i >= 0; i-- ) {
+			if ( !needed[ i ] ) continue;
+			if ( nodes[ i ].node.input >= 0 ) needed[ nodes[ i ].node.input ] = true;
+			if ( nodes[ i ].node.mask >= 0 ) needed[ nodes[ i ].node.mask ] = true;
+		}
+		return needed;
+	}
+
+	void UpdateVersions () {
+		using namespace glitchDetail;
+		for ( auto & s : nodes ) {
+			const glitchNode & n = s.node;
+			uint64_t h = 0xcbf29ce484222325ull;
+			h = Combine( h, uint64_t( n.op ) );
+			h = Combine( h, ( n.input >= 0 ) ? nodes[ n.input ].version : 0 );
+			h = Combine( h, ( n.mask >= 0 ) ? nodes[ n.mask ].version : 0 );
+			h = Combine( h, uint64_t( n.pattern ) );
+			h = Combine( h, n.invert );
+			h = Combine( h, uint64_t( n.size ) );
+			h = Combine( h, FloatBits( n.amount ) );
+			for ( int c = 0; c < 3; c++ ) h = Combine( h, FloatBits( n.color[ c ] ) );
+			h = Combine( h, uint64_t( n.stampMode ) );
+			h = Combine( h, n.seed );
+			h = Combine( h, uint64_t( tileSize ) );
+			h = Combine( h, uint64_t( input.width ) << 32 | input.height );
+			if ( n.op == glitchOp::input ) h = Combine( h, inputVersion );
+			if ( n.op == glitchOp::glyphStamp ) h = Combine( h, uint64_t( uintptr_t( glyphs.get() ) ) );
+			s.version = h;
+		}
+	}
+
+	void EvaluateTile ( int i, const glitchDetail::tile & t ) {
+		using namespace glitchDetail;
+		const glitchNode & n = nodes[ i ].node;
+		if ( n.op == glitchOp::input ) return;
+		ImageF & out = nodes[ i ].result;
+		const int width = int( out.width );
+		std::mt19937 rng( n.seed * 0x9e3779b9u ^ ( t.index * 0x85ebca6bu + uint32_t( i ) ) );
+
+		// effects start from a copy of the input tile - black without one
+		const ImageF * source = ( n.input >= 0 ) ? &Result( n.input ) : nullptr;
+		for ( int y = t.y0; y < t.y1; y++ ) {
+			float * o = &out.data[ ( size_t( y ) * width + t.x0 ) * 4 ];
+			if ( source ) {
+				std::memcpy( o, &source->data[ ( size_t( y ) * width + t.x0 ) * 4 ], sizeof( float ) * 4 * t.Width() );
+			} else {
+				std::fill( o, o + 4 * t.Width(), 0.0f );
+			}
+		}
+
+		switch ( n.op ) {
+			case glitchOp::mask: {
+				const bool tileSet = std::uniform_real_distribution< float >( 0.0f, 1.0f )( rng ) < n.amount;
+				for ( int y = t.y0; y < t.y1; y++ ) {
+					float * o = &out.data[ ( size_t( y ) * width + t.x0 ) * 4 ];
+					for ( int x = t.x0; x < t.x1; x++, o += 4 ) {
+						o[ 0 ] = o[ 1 ] = o[ 2 ] = o[ 3 ] = PatternSet( n, x, y, tileSet, rng ) ? 1.0f : 0.0f;
+					}
+				}
+				return; // masks aren't masked
+			}
+			case glitchOp::clear: {
+				const bool tileSet = std::uniform_real_distribution< float >( 0.0f, 1.0f )( rng ) < n.amount;
+				for ( int y = t.y0; y < t.y1; y++ ) {
+					float * o = &out.data[ ( size_t( y ) * width + t.x0 ) * 4 ];
+					for ( int x = t.x0; x < t.x1; x++, o += 4 ) {
+						if ( PatternSet( n, x, y, tileSet, rng ) ) o[ 0 ] = o[ 1 ] = o[ 2 ] = 0.0f;
+					}
+				}
+				break;
+			}
+			case glitchOp::glyphStamp: GlyphStamp( n, out, t, rng ); break;
+			case glitchOp::blur: Blur( out, t, std::max( n.size, 1 ) ); break;
+			case glitchOp::dither: Dither( out, t, std::clamp( n.size, 1, 8 ) ); break;
+			case glitchOp::resetSamples: {
+				for ( int y = t.y0; y < t.y1; y++ ) {
+					float * o = &out.data[ ( size_t( y ) * width + t.x0 ) * 4 ];
+					for ( int x = 0; x < t.Width(); x++ ) o[ x * 4 + 3 ] = n.amount;
+				}
+				break;
+			}
+			case glitchOp::byteShuffle: ByteShuffle( n, out, t, rng ); break;
+			default: break;
+		}
+
+		// mixed back toward the input by the mask's red channel
+		if ( n.mask >= 0 ) {
+			const ImageF & m = Result( n.mask );
+			for ( int y = t.y0; y < t.y1; y++ ) {
+				const size_t row = ( size_t( y ) * width + t.x0 ) * 4;
+				float * o = &out.data[ row ];
+				const float * s = source ? &source->data[ row ] : nullptr;
+				const float * k = &m.data[ row ];
+				for ( int x = 0; x < t.Width() * 4; x++ ) {
+					const float original = s ? s[ x ] : 0.0f;
+					o[ x ] = original + ( o[ x ] - original ) * k[ x & ~3 ];
+				}
+			}
+		}
+	}
+
+	// glyph count per tile is amount, the fraction rolled as one more - each is a random code from the atlas, at a
+	// random spot in the tile, scaled up size times, and clipped to the tile
+	void GlyphStamp ( const glitchNode & n, ImageF & out, const glitchDetail::tile & t, std::mt19937 & rng ) {
+		std::uniform_real_distribution< float > unit( 0.0f, 1.0f );
+		const int scale = std::max( n.size, 1 );
+		const int glyphWidth = 8 * scale, glyphHeight = 16 * scale;
+		const float whole = std::floor( std::max( n.amount, 0.0f ) );
+		const int count = int( whole ) + ( unit( rng ) < n.amount - whole ? 1 : 0 );
+		const bool atlas = glyphs && glyphs->width == 128 && glyphs->height == 256;
+		for ( int g = 0; g < count; g++ ) {
+			const int code = std::uniform_int_distribution< int >( 1, 254 )( rng );
+			const int gx = t.x0 + int( unit( rng ) * t.Width() ) - glyphWidth / 2;
+			const int gy = t.y0 + int( unit( rng ) * t.Height() ) - glyphHeight / 2;
+			const float sign = ( n.stampMode == 1 || ( n.stampMode == 2 && unit( rng ) < 0.5f ) ) ? -1.0f : 1.0f;
+			for ( int y = std::max( gy, t.y0 ); y < std::min( gy + glyphHeight, t.y1 ); y++ ) {
+				for ( int x = std::max( gx, t.x0 ); x < std::min( gx + glyphWidth, t.x1 ); x++ ) {
+					// without the atlas, a solid block
+					float coverage = 1.0f;
+					if ( atlas ) {
+						const int u = ( code % 16 ) * 8 + ( x - gx ) / scale;
+						const int v = ( code / 16 ) * 16 + ( y - gy ) / scale;
+						coverage = glyphs->data[ ( size_t( v ) * 128 + u ) * 4 + 3 ] / 255.0f;
+					}
+					float * o = &out.data[ ( size_t( y ) * out.width + x ) * 4 ];
+					for ( int c = 0; c < 3; c++ ) o[ c ] = std::max( o[ c ] + sign * coverage * n.color[ c ], 0.0f );
+				}
+			}
+		}
+	}
+
+	// running sums along rows then columns, clamped at the tile edges - color only
+	void Blur ( ImageF & out, const glitchDetail::tile & t, int radius ) {
+		const int w = t.Width(), h = t.Height();
+		std::vector< float > buffer( size_t( w ) * h * 3 );
+		auto At = [ & ] ( int x, int y ) { return &out.data[ ( size_t( t.y0 + y ) * out.width + t.x0 + x ) * 4 ]; };
+		const float normalize = 1.0f / ( 2 * radius + 1 );
+		for ( int y = 0; y < h; y++ ) {
+			float sum[ 3 ] = { 0.0f, 0.0f, 0.0f };
+			for ( int k = -radius; k <= radius; k++ ) {
+				const float * p = At( std::clamp( k, 0, w - 1 ), y );
+				for ( int c = 0; c < 3; c++ ) sum[ c ] += p[ c ];
+			}
+			for ( int x = 0; x < w; x++ ) {
+				for ( int c = 0; c < 3; c++ ) buffer[ ( size_t( y ) * w + x ) * 3 + c ] = sum[ c ] * normalize;
+				const float * add = At( std::min( x + radius + 1, w - 1 ), y );
+				const float * remove = At( std::max( x - radius, 0 ), y );
+				for ( int c = 0; c < 3; c++ ) sum[ c ] += add[ c ] - remove[ c ];
+			}
+		}
+		for ( int x = 0; x < w; x++ ) {
+			float sum[ 3 ] = { 0.0f, 0.0f, 0.0f };
+			for ( int k = -radius; k <= radius; k++ ) {
+				const float * p = &buffer[ ( size_t( std::clamp( k, 0, h - 1 ) ) * w + x ) * 3 ];
+				for ( int c = 0; c < 3; c++ ) sum[ c ] += p[ c ];
+			}
+			for ( int y = 0; y < h; y++ ) {
+				float * o = At( x, y );
+				for ( int c = 0; c < 3; c++ ) o[ c ] = sum[ c ] * normalize;
+				const float * add = &buffer[ ( size_t( std::min( y + radius + 1, h - 1 ) ) * w + x ) * 3 ];
+				const float * remove = &buffer[ ( size_t( std::max( y - radius, 0 ) ) * w + x ) * 3 ];
+				for ( int c = 0; c < 3; c++ ) sum[ c ] += add[ c ] - remove[ c ];
+			}
+		}
+	}
+
+	// levels span zero to the brightest channel in the tile, bayer matrix anchored at the tile corner
+	void Dither ( ImageF & out, const glitchDetail::tile & t, int bits ) {
+		float brightest = 0.0f;
+		for ( int y = t.y0; y < t.y1; y++ ) {
+			const float * o = &out.data[ ( size_t( y ) * out.width + t.x0 ) * 4 ];
+			for ( int x = 0; x < t.Width(); x++ ) {
+				for ( int c = 0; c < 3; c++ ) brightest = std::max( brightest, o[ x * 4 + c ] );
+			}
+		}
+		if ( !( brightest > 0.0f ) || !std::isfinite( brightest ) ) return;
+		const float levels = float( ( 1 << bits ) - 1 );
+		for ( int y = t.y0; y < t.y1; y++ ) {
+			float * o = &out.data[ ( size_t( y ) * out.width + t.x0 ) * 4 ];
+			for ( int x = 0; x < t.Width(); x++ ) {
+				const float threshold = ditherDetail::BayerThreshold( x, y - t.y0 );
+				for ( int c = 0; c < 3; c++ ) {
+					const float v = std::clamp( o[ x * 4 + c ] / brightest, 0.0f, 1.0f );
+					o[ x * 4 + c ] = std::min( std::floor( v * levels + threshold ), levels ) / levels * brightest;
+				}
+			}
+		}
+	}
+
+	// color bytes of the tile in spans of size bytes, each one shuffled with probability amount - spans of 4 mangle
+	// single floats, 12 whole pixels, anything larger smears across pixels. Sample counts are left alone
+	void ByteShuffle ( const glitchNode & n, ImageF & out, const glitchDetail::tile & t, std::mt19937 & rng ) {
+		const int w = t.Width(), h = t.Height();
+		std::vector< float > color( size_t( w ) * h * 3 );
+		for ( int y = 0; y < h; y++ ) {
+			const float * o = &out.data[ ( size_t( t.y0 + y ) * out.width + t.x0 ) * 4 ];
+			for ( int x = 0; x < w; x++ ) {
+				for ( int c = 0; c < 3; c++ ) color[ ( size_t( y ) * w + x ) * 3 + c ] = o[ x * 4 + c ];
+			}
+		}
+		uint8_t * bytes = ( uint8_t * ) color.data();
+		const size_t total = color.size() * sizeof( float );
+		const size_t span = size_t( std::max( n.size, 2 ) );
+		std::uniform_real_distribution< float > unit( 0.0f, 1.0f );
+		for ( size_t start = 0; start < total; start += span ) {
+			if ( unit( rng ) < n.amount ) std::shuffle( bytes + start, bytes + std::min( start + span, total ), rng );
+		}
+		for ( int y = 0; y < h; y++ ) {
+			float * o = &out.data[ ( size_t( t.y0 + y ) * out.width + t.x0 ) * 4 ];
+			for ( int x = 0; x < w; x++ ) {
+				for ( int c = 0; c < 3; c++ ) o[ x * 4 + c ] = color[ ( size_t( y ) * w + x ) * 3 + c ];
+			}
+		}
+	}
+
+	std::vector< nodeState > nodes;
+	ImageF input;
+	uint64_t inputVersion = 0;
+	std::shared_ptr< const Image > glyphs;
+	int evaluated = 0;
+	size_t nonFinite = 0;
+};
+
+#endif
@@ -21,6 +21,15 @@
 // TinyEXR is for loading and saving of high bit depth images - 16, 32 bits
 #include "../ImageHandling/tinyEXR/tinyexr.h"
 
+// RGBA8 / sRGB / half / float conversion kernels
+#include "../ImageHandling/PixelFormat.h"
+
+// multithreaded PNG writer, much faster than lodepng's encoder
+#include "../ImageHandling/FastPNG.h"
+
+// separable box / bilinear / lanczos / mitchell resampling and mip chains, multithreaded
+#include "../ImageHandling/Resample.h"
+
 #include <vector>
 #include <random>
 #include <string>
@@ -33,7 +42,8 @@
 // adding additional backends is as simple as adding an enum, writing the corresponding load/save implementation
 enum backend {
 	STB = 0,
-	LODEPNG = 1
+	LODEPNG = 1,
+	FASTPNG = 2		// save only, see FastPNG.h - loading falls back to lodepng, the output is a standard PNG
 	// fpng has been removed, but leaving the option to potentially add other load/save options here
 		// fpng has a really weird situation where it throws an error loading regular pngs, it only
 		// wants to deal with its own format - I haven't found any use for it, unless you were using
@@ -107,17 +117,19 @@ public:
 		Clear(); // remove existing data
 		switch ( loader ) {
 			case STB:		result = Load_stb( path ); 		break;
-			case LODEPNG:	result = Load_lodepng( path ); 	break;
+			case LODEPNG:
+			case FASTPNG:	result = Load_lodepng( path ); 	break;
 			default: break;
 		}
 		if ( !result ) { std::cout << "Image::Load Failed" << std::endl; }
 		return result;
 	}
 
-	bool Save ( std::string path, backend loader = LODEPNG ) {
+	bool Save ( std::string path, backend loader = FASTPNG ) {
 		switch ( loader ) {
 			case STB:		return Save_stb( path );
 			case LODEPNG:	return Save_lodepng( path );
+			case FASTPNG:	return Save_fastpng( path );
 			default: break;
 		}
 		return false;
@@ -169,57 +181,45 @@ public:
 	}
 
 	void FlipVertical () {
-		// back up the existing state of the image
-		std::vector< uint8_t > oldData;
-		oldData.reserve( width * height * 4 );
-		for ( auto c : data ) {
-			oldData.push_back( c );
-		}
-		// flip it
-		data.resize( 0 );
-		data.reserve( width * height * 4 );
-		for ( uint32_t y = 0; y < height; y++ ) {
-			for ( uint32_t x = 0; x < width; x++ ) {
-				data.push_back( oldData[ ( x + ( height - y - 1 ) * width ) * 4 + 0 ] );
-				data.push_back( oldData[ ( x + ( height - y - 1 ) * width ) * 4 + 1 ] );
-				data.push_back( oldData[ ( x + ( height - y - 1 ) * width ) * 4 + 2 ] );
-				data.push_back( oldData[ ( x + ( height - y - 1 ) * width ) * 4 + 3 ] );
-			}
-		}
+		// back up the existing state of the image, then copy rows back in reverse order
+		std::vector< uint8_t > oldData( data );
+		ConvertImage< pixelFormat::RGBA8, pixelFormat::RGBA8 >( oldData.data(), data.data(), width, height, true );
 	}
 
-	void Resize ( float scaleFactor ) {
-		int newX = std::floor( scaleFactor * float( width ) );
-	 	int newY = std::floor( scaleFactor * float( height ) );
+	// scales both dimensions by scaleFactor - see Resample.h for the filters, sRGB filters color in linear space
+	void Resize ( float scaleFactor, resampleFilter filter = resampleFilter::mitchell, bool sRGB = false ) {
+		ResizeTo( uint32_t( std::floor( scaleFactor * float( width ) ) ), uint32_t( std::floor( scaleFactor * float( height ) ) ), filter, sRGB );
+	}
 
-		// do the resize
-		const uint32_t oldSize = width * height * numChannels;
-		uint8_t * oldData = ( uint8_t * ) malloc( oldSize );
-		for ( uint32_t i = 0; i < oldSize; i++ ) {
-			oldData[ i ] = data[ i ];
+	void ResizeTo ( uint32_t newX, uint32_t newY, resampleFilter filter = resampleFilter::mitchell, bool sRGB = false ) {
+		if ( newX == width && newY == height ) return;
+		std::vector< uint8_t > newData( size_t( newX ) * newY * numChannels );
+		if ( sRGB ) {
+			ResamplePixels< pixelFormat::SRGBA8 >( data.data(), width, height, newData.data(), newX, newY, filter );
+		} else {
+			ResamplePixels< pixelFormat::RGBA8 >( data.data(), width, height, newData.data(), newX, newY, filter );
 		}
-
-		// buffer needs to be allocated before the resize function works
-		uint8_t * newData = ( unsigned char * ) malloc( newX * newY * numChannels );
-		stbir_resize_uint8( oldData, width, height, width * numChannels, newData, newX, newY, newX * numChannels, numChannels );
-
-		// there's also a srgb version, would need to look at the extra parameters that it needs
-			// stbir_resize_uint8_srgb( ... );
-
-		// image dimensions are now scaled up by scaleFactor
+		data.swap( newData );
 		width = newX;
 		height = newY;
+	}
 
-		// copy new data back to the data vector
-		data.resize( 0 );
-		const uint32_t newSize = width * height * numChannels;
-		data.reserve( newSize );
-		for ( uint32_t i = 0; i < newSize; i++ ) {
-			data.push_back( newData[ i ] );
+	// successive half size images down to 1x1, not including this one
+	std::vector< Image > MipChain ( resampleFilter filter = resampleFilter::box, bool sRGB = false ) {
+		std::vector< std::pair< uint32_t, uint32_t > > sizes;
+		std::vector< std::vector< uint8_t > > levels = sRGB ?
+			BuildMipLevels< pixelFormat::SRGBA8 >( data.data(), width, height, filter, &sizes ) :
+			BuildMipLevels< pixelFormat::RGBA8 >( data.data(), width, height, filter, &sizes );
+		std::vector< Image > chain( levels.size() );
+		for ( size_t i = 0; i < levels.size(); i++ ) {
+			chain[ i ].width = sizes[ i ].first;
+			chain[ i ].height = sizes[ i ].second;
+			chain[ i ].data.swap( levels[ i ] );
 		}
+		return chain;
 	}
 
-	rgba GetAtXY ( uint32_t x, uint32_t y ) {
+	rgba GetAtXY ( uint32_t x, uint32_t y ) const {
 		rgba temp; // initialized with zeroes
 		if ( x < 0 || x >= width || y < 0 || y >= height ) return temp;
 		uint32_t index = ( x + y * width ) * numChannels;
@@ -463,6 +463,15 @@ private:
 			return false;
 		}
 	}
+
+	// ==== FastPNG ======================================
+	bool Save_fastpng ( std::string path, pngCompression mode = pngCompression::fast ) {
+		if ( !WritePNGFile( path, EncodePNG( data.data(), width, height, mode ) ) ) {
+			std::cout << "fastpng save error: could not write " << path << std::endl;
+			return false;
+		}
+		return true;
+	}
 };
 
 class ImageF {
@@ -489,17 +498,7 @@ public:
 		width = temp.width;
 		height = temp.height;
 		data.resize( width * height * numChannels );
-		for ( uint32_t y = 0; y < height; y++ ) {
-			for ( uint32_t x = 0; x < width; x++ ) {
-				rgba tempVal = temp.GetAtXY( x, y );
-				rgbaF tempValF;
-				tempValF.r = tempVal.r / 255.0f;
-				tempValF.g = tempVal.g / 255.0f;
-				tempValF.b = tempVal.b / 255.0f;
-				tempValF.a = tempVal.a / 255.0f;
-				SetAtXY( x, y, tempValF );
-			}
-		}
+		ConvertPixels< pixelFormat::RGBA8, pixelFormat::RGBA32F >( temp.data.data(), data.data(), width * height );
 	}
 
 	ImageF ( int x, int y, float* contents ) : width( x ), height( y ) {
@@ -605,7 +604,21 @@ public:
 		free( header.requested_pixel_types );
 	}
 
-	// will need a save function, to save higher bitrate, maybe 16 bit png? LodePNG will do it
+	// 16 bits per channel PNG, values clamped to 0..1 - use saveEXR to keep the full range
+	bool SavePNG16 ( std::string path, pngCompression mode = pngCompression::fast ) {
+		std::vector< uint16_t > converted( data.size() );
+		ParallelFor( 0, int( height ), [ & ] ( int y ) {
+			const size_t rowStart = size_t( y ) * width * numChannels;
+			for ( size_t i = rowStart; i < rowStart + width * numChannels; i++ ) {
+				converted[ i ] = uint16_t( std::clamp( data[ i ], 0.0f, 1.0f ) * 65535.0f + 0.5f );
+			}
+		} );
+		if ( !WritePNGFile( path, EncodePNG16( converted.data(), width, height, mode ) ) ) {
+			std::cout << "fastpng save error: could not write " << path << std::endl;
+			return false;
+		}
+		return true;
+	}
 
 	void CropTo ( int x, int y ) {
 	// take this image data, and trim it, creating another image that is:
@@ -652,23 +665,35 @@ public:
 	}
 
 	void FlipVertical () {
-		// back up the existing state of the image
-		std::vector< float > oldData;
-		oldData.reserve( width * height * 4 );
-		for ( auto c : data ) {
-			oldData.push_back( c );
-		}
-		// flip it
-		data.resize( 0 );
-		data.reserve( width * height * 4 );
-		for ( uint32_t y = 0; y < height; y++ ) {
-			for ( uint32_t x = 0; x < width; x++ ) {
-				data.push_back( oldData[ ( x + ( height - y - 1 ) * width ) * 4 + 0 ] );
-				data.push_back( oldData[ ( x + ( height - y - 1 ) * width ) * 4 + 1 ] );
-				data.push_back( oldData[ ( x + ( height - y - 1 ) * width ) * 4 + 2 ] );
-				data.push_back( oldData[ ( x + ( height - y - 1 ) * width ) * 4 + 3 ] );
-			}
+		// back up the existing state of the image, then copy rows back in reverse order
+		std::vector< float > oldData( data );
+		ConvertImage< pixelFormat::RGBA32F, pixelFormat::RGBA32F >( oldData.data(), data.data(), width, height, true );
+	}
+
+	// same filters as Image::Resize - the data is already linear, so there's no sRGB option
+	void Resize ( float scaleFactor, resampleFilter filter = resampleFilter::mitchell ) {
+		ResizeTo( uint32_t( std::floor( scaleFactor * float( width ) ) ), uint32_t( std::floor( scaleFactor * float( height ) ) ), filter );
+	}
+
+	void ResizeTo ( uint32_t newX, uint32_t newY, resampleFilter filter = resampleFilter::mitchell ) {
+		if ( newX == width && newY == height ) return;
+		std::vector< float > newData( size_t( newX ) * newY * numChannels );
+		ResamplePixels< pixelFormat::RGBA32F >( data.data(), width, height, newData.data(), newX, newY, filter );
+		data.swap( newData );
+		width = newX;
+		height = newY;
+	}
+
+	std::vector< ImageF > MipChain ( resampleFilter filter = resampleFilter::box ) {
+		std::vector< std::pair< uint32_t, uint32_t > > sizes;
+		std::vector< std::vector< float > > levels = BuildMipLevels< pixelFormat::RGBA32F >( data.data(), width, height, filter, &sizes );
+		std::vector< ImageF > chain( levels.size() );
+		for ( size_t i = 0; i < levels.size(); i++ ) {
+			chain[ i ].width = sizes[ i ].first;
+			chain[ i ].height = sizes[ i ].second;
+			chain[ i ].data.swap( levels[ i ] );
 		}
+		return chain;
 	}
 
 	rgbaF GetAtXY ( uint32_t x, uint32_t y ) {
@@ -0,0 +1,387 @@
+#pragma once
+#ifndef IMAGEMETRICS_H
+#define IMAGEMETRICS_H
+
+#include "../ImageHandling/Image.h"
+#include "../Threading/ThreadPool.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// image comparison, for judging convergence of a render against a reference
+	// - MSE, relMSE, PSNR over RGB, alpha is ignored
+	// - SSIM on luminance, values clamped to [ 0, 1 ], 11 tap gaussian window with sigma 1.5
+	// - FLIP is LDR-FLIP ( Andersson et al. 2020 ) on values clamped to [ 0, 1 ] - tonemap both first for a perceptual
+	//   comparison of HDR content. Inputs are treated as already linear, so the sRGB decode step is skipped
+	// - everything is parallel over rows, partial sums are kept per row so results don't depend on thread count
+
+struct imageComparison {
+	bool valid = false; // false when the sizes don't match, everything else is left at zero
+	double MSE = 0.0;
+	double relMSE = 0.0;
+	double PSNR = 0.0;
+	double SSIM = 0.0;
+	double FLIP = 0.0;
+};
+
+// per-pixel error, written as greyscale with alpha 1 so they can go straight to saveEXR
+struct imageErrorMaps {
+	ImageF squaredError;
+	ImageF relativeSquaredError;
+	ImageF SSIM;
+	ImageF FLIP;
+};
+
+// single channel working buffer
+struct metricPlane {
+	metricPlane () {}
+	metricPlane ( int w, int h ) : width( w ), height( h ), data( size_t( w ) * h, 0.0f ) {}
+	float & operator () ( int x, int y ) { return data[ size_t( x ) + size_t( y ) * width ]; }
+	float operator () ( int x, int y ) const { return data[ size_t( x ) + size_t( y ) * width ]; }
+	int width = 0;
+	int height = 0;
+	std::vector< float > data;
+};
+
+// ==== helpers =====================================
+// horizontal pass, then vertical pass, clamp to edge - both passes parallel over rows
+inline void SeparableConvolve ( const metricPlane & in, metricPlane & out, const std::vector< float > & kernelX, const std::vector< float > & kernelY ) {
+	const int rx = int( kernelX.size() ) / 2;
+	const int ry = int( kernelY.size() ) / 2;
+	metricPlane temp( in.width, in.height );
+	out = metricPlane( in.width, in.height );
+	ParallelFor( 0, in.height, [ & ] ( int y ) {
+		for ( int x = 0; x < in.width; x++ ) {
+			float sum = 0.0f;
+			for ( int k = -rx; k <= rx; k++ ) {
+				sum += kernelX[ k + rx ] * in( std::clamp( x + k, 0, in.width - 1 ), y );
+			}
+			temp( x, y ) = sum;
+		}
+	}, 8 );
+	ParallelFor( 0, in.height, [ & ] ( int y ) {
+		float * row = &out.data[ size_t( y ) * in.width ];
+		for ( int k = -ry; k <= ry; k++ ) {
+			const float weight = kernelY[ k + ry ];
+			const float * source = &temp.data[ size_t( std::clamp( y + k, 0, in.height - 1 ) ) * in.width ];
+			for ( int x = 0; x < in.width; x++ ) {
+				row[ x ] += weight * source[ x ];
+			}
+		}
+	}, 8 );
+}
+
+inline std::vector< float > GaussianKernel ( int radius, float sigma ) {
+	std::vector< float > kernel( 2 * radius + 1 );
+	float sum = 0.0f;
+	for ( int i = -radius; i <= radius; i++ ) {
+		sum += kernel[ i + radius ] = std::exp( -( i * i ) / ( 2.0f * sigma * sigma ) );
+	}
+	for ( auto & k : kernel ) k /= sum;
+	return kernel;
+}
+
+inline ImageF PlaneToImage ( const metricPlane & plane ) {
+	ImageF result( plane.width, plane.height );
+	for ( size_t i = 0; i < plane.data.size(); i++ ) {
+		result.data[ 4 * i + 0 ] = result.data[ 4 * i + 1 ] = result.data[ 4 * i + 2 ] = plane.data[ i ];
+		result.data[ 4 * i + 3 ] = 1.0f;
+	}
+	return result;
+}
+
+// sum over a plane, per row partials so the result is deterministic
+inline double PlaneMean ( const metricPlane & plane ) {
+	std::vector< double > rowSums( plane.height, 0.0 );
+	ParallelFor( 0, plane.height, [ & ] ( int y ) {
+		double sum = 0.0;
+		for ( int x = 0; x < plane.width; x++ ) sum += plane( x, y );
+		rowSums[ y ] = sum;
+	}, 16 );
+	double total = 0.0;
+	for ( double s : rowSums ) total += s;
+	return total / ( double( plane.width ) * plane.height );
+}
+
+// ==== FLIP color math =============================
+namespace flipDetail {
+	constexpr float qc = 0.7f;
+	constexpr float qf = 0.5f;
+	constexpr float pc = 0.4f;
+	constexpr float pt = 0.95f;
+	constexpr float defaultPixelsPerDegree = 67.0f; // 0.7m viewing distance, 0.7m wide 4k monitor
+	constexpr float pi = 3.14159265358979323846f;
+
+	// linear RGB <-> XYZ, D65
+	inline void LinearRGBToXYZ ( const float * rgb, float * xyz ) {
+		xyz[ 0 ] = ( 10135552.0f * rgb[ 0 ] + 8788810.0f * rgb[ 1 ] + 4435075.0f * rgb[ 2 ] ) / 24577794.0f;
+		xyz[ 1 ] = ( 2613072.0f * rgb[ 0 ] + 8788810.0f * rgb[ 1 ] + 887015.0f * rgb[ 2 ] ) / 12288897.0f;
+		xyz[ 2 ] = ( 1425312.0f * rgb[ 0 ] + 8788810.0f * rgb[ 1 ] + 70074185.0f * rgb[ 2 ] ) / 73733382.0f;
+	}
+
+	inline void XYZToLinearRGB ( const float * xyz, float * rgb ) {
+		rgb[ 0 ] =  3.241003275f * xyz[ 0 ] - 1.537398934f * xyz[ 1 ] - 0.498615861f * xyz[ 2 ];
+		rgb[ 1 ] = -0.969224334f * xyz[ 0 ] + 1.875930071f * xyz[ 1 ] + 0.041554224f * xyz[ 2 ];
+		rgb[ 2 ] =  0.055639423f * xyz[ 0 ] - 0.204011202f * xyz[ 1 ] + 1.057148933f * xyz[ 2 ];
+	}
+
+	// XYZ of linear RGB ( 1, 1, 1 )
+	constexpr float whiteXYZ[ 3 ] = { 0.950428545f, 1.0f, 1.088900371f };
+
+	inline void XYZToYCxCz ( const float * xyz, float * ycc ) {
+		const float x = xyz[ 0 ] / whiteXYZ[ 0 ], y = xyz[ 1 ] / whiteXYZ[ 1 ], z = xyz[ 2 ] / whiteXYZ[ 2 ];
+		ycc[ 0 ] = 116.0f * y - 16.0f;
+		ycc[ 1 ] = 500.0f * ( x - y );
+		ycc[ 2 ] = 200.0f * ( y - z );
+	}
+
+	inline void YCxCzToXYZ ( const float * ycc, float * xyz ) {
+		const float y = ( ycc[ 0 ] + 16.0f ) / 116.0f;
+		xyz[ 0 ] = ( y + ycc[ 1 ] / 500.0f ) * whiteXYZ[ 0 ];
+		xyz[ 1 ] = y * whiteXYZ[ 1 ];
+		xyz[ 2 ] = ( y - ycc[ 2 ] / 200.0f ) * whiteXYZ[ 2 ];
+	}
+
+	// L*a*b*, with the Hunt adjustment applied to a and b
+	inline void XYZToHuntLab ( const float * xyz, float * lab ) {
+		constexpr float delta = 6.0f / 29.0f;
+		auto f = [ & ] ( float t ) {
+			return ( t > delta * delta * delta ) ? std::cbrt( t ) : t / ( 3.0f * delta * delta ) + 4.0f / 29.0f;
+		};
+		const float fx = f( xyz[ 0 ] / whiteXYZ[ 0 ] ), fy = f( xyz[ 1 ] / whiteXYZ[ 1 ] ), fz = f( xyz[ 2 ] / whiteXYZ[ 2 ] );
+		lab[ 0 ] = 116.0f * fy - 16.0f;
+		lab[ 1 ] = 500.0f * ( fx - fy ) * 0.01f * lab[ 0 ];
+		lab[ 2 ] = 200.0f * ( fy - fz ) * 0.01f * lab[ 0 ];
+	}
+
+	inline float HyAB ( const float * a, const float * b ) {
+		const float da = a[ 1 ] - b[ 1 ], db = a[ 2 ] - b[ 2 ];
+		return std::abs( a[ 0 ] - b[ 0 ] ) + std::sqrt( da * da + db * db );
+	}
+
+	// contrast sensitivity filters - a1, b1, a2, b2 per YCxCz channel
+	constexpr float csfParameters[ 3 ][ 4 ] = {
+		{ 1.0f,  0.0047f, 0.0f,  1e-5f },	// achromatic
+		{ 1.0f,  0.0053f, 0.0f,  1e-5f },	// red-green
+		{ 34.1f, 0.04f,   13.5f, 0.025f }	// blue-yellow
+	};
+
+	// each CSF is the sum of two gaussians, both separable - filter with each and recombine with the 2D weights
+	inline void CSFFilter ( const metricPlane & in, metricPlane & out, int channel, float pixelsPerDegree ) {
+		const int radius = int( std::ceil( 3.0f * std::sqrt( 0.04f / ( 2.0f * pi * pi ) ) * pixelsPerDegree ) );
+		const float deltaX = 1.0f / pixelsPerDegree;
+		const float * p = csfParameters[ channel ];
+		std::vector< float > g[ 2 ];
+		float weight[ 2 ], kernelSum2D = 0.0f;
+		for ( int term = 0; term < 2; term++ ) {
+			const float a = p[ 2 * term ], b = p[ 2 * term + 1 ];
+			g[ term ].resize( 2 * radius + 1 );
+			float sum1D = 0.0f;
+			for ( int i = -radius; i <= radius; i++ ) {
+				const float x = i * deltaX;
+				sum1D += g[ term ][ i + radius ] = std::exp( -pi * pi * x * x / b );
+			}
+			weight[ term ] = a * std::sqrt( pi / b );
+			kernelSum2D += weight[ term ] * sum1D * sum1D;
+		}
+		SeparableConvolve( in, out, g[ 0 ], g[ 0 ] );
+		const float w0 = weight[ 0 ] / kernelSum2D;
+		if ( weight[ 1 ] == 0.0f ) {
+			for ( auto & v : out.data ) v *= w0;
+		} else {
+			metricPlane second;
+			SeparableConvolve( in, second, g[ 1 ], g[ 1 ] );
+			const float w1 = weight[ 1 ] / kernelSum2D;
+			for ( size_t i = 0; i < out.data.size(); i++ ) out.data[ i ] = w0 * out.data[ i ] + w1 * second.data[ i ];
+		}
+	}
+
+	// edge ( first derivative of gaussian ) or point ( second derivative ) detector magnitude, separable in x and y
+	inline metricPlane FeatureMagnitude ( const metricPlane & luminance, bool edges, float pixelsPerDegree ) {
+		const float sd = 0.5f * 0.082f * pixelsPerDegree;
+		const int radius = int( std::ceil( 3.0f * sd ) );
+		std::vector< float > g( 2 * radius + 1 ), h( 2 * radius + 1 );
+		float gSum = 0.0f, positiveSum = 0.0f, negativeSum = 0.0f;
+		for ( int i = -radius; i <= radius; i++ ) {
+			const float gaussian = std::exp( -( i * i ) / ( 2.0f * sd * sd ) );
+			gSum += g[ i + radius ] = gaussian;
+			const float value = edges ? -i * gaussian : ( ( i * i ) / ( sd * sd ) - 1.0f ) * gaussian;
+			h[ i + radius ] = value;
+			( value > 0.0f ? positiveSum : negativeSum ) += value;
+		}
+		for ( auto & v : g ) v /= gSum;
+		for ( auto & v : h ) v = ( v > 0.0f ) ? v / positiveSum : v / -negativeSum;
+
+		metricPlane fx, fy;
+		SeparableConvolve( luminance, fx, h, g );
+		SeparableConvolve( luminance, fy, g, h );
+		for ( size_t i = 0; i < fx.data.size(); i++ ) {
+			fx.data[ i ] = std::sqrt( fx.data[ i ] * fx.data[ i ] + fy.data[ i ] * fy.data[ i ] );
+		}
+		return fx;
+	}
+
+	// CSF filtered, clamped, Hunt adjusted L*a*b* for the color pipeline, plus normalized luminance for the features
+	inline void Preprocess ( const ImageF & image, float pixelsPerDegree, metricPlane lab[ 3 ], metricPlane & luminance ) {
+		const int w = image.width, h = image.height;
+		metricPlane ycc[ 3 ] = { metricPlane( w, h ), metricPlane( w, h ), metricPlane( w, h ) };
+		luminance = metricPlane( w, h );
+		ParallelFor( 0, h, [ & ] ( int y ) {
+			for ( int x = 0; x < w; x++ ) {
+				const float * src = &image.data[ 4 * ( size_t( x ) + size_t( y ) * w ) ];
+				float rgb[ 3 ], xyz[ 3 ], c[ 3 ];
+				for ( int i = 0; i < 3; i++ ) rgb[ i ] = std::clamp( src[ i ], 0.0f, 1.0f );
+				LinearRGBToXYZ( rgb, xyz );
+				XYZToYCxCz( xyz, c );
+				ycc[ 0 ]( x, y ) = c[ 0 ];
+				ycc[ 1 ]( x, y ) = c[ 1 ];
+				ycc[ 2 ]( x, y ) = c[ 2 ];
+				luminance( x, y ) = ( c[ 0 ] + 16.0f ) / 116.0f;
+			}
+		}, 8 );
+
+		metricPlane filtered[ 3 ];
+		for ( int c = 0; c < 3; c++ ) {
+			CSFFilter( ycc[ c ], filtered[ c ], c, pixelsPerDegree );
+			lab[ c ] = metricPlane( w, h );
+		}
+
+		ParallelFor( 0, h, [ & ] ( int y ) {
+			for ( int x = 0; x < w; x++ ) {
+				float c[ 3 ] = { filtered[ 0 ]( x, y ), filtered[ 1 ]( x, y ), filtered[ 2 ]( x, y ) };
+				float xyz[ 3 ], rgb[ 3 ], result[ 3 ];
+				YCxCzToXYZ( c, xyz );
+				XYZToLinearRGB( xyz, rgb );
+				for ( int i = 0; i < 3; i++ ) rgb[ i ] = std::clamp( rgb[ i ], 0.0f, 1.0f );
+				LinearRGBToXYZ( rgb, xyz );
+				XYZToHuntLab( xyz, result );
+				lab[ 0 ]( x, y ) = result[ 0 ];
+				lab[ 1 ]( x, y ) = result[ 1 ];
+				lab[ 2 ]( x, y ) = result[ 2 ];
+			}
+		}, 8 );
+	}
+}
+
+// ==== individual metrics ==========================
+inline metricPlane FLIPErrorMap ( const ImageF & test, const ImageF & reference, float pixelsPerDegree = flipDetail::defaultPixelsPerDegree ) {
+	using namespace flipDetail;
+	metricPlane testLab[ 3 ], referenceLab[ 3 ], testLuminance, referenceLuminance;
+	Preprocess( test, pixelsPerDegree, testLab, testLuminance );
+	Preprocess( reference, pixelsPerDegree, referenceLab, referenceLuminance );
+
+	const metricPlane testEdges = FeatureMagnitude( testLuminance, true, pixelsPerDegree );
+	const metricPlane testPoints = FeatureMagnitude( testLuminance, false, pixelsPerDegree );
+	const metricPlane referenceEdges = FeatureMagnitude( referenceLuminance, true, pixelsPerDegree );
+	const metricPlane referencePoints = FeatureMagnitude( referenceLuminance, false, pixelsPerDegree );
+
+	// largest color difference, pure green vs pure blue
+	float green[ 3 ] = { 0.0f, 1.0f, 0.0f }, blue[ 3 ] = { 0.0f, 0.0f, 1.0f }, xyz[ 3 ], greenLab[ 3 ], blueLab[ 3 ];
+	LinearRGBToXYZ( green, xyz ); XYZToHuntLab( xyz, greenLab );
+	LinearRGBToXYZ( blue, xyz ); XYZToHuntLab( xyz, blueLab );
+	const float cmax = std::pow( HyAB( greenLab, blueLab ), qc );
+	const float pccmax = pc * cmax;
+
+	metricPlane result( test.width, test.height );
+	ParallelFor( 0, result.height, [ & ] ( int y ) {
+		for ( int x = 0; x < result.width; x++ ) {
+			const float a[ 3 ] = { testLab[ 0 ]( x, y ), testLab[ 1 ]( x, y ), testLab[ 2 ]( x, y ) };
+			const float b[ 3 ] = { referenceLab[ 0 ]( x, y ), referenceLab[ 1 ]( x, y ), referenceLab[ 2 ]( x, y ) };
+			const float powerHyAB = std::pow( HyAB( a, b ), qc );
+			const float colorError = ( powerHyAB < pccmax ) ? ( pt / pccmax ) * powerHyAB :
+				pt + ( ( powerHyAB - pccmax ) / ( cmax - pccmax ) ) * ( 1.0f - pt );
+			const float featureDifference = std::max(
+				std::abs( testEdges( x, y ) - referenceEdges( x, y ) ),
+				std::abs( testPoints( x, y ) - referencePoints( x, y ) ) );
+			const float featureError = std::pow( featureDifference / std::sqrt( 2.0f ), qf );
+			result( x, y ) = std::pow( colorError, 1.0f - featureError );
+		}
+	}, 8 );
+	return result;
+}
+
+inline metricPlane SSIMMap ( const ImageF & test, const ImageF & reference ) {
+	const int w = test.width, h = test.height;
+	metricPlane a( w, h ), b( w, h ), aa( w, h ), bb( w, h ), ab( w, h );
+	ParallelFor( 0, h, [ & ] ( int y ) {
+		for ( int x = 0; x < w; x++ ) {
+			const size_t index = 4 * ( size_t( x ) + size_t( y ) * w );
+			const float * t = &test.data[ index ];
+			const float * r = &reference.data[ index ];
+			const float lt = std::clamp( 0.2126f * t[ 0 ] + 0.7152f * t[ 1 ] + 0.0722f * t[ 2 ], 0.0f, 1.0f );
+			const float lr = std::clamp( 0.2126f * r[ 0 ] + 0.7152f * r[ 1 ] + 0.0722f * r[ 2 ], 0.0f, 1.0f );
+			a( x, y ) = lt; b( x, y ) = lr;
+			aa( x, y ) = lt * lt; bb( x, y ) = lr * lr; ab( x, y ) = lt * lr;
+		}
+	}, 8 );
+
+	const std::vector< float > window = GaussianKernel( 5, 1.5f );
+	metricPlane muA, muB, sAA, sBB, sAB;
+	SeparableConvolve( a, muA, window, window );
+	SeparableConvolve( b, muB, window, window );
+	SeparableConvolve( aa, sAA, window, window );
+	SeparableConvolve( bb, sBB, window, window );
+	SeparableConvolve( ab, sAB, window, window );
+
+	constexpr float C1 = 0.01f * 0.01f;
+	constexpr float C2 = 0.03f * 0.03f;
+	metricPlane result( w, h );
+	ParallelFor( 0, h, [ & ] ( int y ) {
+		for ( int x = 0; x < w; x++ ) {
+			const float ma = muA( x, y ), mb = muB( x, y );
+			const float varA = sAA( x, y ) - ma * ma;
+			const float varB = sBB( x, y ) - mb * mb;
+			const float covariance = sAB( x, y ) - ma * mb;
+			result( x, y ) = ( ( 2.0f * ma * mb + C1 ) * ( 2.0f * covariance + C2 ) ) /
+				( ( ma * ma + mb * mb + C1 ) * ( varA + varB + C2 ) );
+		}
+	}, 8 );
+	return result;
+}
+
+// ==== everything at once ==========================
+inline imageComparison CompareImages ( const ImageF & test, const ImageF & reference, imageErrorMaps * maps = nullptr ) {
+	imageComparison result;
+	if ( test.width != reference.width || test.height != reference.height || test.data.empty() ) {
+		return result; // not valid, caller reports it
+	}
+
+	const int w = test.width, h = test.height;
+	metricPlane squared( w, h ), relative( w, h );
+	ParallelFor( 0, h, [ & ] ( int y ) {
+		for ( int x = 0; x < w; x++ ) {
+			const size_t index = 4 * ( size_t( x ) + size_t( y ) * w );
+			float se = 0.0f, rse = 0.0f;
+			for ( int c = 0; c < 3; c++ ) {
+				const float t = test.data[ index + c ], r = reference.data[ index + c ];
+				const float d2 = ( t - r ) * ( t - r );
+				se += d2;
+				rse += d2 / ( r * r + 0.01f );
+			}
+			squared( x, y ) = se / 3.0f;
+			relative( x, y ) = rse / 3.0f;
+		}
+	}, 8 );
+
+	const metricPlane ssim = SSIMMap( test, reference );
+	const metricPlane flip = FLIPErrorMap( test, reference );
+
+	result.MSE = PlaneMean( squared );
+	result.relMSE = PlaneMean( relative );
+	result.PSNR = ( result.MSE > 0.0 ) ? 10.0 * std::log10( 1.0 / result.MSE ) : std::numeric_limits< double >::infinity();
+	result.SSIM = PlaneMean( ssim );
+	result.FLIP = PlaneMean( flip );
+
+	result.valid = true;
+
+	if ( maps != nullptr ) {
+		maps->squaredError = PlaneToImage( squared );
+		maps->relativeSquaredError = PlaneToImage( relative );
+		maps->SSIM = PlaneToImage( ssim );
+		maps->FLIP = PlaneToImage( flip );
+	}
+	return result;
+}
+
+#endif
@@ -0,0 +1,206 @@
+#pragma once
+#ifndef OKLAB_H
+#define OKLAB_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// Björn Ottosson's Oklab - https://bottosson.github.io/posts/oklab/
+	// perceptual color space, euclidean distance in it is a reasonable approximation of perceived difference, which is
+	// what the palette matching and dithering want. Input / output here is linear sRGB ( not gamma encoded )
+	// - Oklch is the same space in polar form: L, chroma C = length( a, b ), hue h = atan2( b, a ) in radians, -pi..pi
+	// - the batch versions below take rows of pixels, and are what the dither and palette stages use
+
+// std::cbrt is the bulk of the cost of the conversion - bit trick initial guess ( within a few percent ), then two
+// Halley iterations, which gets to float precision: measured within 3 ulp of std::cbrt over 1e-30..1e38. Odd, and
+// exactly zero below 1e-30 in magnitude. NaN and infinity pass through, finite inputs past 1.1e38 overflow in the
+// iteration. No branches, so the loops it ends up in vectorize
+inline float FastCbrt ( float x ) {
+	uint32_t bits;
+	std::memcpy( &bits, &x, 4 );
+	const uint32_t sign = bits & 0x80000000u;
+	bits = ( bits & 0x7fffffffu ) / 3 + 0x2a514067;
+	const float a = std::abs( x );
+	float y;
+	std::memcpy( &y, &bits, 4 );
+	// ratio first, y * ( y3 + 2a ) overflows for large a
+	float y3 = y * y * y;
+	y = y * ( ( y3 + 2.0f * a ) / ( 2.0f * y3 + a ) );
+	y3 = y * y * y;
+	y = y * ( ( y3 + 2.0f * a ) / ( 2.0f * y3 + a ) );
+	y = ( a > 1e-30f ) ? y : 0.0f;
+	y = ( a <= std::numeric_limits< float >::max() ) ? y : a; // false for NaN as well as infinity
+	std::memcpy( &bits, &y, 4 );
+	bits |= sign;
+	std::memcpy( &y, &bits, 4 );
+	return y;
+}
+
+// octant folded to [ 0, 1 ], then a degree 12 odd polynomial - within 8e-7 radians of std::atan2. ( 0, 0 ) gives 0
+inline float FastAtan2 ( float y, float x ) {
+	const float ax = std::abs( x ), ay = std::abs( y );
+	const float t = std::min( ax, ay ) / std::max( std::max( ax, ay ), 1e-30f );
+	const float s = t * t;
+	float r = t * ( 0.999999226f + s * ( -0.33325678f + s * ( 0.198720403f + s * ( -0.134478641f + s * ( 0.083126453f + s * ( -0.0363604309f + s * 0.00764835393f ) ) ) ) ) );
+	r = ( ay > ax ) ? 1.57079633f - r : r;
+	r = ( x < 0.0f ) ? 3.14159265f - r : r;
+	return ( y < 0.0f ) ? -r : r;
+}
+
+// larger of the two times sqrt( 1 + t^2 ) of their ratio, that on [ 0, 1 ] as a polynomial - within 4e-7 relative.
+// std::sqrt keeps a call to sqrtf around for errno, which is enough to stop the loop from vectorizing
+inline float FastHypot ( float x, float y ) {
+	const float ax = std::abs( x ), ay = std::abs( y );
+	const float m = std::max( ax, ay );
+	const float t = std::min( ax, ay ) / std::max( m, 1e-30f );
+	const float s = t * t;
+	return m * ( 1.00000022f + s * ( 0.499977981f + s * ( -0.124633542f + s * ( 0.0601210445f + s * ( -0.0312367339f + s * ( 0.0124928867f - s * 0.00250842473f ) ) ) ) ) );
+}
+
+// quadrant from the nearest multiple of pi / 2, then Taylor series on the remaining +/- pi / 4 - measured within 4e-7
+// of double precision sin / cos for | x | up to 3000. pi / 2 is subtracted in three parts, short enough that each
+// product with the quadrant count is exact up to there, so the error doesn't grow with the argument
+inline void FastSinCos ( float x, float & s, float & c ) {
+	// round to nearest by adding 1.5 * 2^23, the quadrant lands in the low mantissa bits
+	const float shifted = x * 0.636619772f + 12582912.0f;
+	uint32_t quadrant;
+	std::memcpy( &quadrant, &shifted, 4 );
+	const float k = shifted - 12582912.0f;
+	const float r = ( ( x - k * 1.5703125f ) - k * 4.83870506e-4f ) - k * -4.37113883e-8f;
+	const float r2 = r * r;
+	const float sr = r * ( 1.0f + r2 * ( -1.0f / 6.0f + r2 * ( 1.0f / 120.0f + r2 * ( -1.0f / 5040.0f ) ) ) );
+	const float cr = 1.0f + r2 * ( -0.5f + r2 * ( 1.0f / 24.0f + r2 * ( -1.0f / 720.0f + r2 * ( 1.0f / 40320.0f ) ) ) );
+	const float sw = ( quadrant & 1 ) ? cr : sr;
+	const float cw = ( quadrant & 1 ) ? sr : cr;
+	s = ( quadrant & 2 ) ? -sw : sw;
+	c = ( ( quadrant + 1 ) & 2 ) ? -cw : cw;
+}
+
+inline void LinearSRGBToOklab ( const float * rgb, float * lab ) {
+	const float l = FastCbrt( 0.4122214708f * rgb[ 0 ] + 0.5363325363f * rgb[ 1 ] + 0.0514459929f * rgb[ 2 ] );
+	const float m = FastCbrt( 0.2119034982f * rgb[ 0 ] + 0.6806995451f * rgb[ 1 ] + 0.1073969566f * rgb[ 2 ] );
+	const float s = FastCbrt( 0.0883024619f * rgb[ 0 ] + 0.2817188376f * rgb[ 1 ] + 0.6299787005f * rgb[ 2 ] );
+	lab[ 0 ] = 0.2104542553f * l + 0.7936177850f * m - 0.0040720468f * s;
+	lab[ 1 ] = 1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s;
+	lab[ 2 ] = 0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s;
+}
+
+inline void OklabToLinearSRGB ( const float * lab, float * rgb ) {
+	const float l_ = lab[ 0 ] + 0.3963377774f * lab[ 1 ] + 0.2158037573f * lab[ 2 ];
+	const float m_ = lab[ 0 ] - 0.1055613458f * lab[ 1 ] - 0.0638541728f * lab[ 2 ];
+	const float s_ = lab[ 0 ] - 0.0894841775f * lab[ 1 ] - 1.2914855480f * lab[ 2 ];
+	const float l = l_ * l_ * l_;
+	const float m = m_ * m_ * m_;
+	const float s = s_ * s_ * s_;
+	rgb[ 0 ] = +4.0767416621f * l - 3.3077115913f * m + 0.2309699292f * s;
+	rgb[ 1 ] = -1.2684380046f * l + 2.6097574011f * m - 0.3413193965f * s;
+	rgb[ 2 ] = -0.0041960863f * l - 0.7034186147f * m + 1.7076147010f * s;
+}
+
+inline void OklabToOklch ( const float * lab, float * lch ) {
+	const float a = lab[ 1 ], b = lab[ 2 ];
+	lch[ 0 ] = lab[ 0 ];
+	lch[ 1 ] = FastHypot( a, b );
+	lch[ 2 ] = FastAtan2( b, a );
+}
+
+inline void OklchToOklab ( const float * lch, float * lab ) {
+	float s, c;
+	FastSinCos( lch[ 2 ], s, c );
+	lab[ 0 ] = lch[ 0 ];
+	lab[ 1 ] = lch[ 1 ] * c;
+	lab[ 2 ] = lch[ 1 ] * s;
+}
+
+// ==== batches =====================================
+	// - count pixels, in and out strides are in floats ( 3 for packed color, 4 for RGBA - alpha is left alone )
+	// - the pixels go through in chunks of 16, copied to channel arrays on the stack: the math is then flat loops over
+	//   those, which vectorize ( -march=native ), with no aliasing checks against the strided in / out pointers. In
+	//   place ( in == out, same stride ) is fine
+namespace oklabDetail {
+	constexpr int lanes = 16;
+
+	template < typename Kernel >
+	inline void Chunked ( const float * in, int inStride, float * out, int outStride, size_t count, Kernel && kernel ) {
+		alignas( 64 ) float x[ 3 ][ lanes ];
+		alignas( 64 ) float y[ 3 ][ lanes ];
+		for ( size_t base = 0; base < count; base += lanes ) {
+			const int n = int( std::min( size_t( lanes ), count - base ) );
+			const float * source = in + base * inStride;
+			for ( int i = 0; i < lanes; i++ ) {
+				for ( int c = 0; c < 3; c++ ) x[ c ][ i ] = ( i < n ) ? source[ i * inStride + c ] : 0.0f;
+			}
+			kernel( x, y );
+			float * destination = out + base * outStride;
+			for ( int i = 0; i < n; i++ ) {
+				for ( int c = 0; c < 3; c++ ) destination[ i * outStride + c ] = y[ c ][ i ];
+			}
+		}
+	}
+}
+
+inline void LinearSRGBToOklab ( const float * rgb, int inStride, float * lab, int outStride, size_t count ) {
+	using namespace oklabDetail;
+	Chunked( rgb, inStride, lab, outStride, count, [] ( float ( &x )[ 3 ][ lanes ], float ( &y )[ 3 ][ lanes ] ) {
+		alignas( 64 ) float lms[ 3 ][ lanes ];
+		for ( int i = 0; i < lanes; i++ ) {
+			lms[ 0 ][ i ] = 0.4122214708f * x[ 0 ][ i ] + 0.5363325363f * x[ 1 ][ i ] + 0.0514459929f * x[ 2 ][ i ];
+			lms[ 1 ][ i ] = 0.2119034982f * x[ 0 ][ i ] + 0.6806995451f * x[ 1 ][ i ] + 0.1073969566f * x[ 2 ][ i ];
+			lms[ 2 ][ i ] = 0.0883024619f * x[ 0 ][ i ] + 0.2817188376f * x[ 1 ][ i ] + 0.6299787005f * x[ 2 ][ i ];
+		}
+		for ( int c = 0; c < 3; c++ ) {
+			for ( int i = 0; i < lanes; i++ ) lms[ c ][ i ] = FastCbrt( lms[ c ][ i ] );
+		}
+		for ( int i = 0; i < lanes; i++ ) {
+			y[ 0 ][ i ] = 0.2104542553f * lms[ 0 ][ i ] + 0.7936177850f * lms[ 1 ][ i ] - 0.0040720468f * lms[ 2 ][ i ];
+			y[ 1 ][ i ] = 1.9779984951f * lms[ 0 ][ i ] - 2.4285922050f * lms[ 1 ][ i ] + 0.4505937099f * lms[ 2 ][ i ];
+			y[ 2 ][ i ] = 0.0259040371f * lms[ 0 ][ i ] + 0.7827717662f * lms[ 1 ][ i ] - 0.8086757660f * lms[ 2 ][ i ];
+		}
+	} );
+}
+
+inline void OklabToLinearSRGB ( const float * lab, int inStride, float * rgb, int outStride, size_t count ) {
+	using namespace oklabDetail;
+	Chunked( lab, inStride, rgb, outStride, count, [] ( float ( &x )[ 3 ][ lanes ], float ( &y )[ 3 ][ lanes ] ) {
+		for ( int i = 0; i < lanes; i++ ) {
+			const float l_ = x[ 0 ][ i ] + 0.3963377774f * x[ 1 ][ i ] + 0.2158037573f * x[ 2 ][ i ];
+			const float m_ = x[ 0 ][ i ] - 0.1055613458f * x[ 1 ][ i ] - 0.0638541728f * x[ 2 ][ i ];
+			const float s_ = x[ 0 ][ i ] - 0.0894841775f * x[ 1 ][ i ] - 1.2914855480f * x[ 2 ][ i ];
+			const float l = l_ * l_ * l_;
+			const float m = m_ * m_ * m_;
+			const float s = s_ * s_ * s_;
+			y[ 0 ][ i ] = +4.0767416621f * l - 3.3077115913f * m + 0.2309699292f * s;
+			y[ 1 ][ i ] = -1.2684380046f * l + 2.6097574011f * m - 0.3413193965f * s;
+			y[ 2 ][ i ] = -0.0041960863f * l - 0.7034186147f * m + 1.7076147010f * s;
+		}
+	} );
+}
+
+inline void OklabToOklch ( const float * lab, int inStride, float * lch, int outStride, size_t count ) {
+	using namespace oklabDetail;
+	Chunked( lab, inStride, lch, outStride, count, [] ( float ( &x )[ 3 ][ lanes ], float ( &y )[ 3 ][ lanes ] ) {
+		for ( int i = 0; i < lanes; i++ ) {
+			y[ 0 ][ i ] = x[ 0 ][ i ];
+			y[ 1 ][ i ] = FastHypot( x[ 1 ][ i ], x[ 2 ][ i ] );
+		}
+		for ( int i = 0; i < lanes; i++ ) y[ 2 ][ i ] = FastAtan2( x[ 2 ][ i ], x[ 1 ][ i ] );
+	} );
+}
+
+inline void OklchToOklab ( const float * lch, int inStride, float * lab, int outStride, size_t count ) {
+	using namespace oklabDetail;
+	Chunked( lch, inStride, lab, outStride, count, [] ( float ( &x )[ 3 ][ lanes ], float ( &y )[ 3 ][ lanes ] ) {
+		for ( int i = 0; i < lanes; i++ ) {
+			float s, c;
+			FastSinCos( x[ 2 ][ i ], s, c );
+			y[ 0 ][ i ] = x[ 0 ][ i ];
+			y[ 1 ][ i ] = x[ 1 ][ i ] * c;
+			y[ 2 ][ i ] = x[ 1 ][ i ] * s;
+		}
+	} );
+}
+
+#endif
@@ -0,0 +1,485 @@
+#pragma once
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include "../ImageHandling/AssetCache.h"
+#include "../ImageHandling/Dither.h"
+#include "../ImageHandling/Image.h"
+#include "../ImageHandling/Oklab.h"
+#include "../Threading/ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#if defined( __SSE2__ )
+#include <immintrin.h>
+#endif
+
+// mapping images down to a fixed set of colors, with optional dithering
+	// - palettes come from paletteList.png, one palette per row, ending at the first transparent pixel
+	// - matching is nearest color in Oklab. A k-d tree answers arbitrary queries, and a precomputed lookup table over
+	//   the Oklab gamut answers the rest. Each of its 128^3 cells holds every color that could be nearest to any point
+	//   inside it - almost always four or fewer, so a lookup is one table read and four distances side by side, and
+	//   still exact. Cells with more go to a list, anything outside the table falls back to the tree
+	// - ordered and blue noise dithering are parallel over rows. Error diffusion is serpentine, through
+	//   DiffuseErrorWavefront in Dither.h
+
+enum class paletteDither {
+	none,
+	ordered,		// 8x8 bayer matrix
+	blueNoise,		// thresholds from a tiling blue noise texture, one channel per Oklab channel
+	errorDiffusion	// serpentine floyd-steinberg, error carried in Oklab
+};
+
+// for the UI, in enum order
+inline const char * paletteDitherNames[] = { "None", "Bayer 8x8", "Blue Noise", "Floyd-Steinberg" };
+
+struct paletteMapParameters {
+	paletteDither dither = paletteDither::ordered;
+	float strength = 1.0f;				// scales the dither offsets / diffused error
+	const Image * blueNoise = nullptr;	// required for paletteDither::blueNoise, falls back to ordered without it
+};
+
+namespace paletteDetail {
+	using labColor = std::array< float, 3 >;
+
+	inline float DistanceSquared ( const labColor & a, const labColor & b ) {
+		const float d0 = a[ 0 ] - b[ 0 ], d1 = a[ 1 ] - b[ 1 ], d2 = a[ 2 ] - b[ 2 ];
+		return d0 * d0 + d1 * d1 + d2 * d2;
+	}
+
+	// implicit k-d tree - points are reordered so every range [ lo, hi ) splits at its median, on the widest axis
+	class kdTree {
+	public:
+		void Build ( const std::vector< labColor > & colors ) {
+			points = colors;
+			index.resize( colors.size() );
+			axis.assign( colors.size(), 0 );
+			for ( size_t i = 0; i < index.size(); i++ ) index[ i ] = int( i );
+			Build( 0, int( points.size() ) );
+		}
+
+		// index into the original color list - 0 when nothing compares closer ( a NaN query, or an empty tree ), so the
+		// result is always safe to look up in a non empty palette
+		int Nearest ( const labColor & q, float * distanceSquared = nullptr ) const {
+			int best = -1;
+			float bestDistance = std::numeric_limits< float >::max();
+			Nearest( q, 0, int( points.size() ), best, bestDistance );
+			if ( distanceSquared ) *distanceSquared = bestDistance;
+			return best < 0 ? 0 : index[ best ];
+		}
+
+		// original indices of every color within sqrt( radiusSquared ) of q
+		void WithinRadius ( const labColor & q, float radiusSquared, std::vector< int > & out ) const {
+			WithinRadius( q, radiusSquared, 0, int( points.size() ), out );
+		}
+
+	private:
+		void Build ( int lo, int hi ) {
+			if ( hi - lo <= 1 ) return;
+			labColor minimum = points[ lo ], maximum = points[ lo ];
+			for ( int i = lo; i < hi; i++ ) {
+				for ( int c = 0; c < 3; c++ ) {
+					minimum[ c ] = std::min( minimum[ c ], points[ i ][ c ] );
+					maximum[ c ] = std::max( maximum[ c ], points[ i ][ c ] );
+				}
+			}
+			int split = 0;
+			for ( int c = 1; c < 3; c++ ) {
+				if ( maximum[ c ] - minimum[ c ] > maximum[ split ] - minimum[ split ] ) split = c;
+			}
+			const int mid = ( lo + hi ) / 2;
+			// sort a permutation, then apply it to both the points and the original indices
+			std::vector< int > order( hi - lo );
+			for ( int i = 0; i < hi - lo; i++ ) order[ i ] = lo + i;
+			std::nth_element( order.begin(), order.begin() + ( mid - lo ), order.end(), [ & ] ( int a, int b ) {
+				return points[ a ][ split ] < points[ b ][ split ];
+			} );
+			std::vector< labColor > sortedPoints( hi - lo );
+			std::vector< int > sortedIndex( hi - lo );
+			for ( int i = 0; i < hi - lo; i++ ) {
+				sortedPoints[ i ] = points[ order[ i ] ];
+				sortedIndex[ i ] = index[ order[ i ] ];
+			}
+			std::copy( sortedPoints.begin(), sortedPoints.end(), points.begin() + lo );
+			std::copy( sortedIndex.begin(), sortedIndex.end(), index.begin() + lo );
+			axis[ mid ] = uint8_t( split );
+			Build( lo, mid );
+			Build( mid + 1, hi );
+		}
+
+		void Nearest ( const labColor & q, int lo, int hi, int & best, float & bestDistance ) const {
+			if ( hi <= lo ) return;
+			const int mid = ( lo + hi ) / 2;
+			const float d = DistanceSquared( q, points[ mid ] );
+			if ( d < bestDistance ) {
+				bestDistance = d;
+				best = mid;
+			}
+			if ( hi - lo == 1 ) return;
+			const float planeOffset = q[ axis[ mid ] ] - points[ mid ][ axis[ mid ] ];
+			// near side first, then the far side only if the splitting plane is closer than the best so far
+			if ( planeOffset < 0.0f ) {
+				Nearest( q, lo, mid, best, bestDistance );
+				if ( planeOffset * planeOffset < bestDistance ) Nearest( q, mid + 1, hi, best, bestDistance );
+			} else {
+				Nearest( q, mid + 1, hi, best, bestDistance );
+				if ( planeOffset * planeOffset < bestDistance ) Nearest( q, lo, mid, best, bestDistance );
+			}
+		}
+
+		void WithinRadius ( const labColor & q, float radiusSquared, int lo, int hi, std::vector< int > & out ) const {
+			if ( hi <= lo ) return;
+			const int mid = ( lo + hi ) / 2;
+			if ( DistanceSquared( q, points[ mid ] ) <= radiusSquared ) out.push_back( index[ mid ] );
+			if ( hi - lo == 1 ) return;
+			const float planeOffset = q[ axis[ mid ] ] - points[ mid ][ axis[ mid ] ];
+			if ( planeOffset < 0.0f || planeOffset * planeOffset <= radiusSquared ) WithinRadius( q, radiusSquared, lo, mid, out );
+			if ( planeOffset >= 0.0f || planeOffset * planeOffset <= radiusSquared ) WithinRadius( q, radiusSquared, mid + 1, hi, out );
+		}
+
+		std::vector< labColor > points;
+		std::vector< int > index;
+		std::vector< uint8_t > axis;
+	};
+
+	// linear RGBA in, alpha is skipped - batch conversion, see Oklab.h
+	// non finite input ( a tonemap dividing zero by zero on black, say ) is flushed to the edge of the range, NaN to the
+	// low end - the compare is false for NaN, where a clamp would pass it through
+	constexpr float labLimit = 1e4f;
+	inline void LinearRowToOklab ( const float * rgba, labColor * out, uint32_t count ) {
+		static_assert( sizeof( labColor ) == 3 * sizeof( float ), "labColor rows are written as packed floats" );
+		LinearSRGBToOklab( rgba, 4, out[ 0 ].data(), 3, count );
+		float * values = out[ 0 ].data();
+		for ( size_t i = 0; i < size_t( count ) * 3; i++ ) {
+			values[ i ] = ( values[ i ] > -labLimit ) ? std::min( values[ i ], labLimit ) : -labLimit;
+		}
+	}
+}
+
+class Palette {
+public:
+	Palette () {}
+
+	// sRGB colors, alpha is ignored
+	Palette ( const std::vector< rgba > & sRGBColors ) {
+		Build( sRGBColors );
+	}
+
+	void Build ( const std::vector< rgba > & sRGBColors ) {
+		using namespace paletteDetail;
+		colors = sRGBColors;
+		for ( auto & c : colors ) c.a = 255;
+		lab.resize( colors.size() );
+		for ( size_t i = 0; i < colors.size(); i++ ) {
+			const float linear[ 3 ] = { SRGBToLinear( colors[ i ].r / 255.0f ), SRGBToLinear( colors[ i ].g / 255.0f ), SRGBToLinear( colors[ i ].b / 255.0f ) };
+			LinearSRGBToOklab( linear, lab[ i ].data() );
+		}
+		tree.Build( lab );
+		labMin = labMax = lab.empty() ? labColor{ 0.0f, 0.0f, 0.0f } : lab[ 0 ];
+		for ( auto & l : lab ) {
+			for ( int c = 0; c < 3; c++ ) {
+				labMin[ c ] = std::min( labMin[ c ], l[ c ] );
+				labMax[ c ] = std::max( labMax[ c ], l[ c ] );
+			}
+		}
+
+		// typical distance between neighboring colors, sets the scale of the ordered / blue noise offsets
+		spacing = 0.0f;
+		if ( colors.size() > 1 ) {
+			for ( size_t i = 0; i < lab.size(); i++ ) {
+				float nearest = std::numeric_limits< float >::max();
+				for ( size_t j = 0; j < lab.size(); j++ ) {
+					if ( j != i ) nearest = std::min( nearest, DistanceSquared( lab[ i ], lab[ j ] ) );
+				}
+				spacing += std::sqrt( nearest );
+			}
+			spacing /= float( lab.size() );
+		}
+
+		// the table is built on first use, most palettes in a list never get mapped
+		table.clear();
+		overflow.clear();
+	}
+
+	size_t Size () const { return colors.size(); }
+	const rgba & Color ( int i ) const { return colors[ i ]; }
+	const paletteDetail::labColor & Lab ( int i ) const { return lab[ i ]; }
+	float Spacing () const { return spacing; }
+
+	// exact nearest color to an Oklab value, through the table when it's built and the value is inside it
+	int Nearest ( const paletteDetail::labColor & q ) const {
+		using namespace paletteDetail;
+		if ( table.empty() ) return tree.Nearest( q );
+		const float fx = ( q[ 0 ] - gridMin[ 0 ] ) * gridScale[ 0 ];
+		const float fy = ( q[ 1 ] - gridMin[ 1 ] ) * gridScale[ 1 ];
+		const float fz = ( q[ 2 ] - gridMin[ 2 ] ) * gridScale[ 2 ];
+		if ( !( fx >= 0.0f && fy >= 0.0f && fz >= 0.0f && fx < tableSize && fy < tableSize && fz < tableSize ) ) {
+			return tree.Nearest( q );
+		}
+		const tableEntry & e = table[ ( size_t( fz ) * tableSize + size_t( fy ) ) * tableSize + size_t( fx ) ];
+
+		// slots are in palette order, so ties go to the lower index, same as the brute force search
+		if ( e.slot[ 0 ] == overflowSlot ) {
+			int best = 0;
+			float bestDistance = std::numeric_limits< float >::max();
+			for ( const uint16_t * c = &overflow[ e.slot[ 1 ] | ( uint32_t( e.slot[ 2 ] ) << 16 ) ]; *c != endOfList; c++ ) {
+				const float d = DistanceSquared( q, lab[ *c ] );
+				if ( d < bestDistance ) {
+					bestDistance = d;
+					best = *c;
+				}
+			}
+			return best;
+		}
+	#if defined( __SSE2__ )
+		const labColor & c0 = lab[ e.slot[ 0 ] ], & c1 = lab[ e.slot[ 1 ] ], & c2 = lab[ e.slot[ 2 ] ], & c3 = lab[ e.slot[ 3 ] ];
+		const __m128 d0 = _mm_sub_ps( _mm_set1_ps( q[ 0 ] ), _mm_setr_ps( c0[ 0 ], c1[ 0 ], c2[ 0 ], c3[ 0 ] ) );
+		const __m128 d1 = _mm_sub_ps( _mm_set1_ps( q[ 1 ] ), _mm_setr_ps( c0[ 1 ], c1[ 1 ], c2[ 1 ], c3[ 1 ] ) );
+		const __m128 d2 = _mm_sub_ps( _mm_set1_ps( q[ 2 ] ), _mm_setr_ps( c0[ 2 ], c1[ 2 ], c2[ 2 ], c3[ 2 ] ) );
+		const __m128 d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( d0, d0 ), _mm_mul_ps( d1, d1 ) ), _mm_mul_ps( d2, d2 ) );
+		__m128 m = _mm_min_ps( d, _mm_shuffle_ps( d, d, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+		m = _mm_min_ps( m, _mm_shuffle_ps( m, m, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+		return e.slot[ __builtin_ctz( _mm_movemask_ps( _mm_cmpeq_ps( d, m ) ) ) ];
+	#else
+		int best = e.slot[ 0 ];
+		float bestDistance = DistanceSquared( q, lab[ best ] );
+		for ( int i = 1; i < slotCount; i++ ) {
+			const float d = DistanceSquared( q, lab[ e.slot[ i ] ] );
+			const bool closer = d < bestDistance;
+			bestDistance = closer ? d : bestDistance;
+			best = closer ? e.slot[ i ] : best;
+		}
+		return best;
+	#endif
+	}
+
+	// reference for checking the accelerated paths
+	int NearestBruteForce ( const paletteDetail::labColor & q ) const {
+		int best = 0;
+		float bestDistance = std::numeric_limits< float >::max();
+		for ( size_t i = 0; i < lab.size(); i++ ) {
+			const float d = paletteDetail::DistanceSquared( q, lab[ i ] );
+			if ( d < bestDistance ) {
+				bestDistance = d;
+				best = int( i );
+			}
+		}
+		return best;
+	}
+
+	// linear input, sRGB8 palette colors out with the source alpha - indices optionally written per pixel
+	Image Map ( const ImageF & linear, const paletteMapParameters & parameters = paletteMapParameters(), std::vector< uint16_t > * indices = nullptr ) {
+		using namespace paletteDetail;
+		const uint32_t width = linear.width;
+		const uint32_t height = linear.height;
+		Image out( width, height );
+		if ( colors.empty() || width == 0 || height == 0 ) return out;
+		if ( table.empty() ) BuildGrid();
+		std::vector< uint16_t > localIndices;
+		std::vector< uint16_t > & result = indices ? *indices : localIndices;
+		result.resize( size_t( width ) * height );
+
+		paletteDither dither = parameters.dither;
+		const Image * noise = parameters.blueNoise;
+		if ( dither == paletteDither::blueNoise && ( noise == nullptr || noise->width == 0 || noise->height == 0 ) ) {
+			dither = paletteDither::ordered;
+		}
+		const float amplitude = parameters.strength * spacing;
+
+		// each row is converted to Oklab as a batch first - the conversion loop vectorizes, and the lookups don't
+		if ( dither == paletteDither::errorDiffusion ) {
+			DiffuseErrorWavefront< 3 >( width, height, FloydSteinbergKernel(), parameters.strength,
+				[ & ] ( int y, float * row ) {
+					LinearRowToOklab( &linear.data[ size_t( y ) * width * 4 ], ( labColor * ) row, width );
+				},
+				[ & ] ( int x, int y, float * value, float * quantized ) {
+					// clamped to the palette's bounds - colors outside the hull can't be reached anyways, and would
+					// otherwise keep pushing error into their neighbors. Written so NaN lands on the low bound
+					labColor v;
+					for ( int c = 0; c < 3; c++ ) {
+						v[ c ] = value[ c ] = ( value[ c ] > labMin[ c ] ) ? std::min( value[ c ], labMax[ c ] ) : labMin[ c ];
+					}
+					const int match = Nearest( v );
+					result[ size_t( y ) * width + x ] = uint16_t( match );
+					for ( int c = 0; c < 3; c++ ) quantized[ c ] = lab[ match ][ c ];
+				}, true ); // serpentine, like the serial scan this replaced - the rows can't overlap, see Dither.h
+		} else {
+			ParallelFor( 0, int( height ), [ & ] ( int y ) {
+				thread_local std::vector< labColor > row;
+				row.resize( width );
+				LinearRowToOklab( &linear.data[ size_t( y ) * width * 4 ], row.data(), width );
+				if ( dither == paletteDither::ordered ) {
+					for ( uint32_t x = 0; x < width; x++ ) {
+						const float offset = ( ditherDetail::BayerThreshold( x, y ) - 0.5f ) * amplitude;
+						for ( int c = 0; c < 3; c++ ) row[ x ][ c ] += offset;
+					}
+				} else if ( dither == paletteDither::blueNoise ) {
+					const uint8_t * noiseRow = &noise->data[ size_t( y % noise->height ) * noise->width * 4 ];
+					for ( uint32_t x = 0; x < width; x++ ) {
+						const uint8_t * n = &noiseRow[ ( x % noise->width ) * 4 ];
+						for ( int c = 0; c < 3; c++ ) row[ x ][ c ] += ( ( n[ c ] + 0.5f ) / 256.0f - 0.5f ) * amplitude;
+					}
+				}
+				uint16_t * indexRow = &result[ size_t( y ) * width ];
+				for ( uint32_t x = 0; x < width; x++ ) {
+					indexRow[ x ] = uint16_t( Nearest( row[ x ] ) );
+				}
+			}, 8 );
+		}
+
+		// write out the colors, keeping the source alpha
+		ParallelFor( 0, int( height ), [ & ] ( int y ) {
+			for ( uint32_t x = 0; x < width; x++ ) {
+				const size_t i = size_t( y ) * width + x;
+				const rgba & c = colors[ result[ i ] ];
+				uint8_t * p = &out.data[ i * 4 ];
+				p[ 0 ] = c.r;
+				p[ 1 ] = c.g;
+				p[ 2 ] = c.b;
+				p[ 3 ] = EncodeUNorm8( linear.data[ i * 4 + 3 ] );
+			}
+		}, 8 );
+		return out;
+	}
+
+	// 8-bit sRGB input, decoded to linear first
+	Image Map ( const Image & sRGB, const paletteMapParameters & parameters = paletteMapParameters(), std::vector< uint16_t > * indices = nullptr ) {
+		ImageF linear( sRGB.width, sRGB.height );
+		ParallelFor( 0, int( sRGB.height ), [ & ] ( int y ) {
+			const size_t offset = size_t( y ) * sRGB.width * 4;
+			ConvertPixels< pixelFormat::SRGBA8, pixelFormat::RGBA32F >( &sRGB.data[ offset ], &linear.data[ offset ], sRGB.width );
+		}, 8 );
+		return Map( linear, parameters, indices );
+	}
+
+	// the lookup table over the sRGB gamut in Oklab - Map() calls this as needed
+	void BuildGrid () {
+		using namespace paletteDetail;
+		// covers all of the sRGB gamut, with a little margin - HDR values and wide gamut colors go to the tree
+		gridMin = { -0.01f, -0.25f, -0.33f };
+		const labColor gridMax = { 1.01f, 0.29f, 0.21f };
+		labColor cellSize;
+		for ( int c = 0; c < 3; c++ ) {
+			cellSize[ c ] = ( gridMax[ c ] - gridMin[ c ] ) / float( tableSize );
+			gridScale[ c ] = 1.0f / cellSize[ c ];
+		}
+		const float halfDiagonal = 0.5f * std::sqrt( cellSize[ 0 ] * cellSize[ 0 ] + cellSize[ 1 ] * cellSize[ 1 ] + cellSize[ 2 ] * cellSize[ 2 ] );
+
+		// anything nearest to a point in a box is within ( nearest to center ) + 2 * halfDiagonal of the center. Blocks of
+		// subdivision^3 cells find their candidates through the tree once, each cell then only filters that short list
+		constexpr int blockCount = tableSize / subdivision;
+		table.assign( size_t( tableSize ) * tableSize * tableSize, tableEntry() );
+		std::vector< std::vector< uint16_t > > blockOverflow( blockCount * blockCount );
+		std::vector< std::vector< size_t > > blockOverflowCells( blockCount * blockCount );
+		ParallelFor( 0, blockCount * blockCount, [ & ] ( int zy ) {
+			std::vector< int > blockList, cellList;
+			const int bz = zy / blockCount;
+			const int by = zy % blockCount;
+			for ( int bx = 0; bx < blockCount; bx++ ) {
+				const labColor blockCenter = {
+					gridMin[ 0 ] + ( bx + 0.5f ) * subdivision * cellSize[ 0 ],
+					gridMin[ 1 ] + ( by + 0.5f ) * subdivision * cellSize[ 1 ],
+					gridMin[ 2 ] + ( bz + 0.5f ) * subdivision * cellSize[ 2 ] };
+				float nearestSquared;
+				tree.Nearest( blockCenter, &nearestSquared );
+				const float radius = std::sqrt( nearestSquared ) + 2.0f * subdivision * halfDiagonal;
+				blockList.clear();
+				tree.WithinRadius( blockCenter, radius * radius * 1.0001f, blockList );
+				std::sort( blockList.begin(), blockList.end() );
+
+				for ( int i = 0; i < subdivision * subdivision * subdivision; i++ ) {
+					const int x = bx * subdivision + i % subdivision;
+					const int y = by * subdivision + i / subdivision % subdivision;
+					const int z = bz * subdivision + i / ( subdivision * subdivision );
+					const labColor center = {
+						gridMin[ 0 ] + ( x + 0.5f ) * cellSize[ 0 ],
+						gridMin[ 1 ] + ( y + 0.5f ) * cellSize[ 1 ],
+						gridMin[ 2 ] + ( z + 0.5f ) * cellSize[ 2 ] };
+					float cellNearest = std::numeric_limits< float >::max();
+					for ( int c : blockList ) cellNearest = std::min( cellNearest, DistanceSquared( center, lab[ c ] ) );
+					const float cellRadius = std::sqrt( cellNearest ) + 2.0f * halfDiagonal;
+					cellList.clear();
+					for ( int c : blockList ) {
+						if ( DistanceSquared( center, lab[ c ] ) <= cellRadius * cellRadius * 1.0001f ) cellList.push_back( c );
+					}
+
+					// short lists are padded with their first entry, which doesn't change the answer
+					const size_t cell = ( size_t( z ) * tableSize + y ) * tableSize + x;
+					tableEntry & e = table[ cell ];
+					if ( cellList.size() <= slotCount ) {
+						for ( int s = 0; s < slotCount; s++ ) e.slot[ s ] = uint16_t( cellList[ std::min( s, int( cellList.size() ) - 1 ) ] );
+					} else {
+						// offset is local to the block row for now, rebased below
+						std::vector< uint16_t > & list = blockOverflow[ zy ];
+						e.slot[ 0 ] = overflowSlot;
+						e.slot[ 1 ] = uint16_t( list.size() & 0xFFFF );
+						e.slot[ 2 ] = uint16_t( list.size() >> 16 );
+						list.insert( list.end(), cellList.begin(), cellList.end() );
+						list.push_back( endOfList );
+						blockOverflowCells[ zy ].push_back( cell );
+					}
+				}
+			}
+		}, 1 );
+
+		overflow.clear();
+		for ( int zy = 0; zy < blockCount * blockCount; zy++ ) {
+			const uint32_t base = uint32_t( overflow.size() );
+			for ( size_t cell : blockOverflowCells[ zy ] ) {
+				tableEntry & e = table[ cell ];
+				const uint32_t offset = base + ( e.slot[ 1 ] | ( uint32_t( e.slot[ 2 ] ) << 16 ) );
+				e.slot[ 1 ] = uint16_t( offset & 0xFFFF );
+				e.slot[ 2 ] = uint16_t( offset >> 16 );
+			}
+			overflow.insert( overflow.end(), blockOverflow[ zy ].begin(), blockOverflow[ zy ].end() );
+		}
+	}
+
+private:
+	std::vector< rgba > colors;
+	std::vector< paletteDetail::labColor > lab;
+	paletteDetail::kdTree tree;
+	paletteDetail::labColor labMin, labMax;	// bounding box of the palette
+	float spacing = 0.0f;
+
+	// up to four candidates in palette order - or overflowSlot, then the offset of a longer list in the next two
+	static constexpr int slotCount = 4;
+	struct tableEntry {
+		uint16_t slot[ slotCount ];
+	};
+
+	static constexpr int tableSize = 128;					// cells per axis, 16MB of entries
+	static constexpr int subdivision = 4;					// cells per axis in a block that shares one tree query
+	static constexpr uint16_t overflowSlot = 0xFFFF;
+	static constexpr uint16_t endOfList = 0xFFFF;			// palettes stay under 65535 colors, indices are 16 bit
+	paletteDetail::labColor gridMin;
+	paletteDetail::labColor gridScale;
+	std::vector< tableEntry > table;
+	std::vector< uint16_t > overflow;						// lists for cells with more than slotCount candidates
+};
+
+// every palette in the strip - one per row, up to the first fully transparent pixel
+inline std::vector< Palette > LoadPaletteList ( const std::string & path = "src/paletteList.png" ) {
+	std::vector< Palette > palettes;
+	std::shared_ptr< const Image > strip = AssetCache::Get().LoadImage( path );
+	if ( !strip || strip->width == 0 ) return palettes;
+	palettes.resize( strip->height );
+	ParallelFor( 0, int( strip->height ), [ & ] ( int y ) {
+		std::vector< rgba > row;
+		for ( uint32_t x = 0; x < strip->width; x++ ) {
+			rgba c = strip->GetAtXY( x, y );
+			if ( c.a == 0 ) break;
+			row.push_back( c );
+		}
+		palettes[ y ].Build( row );
+	} );
+	palettes.erase( std::remove_if( palettes.begin(), palettes.end(), [] ( const Palette & p ) { return p.Size() == 0; } ), palettes.end() );
+	return palettes;
+}
+
+#endif
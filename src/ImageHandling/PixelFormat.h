@@ -0,0 +1,298 @@
+#pragma once
+#ifndef PIXELFORMAT_H
+#define PIXELFORMAT_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// SSE2 is baseline on x86-64 - AVX2 and F16C paths are picked up when the compiler is allowed to use them ( -march=native )
+#if defined( __SSE2__ )
+#include <immintrin.h>
+#endif
+
+// conversion between the pixel formats that show up around the codebase - all of them are 4 channel RGBA, the difference
+	// is how the channels are stored. Everything goes through either a direct kernel or a small float intermediate block,
+	// and the format pair is resolved at compile time, so there is no per-pixel switching on the hot path
+enum class pixelFormat {
+	RGBA8,		// 8 bits per channel, unsigned normalized, linear ( Image::data, GL_RGBA8 readback )
+	SRGBA8,		// 8 bits per channel, unsigned normalized, sRGB encoded color with linear alpha
+	RGBA16F,	// IEEE half float per channel ( GL_RGBA16F )
+	RGBA32F		// IEEE single float per channel ( ImageF::data, GL_RGBA32F readback )
+};
+
+template < pixelFormat F > struct pixelFormatTraits;
+template <> struct pixelFormatTraits< pixelFormat::RGBA8 >		{ using channelType = uint8_t; };
+template <> struct pixelFormatTraits< pixelFormat::SRGBA8 >		{ using channelType = uint8_t; };
+template <> struct pixelFormatTraits< pixelFormat::RGBA16F >	{ using channelType = uint16_t; };
+template <> struct pixelFormatTraits< pixelFormat::RGBA32F >	{ using channelType = float; };
+
+template < pixelFormat F >
+constexpr size_t BytesPerPixel () { return 4 * sizeof( typename pixelFormatTraits< F >::channelType ); }
+
+// ==== scalar reference functions ==================
+inline float SRGBToLinear ( float value ) {
+	return ( value <= 0.04045f ) ? value / 12.92f : std::pow( ( value + 0.055f ) / 1.055f, 2.4f );
+}
+
+inline float LinearToSRGB ( float value ) {
+	return ( value <= 0.0031308f ) ? value * 12.92f : 1.055f * std::pow( value, 1.0f / 2.4f ) - 0.055f;
+}
+
+// batch sRGB decode for float input in [ 0, 1 ] ( clamp first ) - std::pow is most of the cost of going from display
+// values to anything linear, so the curve above the linear toe is a degree 8 polynomial instead, within 1.1e-6 of it.
+// No branches, so this vectorizes - in place is fine
+inline void SRGBToLinear ( const float * in, float * out, size_t count ) {
+	for ( size_t i = 0; i < count; i++ ) {
+		const float v = in[ i ];
+		const float curve = 0.000858165285f + v * ( 0.0351695827f + v * ( 0.486915687f + v * ( 0.854134495f + v * ( -0.841327597f +
+			v * ( 0.905310444f + v * ( -0.691233606f + v * ( 0.311784524f - v * 0.0616119373f ) ) ) ) ) ) );
+		out[ i ] = ( v <= 0.04045f ) ? v * ( 1.0f / 12.92f ) : curve;
+	}
+}
+
+inline float HalfToFloat ( uint16_t h ) {
+	const uint32_t sign = uint32_t( h & 0x8000 ) << 16;
+	uint32_t exponent = ( h >> 10 ) & 0x1F;
+	uint32_t mantissa = h & 0x3FF;
+	uint32_t bits;
+	if ( exponent == 0x1F ) { // inf / NaN
+		bits = sign | 0x7F800000 | ( mantissa << 13 );
+	} else if ( exponent != 0 ) { // normal
+		bits = sign | ( ( exponent + 112 ) << 23 ) | ( mantissa << 13 );
+	} else if ( mantissa != 0 ) { // denormal - renormalize
+		exponent = 113;
+		while ( !( mantissa & 0x400 ) ) { mantissa <<= 1; exponent--; }
+		bits = sign | ( exponent << 23 ) | ( ( mantissa & 0x3FF ) << 13 );
+	} else { // signed zero
+		bits = sign;
+	}
+	float result;
+	std::memcpy( &result, &bits, sizeof( float ) );
+	return result;
+}
+
+inline uint16_t FloatToHalf ( float f ) {
+	uint32_t bits;
+	std::memcpy( &bits, &f, sizeof( float ) );
+	const uint16_t sign = ( bits >> 16 ) & 0x8000;
+	const int32_t exponent = int32_t( ( bits >> 23 ) & 0xFF ) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	if ( ( ( bits >> 23 ) & 0xFF ) == 0xFF ) { // inf / NaN, keep NaN quiet
+		return sign | 0x7C00 | ( mantissa ? 0x200 : 0 );
+	} else if ( exponent >= 0x1F ) { // overflow to inf
+		return sign | 0x7C00;
+	} else if ( exponent <= 0 ) { // denormal or zero
+		if ( exponent < -10 ) return sign;
+		mantissa |= 0x800000;
+		const uint32_t shift = 14 - exponent;
+		uint32_t halfMantissa = mantissa >> shift;
+		// round to nearest even
+		const uint32_t remainder = mantissa & ( ( 1u << shift ) - 1 );
+		const uint32_t halfway = 1u << ( shift - 1 );
+		if ( remainder > halfway || ( remainder == halfway && ( halfMantissa & 1 ) ) ) halfMantissa++;
+		return sign | uint16_t( halfMantissa );
+	}
+	uint32_t result = ( uint32_t( exponent ) << 10 ) | ( mantissa >> 13 );
+	// round to nearest even - carry into the exponent is correct behavior here
+	const uint32_t remainder = mantissa & 0x1FFF;
+	if ( remainder > 0x1000 || ( remainder == 0x1000 && ( result & 1 ) ) ) result++;
+	return sign | uint16_t( result );
+}
+
+// ==== lookup tables ===============================
+	// function local statics, so they are built once, on first use, and initialization is thread safe
+inline const float * UNorm8DecodeLUT () {
+	static const std::array< float, 256 > table = [] {
+		std::array< float, 256 > t;
+		for ( int i = 0; i < 256; i++ ) t[ i ] = i / 255.0f;
+		return t;
+	}();
+	return table.data();
+}
+
+inline const float * SRGB8DecodeLUT () {
+	static const std::array< float, 256 > table = [] {
+		std::array< float, 256 > t;
+		for ( int i = 0; i < 256; i++ ) t[ i ] = SRGBToLinear( i / 255.0f );
+		return t;
+	}();
+	return table.data();
+}
+
+// encode side is indexed by linear value quantized to 16 bits - the steepest part of the curve ( 12.92 near black ) is
+	// still ~0.05 of an output code per table step, so every entry rounds to the same byte the analytic curve would
+constexpr uint32_t SRGBEncodeLUTBits = 16;
+constexpr float SRGBEncodeLUTScale = float( ( 1u << SRGBEncodeLUTBits ) - 1 );
+inline const uint8_t * SRGB8EncodeLUT () {
+	static const std::array< uint8_t, 1u << SRGBEncodeLUTBits > table = [] {
+		std::array< uint8_t, 1u << SRGBEncodeLUTBits > t;
+		for ( uint32_t i = 0; i < t.size(); i++ )
+			t[ i ] = uint8_t( std::clamp( LinearToSRGB( i / SRGBEncodeLUTScale ) * 255.0f + 0.5f, 0.0f, 255.0f ) );
+		return t;
+	}();
+	return table.data();
+}
+
+// written as a compare rather than std::clamp, so NaN goes to zero the same as it does in the max / min SIMD paths
+inline float Saturate ( float value ) {
+	return ( value > 0.0f ) ? std::min( value, 1.0f ) : 0.0f;
+}
+
+inline uint8_t EncodeUNorm8 ( float value ) {
+	return uint8_t( Saturate( value ) * 255.0f + 0.5f );
+}
+
+inline uint8_t EncodeSRGB8 ( float value ) {
+	return SRGB8EncodeLUT()[ uint32_t( Saturate( value ) * SRGBEncodeLUTScale + 0.5f ) ];
+}
+
+// ==== decode: format -> float RGBA ================
+	// count is the number of channels ( 4x number of pixels ), so that alpha can be identified by index
+template < pixelFormat F >
+inline void DecodeToFloat ( const void * in, float * out, size_t count ) {
+	size_t i = 0;
+	if constexpr ( F == pixelFormat::RGBA32F ) {
+		std::memcpy( out, in, count * sizeof( float ) );
+		return;
+	} else if constexpr ( F == pixelFormat::RGBA8 ) {
+		const uint8_t * src = ( const uint8_t * ) in;
+	#if defined( __AVX2__ )
+		const __m256 scale = _mm256_set1_ps( 1.0f / 255.0f );
+		for ( ; i + 8 <= count; i += 8 ) {
+			const __m128i bytes = _mm_loadl_epi64( ( const __m128i * ) ( src + i ) );
+			_mm256_storeu_ps( out + i, _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( bytes ) ), scale ) );
+		}
+	#elif defined( __SSE2__ )
+		const __m128 scale = _mm_set1_ps( 1.0f / 255.0f );
+		const __m128i zero = _mm_setzero_si128();
+		for ( ; i + 16 <= count; i += 16 ) {
+			const __m128i bytes = _mm_loadu_si128( ( const __m128i * ) ( src + i ) );
+			const __m128i lo16 = _mm_unpacklo_epi8( bytes, zero );
+			const __m128i hi16 = _mm_unpackhi_epi8( bytes, zero );
+			_mm_storeu_ps( out + i +  0, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( lo16, zero ) ), scale ) );
+			_mm_storeu_ps( out + i +  4, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( lo16, zero ) ), scale ) );
+			_mm_storeu_ps( out + i +  8, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( hi16, zero ) ), scale ) );
+			_mm_storeu_ps( out + i + 12, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( hi16, zero ) ), scale ) );
+		}
+	#endif
+		const float * lut = UNorm8DecodeLUT();
+		for ( ; i < count; i++ ) out[ i ] = lut[ src[ i ] ];
+	} else if constexpr ( F == pixelFormat::SRGBA8 ) {
+		// table lookup per channel - alpha stays linear
+		const uint8_t * src = ( const uint8_t * ) in;
+		const float * srgb = SRGB8DecodeLUT();
+		const float * unorm = UNorm8DecodeLUT();
+		for ( ; i < count; i += 4 ) {
+			out[ i + 0 ] = srgb[ src[ i + 0 ] ];
+			out[ i + 1 ] = srgb[ src[ i + 1 ] ];
+			out[ i + 2 ] = srgb[ src[ i + 2 ] ];
+			out[ i + 3 ] = unorm[ src[ i + 3 ] ];
+		}
+	} else if constexpr ( F == pixelFormat::RGBA16F ) {
+		const uint16_t * src = ( const uint16_t * ) in;
+	#if defined( __F16C__ ) && defined( __AVX__ )
+		for ( ; i + 8 <= count; i += 8 ) {
+			_mm256_storeu_ps( out + i, _mm256_cvtph_ps( _mm_loadu_si128( ( const __m128i * ) ( src + i ) ) ) );
+		}
+	#endif
+		for ( ; i < count; i++ ) out[ i ] = HalfToFloat( src[ i ] );
+	}
+}
+
+// ==== encode: float RGBA -> format ================
+template < pixelFormat F >
+inline void EncodeFromFloat ( const float * in, void * out, size_t count ) {
+	size_t i = 0;
+	if constexpr ( F == pixelFormat::RGBA32F ) {
+		std::memcpy( out, in, count * sizeof( float ) );
+		return;
+	} else if constexpr ( F == pixelFormat::RGBA8 ) {
+		uint8_t * dst = ( uint8_t * ) out;
+	#if defined( __SSE2__ )
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps( 1.0f );
+		const __m128 scale = _mm_set1_ps( 255.0f );
+		const __m128 half = _mm_set1_ps( 0.5f );
+		for ( ; i + 16 <= count; i += 16 ) {
+			// clamp, scale, round - max/min order also flushes NaN to zero
+			__m128i v[ 4 ];
+			for ( int j = 0; j < 4; j++ ) {
+				const __m128 x = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( in + i + 4 * j ), zero ), one );
+				v[ j ] = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( x, scale ), half ) );
+			}
+			const __m128i packed = _mm_packus_epi16( _mm_packs_epi32( v[ 0 ], v[ 1 ] ), _mm_packs_epi32( v[ 2 ], v[ 3 ] ) );
+			_mm_storeu_si128( ( __m128i * ) ( dst + i ), packed );
+		}
+	#endif
+		for ( ; i < count; i++ ) dst[ i ] = EncodeUNorm8( in[ i ] );
+	} else if constexpr ( F == pixelFormat::SRGBA8 ) {
+		uint8_t * dst = ( uint8_t * ) out;
+		const uint8_t * lut = SRGB8EncodeLUT();
+	#if defined( __SSE2__ )
+		// compute the table indices four channels at a time, then do the lookups
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps( 1.0f );
+		const __m128 scale = _mm_set1_ps( SRGBEncodeLUTScale );
+		const __m128 half = _mm_set1_ps( 0.5f );
+		alignas( 16 ) int32_t index[ 4 ];
+		for ( ; i + 4 <= count; i += 4 ) {
+			const __m128 x = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( in + i ), zero ), one );
+			_mm_store_si128( ( __m128i * ) index, _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( x, scale ), half ) ) );
+			dst[ i + 0 ] = lut[ index[ 0 ] ];
+			dst[ i + 1 ] = lut[ index[ 1 ] ];
+			dst[ i + 2 ] = lut[ index[ 2 ] ];
+			dst[ i + 3 ] = EncodeUNorm8( in[ i + 3 ] );
+		}
+	#endif
+		for ( ; i < count; i++ ) dst[ i ] = ( i % 4 == 3 ) ? EncodeUNorm8( in[ i ] ) : EncodeSRGB8( in[ i ] );
+	} else if constexpr ( F == pixelFormat::RGBA16F ) {
+		uint16_t * dst = ( uint16_t * ) out;
+	#if defined( __F16C__ ) && defined( __AVX__ )
+		for ( ; i + 8 <= count; i += 8 ) {
+			_mm_storeu_si128( ( __m128i * ) ( dst + i ), _mm256_cvtps_ph( _mm256_loadu_ps( in + i ), _MM_FROUND_TO_NEAREST_INT ) );
+		}
+	#endif
+		for ( ; i < count; i++ ) dst[ i ] = FloatToHalf( in[ i ] );
+	}
+}
+
+// ==== conversion entry points =====================
+template < pixelFormat S, pixelFormat D >
+inline void ConvertPixels ( const void * in, void * out, size_t numPixels ) {
+	if constexpr ( S == D ) {
+		std::memcpy( out, in, numPixels * BytesPerPixel< S >() );
+	} else if constexpr ( D == pixelFormat::RGBA32F ) {
+		DecodeToFloat< S >( in, ( float * ) out, numPixels * 4 );
+	} else if constexpr ( S == pixelFormat::RGBA32F ) {
+		EncodeFromFloat< D >( ( const float * ) in, out, numPixels * 4 );
+	} else {
+		// go through a small float block that stays resident in L1
+		constexpr size_t blockPixels = 256;
+		float block[ blockPixels * 4 ];
+		const uint8_t * src = ( const uint8_t * ) in;
+		uint8_t * dst = ( uint8_t * ) out;
+		for ( size_t base = 0; base < numPixels; base += blockPixels ) {
+			const size_t n = std::min( blockPixels, numPixels - base );
+			DecodeToFloat< S >( src + base * BytesPerPixel< S >(), block, n * 4 );
+			EncodeFromFloat< D >( block, dst + base * BytesPerPixel< D >(), n * 4 );
+		}
+	}
+}
+
+// whole image, row by row - flipVertical handles the bottom-up row order of OpenGL readbacks in the same pass
+template < pixelFormat S, pixelFormat D >
+inline void ConvertImage ( const void * in, void * out, uint32_t width, uint32_t height, bool flipVertical = false ) {
+	const size_t srcStride = size_t( width ) * BytesPerPixel< S >();
+	const size_t dstStride = size_t( width ) * BytesPerPixel< D >();
+	const uint8_t * src = ( const uint8_t * ) in;
+	uint8_t * dst = ( uint8_t * ) out;
+	for ( uint32_t y = 0; y < height; y++ ) {
+		const uint32_t srcRow = flipVertical ? ( height - y - 1 ) : y;
+		ConvertPixels< S, D >( src + srcRow * srcStride, dst + y * dstStride, width );
+	}
+}
+
+#endif
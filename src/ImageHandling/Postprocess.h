@@ -0,0 +1,835 @@
+#pragma once
+#ifndef POSTPROCESS_H
+#define POSTPROCESS_H
+
+#include "../ImageHandling/Image.h"
+#include "../Threading/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// CPU port of postprocess.cs.glsl, for when the final look is needed without going through the GPU
+	// - addDepthFog ( depthCurves.glsl ), gammaCorrect and tonemap() ( tonemap.glsl ) fused into one pass over the
+	//   accumulator, instead of three passes over a whole float image
+	// - rows are cut into blocks of 64 pixels, deinterleaved into per-channel arrays that stay in L1 - every stage is
+	//   then a flat loop over the block with the mode switch hoisted out, which the compiler vectorizes ( -march=native )
+	// - pow / exp go through the branch free FastLog2 / FastExp2 below, so those loops vectorize too - error is around
+	//   1e-7 relative, the GPU's own pow is not any closer than that
+	// - quirks of the shader are kept on purpose, so the two agree: the row / column mixup in MatrixMultiply, the early
+	//   return in the jodie*2ElectricBoogaloo variants, the truncating float -> 8 bit store at the end
+
+// names for the tonemap() switch, in order, for the UI
+inline const char * tonemapModeNames[] = { "None ( Linear )", "ACES ( Narkowicz 2015 )", "Unreal Engine 3", "Unreal Engine 4",
+	"Uncharted 2", "Gran Turismo", "Modified Gran Turismo", "Rienhard", "Modified Rienhard", "jt_tonemap", "robobo1221s",
+	"robo", "jodieRobo", "jodieRobo2", "jodieReinhard", "jodieReinhard2", "Local ( Bilateral Grid )" };
+
+// not a tonemap() curve - depends on the neighborhood, see LocalTonemapGrid below
+constexpr int localTonemapMode = 16;
+
+class ColorGradeLUT;
+class LocalTonemapGrid;
+
+// Durand / Dorsey style local operator - log luminance is split into a base layer ( edge preserving blur ) and detail,
+// the base is compressed to fit the target contrast and the detail is kept
+struct localTonemapSettings {
+	float spatialSigma = 32.0f;		// pixels, the size of a grid cell - cost does not go up with this, it goes down
+	float rangeSigma = 0.4f;		// stops, edges with a larger step than this are preserved
+	float contrast = 5.0f;			// stops the base layer is compressed into, if it spans more
+	float detail = 1.2f;			// scale on the detail layer, 1 keeps it as is
+};
+
+// same meaning as the uniforms of the same name in postprocess.cs.glsl
+struct postprocessSettings {
+	int tonemapMode = 0;
+	int depthMode = 0;
+	float depthScale = 0.0f;
+	float maxDistance = 0.0f;
+	float fogColor[ 3 ] = { 1.0f, 1.0f, 1.0f };
+	float gamma = 1.0f;
+	float whiteBalance[ 3 ] = { 1.0f, 1.0f, 1.0f };	// linear scale from the color temperature, applied after the fog
+	int displayType = 0;	// 0 color, 1 normal, 2 depth
+	const ColorGradeLUT * lut = nullptr;			// when set, white balance + gamma + tonemap is one fetch from this instead
+	localTonemapSettings local;						// for localTonemapMode
+	const LocalTonemapGrid * localGrid = nullptr;	// when set, localTonemapMode uses this grid instead of building one
+};
+
+namespace postprocessDetail {
+	constexpr int blockSize = 64;
+
+	struct block {
+		alignas( 32 ) float r[ blockSize ];
+		alignas( 32 ) float g[ blockSize ];
+		alignas( 32 ) float b[ blockSize ];
+		alignas( 32 ) float depth[ blockSize ];
+	};
+
+	// log2 from the exponent bits, plus an atanh series on the mantissa, folded into [ sqrt( 0.5 ), sqrt( 2 ) ) - x > 0
+	inline float FastLog2 ( float x ) {
+		uint32_t bits;
+		std::memcpy( &bits, &x, 4 );
+		// fold with integer math, no select - a select here stops gcc from vectorizing the loop when anything before it
+		// in the loop ( a clamp, another select ) was already a select. Carries into bit 23 for mantissas past sqrt( 2 )
+		const uint32_t fold = ( ( bits & 0x007fffff ) + ( 0x00800000 - 0x003504f4 ) ) >> 23;
+		const float exponent = float( int32_t( ( bits >> 23 ) + fold ) - 127 );
+		bits = ( bits & 0x007fffff ) | ( 0x3f800000 - ( fold << 23 ) );
+		float m;
+		std::memcpy( &m, &bits, 4 );
+		const float s = ( m - 1.0f ) / ( m + 1.0f );
+		const float s2 = s * s;
+		// 2 / ( k ln 2 ) for k = 1, 3, 5, 7, 9
+		return exponent + s * ( 2.88539008f + s2 * ( 0.96179669f + s2 * ( 0.57707802f + s2 * ( 0.41219859f + s2 * 0.32059890f ) ) ) );
+	}
+
+	// integer part straight into the exponent bits, polynomial on the remainder in [ -0.5, 0.5 ]
+	inline float FastExp2 ( float x ) {
+		x = std::min( std::max( x, -126.0f ), 127.0f );
+		// round to nearest by adding 1.5 * 2^23, the integer lands in the low mantissa bits - std::floor or a float to int
+		// conversion after the clamp both keep gcc from vectorizing the loops this ends up in
+		const float shifted = x + 12582912.0f;
+		uint32_t bits;
+		std::memcpy( &bits, &shifted, 4 );
+		const float f = ( x - ( shifted - 12582912.0f ) ) * 0.69314718f;
+		const float p = 1.0f + f * ( 1.0f + f * ( 0.5f + f * ( 1.0f / 6.0f + f * ( 1.0f / 24.0f + f * ( 1.0f / 120.0f + f * ( 1.0f / 720.0f ) ) ) ) ) );
+		bits = ( bits - 0x4b400000u + 127u ) << 23;
+		float scale;
+		std::memcpy( &scale, &bits, 4 );
+		return p * scale;
+	}
+
+	// GLSL pow is undefined for x < 0 - GPUs go through exp2( y * log2( x ) ) and get NaN, so do the same here, since NaN
+	// in one channel takes the whole pixel to black in the luma based tonemaps. Zero stays zero ( y > 0 )
+	inline float FastPow ( float x, float y ) {
+		const float result = FastExp2( y * FastLog2( x ) );
+		const float zeroOrNaN = ( x == 0.0f ) ? 0.0f : std::numeric_limits< float >::quiet_NaN();
+		return ( x > 0.0f ) ? result : zeroOrNaN;
+	}
+	inline float FastExp ( float x ) { return FastExp2( x * 1.44269504f ); }
+
+	// std::sqrt keeps a call to sqrtf around for errno, which is enough to stop the loop from vectorizing
+	inline float FastSqrt ( float x ) { return FastPow( x, 0.5f ); }
+
+	inline float Mix ( float x, float y, float a ) { return x * ( 1.0f - a ) + y * a; }
+	inline float Step ( float edge, float x ) { return ( x < edge ) ? 0.0f : 1.0f; }
+	inline float Smoothstep ( float edge0, float edge1, float x ) {
+		const float t = std::min( std::max( ( x - edge0 ) / ( edge1 - edge0 ), 0.0f ), 1.0f );
+		return t * t * ( 3.0f - 2.0f * t );
+	}
+
+	// ==== depthCurves.glsl ========================
+	// the fog term for each mode, the mix happens in AddDepthFog - mode 11 is additive instead
+	template < int mode >
+	inline float FogTerm ( float depth, float maxDistance ) {
+		if constexpr ( mode == 1 ) return 2.0f - 2.0f * ( 1.0f / ( 1.0f - depth ) );
+		if constexpr ( mode == 2 ) return 1.0f - ( 1.0f / ( 1.0f + 0.1f * depth * depth ) );
+		if constexpr ( mode == 3 ) return 1.0f - FastPow( depth / 30.0f, 1.618f );
+		if constexpr ( mode == 4 ) return std::min( std::max( FastExp( 0.25f * depth - 3.0f ), 0.0f ), 10.0f );
+		if constexpr ( mode == 5 ) return FastExp( 0.25f * depth - 3.0f );
+		if constexpr ( mode == 6 ) return FastExp( -0.002f * depth * depth * depth );
+		if constexpr ( mode == 7 ) return FastExp( -0.6f * std::max( depth - 3.0f, 0.0f ) );
+		if constexpr ( mode == 8 ) return ( FastSqrt( depth ) / 8.0f ) * depth;
+		if constexpr ( mode == 9 ) return FastSqrt( depth / 9.0f );
+		if constexpr ( mode == 10 ) return ( depth / 10.0f ) * ( depth / 10.0f );
+		if constexpr ( mode == 11 ) return 1.0f / ( 1.0f + FastExp( -2.0f * ( depth * 0.1f - 2.0f ) ) );
+		if constexpr ( mode == 12 ) return depth / maxDistance;
+		return 0.0f;
+	}
+
+	template < int mode >
+	inline void AddDepthFog ( block & p, int count, const postprocessSettings & s ) {
+		for ( int i = 0; i < count; i++ ) {
+			const float t = FogTerm< mode >( p.depth[ i ] * s.depthScale, s.maxDistance );
+			if constexpr ( mode == 11 ) {
+				p.r[ i ] += t * s.fogColor[ 0 ];
+				p.g[ i ] += t * s.fogColor[ 1 ];
+				p.b[ i ] += t * s.fogColor[ 2 ];
+			} else {
+				p.r[ i ] = Mix( p.r[ i ], s.fogColor[ 0 ], t );
+				p.g[ i ] = Mix( p.g[ i ], s.fogColor[ 1 ], t );
+				p.b[ i ] = Mix( p.b[ i ], s.fogColor[ 2 ], t );
+			}
+		}
+	}
+
+	inline void AddDepthFog ( block & p, int count, const postprocessSettings & s ) {
+		switch ( s.depthMode ) {
+			case 1: AddDepthFog< 1 >( p, count, s ); break;
+			case 2: AddDepthFog< 2 >( p, count, s ); break;
+			case 3: AddDepthFog< 3 >( p, count, s ); break;
+			case 4: AddDepthFog< 4 >( p, count, s ); break;
+			case 5: AddDepthFog< 5 >( p, count, s ); break;
+			case 6: AddDepthFog< 6 >( p, count, s ); break;
+			case 7: AddDepthFog< 7 >( p, count, s ); break;
+			case 8: AddDepthFog< 8 >( p, count, s ); break;
+			case 9: AddDepthFog< 9 >( p, count, s ); break;
+			case 10: AddDepthFog< 10 >( p, count, s ); break;
+			case 11: AddDepthFog< 11 >( p, count, s ); break;
+			case 12: AddDepthFog< 12 >( p, count, s ); break;
+			default: break;
+		}
+	}
+
+	inline void GammaCorrect ( block & p, int count, float gamma ) {
+		const float exponent = 1.0f / gamma;
+		for ( int i = 0; i < count; i++ ) {
+			p.r[ i ] = FastPow( p.r[ i ], exponent );
+			p.g[ i ] = FastPow( p.g[ i ], exponent );
+			p.b[ i ] = FastPow( p.b[ i ], exponent );
+		}
+	}
+
+	// ==== tonemap.glsl ============================
+	inline float Luma ( float r, float g, float b ) { return 0.2126f * r + 0.7152f * g + 0.0722f * b; }
+
+	inline float CheapACES ( float v ) {
+		v *= 0.6f;
+		return std::min( std::max( ( v * ( 2.51f * v + 0.03f ) ) / ( v * ( 2.43f * v + 0.59f ) + 0.14f ), 0.0f ), 1.0f );
+	}
+
+	inline float RTT_ODT_Fit ( float v ) {
+		return ( v * ( v + 0.0245786f ) - 0.000090537f ) / ( v * ( 0.983729f * v + 0.4329510f ) + 0.238081f );
+	}
+
+	// MatrixMultiply in the shader reads v[ 1 ] where the second and third rows should read v[ 0 ] - kept, to match
+	inline void ACESFitted ( float & r, float & g, float & b ) {
+		float x = 0.59719f * r + 0.35458f * g + 0.04823f * b;
+		float y = 0.07600f * g + 0.90834f * g + 0.01566f * b;
+		float z = 0.02840f * g + 0.13383f * g + 0.83777f * b;
+		x = RTT_ODT_Fit( x ); y = RTT_ODT_Fit( y ); z = RTT_ODT_Fit( z );
+		r = 1.60475f * x - 0.53108f * y - 0.07367f * z;
+		g = -0.10208f * y + 1.10813f * y - 0.00605f * z;
+		b = -0.00327f * y - 0.07276f * y + 1.07602f * z;
+	}
+
+	inline float Uncharted2 ( float v ) {
+		constexpr float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f, W = 11.2f;
+		constexpr float white = ( ( W * ( A * W + C * B ) + D * E ) / ( W * ( A * W + B ) + D * F ) ) - E / F;
+		v *= 2.0f; // exposure bias
+		return ( ( ( v * ( A * v + C * B ) + D * E ) / ( v * ( A * v + B ) + D * F ) ) - E / F ) * white;
+	}
+
+	// Uchimura 2017, "HDR theory and practice" - P max brightness, a contrast, m linear start, l linear length, c black
+	template < int variant >
+	inline float Uchimura ( float v ) {
+		constexpr float P = 1.0f, c = 1.33f;
+		constexpr float a = ( variant == 0 ) ? 1.0f : 1.7f;
+		constexpr float m = ( variant == 0 ) ? 0.22f : 0.1f;
+		constexpr float l = ( variant == 0 ) ? 0.4f : 0.0f;
+		constexpr float l0 = ( ( P - m ) * l ) / a;
+		constexpr float S0 = m + l0;
+		constexpr float S1 = m + a * l0;
+		constexpr float C2 = ( a * P ) / ( P - S1 );
+		constexpr float CP = -C2 / P;
+
+		const float w0 = 1.0f - Smoothstep( 0.0f, m, v );
+		const float w2 = Step( m + l0, v );
+		const float w1 = 1.0f - w0 - w2;
+		const float T = m * FastPow( v / m, c );
+		const float S = P - ( P - S1 ) * FastExp( CP * ( v - S0 ) );
+		const float L = m + a * ( v - m );
+		return T * w0 + L * w1 + S * w2;
+	}
+
+	inline float Unreal3 ( float v ) { return FastPow( v / ( v + 0.155f ) * 1.019f, 2.8f ); }
+	inline float Rienhard ( float v ) { return v / ( 1.0f + v ); }
+	inline float Rienhard2 ( float v ) { return ( v * ( 1.0f + v / 16.0f ) ) / ( 1.0f + v ); }
+	inline float Robobo1221s ( float v ) { return FastSqrt( v / ( v + 1.0f / v ) ) - std::abs( v ) + v; }
+	inline float Robo ( float v ) { return v / FastSqrt( 1.0f + v * v ); }
+
+	inline void JTTonemap ( float & r, float & g, float & b ) {
+		const float l = 0.2125f * r + 0.7154f * g + 0.0721f * b;
+		const float scale = l / ( 1.0f + l ) / l;
+		r *= scale; g *= scale; b *= scale;
+		const float m = std::max( r, std::max( g, b ) );
+		const auto lightAdjust = [ m ] ( float a ) { return ( ( 1.0f - m ) * ( FastPow( 1.0f - a, m + 1.0f ) - 1.0f ) + a ) / m; };
+		r = std::min( lightAdjust( r / m ), r );
+		g = std::min( lightAdjust( g / m ), g );
+		b = std::min( lightAdjust( b / m ), b );
+	}
+
+	inline void JodieRobo ( float & r, float & g, float & b ) {
+		const float l = Luma( r, g, b );
+		const float scale = 1.0f / FastSqrt( l * l + 1.0f );
+		const float tr = Robo( r ), tg = Robo( g ), tb = Robo( b );
+		r = Mix( r * scale, tr, tr ); g = Mix( g * scale, tg, tg ); b = Mix( b * scale, tb, tb );
+	}
+
+	inline void JodieReinhard ( float & r, float & g, float & b ) {
+		const float l = Luma( r, g, b );
+		const float scale = 1.0f / ( l + 1.0f );
+		const float tr = Rienhard( r ), tg = Rienhard( g ), tb = Rienhard( b );
+		r = Mix( r * scale, tr, tr ); g = Mix( g * scale, tg, tg ); b = Mix( b * scale, tb, tb );
+	}
+
+	// both ElectricBoogaloo variants, only the luma curve differs - this is the simplified form the shader returns early with
+	template < bool robo >
+	inline void ElectricBoogaloo ( float & r, float & g, float & b ) {
+		const float luma = Luma( r, g, b );
+		const float scale = robo ? 1.0f / FastSqrt( luma * luma + 1.0f ) : 1.0f / ( luma + 1.0f );
+		r *= scale; g *= scale; b *= scale;
+		const float mappedLuma = luma * scale;
+		const float channelMax = std::max( std::max( std::max( r, g ), b ), 1.0f );
+		const float offset = channelMax * mappedLuma - mappedLuma;
+		const float denominator = mappedLuma - channelMax;
+		r = ( ( mappedLuma * r - r ) - offset ) / denominator;
+		g = ( ( mappedLuma * g - g ) - offset ) / denominator;
+		b = ( ( mappedLuma * b - b ) - offset ) / denominator;
+	}
+
+	template < typename Curve >
+	inline void PerChannel ( block & p, int count, Curve curve ) {
+		for ( int i = 0; i < count; i++ ) {
+			p.r[ i ] = curve( p.r[ i ] );
+			p.g[ i ] = curve( p.g[ i ] );
+			p.b[ i ] = curve( p.b[ i ] );
+		}
+	}
+
+	template < typename Operator >
+	inline void PerPixel ( block & p, int count, Operator op ) {
+		for ( int i = 0; i < count; i++ ) {
+			op( p.r[ i ], p.g[ i ], p.b[ i ] );
+		}
+	}
+
+	inline void Tonemap ( block & p, int count, int mode ) {
+		switch ( mode ) {
+			case 1: PerChannel( p, count, CheapACES ); break;
+			case 2: PerChannel( p, count, Unreal3 ); break;
+			case 3: PerPixel( p, count, ACESFitted ); break;
+			case 4: PerChannel( p, count, Uncharted2 ); break;
+			case 5: PerChannel( p, count, Uchimura< 0 > ); break;
+			case 6: PerChannel( p, count, Uchimura< 1 > ); break;
+			case 7: PerChannel( p, count, Rienhard ); break;
+			case 8: PerChannel( p, count, Rienhard2 ); break;
+			case 9: PerPixel( p, count, JTTonemap ); break;
+			case 10: PerChannel( p, count, Robobo1221s ); break;
+			case 11: PerChannel( p, count, Robo ); break;
+			case 12: PerPixel( p, count, JodieRobo ); break;
+			case 13: PerPixel( p, count, ElectricBoogaloo< true > ); break;
+			case 14: PerPixel( p, count, JodieReinhard ); break;
+			case 15: PerPixel( p, count, ElectricBoogaloo< false > ); break;
+			default: break; // 0, none - and localTonemapMode, which runs on the whole image after this, in PostprocessImageF()
+		}
+	}
+
+	// everything after the fog - this is the part that ColorGradeLUT bakes
+	inline void ColorGrade ( block & p, int count, const postprocessSettings & s ) {
+		for ( int i = 0; i < count; i++ ) {
+			p.r[ i ] *= s.whiteBalance[ 0 ];
+			p.g[ i ] *= s.whiteBalance[ 1 ];
+			p.b[ i ] *= s.whiteBalance[ 2 ];
+		}
+		GammaCorrect( p, count, s.gamma );
+		Tonemap( p, count, s.tonemapMode );
+	}
+
+	// color, normal and depth display types - only color goes through the postprocess stages, in RunStages() below
+	inline void LoadBlock ( block & p, int count, const float * color, const float * normalDepth, const postprocessSettings & s ) {
+		for ( int i = 0; i < count; i++ ) {
+			const float * source = ( s.displayType == 1 && normalDepth ) ? normalDepth + i * 4 : color + i * 4;
+			p.r[ i ] = source[ 0 ];
+			p.g[ i ] = source[ 1 ];
+			p.b[ i ] = source[ 2 ];
+			p.depth[ i ] = normalDepth ? normalDepth[ i * 4 + 3 ] : 0.0f;
+		}
+	}
+}
+
+// ==== baked color grade ===========================
+// white balance, gamma and tonemap baked into a 3D table whenever those parameters change, so the per pixel cost is one
+// trilinear fetch, the same for every tonemap mode - the luma based tonemaps mix channels, so a 1D table per channel
+// would not cover them
+	// - input is HDR, so the table is indexed through a shaper: t = pow( c, 1 / gamma ), then log2( 1 + t / epsilon ) -
+	//   gamma is the steepest part of the curve near black, and taking it out leaves the tonemaps close to linear over
+	//   each cell, while the log spends most of the entries on the dark end
+	// - the same table is uploaded as a 3D texture for postprocess.cs.glsl, which does the same shaper math
+	// - input at or below zero ( or NaN ) takes the black entry, above shaperMax it clamps
+	// - jt_tonemap and the two ElectricBoogaloo variants have a max() over channels and a near singular division, which
+	//   no reasonable table size follows - Bakeable() is false for those, and both sides stay on the analytic path. Same
+	//   for gamma under 0.5, where pow( c, 1 / gamma ) is close to a step around c = 1 and the cells can't follow it
+	// - localTonemapMode is not a function of the color alone, so it isn't baked either
+class ColorGradeLUT {
+public:
+	static constexpr int size = 65;
+	static constexpr float shaperMax = 1024.0f;
+	static constexpr float shaperEpsilon = 1.0f / 32.0f;
+
+	static bool Bakeable ( int tonemapMode, float gamma ) {
+		return tonemapMode != 9 && tonemapMode != 13 && tonemapMode != 15 && tonemapMode != localTonemapMode && gamma >= 0.5f;
+	}
+
+	// [ 0, 1 ] over [ 0, shaperMax ] - log2( 1 + t / epsilon ) of t = pow( c, 1 / gamma ), divided by its value at shaperMax,
+	// which is ShaperRange() and goes to the GPU as a uniform
+	float ShaperRange () const { return range; }
+	float Shaper ( float c ) const {
+		const float t = std::pow( std::min( std::max( c, 0.0f ), shaperMax ), 1.0f / gamma );
+		return std::log2( 1.0f + t / shaperEpsilon ) / range;
+	}
+	float InverseShaper ( float u ) const {
+		return std::pow( ( std::exp2( u * range ) - 1.0f ) * shaperEpsilon, gamma );
+	}
+
+	// rebakes if the tonemap mode, gamma or white balance differ from the last call - true when it did, so the caller
+	// knows to upload it again
+	bool Update ( const postprocessSettings & s ) {
+		if ( valid && s.tonemapMode == tonemapMode && s.gamma == gamma && std::equal( s.whiteBalance, s.whiteBalance + 3, whiteBalance ) ) {
+			return false;
+		}
+		valid = true;
+		tonemapMode = s.tonemapMode;
+		gamma = s.gamma;
+		std::copy( s.whiteBalance, s.whiteBalance + 3, whiteBalance );
+		// log2( 1 + shaperMax^( 1 / gamma ) / epsilon ), rearranged so low gamma ( the slider goes to 0.01 ) doesn't overflow
+		const float top = std::log2( shaperMax ) / gamma;
+		range = top - std::log2( shaperEpsilon ) + std::log2( 1.0f + shaperEpsilon * std::exp2( -top ) );
+		Build( s );
+		return true;
+	}
+
+	// RGBA float, red index fastest, size^3 entries - what glTexImage3D wants
+	const float * Data () const { return data.data(); }
+
+	// trilinear lookup, in place - shaper for the whole block first, that part vectorizes, then the fetches
+	void Apply ( postprocessDetail::block & p, int count ) const {
+		using namespace postprocessDetail;
+		constexpr float last = float( size - 1 );
+		const float exponent = 1.0f / gamma;
+		const float scale = last / range;
+		// three passes per channel - a select anywhere ahead of FastLog2 in the same loop, even FastPow's own, and gcc
+		// gives up on vectorizing it. The first pass takes NaN and negative input to 0, black, like the shaper range does
+		const auto Shape = [ & ] ( float * v ) {
+			for ( int i = 0; i < count; i++ ) v[ i ] = std::min( ( v[ i ] > 0.0f ) ? v[ i ] : 0.0f, shaperMax );
+			for ( int i = 0; i < count; i++ ) v[ i ] = FastPow( v[ i ], exponent );
+			for ( int i = 0; i < count; i++ ) v[ i ] = std::min( FastLog2( 1.0f + v[ i ] * ( 1.0f / shaperEpsilon ) ) * scale, last );
+		};
+		Shape( p.r );
+		Shape( p.g );
+		Shape( p.b );
+
+		const size_t strideY = size_t( size ) * 4;
+		const size_t strideZ = size_t( size ) * size * 4;
+		for ( int i = 0; i < count; i++ ) {
+			const int x = std::min( int( p.r[ i ] ), size - 2 );
+			const int y = std::min( int( p.g[ i ] ), size - 2 );
+			const int z = std::min( int( p.b[ i ] ), size - 2 );
+			const float fx = p.r[ i ] - float( x );
+			const float fy = p.g[ i ] - float( y );
+			const float fz = p.b[ i ] - float( z );
+			const float * base = &data[ x * 4 + y * strideY + z * strideZ ];
+			float result[ 3 ];
+			for ( int c = 0; c < 3; c++ ) {
+				const float c00 = base[ c ] + fx * ( base[ 4 + c ] - base[ c ] );
+				const float c10 = base[ strideY + c ] + fx * ( base[ strideY + 4 + c ] - base[ strideY + c ] );
+				const float c01 = base[ strideZ + c ] + fx * ( base[ strideZ + 4 + c ] - base[ strideZ + c ] );
+				const float c11 = base[ strideZ + strideY + c ] + fx * ( base[ strideZ + strideY + 4 + c ] - base[ strideZ + strideY + c ] );
+				const float c0 = c00 + fy * ( c10 - c00 );
+				const float c1 = c01 + fy * ( c11 - c01 );
+				result[ c ] = c0 + fz * ( c1 - c0 );
+			}
+			p.r[ i ] = result[ 0 ];
+			p.g[ i ] = result[ 1 ];
+			p.b[ i ] = result[ 2 ];
+		}
+	}
+
+	// largest difference from the analytic curves, in display units - both sides clamped to [ 0, 1 ] first, like the 8 bit
+	// store does. Inputs are log distributed from 2^-16 to shaperMax per channel, plus some black
+	float MaxError ( const postprocessSettings & s, int samples = 1 << 20 ) const {
+		using namespace postprocessDetail;
+		std::atomic< uint32_t > worstBits{ 0 };
+		const int blocks = ( samples + blockSize - 1 ) / blockSize;
+		const float stops = std::log2( shaperMax ) + 16.0f;
+		ParallelFor( 0, blocks, [ & ] ( int b ) {
+			block analytic, baked;
+			uint32_t state = 0x9e3779b9u * uint32_t( b + 1 );
+			for ( int i = 0; i < blockSize; i++ ) {
+				float * channels[ 3 ] = { &analytic.r[ i ], &analytic.g[ i ], &analytic.b[ i ] };
+				for ( int c = 0; c < 3; c++ ) {
+					state = state * 1664525u + 1013904223u;
+					const float u = float( state >> 8 ) / 16777216.0f;
+					*channels[ c ] = ( ( state & 0xff ) < 8 ) ? 0.0f : std::exp2( u * stops - 16.0f );
+				}
+			}
+			baked = analytic;
+			ColorGrade( analytic, blockSize, s );
+			Apply( baked, blockSize );
+			float worst = 0.0f;
+			const auto Display = [] ( float v ) { return std::min( ( v > 0.0f ) ? v : 0.0f, 1.0f ); };
+			for ( int i = 0; i < blockSize; i++ ) {
+				worst = std::max( worst, std::abs( Display( analytic.r[ i ] ) - Display( baked.r[ i ] ) ) );
+				worst = std::max( worst, std::abs( Display( analytic.g[ i ] ) - Display( baked.g[ i ] ) ) );
+				worst = std::max( worst, std::abs( Display( analytic.b[ i ] ) - Display( baked.b[ i ] ) ) );
+			}
+			// positive floats order the same as their bits
+			uint32_t bits;
+			std::memcpy( &bits, &worst, 4 );
+			uint32_t previous = worstBits.load();
+			while ( bits > previous && !worstBits.compare_exchange_weak( previous, bits ) ) {}
+		}, 16 );
+		const uint32_t bits = worstBits.load();
+		float worst;
+		std::memcpy( &worst, &bits, 4 );
+		return worst;
+	}
+
+private:
+	void Build ( const postprocessSettings & s ) {
+		using namespace postprocessDetail;
+		data.resize( size_t( size ) * size * size * 4 );
+		float lattice[ size ];
+		for ( int i = 0; i < size; i++ ) lattice[ i ] = InverseShaper( float( i ) / float( size - 1 ) );
+		lattice[ 0 ] = 0.0f;
+		ParallelFor( 0, size * size, [ & ] ( int yz ) {
+			const int y = yz % size, z = yz / size;
+			float * row = &data[ size_t( yz ) * size * 4 ];
+			block p;
+			for ( int base = 0; base < size; base += blockSize ) {
+				const int n = std::min( blockSize, size - base );
+				for ( int i = 0; i < n; i++ ) {
+					p.r[ i ] = lattice[ base + i ];
+					p.g[ i ] = lattice[ y ];
+					p.b[ i ] = lattice[ z ];
+				}
+				ColorGrade( p, n, s );
+				for ( int i = 0; i < n; i++ ) {
+					// NaN out of the curves shows up as black on the display, store it that way so it interpolates sanely
+					float * texel = &row[ ( base + i ) * 4 ];
+					texel[ 0 ] = ( p.r[ i ] == p.r[ i ] ) ? p.r[ i ] : 0.0f;
+					texel[ 1 ] = ( p.g[ i ] == p.g[ i ] ) ? p.g[ i ] : 0.0f;
+					texel[ 2 ] = ( p.b[ i ] == p.b[ i ] ) ? p.b[ i ] : 0.0f;
+					texel[ 3 ] = 1.0f;
+				}
+			}
+		}, 32 );
+	}
+
+	std::vector< float > data;
+	bool valid = false;
+	int tonemapMode = 0;
+	float gamma = 1.0f;
+	float range = 1.0f;
+	float whiteBalance[ 3 ] = { 0.0f, 0.0f, 0.0f };
+};
+
+// ==== local tonemap ===============================
+// bilateral grid over log2 luminance ( Paris / Durand, Chen et al ) - a naive bilateral filter at these radii costs
+// thousands of taps per pixel, the grid is a downsampled ( x, y, log luminance ) volume that does the same in O( 1 )
+	// - splat: each pixel adds ( L, 1 ) to its nearest cell, cells are spatialSigma pixels by rangeSigma stops
+	// - blur: [ 1 4 6 4 1 ] / 16 along each axis, a gaussian of one cell - the cost depends on the grid size, which goes
+	//   down as the radius goes up
+	// - slice: trilinear fetch at ( x, y, L ) of each pixel, sum( L ) / count is the edge preserving base layer
+	// - the remap is in log space: base is scaled so its range fits in contrast stops, with the brightest base at 1.0,
+	//   and the detail ( L - base ) goes back on top, scaled by detail. Color is multiplied by the change in luminance
+	// - splat and blur run across the thread pool in slices of the grid, so no two threads write the same cell
+	// - the grid is laid out x fastest, then y, then L, as ( sum, count ) pairs - that is an RG32F 3D texture, and
+	//   postprocess.cs.glsl does the slice with one linear filtered fetch, through TextureTransform()
+	// - input is what the tonemap curves would see, after fog, white balance and gamma, with the top row first
+class LocalTonemapGrid {
+public:
+	static constexpr int maxRangeCells = 64;		// the range sigma goes up past this, for images with a huge range
+	static constexpr float luminanceFloor = 1.0f / 65536.0f;
+
+	bool Valid () const { return !data.empty(); }
+	int Width () const { return dims[ 0 ]; }
+	int Height () const { return dims[ 1 ]; }
+	int Depth () const { return dims[ 2 ]; }
+	const float * Data () const { return data.data(); }
+
+	// slice and remap terms, for the shader uniforms
+	float BaseMax () const { return baseMax; }
+	float Compression () const { return compression; }
+	float Detail () const { return settings.detail; }
+
+	// texture coordinate = vec3( x, y, L ) * scale + offset, with x and y in pixels, y from the top
+	void TextureTransform ( float scale[ 3 ], float offset[ 3 ] ) const {
+		scale[ 0 ] = 1.0f / ( settings.spatialSigma * dims[ 0 ] );
+		scale[ 1 ] = 1.0f / ( settings.spatialSigma * dims[ 1 ] );
+		scale[ 2 ] = 1.0f / ( rangeSigma * dims[ 2 ] );
+		offset[ 0 ] = 0.5f / dims[ 0 ];
+		offset[ 1 ] = 0.5f / dims[ 1 ];
+		offset[ 2 ] = ( 0.5f - minimum / rangeSigma ) / dims[ 2 ];
+	}
+
+	void Build ( const ImageF & image, const localTonemapSettings & s ) {
+		using namespace postprocessDetail;
+		settings = s;
+		settings.spatialSigma = std::max( s.spatialSigma, 1.0f );
+		const int w = int( image.width ), h = int( image.height );
+		if ( w == 0 || h == 0 ) {
+			data.clear();
+			return;
+		}
+
+		// log luminance, and its range per row
+		std::vector< float > luminance( size_t( w ) * h );
+		std::vector< float > rowMin( h ), rowMax( h );
+		ParallelFor( 0, h, [ & ] ( int y ) {
+			float * L = &luminance[ size_t( y ) * w ];
+			LogLuminance( &image.data[ size_t( y ) * w * 4 ], L, w );
+			float lo = L[ 0 ], hi = L[ 0 ];
+			for ( int x = 1; x < w; x++ ) {
+				lo = std::min( lo, L[ x ] );
+				hi = std::max( hi, L[ x ] );
+			}
+			rowMin[ y ] = lo;
+			rowMax[ y ] = hi;
+		}, 8 );
+		minimum = *std::min_element( rowMin.begin(), rowMin.end() );
+		const float maximum = *std::max_element( rowMax.begin(), rowMax.end() );
+
+		rangeSigma = std::max( std::max( s.rangeSigma, 0.01f ), ( maximum - minimum ) / ( maxRangeCells - 1 ) );
+		const float spatial = settings.spatialSigma;
+		dims[ 0 ] = int( ( w - 1 ) / spatial + 0.5f ) + 1;
+		dims[ 1 ] = int( ( h - 1 ) / spatial + 0.5f ) + 1;
+		dims[ 2 ] = int( ( maximum - minimum ) / rangeSigma + 0.5f ) + 1;
+		const int gx = dims[ 0 ], gy = dims[ 1 ], gz = dims[ 2 ];
+		const size_t sliceStride = size_t( gx ) * gy * 2;
+		data.assign( sliceStride * gz, 0.0f );
+
+		// splat, one grid row per task - the pixel rows that round to it
+		ParallelFor( 0, gy, [ & ] ( int j ) {
+			const int yStart = std::max( 0, int( std::ceil( ( j - 0.5f ) * spatial ) ) - 1 );
+			const int yEnd = std::min( h, int( ( j + 0.5f ) * spatial ) + 2 );
+			for ( int y = yStart; y < yEnd; y++ ) {
+				if ( int( y / spatial + 0.5f ) != j ) continue;
+				const float * L = &luminance[ size_t( y ) * w ];
+				for ( int x = 0; x < w; x++ ) {
+					const int i = int( x / spatial + 0.5f );
+					const int k = int( ( L[ x ] - minimum ) / rangeSigma + 0.5f );
+					float * cell = &data[ k * sliceStride + ( size_t( j ) * gx + i ) * 2 ];
+					cell[ 0 ] += L[ x ];
+					cell[ 1 ] += 1.0f;
+				}
+			}
+		}, 1 );
+
+		// range of the base layer, over the cells that have pixels in them - the blur spreads into empty ones
+		std::vector< uint8_t > occupied( size_t( gx ) * gy * gz );
+		for ( size_t c = 0; c < occupied.size(); c++ ) occupied[ c ] = data[ c * 2 + 1 ] > 0.0f;
+
+		// blur, x and L in slices of constant y, then y in slices of constant L
+		std::vector< float > scratch( data.size() );
+		ParallelFor( 0, gy, [ & ] ( int j ) {
+			for ( int k = 0; k < gz; k++ ) {
+				const size_t row = k * sliceStride + size_t( j ) * gx * 2;
+				BlurLine( &data[ row ], &scratch[ row ], gx, 2 );
+			}
+			for ( int i = 0; i < gx; i++ ) {
+				const size_t column = ( size_t( j ) * gx + i ) * 2;
+				BlurLine( &scratch[ column ], &data[ column ], gz, sliceStride );
+			}
+		}, 1 );
+		ParallelFor( 0, gz, [ & ] ( int k ) {
+			for ( int i = 0; i < gx; i++ ) {
+				const size_t column = k * sliceStride + size_t( i ) * 2;
+				BlurLine( &data[ column ], &scratch[ column ], gy, size_t( gx ) * 2 );
+			}
+		}, 1 );
+		data.swap( scratch );
+
+		float baseMin = std::numeric_limits< float >::max();
+		baseMax = -std::numeric_limits< float >::max();
+		for ( size_t c = 0; c < occupied.size(); c++ ) {
+			if ( !occupied[ c ] ) continue;
+			const float base = data[ c * 2 ] / data[ c * 2 + 1 ];
+			baseMin = std::min( baseMin, base );
+			baseMax = std::max( baseMax, base );
+		}
+		compression = std::min( 1.0f, std::max( s.contrast, 0.0f ) / std::max( baseMax - baseMin, 1e-6f ) );
+	}
+
+	// remaps the image in place - same size as the one the grid was built from
+	void Apply ( ImageF & image ) const {
+		using namespace postprocessDetail;
+		if ( !Valid() ) return;
+		const int w = int( image.width ), h = int( image.height );
+		ParallelFor( 0, h, [ & ] ( int y ) {
+			alignas( 32 ) float L[ blockSize ];
+			alignas( 32 ) float base[ blockSize ];
+			alignas( 32 ) float scale[ blockSize ];
+			for ( int x0 = 0; x0 < w; x0 += blockSize ) {
+				const int n = std::min( blockSize, w - x0 );
+				float * pixels = &image.data[ ( size_t( y ) * w + x0 ) * 4 ];
+				LogLuminance( pixels, L, n );
+				for ( int i = 0; i < n; i++ ) base[ i ] = Slice( float( x0 + i ), float( y ), L[ i ] );
+				for ( int i = 0; i < n; i++ ) {
+					const float out = ( base[ i ] - baseMax ) * compression + settings.detail * ( L[ i ] - base[ i ] );
+					scale[ i ] = FastExp2( out - L[ i ] );
+				}
+				for ( int i = 0; i < n; i++ ) {
+					pixels[ i * 4 + 0 ] *= scale[ i ];
+					pixels[ i * 4 + 1 ] *= scale[ i ];
+					pixels[ i * 4 + 2 ] *= scale[ i ];
+				}
+			}
+		}, 8 );
+	}
+
+private:
+	// Rec. 709 luma, floored so black and negative inputs have a log
+	static void LogLuminance ( const float * pixels, float * L, int count ) {
+		for ( int i = 0; i < count; i++ ) {
+			const float luma = 0.2126f * pixels[ i * 4 + 0 ] + 0.7152f * pixels[ i * 4 + 1 ] + 0.0722f * pixels[ i * 4 + 2 ];
+			L[ i ] = ( luma > luminanceFloor ) ? luma : luminanceFloor;
+		}
+		for ( int i = 0; i < count; i++ ) L[ i ] = postprocessDetail::FastLog2( L[ i ] );
+	}
+
+	// ( sum, count ) pairs, stride apart - zero past both ends, which the homogeneous divide takes care of
+	static void BlurLine ( const float * in, float * out, int count, size_t stride ) {
+		for ( int i = 0; i < count; i++ ) {
+			float sum = 0.0f, weight = 0.0f;
+			for ( int t = -2; t <= 2; t++ ) {
+				if ( i + t < 0 || i + t >= count ) continue;
+				const float tap = ( t == 0 ) ? 6.0f : ( t == 1 || t == -1 ) ? 4.0f : 1.0f;
+				sum += tap * in[ ( i + t ) * stride ];
+				weight += tap * in[ ( i + t ) * stride + 1 ];
+			}
+			out[ i * stride ] = sum * ( 1.0f / 16.0f );
+			out[ i * stride + 1 ] = weight * ( 1.0f / 16.0f );
+		}
+	}
+
+	// trilinear, with the coordinates clamped to the cell centers like GL_CLAMP_TO_EDGE
+	float Slice ( float x, float y, float L ) const {
+		const float c[ 3 ] = { x / settings.spatialSigma, y / settings.spatialSigma, ( L - minimum ) / rangeSigma };
+		int i0[ 3 ], i1[ 3 ];
+		float f[ 3 ];
+		for ( int a = 0; a < 3; a++ ) {
+			const float clamped = std::min( std::max( c[ a ], 0.0f ), float( dims[ a ] - 1 ) );
+			i0[ a ] = int( clamped );
+			i1[ a ] = std::min( i0[ a ] + 1, dims[ a ] - 1 );
+			f[ a ] = clamped - i0[ a ];
+		}
+		float sum = 0.0f, weight = 0.0f;
+		for ( int corner = 0; corner < 8; corner++ ) {
+			const int i = ( corner & 1 ) ? i1[ 0 ] : i0[ 0 ];
+			const int j = ( corner & 2 ) ? i1[ 1 ] : i0[ 1 ];
+			const int k = ( corner & 4 ) ? i1[ 2 ] : i0[ 2 ];
+			const float t = ( ( corner & 1 ) ? f[ 0 ] : 1.0f - f[ 0 ] ) * ( ( corner & 2 ) ? f[ 1 ] : 1.0f - f[ 1 ] ) * ( ( corner & 4 ) ? f[ 2 ] : 1.0f - f[ 2 ] );
+			const float * cell = &data[ ( ( size_t( k ) * dims[ 1 ] + j ) * dims[ 0 ] + i ) * 2 ];
+			sum += t * cell[ 0 ];
+			weight += t * cell[ 1 ];
+		}
+		return sum / std::max( weight, 1e-20f );
+	}
+
+	std::vector< float > data;
+	localTonemapSettings settings;
+	int dims[ 3 ] = { 0, 0, 0 };
+	float minimum = 0.0f;		// log luminance at the center of the first range cell
+	float rangeSigma = 1.0f;	// as used, after the maxRangeCells limit
+	float baseMax = 0.0f;
+	float compression = 1.0f;
+};
+
+namespace postprocessDetail {
+	inline void RunStages ( block & p, int count, const postprocessSettings & s ) {
+		if ( s.displayType == 2 ) {
+			for ( int i = 0; i < count; i++ ) p.r[ i ] = p.g[ i ] = p.b[ i ] = 1.0f / p.depth[ i ];
+		} else if ( s.displayType == 0 ) {
+			AddDepthFog( p, count, s );
+			if ( s.lut && ColorGradeLUT::Bakeable( s.tonemapMode, s.gamma ) ) {
+				s.lut->Apply( p, count );
+			} else {
+				ColorGrade( p, count, s );
+			}
+		}
+	}
+
+	// display referred RGBA float to 8 bit, the same way as the 8 bit PostprocessPixels() below
+	inline void Quantize ( const float * in, uint8_t * out, size_t count ) {
+		for ( size_t i = 0; i < count; i++ ) {
+			for ( int c = 0; c < 3; c++ ) {
+				const float v = in[ i * 4 + c ];
+				out[ i * 4 + c ] = uint8_t( std::min( ( v > 0.0f ) ? v * 255.0f : 0.0f, 255.0f ) );
+			}
+			out[ i * 4 + 3 ] = 255;
+		}
+	}
+}
+
+// runs count pixels of RGBA float accumulator through the postprocess - normalDepth is the normal / depth accumulator,
+// can be null when fog is off. Output is display referred RGBA float with alpha 1, not yet clamped or quantized
+inline void PostprocessPixels ( const float * color, const float * normalDepth, float * out, size_t count, const postprocessSettings & s ) {
+	using namespace postprocessDetail;
+	block p;
+	for ( size_t base = 0; base < count; base += blockSize ) {
+		const int n = int( std::min( size_t( blockSize ), count - base ) );
+		LoadBlock( p, n, color + base * 4, normalDepth ? normalDepth + base * 4 : nullptr, s );
+		RunStages( p, n, s );
+		float * o = out + base * 4;
+		for ( int i = 0; i < n; i++ ) {
+			o[ i * 4 + 0 ] = p.r[ i ];
+			o[ i * 4 + 1 ] = p.g[ i ];
+			o[ i * 4 + 2 ] = p.b[ i ];
+			o[ i * 4 + 3 ] = 1.0f;
+		}
+	}
+}
+
+// same, straight to 8 bit the way the shader's imageStore does it - uint( value * 255 ), truncating, clamped to range
+inline void PostprocessPixels ( const float * color, const float * normalDepth, uint8_t * out, size_t count, const postprocessSettings & s ) {
+	using namespace postprocessDetail;
+	block p;
+	for ( size_t base = 0; base < count; base += blockSize ) {
+		const int n = int( std::min( size_t( blockSize ), count - base ) );
+		LoadBlock( p, n, color + base * 4, normalDepth ? normalDepth + base * 4 : nullptr, s );
+		RunStages( p, n, s );
+		uint8_t * o = out + base * 4;
+		for ( int i = 0; i < n; i++ ) {
+			// comparison order flushes NaN to zero
+			o[ i * 4 + 0 ] = uint8_t( std::min( ( p.r[ i ] > 0.0f ) ? p.r[ i ] * 255.0f : 0.0f, 255.0f ) );
+			o[ i * 4 + 1 ] = uint8_t( std::min( ( p.g[ i ] > 0.0f ) ? p.g[ i ] * 255.0f : 0.0f, 255.0f ) );
+			o[ i * 4 + 2 ] = uint8_t( std::min( ( p.b[ i ] > 0.0f ) ? p.b[ i ] * 255.0f : 0.0f, 255.0f ) );
+			o[ i * 4 + 3 ] = 255;
+		}
+	}
+}
+
+// whole images, split across the thread pool in bands of rows - normalDepth may be null, otherwise the same size as color
+// - localTonemapMode goes through the tonemap stage unchanged, then the grid runs over the whole image here - the
+//   one from s.localGrid, or one built from this image
+inline ImageF PostprocessImageF ( const ImageF & color, const ImageF * normalDepth, const postprocessSettings & s ) {
+	ImageF result( color.width, color.height );
+	ParallelFor( 0, int( color.height ), [ & ] ( int y ) {
+		const size_t offset = size_t( y ) * color.width * 4;
+		PostprocessPixels( &color.data[ offset ], normalDepth ? &normalDepth->data[ offset ] : nullptr, &result.data[ offset ], color.width, s );
+	}, 8 );
+	if ( s.displayType == 0 && s.tonemapMode == localTonemapMode ) {
+		if ( s.localGrid ) {
+			s.localGrid->Apply( result );
+		} else {
+			LocalTonemapGrid grid;
+			grid.Build( result, s.local );
+			grid.Apply( result );
+		}
+	}
+	return result;
+}
+
+inline Image PostprocessImage ( const ImageF & color, const ImageF * normalDepth, const postprocessSettings & s ) {
+	if ( s.displayType == 0 && s.tonemapMode == localTonemapMode ) {
+		// needs the whole image before anything is quantized
+		const ImageF display = PostprocessImageF( color, normalDepth, s );
+		Image result( color.width, color.height );
+		ParallelFor( 0, int( color.height ), [ & ] ( int y ) {
+			const size_t offset = size_t( y ) * color.width * 4;
+			postprocessDetail::Quantize( &display.data[ offset ], &result.data[ offset ], color.width );
+		}, 8 );
+		return result;
+	}
+	Image result( color.width, color.height );
+	ParallelFor( 0, int( color.height ), [ & ] ( int y ) {
+		const size_t offset = size_t( y ) * color.width * 4;
+		PostprocessPixels( &color.data[ offset ], normalDepth ? &normalDepth->data[ offset ] : nullptr, &result.data[ offset ], color.width, s );
+	}, 8 );
+	return result;
+}
+
+#endif
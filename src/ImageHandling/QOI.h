@@ -0,0 +1,94 @@
+#pragma once
+#ifndef QOI_H
+#define QOI_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// "Quite OK Image" encoder - https://qoiformat.org/qoi-specification.pdf
+	// lossless, single pass, no entropy coding - roughly PNG sized for rendered frames at a small fraction of the cost,
+	// which makes it a good fit for dumping frame sequences. Encode only, there's nothing in the engine that reads it back
+
+namespace qoiDetail {
+	constexpr uint8_t opIndex	= 0x00;	// 00xxxxxx
+	constexpr uint8_t opDiff	= 0x40;	// 01xxxxxx
+	constexpr uint8_t opLuma	= 0x80;	// 10xxxxxx
+	constexpr uint8_t opRun		= 0xC0;	// 11xxxxxx
+	constexpr uint8_t opRGB		= 0xFE;
+	constexpr uint8_t opRGBA	= 0xFF;
+
+	inline int Hash ( const uint8_t * p ) {
+		return ( p[ 0 ] * 3 + p[ 1 ] * 5 + p[ 2 ] * 7 + p[ 3 ] * 11 ) % 64;
+	}
+
+	inline void PutBigEndian ( std::vector< uint8_t > & out, uint32_t value ) {
+		out.push_back( value >> 24 ); out.push_back( ( value >> 16 ) & 0xFF );
+		out.push_back( ( value >> 8 ) & 0xFF ); out.push_back( value & 0xFF );
+	}
+}
+
+// 8 bit RGBA in, rows top to bottom - flipVertical reads the rows bottom up, for frames straight off the GPU
+inline std::vector< uint8_t > EncodeQOI ( const uint8_t * pixels, uint32_t width, uint32_t height, bool flipVertical = false ) {
+	using namespace qoiDetail;
+	std::vector< uint8_t > out;
+	out.reserve( 14 + size_t( width ) * height * 5 + 8 ); // worst case is every pixel as opRGBA
+
+	out.insert( out.end(), { 'q', 'o', 'i', 'f' } );
+	PutBigEndian( out, width );
+	PutBigEndian( out, height );
+	out.push_back( 4 ); // channels
+	out.push_back( 0 ); // sRGB with linear alpha
+
+	uint8_t index[ 64 ][ 4 ] = { { 0 } };
+	uint8_t previous[ 4 ] = { 0, 0, 0, 255 };
+	int run = 0;
+	const size_t numPixels = size_t( width ) * height;
+	for ( uint32_t y = 0; y < height; y++ ) {
+		const uint8_t * row = pixels + size_t( flipVertical ? height - 1 - y : y ) * width * 4;
+		for ( uint32_t x = 0; x < width; x++ ) {
+			const uint8_t * p = row + 4 * x;
+			const bool lastPixel = ( size_t( y ) * width + x + 1 == numPixels );
+			if ( std::memcmp( p, previous, 4 ) == 0 ) {
+				if ( ++run == 62 || lastPixel ) {
+					out.push_back( opRun | ( run - 1 ) );
+					run = 0;
+				}
+				continue;
+			}
+			if ( run > 0 ) {
+				out.push_back( opRun | ( run - 1 ) );
+				run = 0;
+			}
+
+			const int h = Hash( p );
+			if ( std::memcmp( index[ h ], p, 4 ) == 0 ) {
+				out.push_back( opIndex | h );
+			} else {
+				std::memcpy( index[ h ], p, 4 );
+				if ( p[ 3 ] == previous[ 3 ] ) {
+					const int8_t dr = int8_t( p[ 0 ] - previous[ 0 ] );
+					const int8_t dg = int8_t( p[ 1 ] - previous[ 1 ] );
+					const int8_t db = int8_t( p[ 2 ] - previous[ 2 ] );
+					const int drdg = dr - dg;
+					const int dbdg = db - dg;
+					if ( dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2 ) {
+						out.push_back( opDiff | ( dr + 2 ) << 4 | ( dg + 2 ) << 2 | ( db + 2 ) );
+					} else if ( drdg > -9 && drdg < 8 && dg > -33 && dg < 32 && dbdg > -9 && dbdg < 8 ) {
+						out.push_back( opLuma | ( dg + 32 ) );
+						out.push_back( ( drdg + 8 ) << 4 | ( dbdg + 8 ) );
+					} else {
+						out.insert( out.end(), { opRGB, p[ 0 ], p[ 1 ], p[ 2 ] } );
+					}
+				} else {
+					out.insert( out.end(), { opRGBA, p[ 0 ], p[ 1 ], p[ 2 ], p[ 3 ] } );
+				}
+			}
+			std::memcpy( previous, p, 4 );
+		}
+	}
+	out.insert( out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 } ); // end marker
+	return out;
+}
+
+#endif
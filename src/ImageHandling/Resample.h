@@ -0,0 +1,173 @@
+#pragma once
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include "../ImageHandling/PixelFormat.h"
+#include "../Threading/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// separable image resampling for any of the pixel formats, multithreaded across rows
+	// - filters are evaluated once per output column / row into a table of taps, then applied as a horizontal pass into a
+	//   float intermediate followed by a vertical pass - widened by the scale factor when shrinking, so there's no aliasing
+	// - 8-bit sRGB data is filtered in linear space and re-encoded, alpha stays linear ( SRGBA8 vs RGBA8 format )
+	// - edges clamp, sample centers are at pixel centers
+
+enum class resampleFilter {
+	box,		// area average when shrinking, nearest neighbor when enlarging
+	bilinear,	// triangle / tent
+	lanczos3,	// sharpest, rings a little on hard edges
+	mitchell	// B = C = 1/3, a good default either direction
+};
+
+namespace resampleDetail {
+	constexpr float pi = 3.14159265358979f;
+
+	inline float Radius ( resampleFilter filter ) {
+		switch ( filter ) {
+			case resampleFilter::box:		return 0.5f;
+			case resampleFilter::bilinear:	return 1.0f;
+			case resampleFilter::lanczos3:	return 3.0f;
+			case resampleFilter::mitchell:	return 2.0f;
+		}
+		return 1.0f;
+	}
+
+	inline float Sinc ( float x ) {
+		if ( std::abs( x ) < 1e-5f ) return 1.0f;
+		x *= pi;
+		return std::sin( x ) / x;
+	}
+
+	inline float Kernel ( resampleFilter filter, float x ) {
+		x = std::abs( x );
+		switch ( filter ) {
+			case resampleFilter::box:		return ( x < 0.5f ) ? 1.0f : 0.0f;
+			case resampleFilter::bilinear:	return std::max( 1.0f - x, 0.0f );
+			case resampleFilter::lanczos3:	return ( x < 3.0f ) ? Sinc( x ) * Sinc( x / 3.0f ) : 0.0f;
+			case resampleFilter::mitchell: {
+				constexpr float B = 1.0f / 3.0f, C = 1.0f / 3.0f;
+				if ( x < 1.0f ) {
+					return ( ( 12.0f - 9.0f * B - 6.0f * C ) * x * x * x + ( -18.0f + 12.0f * B + 6.0f * C ) * x * x + ( 6.0f - 2.0f * B ) ) / 6.0f;
+				} else if ( x < 2.0f ) {
+					return ( ( -B - 6.0f * C ) * x * x * x + ( 6.0f * B + 30.0f * C ) * x * x + ( -12.0f * B - 48.0f * C ) * x + ( 8.0f * B + 24.0f * C ) ) / 6.0f;
+				}
+				return 0.0f;
+			}
+		}
+		return 0.0f;
+	}
+
+	// for each output coordinate, a fixed number of ( source index, weight ) taps - unused taps have zero weight
+	struct tapTable {
+		int tapsPerOutput = 0;
+		std::vector< int > indices;
+		std::vector< float > weights;
+	};
+
+	inline tapTable BuildTaps ( int inSize, int outSize, resampleFilter filter ) {
+		tapTable t;
+		const float scale = float( inSize ) / float( outSize );
+		const float filterScale = std::max( scale, 1.0f ); // widen the kernel when shrinking
+		const float support = Radius( filter ) * filterScale;
+		t.tapsPerOutput = int( std::ceil( 2.0f * support ) ) + 1;
+		t.indices.resize( size_t( outSize ) * t.tapsPerOutput, 0 );
+		t.weights.resize( size_t( outSize ) * t.tapsPerOutput, 0.0f );
+
+		for ( int i = 0; i < outSize; i++ ) {
+			const float center = ( i + 0.5f ) * scale;
+			const int first = int( std::floor( center - support ) );
+			int * indices = &t.indices[ size_t( i ) * t.tapsPerOutput ];
+			float * weights = &t.weights[ size_t( i ) * t.tapsPerOutput ];
+			float total = 0.0f;
+			for ( int k = 0; k < t.tapsPerOutput; k++ ) {
+				const int j = first + k;
+				const float w = Kernel( filter, ( j + 0.5f - center ) / filterScale );
+				indices[ k ] = std::clamp( j, 0, inSize - 1 );
+				weights[ k ] = w;
+				total += w;
+			}
+			if ( total == 0.0f ) { // can only happen with box, right between two samples - take the nearest
+				indices[ 0 ] = std::clamp( int( center ), 0, inSize - 1 );
+				weights[ 0 ] = total = 1.0f;
+			}
+			for ( int k = 0; k < t.tapsPerOutput; k++ ) {
+				weights[ k ] /= total;
+			}
+		}
+		return t;
+	}
+}
+
+// resamples a 4 channel image of format F to a new size - in and out must not overlap
+template < pixelFormat F >
+void ResamplePixels ( const void * in, uint32_t inWidth, uint32_t inHeight, void * out, uint32_t outWidth, uint32_t outHeight, resampleFilter filter ) {
+	using namespace resampleDetail;
+	if ( inWidth == 0 || inHeight == 0 || outWidth == 0 || outHeight == 0 ) return;
+	const uint8_t * src = ( const uint8_t * ) in;
+	uint8_t * dst = ( uint8_t * ) out;
+	constexpr size_t bpp = BytesPerPixel< F >();
+
+	const tapTable horizontal = BuildTaps( inWidth, outWidth, filter );
+	const tapTable vertical = BuildTaps( inHeight, outHeight, filter );
+
+	// horizontal pass: every input row, decoded to float, filtered down / up to the output width
+	std::vector< float > intermediate( size_t( outWidth ) * inHeight * 4 );
+	ParallelFor( 0, int( inHeight ), [ & ] ( int y ) {
+		thread_local std::vector< float > decoded;
+		decoded.resize( size_t( inWidth ) * 4 );
+		DecodeToFloat< F >( src + size_t( y ) * inWidth * bpp, decoded.data(), size_t( inWidth ) * 4 );
+		float * row = &intermediate[ size_t( y ) * outWidth * 4 ];
+		for ( uint32_t x = 0; x < outWidth; x++ ) {
+			const int * indices = &horizontal.indices[ size_t( x ) * horizontal.tapsPerOutput ];
+			const float * weights = &horizontal.weights[ size_t( x ) * horizontal.tapsPerOutput ];
+			float sum[ 4 ] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for ( int k = 0; k < horizontal.tapsPerOutput; k++ ) {
+				const float * p = &decoded[ size_t( indices[ k ] ) * 4 ];
+				for ( int c = 0; c < 4; c++ ) sum[ c ] += weights[ k ] * p[ c ];
+			}
+			for ( int c = 0; c < 4; c++ ) row[ x * 4 + c ] = sum[ c ];
+		}
+	}, 4 );
+
+	// vertical pass: each output row is a weighted sum of whole intermediate rows, then encoded back to F
+	ParallelFor( 0, int( outHeight ), [ & ] ( int y ) {
+		thread_local std::vector< float > accumulated;
+		accumulated.assign( size_t( outWidth ) * 4, 0.0f );
+		const int * indices = &vertical.indices[ size_t( y ) * vertical.tapsPerOutput ];
+		const float * weights = &vertical.weights[ size_t( y ) * vertical.tapsPerOutput ];
+		for ( int k = 0; k < vertical.tapsPerOutput; k++ ) {
+			const float w = weights[ k ];
+			if ( w == 0.0f ) continue;
+			const float * row = &intermediate[ size_t( indices[ k ] ) * outWidth * 4 ];
+			for ( size_t i = 0; i < size_t( outWidth ) * 4; i++ ) {
+				accumulated[ i ] += w * row[ i ];
+			}
+		}
+		EncodeFromFloat< F >( accumulated.data(), dst + size_t( y ) * outWidth * bpp, size_t( outWidth ) * 4 );
+	}, 4 );
+}
+
+// successive halvings down to 1x1, not including the base level - levels[ 0 ] is half size
+template < pixelFormat F >
+std::vector< std::vector< typename pixelFormatTraits< F >::channelType > > BuildMipLevels ( const void * base, uint32_t width, uint32_t height,
+	resampleFilter filter = resampleFilter::box, std::vector< std::pair< uint32_t, uint32_t > > * sizes = nullptr ) {
+	using channelType = typename pixelFormatTraits< F >::channelType;
+	std::vector< std::vector< channelType > > levels;
+	const void * previous = base;
+	while ( width > 1 || height > 1 ) {
+		const uint32_t nextWidth = std::max( width / 2, 1u );
+		const uint32_t nextHeight = std::max( height / 2, 1u );
+		levels.emplace_back( size_t( nextWidth ) * nextHeight * 4 );
+		ResamplePixels< F >( previous, width, height, levels.back().data(), nextWidth, nextHeight, filter );
+		if ( sizes ) sizes->push_back( { nextWidth, nextHeight } );
+		previous = levels.back().data();
+		width = nextWidth;
+		height = nextHeight;
+	}
+	return levels;
+}
+
+#endif
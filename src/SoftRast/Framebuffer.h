@@ -0,0 +1,125 @@
+#pragma once
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "../ImageHandling/Image.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// SoftRast render target - one float of depth and four bytes of color per pixel, in the order the rasterizer walks them
+	// - 64x64 tiles, the same ones DrawModel bins into, so each raster thread writes its own contiguous range
+	// - inside a tile, 8x8 blocks row major, and inside a block, pixels row major - one block is 64 consecutive depths,
+	//   so the block depth test, the block max and the per pixel loop over a block all run over a flat array
+	// - padded out to whole tiles. Padding depth is -max, so it never raises a block's farthest depth, and it's never
+	//   written, since everything drawn is clipped to width x height
+	// - Image / ImageF copies are only made on request, by ResolveColor and ResolveDepth
+	// - for deferred shading there's a visibility buffer alongside, in the same layout - which triangle is visible at
+	//   each pixel, and where on it. It's only allocated once something asks for it
+
+// what the deferred shading pass needs to find a pixel's surface again - the first barycentric is 1 - b1 - b2
+struct visibilitySample {
+	uint32_t triangle;
+	float b1;
+	float b2;
+};
+
+class Framebuffer {
+public:
+	static constexpr int tileSize = 64;
+	static constexpr int blockSize = 8;
+	static constexpr int blockPixels = blockSize * blockSize;
+	static constexpr int tilePixels = tileSize * tileSize;
+	static constexpr uint32_t noTriangle = ~0u;
+
+	Framebuffer ( uint32_t x = 0, uint32_t y = 0 ) : width( x ), height( y ) {
+		tilesX = ( int( width ) + tileSize - 1 ) / tileSize;
+		tilesY = ( int( height ) + tileSize - 1 ) / tileSize;
+		depth.resize( size_t( tilesX ) * tilesY * tilePixels );
+		color.resize( depth.size() );
+		Clear();
+	}
+
+	// depth defaults to the far value ImageF starts with
+	void Clear ( rgba clearColor = rgba(), float clearDepth = positiveMax ) {
+		std::fill( color.begin(), color.end(), clearColor );
+		std::fill( depth.begin(), depth.end(), -std::numeric_limits< float >::max() );
+		for ( uint32_t y = 0; y < height; y++ ) {
+			for ( uint32_t x = 0; x < width; x += blockSize ) {
+				const size_t index = Index( x, y );
+				std::fill( &depth[ index ], &depth[ index ] + std::min( uint32_t( blockSize ), width - x ), clearDepth );
+			}
+		}
+	}
+
+	// allocates the visibility buffer if needed, and marks every pixel as showing no triangle
+	void ClearVisibility () {
+		visibility.resize( depth.size() );
+		std::fill( visibility.begin(), visibility.end(), visibilitySample { noTriangle, 0.0f, 0.0f } );
+	}
+
+	bool Contains ( int x, int y ) const { return x >= 0 && y >= 0 && x < int( width ) && y < int( height ); }
+
+	// first pixel of the 8x8 block with its top left corner at ( bx, by ), the rest follow row by row
+	size_t BlockIndex ( int bx, int by ) const {
+		return ( size_t( by / tileSize ) * tilesX + bx / tileSize ) * tilePixels +
+			( ( by % tileSize ) / blockSize * ( tileSize / blockSize ) + ( bx % tileSize ) / blockSize ) * blockPixels;
+	}
+
+	size_t Index ( int x, int y ) const {
+		return BlockIndex( x & ~( blockSize - 1 ), y & ~( blockSize - 1 ) ) + ( y % blockSize ) * blockSize + x % blockSize;
+	}
+
+	// unchecked - see Contains
+	float Depth ( int x, int y ) const { return depth[ Index( x, y ) ]; }
+	rgba Color ( int x, int y ) const { return color[ Index( x, y ) ]; }
+	void Write ( int x, int y, rgba c, float d ) {
+		const size_t index = Index( x, y );
+		color[ index ] = c;
+		depth[ index ] = d;
+	}
+
+	// farthest depth in the 8x8 block at ( bx, by )
+	float BlockMaxDepth ( int bx, int by ) const {
+		const float * block = &depth[ BlockIndex( bx, by ) ];
+		float farthest = block[ 0 ];
+		for ( int i = 1; i < blockPixels; i++ ) farthest = std::max( farthest, block[ i ] );
+		return farthest;
+	}
+
+	// row major copies, top row first like the rest of Image
+	Image ResolveColor () const {
+		Image result( width, height );
+		for ( uint32_t y = 0; y < height; y++ ) {
+			for ( uint32_t x = 0; x < width; x++ ) {
+				std::memcpy( &result.data[ ( size_t( y ) * width + x ) * 4 ], &color[ Index( x, y ) ], 4 );
+			}
+		}
+		return result;
+	}
+
+	// depth in red, green and blue, alpha at one
+	ImageF ResolveDepth () const {
+		ImageF result( width, height );
+		for ( uint32_t y = 0; y < height; y++ ) {
+			for ( uint32_t x = 0; x < width; x++ ) {
+				const float d = depth[ Index( x, y ) ];
+				float * pixel = &result.data[ ( size_t( y ) * width + x ) * 4 ];
+				pixel[ 0 ] = pixel[ 1 ] = pixel[ 2 ] = d;
+				pixel[ 3 ] = 1.0f;
+			}
+		}
+		return result;
+	}
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	int tilesX = 0;
+	int tilesY = 0;
+	std::vector< float > depth;
+	std::vector< rgba > color;
+	std::vector< visibilitySample > visibility;	// empty until ClearVisibility
+};
+
+#endif
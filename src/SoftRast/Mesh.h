@@ -0,0 +1,210 @@
+#pragma once
+#ifndef MESH_H
+#define MESH_H
+
+#include "../engine/includes.h"
+
+#include <unordered_map>
+
+struct triangle {
+	vec3 p0, p1, p2; // per vertex position
+	vec3 t0, t1, t2; // per vertex texcoord xy, texture index
+	vec3 n0, n1, n2; // per vertex normals
+	vec3 c0, c1, c2; // per vertex color
+
+	vec3 t; // tangent
+	vec3 b; // bitangent
+};
+
+// indexed mesh - one copy of each distinct vertex, in separate streams per attribute, and three indices per triangle
+	// - AddTriangle merges vertices that match exactly in every attribute ( the material index is part of the texcoord,
+	//   so vertices on a material boundary stay separate )
+	// - OptimizeVertexCache reorders the triangles so ones sharing vertices are drawn close together ( Tipsify, Sander,
+	//   Nehab and Barczak 2007 ), then renumbers the vertices in order of first use, so the streams are read roughly in
+	//   order too
+namespace meshDetail {
+	// all the attributes of a vertex, compared bitwise
+	static_assert( sizeof( vec3 ) == 3 * sizeof( float ), "vertex keys are copied from packed vec3s" );
+	struct vertexKey {
+		float values[ 12 ];
+		bool operator == ( const vertexKey &other ) const { return std::memcmp( values, other.values, sizeof( values ) ) == 0; }
+	};
+
+	struct vertexKeyHash {
+		size_t operator () ( const vertexKey &k ) const {
+			uint64_t h = 0xcbf29ce484222325ull; // FNV-1a
+			const uint8_t *bytes = ( const uint8_t * ) k.values;
+			for ( size_t i = 0; i < sizeof( k.values ); i++ ) {
+				h ^= bytes[ i ];
+				h *= 0x100000001b3ull;
+			}
+			return size_t( h );
+		}
+	};
+}
+
+struct indexedMesh {
+	// per vertex
+	std::vector< vec3 > positions;
+	std::vector< vec3 > texCoords; // xy, texture index
+	std::vector< vec3 > normals;
+	std::vector< vec3 > colors;
+
+	// per triangle
+	std::vector< uint32_t > indices;
+	std::vector< vec3 > tangents;
+	std::vector< vec3 > bitangents;
+
+	size_t VertexCount () const { return positions.size(); }
+	size_t TriangleCount () const { return indices.size() / 3; }
+
+	void AddTriangle ( const triangle &t ) {
+		AddVertex( t.p0, t.t0, t.n0, t.c0 );
+		AddVertex( t.p1, t.t1, t.n1, t.c1 );
+		AddVertex( t.p2, t.t2, t.n2, t.c2 );
+		tangents.push_back( t.t );
+		bitangents.push_back( t.b );
+	}
+
+	// the old one struct per triangle form, for single triangle drawing
+	triangle Triangle ( size_t i ) const {
+		const uint32_t a = indices[ 3 * i ], b = indices[ 3 * i + 1 ], c = indices[ 3 * i + 2 ];
+		triangle t;
+		t.p0 = positions[ a ]; t.p1 = positions[ b ]; t.p2 = positions[ c ];
+		t.t0 = texCoords[ a ]; t.t1 = texCoords[ b ]; t.t2 = texCoords[ c ];
+		t.n0 = normals[ a ]; t.n1 = normals[ b ]; t.n2 = normals[ c ];
+		t.c0 = colors[ a ]; t.c1 = colors[ b ]; t.c2 = colors[ c ];
+		t.t = tangents[ i ];
+		t.b = bitangents[ i ];
+		return t;
+	}
+
+	void Clear () {
+		positions.clear(); texCoords.clear(); normals.clear(); colors.clear();
+		indices.clear(); tangents.clear(); bitangents.clear();
+		lookup.clear();
+	}
+
+	// cacheSize is the FIFO size the order is tuned for
+	void OptimizeVertexCache ( const int cacheSize = 16 ) {
+		const int numVertices = int( VertexCount() );
+		const int numTriangles = int( TriangleCount() );
+		if ( numTriangles == 0 ) return;
+
+		// triangles using each vertex, as offsets into one array
+		std::vector< int > adjacencyStart( numVertices + 1, 0 );
+		for ( uint32_t v : indices ) adjacencyStart[ v + 1 ]++;
+		std::partial_sum( adjacencyStart.begin(), adjacencyStart.end(), adjacencyStart.begin() );
+		std::vector< int > adjacency( indices.size() );
+		std::vector< int > fill( adjacencyStart.begin(), adjacencyStart.end() - 1 );
+		for ( int i = 0; i < int( indices.size() ); i++ ) adjacency[ fill[ indices[ i ] ]++ ] = i / 3;
+
+		// Tipsify - fan out from a vertex, emitting all its remaining triangles, then move to the vertex among the ones
+		// just touched that will still be in the cache and has the most triangles left, falling back to the most
+		// recently touched vertex with any left, then to scanning forward
+		std::vector< int > live( numVertices ), cacheTime( numVertices, 0 ), deadEnd;
+		for ( int v = 0; v < numVertices; v++ ) live[ v ] = adjacencyStart[ v + 1 ] - adjacencyStart[ v ];
+		std::vector< bool > emitted( numTriangles, false );
+		std::vector< int > order;
+		order.reserve( numTriangles );
+		std::vector< int > candidates;
+		int current = 0, timestamp = cacheSize + 1, cursor = 1;
+		while ( current >= 0 ) {
+			candidates.clear();
+			for ( int a = adjacencyStart[ current ]; a < adjacencyStart[ current + 1 ]; a++ ) {
+				const int t = adjacency[ a ];
+				if ( emitted[ t ] ) continue;
+				emitted[ t ] = true;
+				order.push_back( t );
+				for ( int k = 0; k < 3; k++ ) {
+					const int v = int( indices[ 3 * t + k ] );
+					deadEnd.push_back( v );
+					candidates.push_back( v );
+					live[ v ]--;
+					if ( timestamp - cacheTime[ v ] > cacheSize ) cacheTime[ v ] = timestamp++;
+				}
+			}
+
+			int next = -1, best = -1;
+			for ( int v : candidates ) {
+				if ( live[ v ] <= 0 ) continue;
+				const int age = timestamp - cacheTime[ v ];
+				const int priority = ( age + 2 * live[ v ] <= cacheSize ) ? age : 0;
+				if ( priority > best ) {
+					best = priority;
+					next = v;
+				}
+			}
+			if ( next < 0 ) {
+				while ( !deadEnd.empty() && next < 0 ) {
+					if ( live[ deadEnd.back() ] > 0 ) next = deadEnd.back();
+					deadEnd.pop_back();
+				}
+			}
+			if ( next < 0 ) {
+				while ( cursor < numVertices && live[ cursor ] <= 0 ) cursor++;
+				next = ( cursor < numVertices ) ? cursor : -1;
+			}
+			current = next;
+		}
+
+		// triangles in the new order, and vertices renumbered by first use - unreferenced vertices are dropped
+		std::vector< uint32_t > remap( numVertices, ~0u );
+		std::vector< uint32_t > newIndices( indices.size() );
+		std::vector< vec3 > newTangents( numTriangles ), newBitangents( numTriangles );
+		uint32_t used = 0;
+		for ( int i = 0; i < numTriangles; i++ ) {
+			const int t = order[ i ];
+			for ( int k = 0; k < 3; k++ ) {
+				uint32_t &r = remap[ indices[ 3 * t + k ] ];
+				if ( r == ~0u ) r = used++;
+				newIndices[ 3 * i + k ] = r;
+			}
+			newTangents[ i ] = tangents[ t ];
+			newBitangents[ i ] = bitangents[ t ];
+		}
+		auto Permute = [ & ] ( std::vector< vec3 > &stream ) {
+			std::vector< vec3 > reordered( used );
+			for ( int v = 0; v < numVertices; v++ ) if ( remap[ v ] != ~0u ) reordered[ remap[ v ] ] = stream[ v ];
+			stream.swap( reordered );
+		};
+		Permute( positions ); Permute( texCoords ); Permute( normals ); Permute( colors );
+		indices.swap( newIndices );
+		tangents.swap( newTangents );
+		bitangents.swap( newBitangents );
+		lookup.clear(); // numbering changed, and loading is done
+	}
+
+	// average cache misses per triangle for a FIFO cache of this size - 3.0 is no reuse at all, 0.5 is ideal for a grid
+	float AverageCacheMissRatio ( const int cacheSize = 16 ) const {
+		if ( indices.empty() ) return 0.0f;
+		std::deque< uint32_t > fifo;
+		size_t misses = 0;
+		for ( uint32_t v : indices ) {
+			if ( std::find( fifo.begin(), fifo.end(), v ) != fifo.end() ) continue;
+			misses++;
+			fifo.push_back( v );
+			if ( int( fifo.size() ) > cacheSize ) fifo.pop_front();
+		}
+		return float( misses ) / float( TriangleCount() );
+	}
+
+private:
+	void AddVertex ( const vec3 p, const vec3 t, const vec3 n, const vec3 c ) {
+		meshDetail::vertexKey key;
+		const vec3 attributes[ 4 ] = { p, t, n, c };
+		std::memcpy( key.values, attributes, sizeof( key.values ) );
+		auto result = lookup.emplace( key, uint32_t( positions.size() ) );
+		if ( result.second ) {
+			positions.push_back( p );
+			texCoords.push_back( t );
+			normals.push_back( n );
+			colors.push_back( c );
+		}
+		indices.push_back( result.first->second );
+	}
+
+	std::unordered_map< meshDetail::vertexKey, uint32_t, meshDetail::vertexKeyHash > lookup;
+};
+
+#endif
@@ -0,0 +1,295 @@
+#pragma once
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "../ImageHandling/AssetCache.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// processed meshes, persisted next to the decoded images in the asset cache directory
+	// - LoadModel writes one after parsing an OBJ: the deduplicated, reordered vertex and index streams, the material
+	//   table with its texture paths, and every file that went into it ( the OBJ and its MTL libraries )
+	// - later loads map the file and copy the streams straight out - no parsing, no vertex merging, no reordering
+	// - each source file is checked by modification time and size first, and only hashed when those differ, so touching
+	//   a file costs one hash ( the new time is written back on a match ) but doesn't throw the cache away, and editing
+	//   it does
+	// - meshCacheVersion goes up whenever the layout, or the processing that produced the streams, changes
+
+constexpr uint32_t meshCacheVersion = 1;
+
+// what LoadModel needs from a material, texture paths with the search path already applied, empty for none
+struct meshMaterial {
+	std::string name;
+	std::string diffuse;
+	std::string normal;
+};
+
+// a file the mesh was built from
+struct meshDependency {
+	std::string path;
+	int64_t modified = 0;
+	uint64_t size = 0;
+	uint64_t hash = 0;
+};
+
+struct meshCacheHeader {
+	char magic[ 8 ] = { 'S', 'I', 'R', 'E', 'N', 'M', 'C', '\0' };
+	uint32_t version = meshCacheVersion;
+	uint32_t vec3Size = sizeof( vec3 );	// the streams are written as the in memory vec3s
+	uint64_t vertexCount = 0;
+	uint64_t triangleCount = 0;
+	uint64_t materialCount = 0;
+	uint64_t dependencyCount = 0;
+	uint64_t tableOffset = 0;			// materials, then dependencies, after the streams
+	uint64_t tableSize = 0;
+	uint64_t fileSize = 0;
+};
+static_assert( sizeof( meshCacheHeader ) <= assetCachePageSize, "mesh cache header must fit in the first page" );
+
+namespace meshCacheDetail {
+	constexpr size_t alignment = 64;
+	inline size_t Align ( size_t offset ) { return ( offset + alignment - 1 ) & ~( alignment - 1 ); }
+
+	inline std::string CachePathFor ( const std::string & modelPath, const std::string & mtlSearchPath ) {
+		const std::string key = modelPath + '\n' + mtlSearchPath;
+		std::stringstream ss;
+		ss << assetCacheDirectory << std::hex << std::setw( 16 ) << std::setfill( '0' )
+			<< HashBytes( ( const uint8_t * ) key.data(), key.size() ) << ".mesh";
+		return ss.str();
+	}
+
+	inline uint64_t HashFile ( const std::string & path ) {
+		mappedFile file( path );
+		return file.Valid() ? HashBytes( file.base, file.size ) : 0;
+	}
+
+	// still matches what the mesh was built from - cheap check first, the hash only when that fails. A hash match under
+	// a new timestamp updates d.modified and sets touched, so the caller can record it and skip the hash next time
+	inline bool Current ( meshDependency & d, bool & touched ) {
+		int64_t modified;
+		uint64_t size;
+		touched = false;
+		if ( !StatFile( d.path, modified, size ) || size != d.size ) return false;
+		if ( modified == d.modified ) return true;
+		if ( HashFile( d.path ) != d.hash ) return false;
+		d.modified = modified;
+		touched = true;
+		return true;
+	}
+
+	// in place, over the modified fields of the dependency table - failure only costs the hashes again next load
+	inline void RewriteModified ( const std::string & cachePath, const std::vector< std::pair< uint64_t, int64_t > > & fields ) {
+		std::fstream file( cachePath, std::ios::binary | std::ios::in | std::ios::out );
+		for ( auto & f : fields ) {
+			if ( !file.is_open() ) return;
+			file.seekp( f.first );
+			file.write( ( const char * ) &f.second, sizeof( f.second ) );
+		}
+	}
+
+	// length prefixed strings and plain values, for the material and dependency table
+	struct tableWriter {
+		std::vector< uint8_t > bytes;
+		template < typename T > void Value ( const T & v ) {
+			const uint8_t * p = ( const uint8_t * ) &v;
+			bytes.insert( bytes.end(), p, p + sizeof( T ) );
+		}
+		void String ( const std::string & s ) {
+			Value( uint32_t( s.size() ) );
+			bytes.insert( bytes.end(), s.begin(), s.end() );
+		}
+	};
+
+	struct tableReader {
+		const uint8_t * data;
+		size_t size;
+		size_t offset = 0;
+		bool ok = true;
+		template < typename T > T Value () {
+			T v{};
+			if ( offset + sizeof( T ) > size ) { ok = false; return v; }
+			std::memcpy( &v, data + offset, sizeof( T ) );
+			offset += sizeof( T );
+			return v;
+		}
+		std::string String () {
+			const uint32_t length = Value< uint32_t >();
+			if ( !ok || offset + length > size ) { ok = false; return std::string(); }
+			std::string s( ( const char * ) data + offset, length );
+			offset += length;
+			return s;
+		}
+	};
+
+	// the streams, in file order
+	template < typename M, typename F >
+	void ForEachStream ( M & mesh, F && f ) {
+		f( mesh.positions.data(), mesh.positions.size() * sizeof( vec3 ) );
+		f( mesh.texCoords.data(), mesh.texCoords.size() * sizeof( vec3 ) );
+		f( mesh.normals.data(), mesh.normals.size() * sizeof( vec3 ) );
+		f( mesh.colors.data(), mesh.colors.size() * sizeof( vec3 ) );
+		f( mesh.indices.data(), mesh.indices.size() * sizeof( uint32_t ) );
+		f( mesh.tangents.data(), mesh.tangents.size() * sizeof( vec3 ) );
+		f( mesh.bitangents.data(), mesh.bitangents.size() * sizeof( vec3 ) );
+	}
+}
+
+// MTL libraries named by the OBJ, as paths under the search path - the OBJ text is scanned for mtllib lines
+inline std::vector< std::string > MaterialLibraries ( const std::string & modelPath, const std::string & mtlSearchPath ) {
+	std::vector< std::string > libraries;
+	mappedFile obj( modelPath );
+	if ( !obj.Valid() ) return libraries;
+	const char * text = ( const char * ) obj.base;
+	const std::string keyword = "mtllib";
+	for ( size_t line = 0; line < obj.size; ) {
+		size_t end = line;
+		while ( end < obj.size && text[ end ] != '\n' ) end++;
+		if ( end - line > keyword.size() && std::memcmp( text + line, keyword.data(), keyword.size() ) == 0 &&
+			( text[ line + keyword.size() ] == ' ' || text[ line + keyword.size() ] == '\t' ) ) {
+			std::stringstream names( std::string( text + line + keyword.size(), end - line - keyword.size() ) );
+			std::string name;
+			while ( names >> name ) libraries.push_back( mtlSearchPath + name );
+		}
+		line = end + 1;
+	}
+	return libraries;
+}
+
+// fills mesh and materials from the cache file for this model, if there is one and every source file still matches
+inline bool ReadMeshCache ( const std::string & modelPath, const std::string & mtlSearchPath, indexedMesh & mesh, std::vector< meshMaterial > & materials ) {
+	using namespace meshCacheDetail;
+	const std::string cachePath = CachePathFor( modelPath, mtlSearchPath );
+	mappedFile cached( cachePath );
+	if ( !cached.Valid() || cached.size < assetCachePageSize ) return false;
+
+	meshCacheHeader header;
+	std::memcpy( &header, cached.base, sizeof( header ) );
+	if ( std::memcmp( header.magic, meshCacheHeader().magic, sizeof( header.magic ) ) != 0 ||
+		header.version != meshCacheVersion || header.vec3Size != sizeof( vec3 ) || header.fileSize != cached.size ||
+		header.tableOffset > cached.size || header.tableSize > cached.size - header.tableOffset ||
+		// counts bounded by the file size before anything gets allocated from them, the streams are checked exactly below
+		header.vertexCount > cached.size || header.triangleCount > cached.size || header.materialCount > header.tableSize ) {
+		return false;
+	}
+
+	// sources first - a stale cache is as good as none
+	tableReader table = { cached.base + header.tableOffset, header.tableSize };
+	std::vector< meshMaterial > tableMaterials( header.materialCount );
+	for ( auto & m : tableMaterials ) {
+		m.name = table.String();
+		m.diffuse = table.String();
+		m.normal = table.String();
+	}
+	std::vector< std::pair< uint64_t, int64_t > > touchedFields; // file offset and new value of each stale modified time
+	for ( uint64_t i = 0; i < header.dependencyCount && table.ok; i++ ) {
+		meshDependency d;
+		d.path = table.String();
+		const uint64_t modifiedOffset = header.tableOffset + table.offset;
+		d.modified = table.Value< int64_t >();
+		d.size = table.Value< uint64_t >();
+		d.hash = table.Value< uint64_t >();
+		bool touched;
+		if ( !table.ok || !Current( d, touched ) ) return false;
+		if ( touched ) touchedFields.push_back( { modifiedOffset, d.modified } );
+	}
+	if ( !table.ok ) return false;
+
+	mesh.Clear();
+	mesh.positions.resize( header.vertexCount );
+	mesh.texCoords.resize( header.vertexCount );
+	mesh.normals.resize( header.vertexCount );
+	mesh.colors.resize( header.vertexCount );
+	mesh.indices.resize( header.triangleCount * 3 );
+	mesh.tangents.resize( header.triangleCount );
+	mesh.bitangents.resize( header.triangleCount );
+	size_t offset = assetCachePageSize;
+	bool fits = true;
+	ForEachStream( mesh, [ & ] ( void * destination, size_t bytes ) {
+		fits = fits && offset + bytes <= header.tableOffset;
+		if ( fits ) std::memcpy( destination, cached.base + offset, bytes );
+		offset = Align( offset + bytes );
+	} );
+	// sizes can all be consistent with the contents still damaged - an index past the vertices would be read through
+	// by everything downstream, so those throw the cache away too
+	fits = fits && std::all_of( mesh.indices.begin(), mesh.indices.end(), [ & ] ( uint32_t i ) { return i < header.vertexCount; } );
+	if ( !fits ) {
+		mesh.Clear();
+		return false;
+	}
+	materials = std::move( tableMaterials );
+
+	// same contents under new timestamps - record them, so the next load takes the cheap path again
+	if ( !touchedFields.empty() ) RewriteModified( cachePath, touchedFields );
+	return true;
+}
+
+// header page, then the streams at 64 byte alignment, then the table - written to a temporary and renamed, like the
+// image cache, so an interrupted run never leaves a partial file behind
+inline void WriteMeshCache ( const std::string & modelPath, const std::string & mtlSearchPath, const indexedMesh & mesh,
+	const std::vector< meshMaterial > & materials, const std::vector< std::string > & sources ) {
+	using namespace meshCacheDetail;
+
+	tableWriter table;
+	for ( auto & m : materials ) {
+		table.String( m.name );
+		table.String( m.diffuse );
+		table.String( m.normal );
+	}
+	uint64_t dependencyCount = 0;
+	for ( auto & path : sources ) {
+		meshDependency d;
+		d.path = path;
+		if ( !StatFile( path, d.modified, d.size ) ) return; // can't validate it later, so don't cache it
+		d.hash = HashFile( path );
+		table.String( d.path );
+		table.Value( d.modified );
+		table.Value( d.size );
+		table.Value( d.hash );
+		dependencyCount++;
+	}
+
+	std::vector< std::pair< const void *, size_t > > streams;
+	ForEachStream( mesh, [ & ] ( const void * source, size_t bytes ) {
+		streams.push_back( { source, bytes } );
+	} );
+	size_t offset = assetCachePageSize;
+	for ( auto & s : streams ) offset = Align( offset + s.second );
+
+	meshCacheHeader header;
+	header.vertexCount = mesh.VertexCount();
+	header.triangleCount = mesh.TriangleCount();
+	header.materialCount = materials.size();
+	header.dependencyCount = dependencyCount;
+	header.tableOffset = offset;
+	header.tableSize = table.bytes.size();
+	header.fileSize = offset + table.bytes.size();
+
+	std::error_code ec;
+	std::filesystem::create_directories( assetCacheDirectory, ec );
+	const std::string cachePath = CachePathFor( modelPath, mtlSearchPath );
+	const std::string tempPath = cachePath + ".tmp" + std::to_string( getpid() );
+	std::ofstream file( tempPath, std::ios::binary );
+	std::vector< uint8_t > padding( assetCachePageSize, 0 );
+	std::memcpy( padding.data(), &header, sizeof( header ) );
+	file.write( ( const char * ) padding.data(), padding.size() );
+	std::fill( padding.begin(), padding.end(), 0 );
+	size_t written = assetCachePageSize;
+	for ( auto & s : streams ) {
+		file.write( ( const char * ) s.first, s.second );
+		written += s.second;
+		file.write( ( const char * ) padding.data(), Align( written ) - written );
+		written = Align( written );
+	}
+	file.write( ( const char * ) table.bytes.data(), table.bytes.size() );
+	file.close();
+	if ( file.good() ) {
+		std::filesystem::rename( tempPath, cachePath, ec );
+	} else {
+		std::filesystem::remove( tempPath, ec );
+	}
+}
+
+#endif
@@ -3,16 +3,10 @@
 
 #include "../ModelLoading/TinyOBJLoader/tiny_obj_loader.h"
 #include "../engine/includes.h"
-
-struct triangle {
-	vec3 p0, p1, p2; // per vertex position
-	vec3 t0, t1, t2; // per vertex texcoord xy, texture index
-	vec3 n0, n1, n2; // per vertex normals
-	vec3 c0, c1, c2; // per vertex color
-
-	vec3 t; // tangent
-	vec3 b; // bitangent
-};
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "TextureStreaming.h"
+#include "Framebuffer.h"
 
 // helper functions
 static const float RemapRange ( const float value, const float iMin, const float iMax, const float oMin, const float oMax ) {
@@ -21,10 +15,7 @@ static const float RemapRange ( const float value, const float iMin, const float
 
 static const rgba RGBAFromVec4( vec4 color ) {
 	rgba temp;
-	temp.r = uint8_t( RemapRange( color.r, 0.0f, 1.0f, 0.0f, 255.0f ) );
-	temp.g = uint8_t( RemapRange( color.g, 0.0f, 1.0f, 0.0f, 255.0f ) );
-	temp.b = uint8_t( RemapRange( color.b, 0.0f, 1.0f, 0.0f, 255.0f ) );
-	temp.a = uint8_t( RemapRange( color.a, 0.0f, 1.0f, 0.0f, 255.0f ) );
+	ConvertPixels< pixelFormat::RGBA32F, pixelFormat::RGBA8 >( &color[ 0 ], &temp, 1 );
 	return temp;
 }
 
@@ -82,58 +73,31 @@ constexpr bool verboseDraw = false;
 class SoftRast {
 public:
 	SoftRast( uint32_t x = 0, uint32_t y = 0 ) : width( x ), height( y ) {
-		Color = Image( x, y );
-		Depth = ImageF( x, y );
-		BlueNoise = Image( "src/noise/blueNoise.png" ); // for sample jitter, write helper function to return some samples
+		framebuffer = Framebuffer( x, y );
+		projection = glm::perspectiveLH_ZO( glm::radians( 30.0f ), ( y == 0 ) ? 1.0f : float( x ) / float( y ), 0.1f, 100.0f );
+		BlueNoise = AssetCache::Get().LoadImage( "src/noise/blueNoise.png" ); // for sample jitter, write helper function to return some samples
 		// init std::random generator as member variable, for picking blue noise sample point - then sweep along x or y to get low discrepancy sequence
 	}
 
 	vec4 BlueNoiseRef ( ivec2 loc ) {
-		rgba value = BlueNoise.GetAtXY( loc.x % BlueNoise.width, loc.y % BlueNoise.height );
-		return vec4( value.r / 255.0f, value.g / 255.0f, value.b / 255.0f, value.a / 255.0f ) - vec4( 0.5f );
+		rgba value = BlueNoise->GetAtXY( loc.x % BlueNoise->width, loc.y % BlueNoise->height );
+		vec4 returnVal;
+		ConvertPixels< pixelFormat::RGBA8, pixelFormat::RGBA32F >( &value, &returnVal[ 0 ], 1 );
+		return returnVal - vec4( 0.5f );
 	}
 
-	std::vector<Image> texSet;
+	// two per material, diffuse then normal - native size, mip levels loaded as they're sampled ( see TextureStreaming.h )
+	TextureStreamer textures;
 	void LoadTex ( string texPath ) {
-		if ( !texPath.empty() ) {
-			Image temp( texPath );
-			temp.FlipVertical();
-
-			// hackity hack hack - pre-squared the chain texture, only non-square texture in the set
-			if ( temp.width == 256 ) {
-				temp.Resize( 8.0f );
-			} else if ( temp.width == 512 ) {
-				temp.Resize( 4.0f );
-			} else if ( temp.width == 1024 ) {
-				temp.Resize( 2.0f );
-			}
-
-			if ( verboseLoad ) {
-				cout << "    loading ";
-				cout << temp.width << "x" << temp.height << " image" << newline;
-				cout << "    done" << endl << endl;
-			}
-
-			texSet.push_back( temp );
-		} else {
-			Image temp( 2048, 2048 );
-
-			if ( verboseLoad ) {
-				cout << "    image defaulting";
-				cout << temp.width << "x" << temp.height << " image" << newline;
-				cout << "    done" << endl << endl;
-			}
-
-			texSet.push_back( temp );
+		textures.Add( texPath );
+		if ( verboseLoad ) {
+			cout << "    texture " << ( texPath.empty() ? "defaulting to blank" : texPath ) << newline;
 		}
 	}
-	vec4 TexRef ( vec2 texCoord, int id ) {
-		uint32_t x = uint32_t( texCoord.x * float( texSet[ id ].width ) );
-		uint32_t y = uint32_t( texCoord.y * float( texSet[ id ].height ) );
-		rgba val = texSet[ id ].GetAtXY( x, y );
-		vec4 returnVal = vec4( float( val.r ) / 255.0f, float( val.g ) / 255.0f, float( val.b ) / 255.0f, float( val.a ) / 255.0f );
-		// cout << returnVal.x << " " << returnVal.y << " " << returnVal.z << " " << returnVal.w << newline;
-		return returnVal;
+
+	// diffuse texture of the material - ddx, ddy are the texCoord change over one pixel, for picking the mip level
+	vec4 TexRef ( vec2 texCoord, int materialID, vec2 ddx, vec2 ddy ) {
+		return textures.Sample( 2 * materialID, texCoord, ddx, ddy );
 	}
 
 	const vec3 NDCToPixelCoords ( vec3 NDCCoord ) {
@@ -149,10 +113,9 @@ public:
 		position = NDCToPixelCoords( position );
 		// TODO: support for alpha blending, based on existing buffer color + input color
 		vec2 positionXY = vec2( position.x, position.y );
-		if ( glm::clamp( positionXY, vec2( 0.0f ), vec2( width, height ) ) == positionXY && // point is on screen
-			Depth.GetAtXY( uint32_t( position.x ), uint32_t( position.y ) ).r > position.z ) { // depth testing
-			Color.SetAtXY( position.x, position.y, RGBAFromVec4( color ) );
-			Depth.SetAtXY( position.x, position.y, { position.z, 0.0f, 0.0f, 0.0f } );
+		if ( framebuffer.Contains( int( positionXY.x ), int( positionXY.y ) ) && // point is on screen
+			framebuffer.Depth( int( positionXY.x ), int( positionXY.y ) ) > position.z ) { // depth testing
+			framebuffer.Write( int( positionXY.x ), int( positionXY.y ), RGBAFromVec4( color ), position.z );
 		}
 	}
 
@@ -183,16 +146,9 @@ public:
 		for ( int x = x0; x <= x1; x++ ) {
 			// interpolated depth value
 			float depth = RemapRange( float( x ), float( x0 ), float( x1 ), z0, z1 );
-			if ( steep ) {
-				if ( Depth.GetAtXY( y, x ).r >= depth ) {
-					Color.SetAtXY( y, x, RGBAFromVec4( color ) );
-					Depth.SetAtXY( y, x, { depth, 0.0f, 0.0f, 0.0f } );
-				}
-			} else {
-				if ( Depth.GetAtXY( x, y ).r >= depth ) {
-					Color.SetAtXY( x, y, RGBAFromVec4( color ) );
-					Depth.SetAtXY( x, y, { depth, 0.0f, 0.0f, 0.0f } );
-				}
+			const int px = steep ? y : x, py = steep ? x : y;
+			if ( framebuffer.Contains( px, py ) && framebuffer.Depth( px, py ) >= depth ) {
+				framebuffer.Write( px, py, RGBAFromVec4( color ), depth );
 			}
 			error2 += derror2;
 			if ( error2 > dx ) {
@@ -204,28 +160,86 @@ public:
 
 	// draw triangle
 	void DrawTriangle ( triangle t, const mat3 transform, const vec3 offset  ) {
+		const mat4 mvp = ModelViewProjection( transform, offset );
+		const clipVertex v[ 3 ] = {
+			{ mvp * vec4( t.p0, 1.0f ), t.t0, t.n0, t.c0 },
+			{ mvp * vec4( t.p1, 1.0f ), t.t1, t.n1, t.c1 },
+			{ mvp * vec4( t.p2, 1.0f ), t.t2, t.n2, t.c2 }
+		};
+		screenTriangle s[ maxClippedTriangles ];
+		const int count = ProjectTriangle( v, t.t, t.b, s, stats );
+		for ( int i = 0; i < count; i++ ) {
+			RasterizeTriangle( s[ i ], s[ i ].bboxMin, s[ i ].bboxMax );
+		}
+	}
 
-		// apply transform
-		t.p0 = transform * ( t.p0 + offset );
-		t.p1 = transform * ( t.p1 + offset );
-		t.p2 = transform * ( t.p2 + offset );
+	// half-space edge functions, in fixed point - vertices snapped to 1/16th of a pixel
+		// - edge i is the one opposite vertex i, its value at pixel ( x, y ) is origin[ i ] + x * stepX[ i ] + y * stepY[ i ],
+		//   positive inside, and the three sum to area anywhere - divided by area they're the barycentric coordinates
+		// - bias is 0 for top and left edges and -1 for the rest, added before the >= 0 test, so a pixel exactly on an edge
+		//   shared by two triangles is drawn by only one of them
+		// - vertices are limited to +/- subpixelLimit pixels, which keeps values inside a partially covered 8x8 block in
+		//   32 bits - the block test below runs in int32 lanes. The clipping guard band keeps triangles well inside that
+	static constexpr int subpixelBits = 4;
+	static constexpr float subpixelLimit = 131072.0f;
+	struct edgeFunctions {
+		int64_t origin[ 3 ];
+		int64_t stepX[ 3 ];
+		int64_t stepY[ 3 ];
+		int64_t bias[ 3 ];
+		int64_t area;
+		bool swapped; // winding was flipped to make area positive, weights 1 and 2 trade places
+	};
+
+	// triangle in screen space, with its pixel bounding box clamped to the screen - empty when min > max
+	struct screenTriangle {
+		triangle t;
+		ivec2 bboxMin;
+		ivec2 bboxMax;
+		edgeFunctions edges;
+		vec3 inverseW;			// per vertex, for perspective correct attributes
+		float minDepth;			// nearest vertex
+		float cullDepth;		// nearest vertex less a margin, for the depth pyramid tests - interpolated depths can land a little nearer
+		vec3 depthPlane;		// depth at vertex 0, and its x and y gradients in screen space
+	};
+
+	// false for degenerate triangles, and ones too far off screen for the fixed point setup
+	static bool SetupEdges ( const triangle &t, edgeFunctions &e ) {
+		const vec3 p[ 3 ] = { t.p0, t.p1, t.p2 };
+		int64_t x[ 3 ], y[ 3 ];
+		for ( int i = 0; i < 3; i++ ) {
+			if ( !( std::abs( p[ i ].x ) < subpixelLimit && std::abs( p[ i ].y ) < subpixelLimit ) ) return false; // catches NaN, too
+			x[ i ] = int64_t( std::nearbyint( p[ i ].x * float( 1 << subpixelBits ) ) );
+			y[ i ] = int64_t( std::nearbyint( p[ i ].y * float( 1 << subpixelBits ) ) );
+		}
 
-		// perspective projection parameters
-		t.p0.x *= RemapRange( t.p0.z, -2.0f, 2.0f, 0.9f, 0.75f );
-		t.p0.y *= RemapRange( t.p0.z, -2.0f, 2.0f, 0.9f, 0.75f );
+		e.area = ( x[ 1 ] - x[ 0 ] ) * ( y[ 2 ] - y[ 0 ] ) - ( y[ 1 ] - y[ 0 ] ) * ( x[ 2 ] - x[ 0 ] );
+		e.swapped = e.area < 0;
+		if ( e.swapped ) {
+			std::swap( x[ 1 ], x[ 2 ] );
+			std::swap( y[ 1 ], y[ 2 ] );
+			e.area = -e.area;
+		}
 
-		t.p1.x *= RemapRange( t.p1.z, -2.0f, 2.0f, 0.9f, 0.75f );
-		t.p1.y *= RemapRange( t.p1.z, -2.0f, 2.0f, 0.9f, 0.75f );
+		// same threshold BarycentricCoords used, 1e-2 square pixels
+		if ( float( e.area ) <= 1e-2f * float( 1 << ( 2 * subpixelBits ) ) ) return false;
 
-		t.p2.x *= RemapRange( t.p2.z, -2.0f, 2.0f, 0.9f, 0.75f );
-		t.p2.y *= RemapRange( t.p2.z, -2.0f, 2.0f, 0.9f, 0.75f );
+		for ( int i = 0; i < 3; i++ ) {
+			const int a = ( i + 1 ) % 3, b = ( i + 2 ) % 3; // edge a -> b, opposite vertex i
+			const int64_t dx = x[ b ] - x[ a ], dy = y[ b ] - y[ a ];
+			e.stepX[ i ] = -dy << subpixelBits;
+			e.stepY[ i ] = dx << subpixelBits;
+			e.origin[ i ] = dy * x[ a ] - dx * y[ a ];
+			e.bias[ i ] = ( dy < 0 || ( dy == 0 && dx > 0 ) ) ? 0 : -1;
+		}
+		return true;
+	}
 
-		// translate x, y of points into screen space
-		t.p0 = NDCToPixelCoords( t.p0 );
-		t.p1 = NDCToPixelCoords( t.p1 );
-		t.p2 = NDCToPixelCoords( t.p2 );
+	// bounding box, edge functions, and depth plane for a triangle already in pixel coordinates - false when there's
+	// nothing to draw. inverseW is left as it is
+	bool SetupTriangle ( const triangle &t, screenTriangle &s ) {
 
-		// clipping for single triangle
+		// bounding box, clamped to the screen
 		vec2 bboxmin(  std::numeric_limits< float >::max(),  std::numeric_limits< float >::max() );
 		vec2 bboxmax( -std::numeric_limits< float >::max(), -std::numeric_limits< float >::max() );
 		vec2 clamp( width - 1, height - 1 );
@@ -260,59 +274,329 @@ public:
 			cout << "  Color:    " << t.c2.x << " " << t.c2.y << " " << t.c2.z << newline << newline;
 		}
 
-		constexpr bool allowPrimitiveJitter = false;
-		ivec2 eval;
-		for ( eval.x = bboxmin.x; eval.x <= bboxmax.x; eval.x++ ) {
-			for ( eval.y = bboxmin.y; eval.y <= bboxmax.y; eval.y++ ) {
-
-				// for( n ) jittered samples? tbd, will need to do something to get an alpha value from the n samples
-				vec4 jitter = allowPrimitiveJitter ? BlueNoiseRef( eval ) : vec4( 0.0f );
-				vec3 bc = BarycentricCoords( t.p0, t.p1, t.p2, vec3( float( eval.x ) + jitter.x, float( eval.y ) + jitter.y, 0.0f ) );
+		// pixels the loop below would visit - NaN positions fail both compares and come out empty
+		s.t = t;
+		s.bboxMin = ivec2( 0 );
+		s.bboxMax = ivec2( -1 );
+		if ( bboxmin.x <= bboxmax.x && bboxmin.y <= bboxmax.y ) {
+			s.bboxMin = ivec2( bboxmin );
+			s.bboxMax = ivec2( glm::floor( bboxmax ) );
+		}
+		if ( !( s.bboxMin.x <= s.bboxMax.x && s.bboxMin.y <= s.bboxMax.y && SetupEdges( t, s.edges ) ) ) return false;
+
+		// depth bounds for the depth pyramid tests
+		const vec3 d1 = t.p1 - t.p0, d2 = t.p2 - t.p0;
+		const float determinant = d1.x * d2.y - d2.x * d1.y;
+		s.minDepth = std::min( { t.p0.z, t.p1.z, t.p2.z } );
+		s.cullDepth = s.minDepth - 1e-4f * ( 1.0f + std::abs( s.minDepth ) );
+		s.depthPlane = vec3( t.p0.z, ( d1.z * d2.y - d2.z * d1.y ) / determinant, ( d2.z * d1.x - d1.z * d2.x ) / determinant );
+		return true;
+	}
 
-				// any barycentric coord being negative means degenerate triangle or sample point outside triangle
-				if ( bc.x < 0 || bc.y < 0 || bc.z < 0 ) continue;
+	// camera - left handed, looking down +z from view space, depth goes 0 to 1 from the near plane to the far plane
+	mat4 view = glm::lookAtLH( vec3( 0.0f, 0.0f, -5.0f ), vec3( 0.0f ), vec3( 0.0f, 1.0f, 0.0f ) );
+	mat4 projection;
+	bool cullBackFaces = true; // counterclockwise is the front, as in the OBJ files
 
-				// if ( // interesting experiment, reject samples with certain ranges of the barycentric coords
-				// 	( std::fmod( bc.x, 0.5f ) > 0.1618 && std::fmod( bc.y, 0.5f ) > 0.1618 ) ||
-				// 	( std::fmod( bc.x, 0.5f ) > 0.1618 && std::fmod( bc.z, 0.5f ) > 0.1618 ) ||
-				// 	( std::fmod( bc.z, 0.5f ) > 0.1618 && std::fmod( bc.y, 0.5f ) > 0.1618 )
-				// ) continue;
+	// model transform is the rotation applied to the offset position, as before
+	mat4 ModelViewProjection ( const mat3 transform, const vec3 offset ) const {
+		return projection * view * mat4( transform ) * glm::translate( offset );
+	}
 
-				float depth = 0.0f; // barycentric interpolation of depth
-				depth += bc.x * t.p0.z;
-				depth += bc.y * t.p1.z;
-				depth += bc.z * t.p2.z;
+	// counts from the last DrawModel ( or accumulated over DrawTriangle calls )
+	struct drawStats {
+		int triangles = 0;		// submitted
+		int frustumCulled = 0;	// entirely outside one of the frustum planes
+		int backFacing = 0;		// culled by winding
+		int clipped = 0;		// crossed the near or far plane, or the guard band
+		int emitted = 0;		// screen space triangles, after clipping, that reached setup
+		void Add ( const drawStats &other ) {
+			triangles += other.triangles; frustumCulled += other.frustumCulled; backFacing += other.backFacing;
+			clipped += other.clipped; emitted += other.emitted;
+		}
+	};
+	drawStats stats;
+
+	// clip space vertex, for clipping - attributes are interpolated along with the position
+	struct clipVertex {
+		vec4 position;
+		vec3 texCoord;
+		vec3 normal;
+		vec3 color;
+	};
+
+	static clipVertex Lerp ( const clipVertex &a, const clipVertex &b, const float t ) {
+		// written as a + ( b - a ) * t so attributes that match at both ends ( the material index ) come out exact
+		return { a.position + ( b.position - a.position ) * t, a.texCoord + ( b.texCoord - a.texCoord ) * t,
+			a.normal + ( b.normal - a.normal ) * t, a.color + ( b.color - a.color ) * t };
+	}
 
-				vec3 texCoord = vec3( 0.0f );
-				texCoord += bc.x * vec3( t.t0.x, t.t0.y, 0.0f );
-				texCoord += bc.y * vec3( t.t1.x, t.t1.y, 0.0f );
-				texCoord += bc.z * vec3( t.t2.x, t.t2.y, 0.0f );
-				texCoord.z = t.t0.z; // single material per tri
+	// projection into clip space, culling, clipping, then setup of what's left
+		// - triangles entirely outside any frustum plane are dropped, as are back faces, by the sign of the determinant of
+		//   the clip space x, y, w - that works before the divide, even with vertices behind the eye
+		// - clipping is against the near and far planes, and against a guard band guardBand times the size of the screen
+		//   for x and y. Parts outside the screen but inside the band are left for the bounding box and edge functions to
+		//   skip, so most triangles crossing the screen edge don't get clipped at all
+		// - returns how many screen triangles were written to out, up to maxClippedTriangles
+	static constexpr float guardBand = 16.0f;
+	static constexpr int maxClippedTriangles = 7; // three vertices, plus one for each of six planes, as a fan
+	int ProjectTriangle ( const clipVertex v[ 3 ], const vec3 tangent, const vec3 bitangent, screenTriangle out[ maxClippedTriangles ], drawStats &counts ) {
+		counts.triangles++;
+
+		// planes as dot products with the clip space position, inside where >= 0 - near, far, then the four sides
+		const vec4 planes[ 6 ] = {
+			vec4( 0.0f, 0.0f, 1.0f, 0.0f ), vec4( 0.0f, 0.0f, -1.0f, 1.0f ),
+			vec4( 1.0f, 0.0f, 0.0f, 1.0f ), vec4( -1.0f, 0.0f, 0.0f, 1.0f ),
+			vec4( 0.0f, 1.0f, 0.0f, 1.0f ), vec4( 0.0f, -1.0f, 0.0f, 1.0f )
+		};
+		uint32_t outsideGuard = 0; // bit per plane, set if any vertex is outside the clipping version of it
+		for ( int p = 0; p < 6; p++ ) {
+			int outsideFrustum = 0;
+			vec4 guardPlane = planes[ p ];
+			if ( p >= 2 ) guardPlane.w = guardBand;
+			for ( int i = 0; i < 3; i++ ) {
+				outsideFrustum += glm::dot( planes[ p ], v[ i ].position ) < 0.0f;
+				if ( glm::dot( guardPlane, v[ i ].position ) < 0.0f ) outsideGuard |= 1u << p;
+			}
+			if ( outsideFrustum == 3 ) {
+				counts.frustumCulled++;
+				return 0;
+			}
+		}
 
-				vec3 normal = vec3( 0.0f );
-				normal += bc.x * vec3( t.n0.x, t.n0.y, t.n0.z );
-				normal += bc.y * vec3( t.n1.x, t.n1.y, t.n1.z );
-				normal += bc.z * vec3( t.n2.x, t.n2.y, t.n2.z );
+		// front faces come out clockwise on screen, with y going up
+		const float determinant = glm::determinant( mat3(
+			vec3( v[ 0 ].position.x, v[ 0 ].position.y, v[ 0 ].position.w ),
+			vec3( v[ 1 ].position.x, v[ 1 ].position.y, v[ 1 ].position.w ),
+			vec3( v[ 2 ].position.x, v[ 2 ].position.y, v[ 2 ].position.w ) ) );
+		if ( cullBackFaces && !( determinant < 0.0f ) ) {
+			counts.backFacing++;
+			return 0;
+		}
 
-				if ( depth < 0.0f ) {
-					return; // cheapo clipping plane
+		// Sutherland-Hodgman, only against the planes something is outside of
+		clipVertex polygon[ 9 ], scratch[ 9 ];
+		int vertexCount = 3;
+		std::copy( v, v + 3, polygon );
+		if ( outsideGuard ) {
+			counts.clipped++;
+			for ( int p = 0; p < 6; p++ ) {
+				if ( !( outsideGuard & ( 1u << p ) ) ) continue;
+				vec4 plane = planes[ p ];
+				if ( p >= 2 ) plane.w = guardBand;
+				int kept = 0;
+				for ( int i = 0; i < vertexCount; i++ ) {
+					const clipVertex &a = polygon[ i ], &b = polygon[ ( i + 1 ) % vertexCount ];
+					const float da = glm::dot( plane, a.position ), db = glm::dot( plane, b.position );
+					if ( da >= 0.0f ) scratch[ kept++ ] = a;
+					if ( ( da >= 0.0f ) != ( db >= 0.0f ) ) scratch[ kept++ ] = Lerp( a, b, da / ( da - db ) );
 				}
+				vertexCount = kept;
+				std::copy( scratch, scratch + kept, polygon );
+				if ( vertexCount < 3 ) return 0;
+			}
+		}
 
-				if ( Depth.GetAtXY( eval.x, eval.y ).r > depth ) { // compute the color to write, texturing, etc, etc
+		// divide, to pixel coordinates, then the fan of triangles out to setup
+		vec3 screen[ 9 ];
+		float inverseW[ 9 ];
+		for ( int i = 0; i < vertexCount; i++ ) {
+			inverseW[ i ] = 1.0f / polygon[ i ].position.w;
+			screen[ i ] = NDCToPixelCoords( vec3( polygon[ i ].position ) * inverseW[ i ] );
+		}
+		int count = 0;
+		for ( int i = 1; i + 1 < vertexCount; i++ ) {
+			triangle f;
+			f.t = tangent;
+			f.b = bitangent;
+			const clipVertex &a = polygon[ 0 ], &b = polygon[ i ], &c = polygon[ i + 1 ];
+			f.p0 = screen[ 0 ]; f.p1 = screen[ i ]; f.p2 = screen[ i + 1 ];
+			f.t0 = a.texCoord; f.t1 = b.texCoord; f.t2 = c.texCoord;
+			f.n0 = a.normal; f.n1 = b.normal; f.n2 = c.normal;
+			f.c0 = a.color; f.c1 = b.color; f.c2 = c.color;
+			out[ count ].inverseW = vec3( inverseW[ 0 ], inverseW[ i ], inverseW[ i + 1 ] );
+			if ( SetupTriangle( f, out[ count ] ) ) count++;
+		}
+		counts.emitted += count;
+		return count;
+	}
 
-					vec4 texRef = TexRef( glm::mod( vec2( texCoord.x, 1.0f - texCoord.y ), vec2( 1.0f ) ), texCoord.z );
-					if ( texRef.a == 0.0f ) {
-						continue; // reject zero alpha samples - still need to implement blending
+	// barycentric change over one pixel step in x and y, for the texCoord derivatives that pick the mip level
+	static void BarycentricSteps ( const edgeFunctions &e, vec3 &stepX, vec3 &stepY ) {
+		const float inverseArea = 1.0f / float( e.area );
+		stepX = vec3( e.stepX[ 0 ], e.stepX[ 1 ], e.stepX[ 2 ] ) * inverseArea;
+		stepY = vec3( e.stepY[ 0 ], e.stepY[ 1 ], e.stepY[ 2 ] ) * inverseArea;
+		if ( e.swapped ) {
+			std::swap( stepX.y, stepX.z );
+			std::swap( stepY.y, stepY.z );
+		}
+	}
+
+	// surface color at a pixel, from the second and third screen space barycentrics - the first is implied, so the
+	// forward path and the deferred pass, which only keeps two, shade exactly the same
+	vec4 Shade ( const screenTriangle &s, vec2 b, const vec3 &bcStepX, const vec3 &bcStepY ) {
+		const triangle &t = s.t;
+		auto TexCoordAt = [ & ] ( vec3 bc ) { // the rest is linear in view space, weights go through 1 / w
+			vec3 pc = bc * s.inverseW;
+			pc /= ( pc.x + pc.y + pc.z );
+			return pc.x * vec2( t.t0 ) + pc.y * vec2( t.t1 ) + pc.z * vec2( t.t2 );
+		};
+		const vec3 bc = vec3( 1.0f - b.x - b.y, b.x, b.y );
+		const vec2 texCoord = TexCoordAt( bc );
+		const vec2 ddx = TexCoordAt( bc + bcStepX ) - texCoord;
+		const vec2 ddy = TexCoordAt( bc + bcStepY ) - texCoord;
+		return TexRef( vec2( texCoord.x, 1.0f - texCoord.y ), int( t.t0.z ), ddx, ddy ); // single material per tri
+	}
+
+	// fills the pixels of the screen space triangle inside [ minCorner, maxCorner ], inclusive
+		// - walks 8x8 blocks, evaluating the edge functions at the block corners first: blocks entirely outside an edge are
+		//   skipped, blocks inside all three are filled without per pixel tests, and only the blocks an edge passes through
+		//   get the 64 lane coverage test
+		// - while the depth pyramid is valid, blocks whose nearest depth is behind the farthest depth already stored in the
+		//   block are skipped too, and blocks that get written have their farthest depth refreshed
+		// - given a visibility id, pixels that pass get depth and a visibility sample instead of a color, and shading
+		//   waits for ShadeVisibility. The texture is still sampled for the alpha test, if it has any zero alpha texels
+		// - returns true if any pixel was written
+	static constexpr int rasterBlockSize = Framebuffer::blockSize;
+	bool RasterizeTriangle ( const screenTriangle &s, const ivec2 minCorner, const ivec2 maxCorner, uint32_t visibilityID = Framebuffer::noTriangle ) {
+		const triangle &t = s.t;
+		bool wroteTriangle = false;
+		const edgeFunctions &e = s.edges;
+		constexpr int n = rasterBlockSize;
+		const float inverseArea = 1.0f / float( e.area );
+		vec3 bcStepX, bcStepY;
+		BarycentricSteps( e, bcStepX, bcStepY );
+		const bool deferred = visibilityID != Framebuffer::noTriangle;
+		const bool alphaTested = !deferred || textures.Transparent( 2 * int( t.t0.z ) );
+
+		for ( int by = minCorner.y & ~( n - 1 ); by <= maxCorner.y; by += n ) {
+			for ( int bx = minCorner.x & ~( n - 1 ); bx <= maxCorner.x; bx += n ) {
+
+				// edge values at the block origin, and their range over the block - it's linear, so that's at the corners
+				int64_t corner[ 3 ];
+				bool outside = false, edgeInside[ 3 ];
+				for ( int i = 0; i < 3; i++ ) {
+					corner[ i ] = e.origin[ i ] + bx * e.stepX[ i ] + by * e.stepY[ i ];
+					const int64_t low = corner[ i ] + e.bias[ i ] + std::min< int64_t >( 0, ( n - 1 ) * e.stepX[ i ] ) + std::min< int64_t >( 0, ( n - 1 ) * e.stepY[ i ] );
+					const int64_t high = corner[ i ] + e.bias[ i ] + std::max< int64_t >( 0, ( n - 1 ) * e.stepX[ i ] ) + std::max< int64_t >( 0, ( n - 1 ) * e.stepY[ i ] );
+					outside = outside || high < 0;
+					edgeInside[ i ] = low >= 0;
+				}
+				if ( outside ) continue;
+
+				// nearest depth of the plane over the block, from the corners - a little margin, since this has to stay on the
+				// near side of the per pixel depth, which is computed differently. Bounded by the nearest vertex, with its own margin
+				float * const blockMax = depthPyramidValid ? &blockMaxDepth[ ( bx / n ) + ( by / n ) * blocksX ] : nullptr;
+				if ( blockMax ) {
+					const vec3 &plane = s.depthPlane;
+					const float atCorner = plane.x + ( float( bx ) - t.p0.x ) * plane.y + ( float( by ) - t.p0.y ) * plane.z;
+					const float nearest = atCorner + std::min( 0.0f, ( n - 1 ) * plane.y ) + std::min( 0.0f, ( n - 1 ) * plane.z );
+					const float margin = 1e-4f * ( 1.0f + std::abs( atCorner ) + ( n - 1 ) * ( std::abs( plane.y ) + std::abs( plane.z ) ) );
+					if ( std::max( nearest - margin, s.cullDepth ) >= *blockMax ) continue;
+				}
+
+				// per pixel coverage - only edges passing through the block are tested, and those stay near zero over it,
+				// so this fits in int32. Edges the block is entirely inside could be anywhere, they're left out
+				uint8_t covered[ n * n ];
+				if ( edgeInside[ 0 ] && edgeInside[ 1 ] && edgeInside[ 2 ] ) {
+					std::fill( covered, covered + n * n, 1 );
+				} else {
+					int32_t start[ 3 ], stepX[ 3 ], stepY[ 3 ];
+					for ( int i = 0; i < 3; i++ ) {
+						start[ i ] = edgeInside[ i ] ? 0 : int32_t( corner[ i ] + e.bias[ i ] );
+						stepX[ i ] = edgeInside[ i ] ? 0 : int32_t( e.stepX[ i ] );
+						stepY[ i ] = edgeInside[ i ] ? 0 : int32_t( e.stepY[ i ] );
+					}
+					for ( int i = 0; i < n * n; i++ ) {
+						const int x = i % n, y = i / n;
+						const int32_t w0 = start[ 0 ] + x * stepX[ 0 ] + y * stepY[ 0 ];
+						const int32_t w1 = start[ 1 ] + x * stepX[ 1 ] + y * stepY[ 1 ];
+						const int32_t w2 = start[ 2 ] + x * stepX[ 2 ] + y * stepY[ 2 ];
+						covered[ i ] = ( w0 | w1 | w2 ) >= 0;
 					}
+				}
 
-					// vec4 color( texCoord.x, texCoord.y, texCoord.z / texSet.size(), 1.0f );
-					vec4 color( texRef.x, texRef.y, texRef.z, 1.0f );
+				// the block's pixels are consecutive in the framebuffer, in the same order as i
+				float * const blockDepth = &framebuffer.depth[ framebuffer.BlockIndex( bx, by ) ];
+				rgba * const blockColor = &framebuffer.color[ framebuffer.BlockIndex( bx, by ) ];
+				visibilitySample * const blockVisibility = deferred ? &framebuffer.visibility[ framebuffer.BlockIndex( bx, by ) ] : nullptr;
+				bool wroteBlock = false;
+				for ( int i = 0; i < n * n; i++ ) {
+					const ivec2 eval = ivec2( bx + i % n, by + i / n );
+					if ( !covered[ i ] || eval.x < minCorner.x || eval.x > maxCorner.x || eval.y < minCorner.y || eval.y > maxCorner.y ) continue;
+
+					// barycentric coordinates from the edge values
+					vec3 bc;
+					for ( int j = 0; j < 3; j++ ) {
+						bc[ j ] = float( corner[ j ] + ( i % n ) * e.stepX[ j ] + ( i / n ) * e.stepY[ j ] ) * inverseArea;
+					}
+					if ( e.swapped ) std::swap( bc.y, bc.z );
+
+					// if ( // interesting experiment, reject samples with certain ranges of the barycentric coords
+					// 	( std::fmod( bc.x, 0.5f ) > 0.1618 && std::fmod( bc.y, 0.5f ) > 0.1618 ) ||
+					// 	( std::fmod( bc.x, 0.5f ) > 0.1618 && std::fmod( bc.z, 0.5f ) > 0.1618 ) ||
+					// 	( std::fmod( bc.z, 0.5f ) > 0.1618 && std::fmod( bc.y, 0.5f ) > 0.1618 )
+					// ) continue;
+
+					float depth = 0.0f; // barycentric interpolation of depth - z / w is linear in screen space
+					depth += bc.x * t.p0.z;
+					depth += bc.y * t.p1.z;
+					depth += bc.z * t.p2.z;
+
+					if ( blockDepth[ i ] > depth ) { // compute the color to write, texturing, etc, etc
+
+						const vec4 texRef = alphaTested ? Shade( s, vec2( bc.y, bc.z ), bcStepX, bcStepY ) : vec4( 1.0f );
+						if ( texRef.a == 0.0f ) {
+							continue; // reject zero alpha samples - still need to implement blending
+						}
+
+						if ( deferred ) {
+							blockVisibility[ i ] = { visibilityID, bc.y, bc.z };
+						} else {
+							// vec4 color( texCoord.x, texCoord.y, texCoord.z / textures.Count(), 1.0f );
+							vec4 color( texRef.x, texRef.y, texRef.z, 1.0f );
+							blockColor[ i ] = RGBAFromVec4( color );
+						}
+						blockDepth[ i ] = depth;
+						wroteBlock = true;
+					}
+				}
 
-					Color.SetAtXY( eval.x, eval.y, RGBAFromVec4( color ) );
-					Depth.SetAtXY( eval.x, eval.y, { depth, 0.0f, 0.0f, 0.0f } );
+				if ( wroteBlock ) {
+					wroteTriangle = true;
+					if ( blockMax ) *blockMax = framebuffer.BlockMaxDepth( bx, by );
 				}
 			}
 		}
+		return wroteTriangle;
+	}
+
+	// depth pyramid - farthest depth stored in each 8x8 block, and in each tile of DrawModel
+		// - depth only ever gets nearer while drawing, so a stale farthest value is still safe to test against, but the
+		//   framebuffer can be cleared from outside, so DrawModel rebuilds the pyramid from it before it starts, and drops
+		//   it when done
+
+	float TileMaxDepth ( int tx, int ty ) const {
+		constexpr int blocksPerTile = rasterTileSize / rasterBlockSize;
+		float farthest = -std::numeric_limits< float >::max();
+		for ( int y = ty * blocksPerTile; y < std::min( ( ty + 1 ) * blocksPerTile, blocksY ); y++ ) {
+			for ( int x = tx * blocksPerTile; x < std::min( ( tx + 1 ) * blocksPerTile, blocksX ); x++ ) {
+				farthest = std::max( farthest, blockMaxDepth[ x + y * blocksX ] );
+			}
+		}
+		return farthest;
+	}
+
+	void BuildDepthPyramid () {
+		blocksX = ( int( width ) + rasterBlockSize - 1 ) / rasterBlockSize;
+		blocksY = ( int( height ) + rasterBlockSize - 1 ) / rasterBlockSize;
+		blockMaxDepth.resize( blocksX * blocksY );
+		ParallelFor( 0, blocksY, [ & ] ( int y ) {
+			for ( int x = 0; x < blocksX; x++ ) {
+				blockMaxDepth[ x + y * blocksX ] = framebuffer.BlockMaxDepth( x * rasterBlockSize, y * rasterBlockSize );
+			}
+		} );
+		depthPyramidValid = true;
 	}
 
 
@@ -320,19 +604,54 @@ public:
 	// on the upside - materials become much, much easier to handle - this means that I will be able to more easily handle multi-texture models
 		// for example, the sponza model I found here https://github.com/jimmiebergmann/Sponza
 
+	// replaces the mesh - from the binary mesh cache when there's a current one for this model ( see MeshCache.h ),
+	// otherwise parsed, processed, and written to the cache for next time
 	void LoadModel ( string modelPath, string mtlSearchPath ) {
+		Tick();
+		std::vector< meshMaterial > materialTable;
+		const bool cacheHit = ReadMeshCache( modelPath, mtlSearchPath, mesh, materialTable );
+		if ( !cacheHit ) {
+			mesh.Clear();
+			if ( ParseModel( modelPath, mtlSearchPath, materialTable ) ) {
+				std::vector< string > sources = MaterialLibraries( modelPath, mtlSearchPath );
+				sources.insert( sources.begin(), modelPath );
+				WriteMeshCache( modelPath, mtlSearchPath, mesh, materialTable, sources );
+			}
+		}
+
+		// iterating through the materials - nothing is read from the textures until they're sampled
+		textures.Clear();
+		for ( size_t materialID = 0; materialID < materialTable.size(); materialID++ ) {
+			LoadTex( materialTable[ materialID ].diffuse );
+			LoadTex( materialTable[ materialID ].normal );
+
+			if ( verboseLoad ) {
+				cout << "Material " << materialID << " is called " << materialTable[ materialID ].name << newline;
+				cout << "  diffuse texture is: " << materialTable[ materialID ].diffuse << newline;
+				// for some reason they use the displacement texture field
+				cout << "  normal texture is: " << materialTable[ materialID ].normal << newline;
+			}
+		}
+
+		if ( verboseLoad ) {
+			cout << "loading took " << Tock() / 1000.0f << "ms" << ( cacheHit ? ", from the mesh cache" : "" ) << newline;
+			cout << "  " << mesh.TriangleCount() << " triangles, " << mesh.VertexCount() << " unique vertices" << newline;
+		}
+	}
+
+	// OBJ through TinyOBJLoader into the mesh, returns false if parsing failed
+	bool ParseModel ( const string &modelPath, const string &mtlSearchPath, std::vector< meshMaterial > &materialTable ) {
 		tinyobj::ObjReaderConfig readerConfig;
 		readerConfig.mtl_search_path = mtlSearchPath;
 
 		tinyobj::ObjReader reader;
 
-		Tick();
-
 		// report any errors or warnings
 		if ( !reader.ParseFromFile( modelPath, readerConfig ) ) {
 			if ( !reader.Error().empty() ) {
 				cout << "TinyOBJLoader: " << reader.Error() << newline;
 			}
+			return false;
 		}
 
 		if ( !reader.Warning().empty() ) {
@@ -346,20 +665,11 @@ public:
 	// eventually I'll implement something for GLTF and have something higher quality to look at, with the
 		// full complement of pbr textures ( intel sponza is a nice option, given sufficient VRAM )
 
-		// iterating through the materials
-		for ( size_t materialID = 0; materialID < materials.size(); materialID++ ) {
-
-			string diffuseTexname = materials[ materialID ].diffuse_texname;
-			string normalTexname = materials[ materialID ].displacement_texname;
-			LoadTex( diffuseTexname.empty() ? string() : mtlSearchPath + diffuseTexname );
-			LoadTex( normalTexname.empty() ? string() : mtlSearchPath + normalTexname );
-
-			if ( verboseLoad ) {
-				cout << "Material " << materialID << " is called " << materials[ materialID ].name << newline;
-				cout << "  diffuse texture is: " << diffuseTexname << newline;
-				// for some reason they use the displacement texture field
-				cout << "  normal texture is: " << normalTexname << newline;
-			}
+		// texture paths per material - for some reason they use the displacement texture field for the normal map
+		for ( auto& m : materials ) {
+			materialTable.push_back( { m.name,
+				m.diffuse_texname.empty() ? string() : mtlSearchPath + m.diffuse_texname,
+				m.displacement_texname.empty() ? string() : mtlSearchPath + m.displacement_texname } );
 		}
 
 
@@ -391,21 +701,21 @@ public:
 					vy = attributes.vertices[ 3 * size_t( idx.vertex_index ) + 1 ];
 					vz = attributes.vertices[ 3 * size_t( idx.vertex_index ) + 2 ];
 
-					tinyobj::real_t nx, ny, nz;
+					tinyobj::real_t nx = 0.0f, ny = 0.0f, nz = 0.0f; // zeroes when missing, so identical vertices still match
 					if ( idx.normal_index >= 0 ) { // Check if `normal_index` is zero or positive. negative = no normal data
 						nx = attributes.normals[ 3 * size_t( idx.normal_index ) + 0 ];
 						ny = attributes.normals[ 3 * size_t( idx.normal_index ) + 1 ];
 						nz = attributes.normals[ 3 * size_t( idx.normal_index ) + 2 ];
 					}
 
-					tinyobj::real_t tx, ty;
+					tinyobj::real_t tx = 0.0f, ty = 0.0f;
 					if ( idx.texcoord_index >= 0 ) { // Check if `texcoord_index` is zero or positive. negative = no texcoord data
 						tx = attributes.texcoords[ 2 * size_t( idx.texcoord_index ) + 0 ];
 						ty = attributes.texcoords[ 2 * size_t( idx.texcoord_index ) + 1 ];
 						// pack the material id in the third element
 					}
 
-					tinyobj::real_t red, green, blue;
+					tinyobj::real_t red = 1.0f, green = 1.0f, blue = 1.0f;
 					if ( idx.vertex_index >= 0 ) { // Check if `vertex_index` is zero or positive. negative = no vertex color data
 						red   = attributes.colors[ 3 * size_t( idx.vertex_index ) + 0 ];
 						green = attributes.colors[ 3 * size_t( idx.vertex_index ) + 1 ];
@@ -459,47 +769,212 @@ public:
 				t.b.z = f * ( -deltaUV2.x * edge1.z + deltaUV1.x * edge2.z );
 
 				// do it
-				triangles.push_back( t );
+				mesh.AddTriangle( t );
 			}
 		}
 
+		const float missesBefore = verboseLoad ? mesh.AverageCacheMissRatio() : 0.0f;
+		mesh.OptimizeVertexCache();
+
 		if ( verboseLoad ) {
-			cout << "loading took " << Tock() / 1000.0f << "ms" << newline;
+			cout << "  vertex cache misses per triangle " << missesBefore << " before reordering, " << mesh.AverageCacheMissRatio() << " after" << newline;
 		}
+		return true;
 	}
 
+	// two phases, both across the thread pool:
+		// - triangles are projected, culled, clipped and set up in chunks, and each chunk bins the screen triangles that
+		//   come out into the screen tiles their bounding boxes touch - chunks have their own bins, so there's no
+		//   contention, and reading the chunks back in order keeps the triangles in model order
+		// - each tile is rasterized by one worker, every triangle clipped to the tile - no two threads touch the same
+		//   pixels, so the framebuffer needs no atomics, and each pixel sees the same sequence of depth tests as drawing
+		//   the triangles one at a time would
+		// - each tile keeps the farthest depth stored in it, triangles whose nearest vertex ( less the same margin the blocks
+		//   use ) is behind that are skipped before any setup of their own, the 8x8 blocks inside get the same test in
+		//   RasterizeTriangle
+		// - with sortFrontToBack, each tile draws its triangles nearest first, so more of the rest fail those tests - this
+		//   changes the order of writes, so where two triangles have exactly the same depth the other one can win
+		// - with deferredShading, rasterization only writes depth and the visibility buffer, and ShadeVisibility shades
+		//   each visible pixel once at the end, so pixels that get covered again never pay for texturing. Same image
+	static constexpr int rasterTileSize = Framebuffer::tileSize;
+	static constexpr int binChunkSize = 4096;
+	bool sortFrontToBack = false;
+	bool deferredShading = false;
 	void DrawModel( const mat3 transform, const vec3 offset = vec3( 0.0f ) ) {
+		static_assert( rasterTileSize % rasterBlockSize == 0, "tiles are made of whole blocks" );
+		static_assert( binChunkSize * maxClippedTriangles <= 0x10000, "visibility ids keep the index within a chunk in 16 bits" );
 		Tick();
-		for ( auto& t : triangles ) {
-			DrawTriangle( t, transform, offset );
+		const int tilesX = ( int( width ) + rasterTileSize - 1 ) / rasterTileSize;
+		const int tilesY = ( int( height ) + rasterTileSize - 1 ) / rasterTileSize;
+		const int numTriangles = int( mesh.TriangleCount() );
+		const int numChunks = ( numTriangles + binChunkSize - 1 ) / binChunkSize;
+
+		// every unique vertex goes to clip space once, triangles pick them up by index
+		TransformVertices( ModelViewProjection( transform, offset ) );
+
+		// buffers are kept between frames, clear() holds on to the capacity
+		screenTriangles.resize( numChunks );
+		bins.resize( numChunks );
+		for ( int chunk = 0; chunk < numChunks; chunk++ ) {
+			screenTriangles[ chunk ].clear();
+			bins[ chunk ].resize( tilesX * tilesY );
+			for ( auto& bin : bins[ chunk ] ) bin.clear();
 		}
+		std::vector< drawStats > chunkStats( numChunks );
+
+		ParallelFor( 0, numChunks, [ & ] ( int chunk ) {
+			const int last = std::min( ( chunk + 1 ) * binChunkSize, numTriangles );
+			std::vector< screenTriangle > &out = screenTriangles[ chunk ];
+			for ( int i = chunk * binChunkSize; i < last; i++ ) {
+				clipVertex v[ 3 ];
+				for ( int k = 0; k < 3; k++ ) {
+					const uint32_t index = mesh.indices[ 3 * i + k ];
+					v[ k ] = { clipPositions[ index ], mesh.texCoords[ index ], mesh.normals[ index ], mesh.colors[ index ] };
+				}
+				screenTriangle clipped[ maxClippedTriangles ];
+				const int count = ProjectTriangle( v, mesh.tangents[ i ], mesh.bitangents[ i ], clipped, chunkStats[ chunk ] );
+				for ( int j = 0; j < count; j++ ) {
+					const screenTriangle &s = clipped[ j ];
+					for ( int y = s.bboxMin.y / rasterTileSize; y <= s.bboxMax.y / rasterTileSize; y++ ) {
+						for ( int x = s.bboxMin.x / rasterTileSize; x <= s.bboxMax.x / rasterTileSize; x++ ) {
+							bins[ chunk ][ x + y * tilesX ].push_back( uint32_t( out.size() ) );
+						}
+					}
+					out.push_back( s );
+				}
+			}
+		} );
+		stats = drawStats();
+		for ( auto& c : chunkStats ) stats.Add( c );
+
+		BuildDepthPyramid();
+		if ( deferredShading ) framebuffer.ClearVisibility();
+		std::atomic< int > binned( 0 ), culled( 0 );
+		ParallelFor( 0, tilesX * tilesY, [ & ] ( int tile ) {
+			const ivec2 tileMin = ivec2( tile % tilesX, tile / tilesX ) * rasterTileSize;
+			const ivec2 tileMax = glm::min( tileMin + ivec2( rasterTileSize - 1 ), ivec2( width - 1, height - 1 ) );
+			float farthest = TileMaxDepth( tile % tilesX, tile / tilesX );
+			int tileBinned = 0, tileCulled = 0;
+			auto Draw = [ & ] ( int chunk, uint32_t i ) {
+				const screenTriangle &s = screenTriangles[ chunk ][ i ];
+				tileBinned++;
+				if ( s.cullDepth >= farthest ) {
+					tileCulled++;
+					return;
+				}
+				const uint32_t id = deferredShading ? ( uint32_t( chunk ) << 16 | i ) : Framebuffer::noTriangle;
+				if ( RasterizeTriangle( s, glm::max( s.bboxMin, tileMin ), glm::min( s.bboxMax, tileMax ), id ) ) {
+					farthest = TileMaxDepth( tile % tilesX, tile / tilesX );
+				}
+			};
+
+			if ( sortFrontToBack ) {
+				std::vector< std::pair< int, uint32_t > > order;
+				for ( int chunk = 0; chunk < numChunks; chunk++ ) {
+					for ( uint32_t i : bins[ chunk ][ tile ] ) order.push_back( { chunk, i } );
+				}
+				std::stable_sort( order.begin(), order.end(), [ & ] ( const std::pair< int, uint32_t > &a, const std::pair< int, uint32_t > &b ) {
+					return screenTriangles[ a.first ][ a.second ].minDepth < screenTriangles[ b.first ][ b.second ].minDepth;
+				} );
+				for ( auto& entry : order ) Draw( entry.first, entry.second );
+			} else {
+				for ( int chunk = 0; chunk < numChunks; chunk++ ) {
+					for ( uint32_t i : bins[ chunk ][ tile ] ) Draw( chunk, i );
+				}
+			}
+			binned += tileBinned;
+			culled += tileCulled;
+		} );
+		depthPyramidValid = false;
+		const int shaded = deferredShading ? ShadeVisibility() : 0;
+		textures.Trim();
+
 		if ( verboseDraw ) {
 			cout << "drawing took " << Tock() / 1000.0f << "ms" << newline;
+			cout << "  " << clipPositions.size() << " vertices transformed, ";
+			cout << stats.triangles << " triangles, " << stats.frustumCulled << " outside the frustum, " << stats.backFacing << " back facing, ";
+			cout << stats.clipped << " clipped, " << stats.emitted << " drawn after clipping" << newline;
+			cout << "  " << culled << " of " << binned << " binned triangles culled against the tile depth" << newline;
+			if ( deferredShading ) cout << "  " << shaded << " visible pixels shaded" << newline;
 		}
 	}
 
+	// deferred shading pass - colors every pixel the last DrawModel left a triangle visible at, tile by tile, returns
+	// how many that was. The visibility ids index the screen triangles DrawModel kept, chunk in the high 16 bits
+	int ShadeVisibility () {
+		std::atomic< int > shaded( 0 );
+		ParallelFor( 0, framebuffer.tilesX * framebuffer.tilesY, [ & ] ( int tile ) {
+			uint32_t lastID = Framebuffer::noTriangle;
+			vec3 bcStepX, bcStepY;
+			int tileShaded = 0;
+			for ( size_t i = size_t( tile ) * Framebuffer::tilePixels; i < size_t( tile + 1 ) * Framebuffer::tilePixels; i++ ) {
+				const visibilitySample &v = framebuffer.visibility[ i ];
+				if ( v.triangle == Framebuffer::noTriangle ) continue;
+				const screenTriangle &s = screenTriangles[ v.triangle >> 16 ][ v.triangle & 0xFFFF ];
+				if ( v.triangle != lastID ) { // neighbouring pixels mostly show the same triangle
+					BarycentricSteps( s.edges, bcStepX, bcStepY );
+					lastID = v.triangle;
+				}
+				const vec4 texRef = Shade( s, vec2( v.b1, v.b2 ), bcStepX, bcStepY );
+				framebuffer.color[ i ] = RGBAFromVec4( vec4( texRef.x, texRef.y, texRef.z, 1.0f ) );
+				tileShaded++;
+			}
+			shaded += tileShaded;
+		} );
+		return shaded;
+	}
+
+	// same projection as DrawModel, lines with an end behind the near plane or past the guard band are skipped
 	void DrawModelWireframe( const mat3 transform, const vec3 offset = vec3( 0.0f ) ) {
 		Tick();
-		for ( auto& t : triangles ) {
-			DrawLine( ( transform * ( t.p0 + offset ) ), ( transform * ( t.p1 + offset ) ), vec4( t.n0, 1.0f ) );
-			DrawLine( ( transform * ( t.p1 + offset ) ), ( transform * ( t.p2 + offset ) ), vec4( t.n1, 1.0f ) );
-			DrawLine( ( transform * ( t.p2 + offset ) ), ( transform * ( t.p0 + offset ) ), vec4( t.n2, 1.0f ) );
+		TransformVertices( ModelViewProjection( transform, offset ) );
+		auto Project = [ & ] ( const uint32_t index, vec3 &ndc ) {
+			const vec4 &clip = clipPositions[ index ];
+			if ( !( clip.z >= 0.0f && clip.z <= clip.w ) ) return false;
+			ndc = vec3( clip ) / clip.w;
+			return std::abs( ndc.x ) <= guardBand && std::abs( ndc.y ) <= guardBand;
+		};
+		for ( size_t i = 0; i < mesh.TriangleCount(); i++ ) {
+			const uint32_t a = mesh.indices[ 3 * i ], b = mesh.indices[ 3 * i + 1 ], c = mesh.indices[ 3 * i + 2 ];
+			vec3 p0, p1, p2;
+			const bool v0 = Project( a, p0 ), v1 = Project( b, p1 ), v2 = Project( c, p2 );
+			if ( v0 && v1 ) DrawLine( p0, p1, vec4( mesh.normals[ a ], 1.0f ) );
+			if ( v1 && v2 ) DrawLine( p1, p2, vec4( mesh.normals[ b ], 1.0f ) );
+			if ( v2 && v0 ) DrawLine( p2, p0, vec4( mesh.normals[ c ], 1.0f ) );
 		}
 		if ( verboseDraw ) {
 			cout << "drawing took " << Tock() / 1000.0f << "ms" << newline;
 		}
 	}
 
-	std::vector<triangle> triangles;
+	// clip space positions of every vertex in the mesh, for the current transform
+	void TransformVertices ( const mat4 &mvp ) {
+		clipPositions.resize( mesh.VertexCount() );
+		ParallelFor( 0, int( mesh.VertexCount() ), [ & ] ( int i ) {
+			clipPositions[ i ] = mvp * vec4( mesh.positions[ i ], 1.0f );
+		}, 4096 );
+	}
+
+	indexedMesh mesh;
+	std::vector< vec4 > clipPositions;
+
+	// DrawModel working data - per chunk, triangles after clipping and setup, and per tile lists of indices into them
+	std::vector< std::vector< screenTriangle > > screenTriangles;
+	std::vector< std::vector< std::vector< uint32_t > > > bins;
+
+	// depth pyramid, only valid during DrawModel
+	std::vector< float > blockMaxDepth;
+	int blocksX = 0;
+	int blocksY = 0;
+	bool depthPyramidValid = false;
 
 	// dimensions
 	uint32_t width = 0;
 	uint32_t height = 0;
 
-	// buffers
-	Image Color;
-	ImageF Depth;
-	Image BlueNoise;
+	// color and depth - ResolveColor / ResolveDepth for Image copies
+	Framebuffer framebuffer;
+	std::shared_ptr< const Image > BlueNoise; // shared with any other users, through the asset cache
 };
 
 #endif
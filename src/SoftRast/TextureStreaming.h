@@ -0,0 +1,411 @@
+#pragma once
+#ifndef TEXTURESTREAMING_H
+#define TEXTURESTREAMING_H
+
+#include "../ImageHandling/AssetCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+
+// SoftRast material textures, kept at their native size with a box filtered mip chain, resident a level at a time
+	// - the chain for a source image is built once and written to the asset cache directory, checked against a hash of
+	//   the source the same way the decoded images in AssetCache.h are
+	// - nothing is read until a texture is first sampled, and then only the level that was asked for is copied out of
+	//   the mapped chain file
+	// - resident levels are charged against budget, and Trim() drops the least recently sampled ones until it fits.
+	//   That's the only place levels go away, between draws, so the raster threads never lose one mid sample
+	// - if the chain file can't be written, the levels built for it stay resident instead, and Trim leaves them alone -
+	//   there's nothing to reload them from. A level that fails to load is marked, and not retried on every sample
+
+constexpr uint32_t mipChainVersion = 3;
+constexpr int mipChainMaxLevels = 32;
+
+struct mipChainHeader {
+	char magic[ 8 ] = { 'S', 'I', 'R', 'E', 'N', 'M', 'P', '\0' };
+	uint32_t version = mipChainVersion;
+	uint32_t levelCount = 0;
+	uint32_t transparent = 0;	// some texel in some level has zero alpha, so samples can come back fully transparent
+	uint64_t contentHash = 0;	// hash of the source file, invalidates the chain when the source changes
+	uint64_t fileSize = 0;
+	uint32_t width[ mipChainMaxLevels ] = {};
+	uint32_t height[ mipChainMaxLevels ] = {};
+	uint64_t offset[ mipChainMaxLevels ] = {};	// level 0 at assetCachePageSize, the rest following at 64 byte alignment
+};
+static_assert( sizeof( mipChainHeader ) <= assetCachePageSize, "mip chain header must fit in the first page" );
+
+// one mip level, stored the way the sampler reads it - this is also the layout in the chain file
+	// - RGBA16F, so texels decode with a single conversion instruction where F16C is available and filtering happens
+	//   on values that were converted once, at build time
+	// - 8x8 texel tiles in row major order, Morton order inside each tile, so neighbours in both directions are close
+	//   by - a bilinear footprint is almost always inside one 512 byte tile, whichever way the surface is turned
+	// - padded out to whole tiles, the padding is never sampled
+struct textureLevel {
+	static constexpr uint32_t tileSize = 8;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t tilesX = 0;
+	std::vector< uint16_t > texels;
+
+	static size_t TexelCount ( uint32_t w, uint32_t h ) {
+		return size_t( ( w + tileSize - 1 ) / tileSize ) * ( ( h + tileSize - 1 ) / tileSize ) * tileSize * tileSize;
+	}
+
+	void Allocate ( uint32_t w, uint32_t h ) {
+		width = w;
+		height = h;
+		tilesX = ( w + tileSize - 1 ) / tileSize;
+		texels.assign( TexelCount( w, h ) * 4, 0 );
+	}
+
+	// the index separates into a part from x and a part from y - tile column plus the low three bits of x spread to
+	// the even Morton bits, tile row plus the low bits of y on the odd ones - so a footprint works out each once
+	size_t Column ( uint32_t x ) const {
+		static constexpr uint8_t spread[ tileSize ] = { 0, 1, 4, 5, 16, 17, 20, 21 };
+		return size_t( x / tileSize ) * tileSize * tileSize + spread[ x % tileSize ];
+	}
+	size_t Row ( uint32_t y ) const {
+		static constexpr uint8_t spread[ tileSize ] = { 0, 2, 8, 10, 32, 34, 40, 42 };
+		return size_t( y / tileSize ) * tilesX * tileSize * tileSize + spread[ y % tileSize ];
+	}
+	size_t Index ( uint32_t x, uint32_t y ) const { return Column( x ) + Row( y ); }
+
+	const uint16_t * Texel ( size_t index ) const { return &texels[ index * 4 ]; }
+	const uint16_t * Texel ( uint32_t x, uint32_t y ) const { return Texel( Index( x, y ) ); }
+
+	// from a row major RGBA8 image
+	void Swizzle ( const Image & image ) {
+		Allocate( image.width, image.height );
+		std::vector< uint16_t > row( size_t( width ) * 4 );
+		for ( uint32_t y = 0; y < height; y++ ) {
+			ConvertPixels< pixelFormat::RGBA8, pixelFormat::RGBA16F >( &image.data[ size_t( y ) * width * 4 ], row.data(), width );
+			for ( uint32_t x = 0; x < width; x++ ) {
+				std::memcpy( &texels[ Index( x, y ) * 4 ], &row[ x * 4 ], 4 * sizeof( uint16_t ) );
+			}
+		}
+	}
+};
+
+enum class textureFilter { nearest, bilinear, trilinear };
+enum class textureWrap { repeat, clamp };
+
+namespace textureDetail {
+	// four channels out of RGBA16F, as floats
+#if defined( __F16C__ )
+	using texel = __m128;
+	inline texel Load ( const uint16_t * p ) { return _mm_cvtph_ps( _mm_loadl_epi64( ( const __m128i * ) p ) ); }
+	inline texel Lerp ( texel a, texel b, float t ) { return _mm_add_ps( a, _mm_mul_ps( _mm_sub_ps( b, a ), _mm_set1_ps( t ) ) ); }
+	inline vec4 ToVec4 ( texel v ) { vec4 result; _mm_storeu_ps( &result[ 0 ], v ); return result; }
+#else
+	using texel = vec4;
+	inline texel Load ( const uint16_t * p ) { return vec4( HalfToFloat( p[ 0 ] ), HalfToFloat( p[ 1 ] ), HalfToFloat( p[ 2 ] ), HalfToFloat( p[ 3 ] ) ); }
+	inline texel Lerp ( texel a, texel b, float t ) { return a + ( b - a ) * t; }
+	inline vec4 ToVec4 ( texel v ) { return v; }
+#endif
+
+	// repeat keeps the fraction, clamp keeps it inside [ 0, 1 ] - either way through a compare at the end, so a NaN or
+	// infinite texCoord comes out as zero instead of turning into a wild texel index
+	inline vec2 Wrap ( vec2 texCoord, textureWrap wrap ) {
+		if ( wrap == textureWrap::repeat ) texCoord -= glm::floor( texCoord );
+		for ( int i = 0; i < 2; i++ ) texCoord[ i ] = ( texCoord[ i ] > 0.0f ) ? std::min( texCoord[ i ], 1.0f ) : 0.0f;
+		return texCoord;
+	}
+
+	// the texCoord is in range after Wrap, so the texel coordinates only ever step off an edge by one, and
+	// wrap or clamp with a compare
+	inline texel Bilinear ( const textureLevel & l, vec2 texCoord, textureWrap wrap ) {
+		texCoord = Wrap( texCoord, wrap );
+		const float u = texCoord.x * float( l.width ) + 0.5f;	// one past the texel coordinate, so truncation floors
+		const float v = texCoord.y * float( l.height ) + 0.5f;
+		const int x = int( u ) - 1, y = int( v ) - 1;
+		const float fx = u - float( x + 1 ), fy = v - float( y + 1 );
+		const int w = int( l.width ), h = int( l.height );
+		int x0, x1, y0, y1;
+		if ( wrap == textureWrap::repeat ) {
+			x0 = x < 0 ? w - 1 : x;
+			y0 = y < 0 ? h - 1 : y;
+			x1 = x + 1 >= w ? 0 : x + 1;
+			y1 = y + 1 >= h ? 0 : y + 1;
+		} else {
+			x0 = std::max( x, 0 );
+			y0 = std::max( y, 0 );
+			x1 = std::min( x + 1, w - 1 );
+			y1 = std::min( y + 1, h - 1 );
+		}
+		const size_t c0 = l.Column( x0 ), c1 = l.Column( x1 ), r0 = l.Row( y0 ), r1 = l.Row( y1 );
+		const texel top = Lerp( Load( l.Texel( c0 + r0 ) ), Load( l.Texel( c1 + r0 ) ), fx );
+		const texel bottom = Lerp( Load( l.Texel( c0 + r1 ) ), Load( l.Texel( c1 + r1 ) ), fx );
+		return Lerp( top, bottom, fy );
+	}
+
+	inline texel Nearest ( const textureLevel & l, vec2 texCoord, textureWrap wrap ) {
+		texCoord = Wrap( texCoord, wrap );
+		const uint32_t x = std::min( uint32_t( texCoord.x * float( l.width ) ), l.width - 1 );
+		const uint32_t y = std::min( uint32_t( texCoord.y * float( l.height ) ), l.height - 1 );
+		return Load( l.Texel( x, y ) );
+	}
+}
+
+class TextureStreamer {
+public:
+	// bytes of resident mip levels kept across Trim() calls
+	size_t budget = size_t( 256 ) << 20;
+
+	textureFilter filter = textureFilter::trilinear;
+
+	// registers a texture, returns its id - an empty path is a blank texture, sampling as transparent black
+	int Add ( const std::string & path, textureWrap wrap = textureWrap::repeat ) {
+		textures.emplace_back();
+		textures.back().path = path;
+		textures.back().wrap = wrap;
+		return int( textures.size() - 1 );
+	}
+
+	size_t Count () const { return textures.size(); }
+
+	// false when no sample of this texture can have zero alpha, so alpha testing can skip sampling it - textures that
+	// failed to load, and blank ones, sample as transparent black everywhere
+	bool Transparent ( int id ) {
+		if ( id < 0 || id >= int( textures.size() ) ) return false;
+		texture & t = textures[ id ];
+		if ( !t.resolved.load( std::memory_order_acquire ) ) Resolve( t );
+		return t.header.levelCount == 0 || t.header.transparent != 0;
+	}
+	size_t ResidentBytes () const { return residentBytes.load( std::memory_order_relaxed ); }
+
+	// only while nothing is sampling
+	void Clear () {
+		textures.clear();
+		residentBytes = 0;
+	}
+
+	// filtered sample from the levels matching the footprint of a pixel - ddx and ddy are the change in texCoord over
+	// one pixel step in x and y. texCoord can be anywhere, the wrap mode of the texture brings it into range
+	vec4 Sample ( int id, vec2 texCoord, vec2 ddx, vec2 ddy ) {
+		using namespace textureDetail;
+		if ( id < 0 || id >= int( textures.size() ) ) return vec4( 1.0f ); // no material
+		texture & t = textures[ id ];
+		if ( !t.resolved.load( std::memory_order_acquire ) ) Resolve( t );
+		if ( t.header.levelCount == 0 ) return vec4( 0.0f );
+
+		const vec2 size = vec2( t.header.width[ 0 ], t.header.height[ 0 ] );
+		const int lastLevel = int( t.header.levelCount ) - 1;
+		float lod = std::log2( std::max( std::max( glm::length( ddx * size ), glm::length( ddy * size ) ), 1.0f ) );
+		// clamped as a float - a degenerate footprint next to a near clipped triangle can be infinite or NaN, and that
+		// converts to INT_MIN. Those get the coarsest level
+		lod = std::isfinite( lod ) ? std::clamp( lod, 0.0f, float( lastLevel ) ) : float( lastLevel );
+
+		if ( filter == textureFilter::trilinear ) {
+			const int level = std::min( int( lod ), lastLevel );
+			const float blend = level == lastLevel ? 0.0f : lod - float( level );
+			const textureLevel * fine = Level( t, level );
+			if ( !fine ) return vec4( 0.0f );
+			const texel a = Bilinear( *fine, texCoord, t.wrap );
+			if ( blend == 0.0f ) return ToVec4( a );
+			const textureLevel * coarse = Level( t, level + 1 );
+			if ( !coarse ) return ToVec4( a );
+			return ToVec4( Lerp( a, Bilinear( *coarse, texCoord, t.wrap ), blend ) );
+		}
+
+		const textureLevel * l = Level( t, std::min( int( lod + 0.5f ), lastLevel ) );
+		if ( !l ) return vec4( 0.0f );
+		return ToVec4( filter == textureFilter::bilinear ? Bilinear( *l, texCoord, t.wrap ) : Nearest( *l, texCoord, t.wrap ) );
+	}
+
+	// least recently sampled levels first, until the resident set fits the budget - call between draws
+	void Trim () {
+		if ( residentBytes.load() > budget ) {
+			struct candidate { uint32_t lastUse; texture * t; int level; };
+			std::vector< candidate > candidates;
+			for ( auto & t : textures ) {
+				for ( int i = 0; i < int( t.header.levelCount ); i++ ) {
+					if ( t.levels[ i ].resident.load() && !t.levels[ i ].pinned ) candidates.push_back( { t.levels[ i ].lastUse.load(), &t, i } );
+				}
+			}
+			std::sort( candidates.begin(), candidates.end(), [] ( const candidate & a, const candidate & b ) {
+				return a.lastUse < b.lastUse;
+			} );
+			for ( auto & c : candidates ) {
+				if ( residentBytes.load() <= budget ) break;
+				mipLevel & l = c.t->levels[ c.level ];
+				residentBytes -= l.level->texels.size() * sizeof( uint16_t );
+				l.resident.store( nullptr );
+				l.level.reset();
+			}
+		}
+		useClock++;
+	}
+
+private:
+	struct mipLevel {
+		std::atomic< textureLevel * > resident { nullptr };	// published once loaded, what Sample reads
+		std::unique_ptr< textureLevel > level;				// owns it
+		std::atomic< uint32_t > lastUse { 0 };
+		std::atomic< bool > failed { false };				// couldn't be loaded - sticky, so it isn't retried per sample
+		bool pinned = false;								// kept from the build, no chain file behind it
+	};
+
+	struct texture {
+		std::string path;
+		std::string chainPath;
+		textureWrap wrap = textureWrap::repeat;
+		mipChainHeader header;						// levelCount stays zero if the source couldn't be loaded
+		std::atomic< bool > resolved { false };
+		std::mutex mutex;							// resolving, and loading levels
+		mipLevel levels[ mipChainMaxLevels ];
+	};
+
+	std::deque< texture > textures;					// deque, so ids stay put as textures are added
+	std::atomic< size_t > residentBytes { 0 };
+	std::atomic< uint32_t > useClock { 1 };
+
+	// resident level, loading it if it isn't - nullptr if it can't be loaded
+	const textureLevel * Level ( texture & t, int level ) {
+		mipLevel & l = t.levels[ level ];
+		const textureLevel * resident = l.resident.load( std::memory_order_acquire );
+		if ( !resident ) {
+			if ( l.failed.load( std::memory_order_relaxed ) ) return nullptr;
+			if ( !( resident = LoadLevel( t, level ) ) ) return nullptr;
+		}
+		const uint32_t now = useClock.load( std::memory_order_relaxed );
+		if ( l.lastUse.load( std::memory_order_relaxed ) != now ) l.lastUse.store( now, std::memory_order_relaxed ); // keeps the line shared
+		return resident;
+	}
+
+	static std::string ChainPathFor ( const std::string & path ) {
+		std::stringstream ss;
+		ss << assetCacheDirectory << std::hex << std::setw( 16 ) << std::setfill( '0' )
+			<< HashBytes( ( const uint8_t * ) path.data(), path.size() ) << ".mips";
+		return ss.str();
+	}
+
+	static size_t Align ( size_t offset ) { return ( offset + 63 ) & ~size_t( 63 ); }
+	static size_t LevelBytes ( uint32_t width, uint32_t height ) { return textureLevel::TexelCount( width, height ) * 4 * sizeof( uint16_t ); }
+
+	// finds the dimensions of every level - from the chain file when it's current, otherwise by building it
+	void Resolve ( texture & t ) {
+		std::lock_guard< std::mutex > lock( t.mutex );
+		if ( t.resolved.load() ) return;
+		uint64_t contentHash = 0;
+		if ( !t.path.empty() ) {
+			mappedFile source( t.path );
+			if ( source.Valid() ) contentHash = HashBytes( source.base, source.size );
+		}
+		if ( contentHash != 0 ) {
+			t.chainPath = ChainPathFor( t.path );
+			if ( !ReadHeader( t.chainPath, contentHash, t.header ) ) {
+				BuildChain( t, contentHash );
+			}
+		}
+		t.resolved.store( true, std::memory_order_release );
+	}
+
+	static bool ReadHeader ( const std::string & chainPath, uint64_t contentHash, mipChainHeader & header ) {
+		mappedFile chain( chainPath );
+		if ( !chain.Valid() || chain.size < assetCachePageSize ) return false;
+		mipChainHeader h;
+		std::memcpy( &h, chain.base, sizeof( h ) );
+		if ( std::memcmp( h.magic, mipChainHeader().magic, sizeof( h.magic ) ) != 0 || h.version != mipChainVersion ||
+			h.contentHash != contentHash || h.fileSize != chain.size || h.levelCount == 0 || h.levelCount > mipChainMaxLevels ) {
+			return false;
+		}
+		for ( uint32_t i = 0; i < h.levelCount; i++ ) {
+			if ( h.offset[ i ] + LevelBytes( h.width[ i ], h.height[ i ] ) > chain.size ) return false;
+		}
+		header = h;
+		return true;
+	}
+
+	// decodes the source, flips it so rows go up with the texcoords, and writes it out with its mip chain, each level
+	// already swizzled - written to a temporary and renamed, like the image cache. If the write fails, every level is
+	// swizzled again and kept resident, pinned, so the texture still samples - caller holds t.mutex
+	void BuildChain ( texture & t, uint64_t contentHash ) {
+		const std::string & chainPath = t.chainPath;
+		Image base;
+		if ( !base.Load( t.path ) || base.data.empty() ) return;
+		base.FlipVertical();
+		std::vector< Image > chain = base.MipChain();
+		chain.insert( chain.begin(), std::move( base ) );
+		chain.resize( std::min< size_t >( chain.size(), mipChainMaxLevels ) );
+
+		mipChainHeader h;
+		h.levelCount = uint32_t( chain.size() );
+		h.contentHash = contentHash;
+		size_t offset = assetCachePageSize;
+		for ( size_t i = 0; i < chain.size(); i++ ) {
+			for ( size_t j = 3; j < chain[ i ].data.size() && !h.transparent; j += 4 ) h.transparent = chain[ i ].data[ j ] == 0;
+			h.width[ i ] = chain[ i ].width;
+			h.height[ i ] = chain[ i ].height;
+			h.offset[ i ] = offset;
+			offset = Align( offset + LevelBytes( chain[ i ].width, chain[ i ].height ) );
+		}
+		h.fileSize = offset;
+
+		std::error_code ec;
+		std::filesystem::create_directories( assetCacheDirectory, ec );
+		const std::string tempPath = chainPath + ".tmp" + std::to_string( getpid() );
+		std::ofstream file( tempPath, std::ios::binary );
+		std::vector< uint8_t > padding( assetCachePageSize, 0 );
+		std::memcpy( padding.data(), &h, sizeof( h ) );
+		file.write( ( const char * ) padding.data(), padding.size() );
+		std::fill( padding.begin(), padding.end(), 0 );
+		textureLevel level;
+		for ( size_t i = 0; i < chain.size(); i++ ) {
+			level.Swizzle( chain[ i ] );
+			const size_t bytes = level.texels.size() * sizeof( uint16_t );
+			file.write( ( const char * ) level.texels.data(), bytes );
+			file.write( ( const char * ) padding.data(), Align( h.offset[ i ] + bytes ) - ( h.offset[ i ] + bytes ) );
+		}
+		file.close();
+		bool written = file.good();
+		if ( written ) {
+			std::filesystem::rename( tempPath, chainPath, ec );
+			written = !ec;
+		}
+		if ( !written ) {
+			std::filesystem::remove( tempPath, ec );
+			for ( size_t i = 0; i < chain.size(); i++ ) {
+				mipLevel & l = t.levels[ i ];
+				l.level = std::make_unique< textureLevel >();
+				l.level->Swizzle( chain[ i ] );
+				l.pinned = true;
+				residentBytes += l.level->texels.size() * sizeof( uint16_t );
+				l.resident.store( l.level.get(), std::memory_order_release );
+			}
+		}
+		t.header = h;
+	}
+
+	// copies one level out of the chain file, nullptr if it's gone or doesn't match any more - then the level is marked
+	// failed, and samples of it come back transparent without another look at the file
+	textureLevel * LoadLevel ( texture & t, int level ) {
+		std::lock_guard< std::mutex > lock( t.mutex );
+		mipLevel & l = t.levels[ level ];
+		if ( textureLevel * resident = l.resident.load() ) return resident; // another thread got here first
+		if ( l.failed.load() ) return nullptr;
+
+		mappedFile chain( t.chainPath );
+		mipChainHeader h;
+		bool matches = chain.Valid() && chain.size >= assetCachePageSize;
+		if ( matches ) {
+			std::memcpy( &h, chain.base, sizeof( h ) );
+			matches = h.contentHash == t.header.contentHash && h.fileSize == chain.size;
+		}
+		if ( !matches ) {
+			l.failed.store( true, std::memory_order_relaxed );
+			return nullptr;
+		}
+
+		l.level = std::make_unique< textureLevel >();
+		l.level->Allocate( t.header.width[ level ], t.header.height[ level ] );
+		const size_t bytes = l.level->texels.size() * sizeof( uint16_t );
+		std::memcpy( l.level->texels.data(), chain.base + t.header.offset[ level ], bytes );
+		residentBytes += bytes;
+		l.resident.store( l.level.get(), std::memory_order_release );
+		return l.level.get();
+	}
+};
+
+#endif
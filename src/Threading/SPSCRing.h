@@ -0,0 +1,52 @@
+#pragma once
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// bounded single producer, single consumer ring of preallocated slots
+	// - slots are written and read in place: BeginWrite() hands out the next free slot ( or nullptr when full ), and
+	//   EndWrite() publishes it - same pattern on the read side - so nothing is allocated, copied or locked in between
+	// - exactly one thread may write and one thread may read, the indices are only ever advanced by their owner
+template < typename T >
+class spscRing {
+public:
+	spscRing ( size_t capacity ) : slots( capacity ) {}
+
+	// producer side
+	T * BeginWrite () {
+		const size_t tail = writeIndex.load( std::memory_order_relaxed );
+		if ( tail - readIndex.load( std::memory_order_acquire ) == slots.size() ) return nullptr; // full
+		return &slots[ tail % slots.size() ];
+	}
+	void EndWrite () {
+		writeIndex.store( writeIndex.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+	}
+
+	// consumer side
+	T * BeginRead () {
+		const size_t head = readIndex.load( std::memory_order_relaxed );
+		if ( head == writeIndex.load( std::memory_order_acquire ) ) return nullptr; // empty
+		return &slots[ head % slots.size() ];
+	}
+	void EndRead () {
+		readIndex.store( readIndex.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+	}
+
+	// safe from any thread, but only a snapshot
+	size_t Size () const { return writeIndex.load( std::memory_order_acquire ) - readIndex.load( std::memory_order_acquire ); }
+	size_t Capacity () const { return slots.size(); }
+
+	// direct slot access, for preallocating before either side starts
+	T & Slot ( size_t i ) { return slots[ i ]; }
+
+private:
+	std::vector< T > slots;
+	// separate cache lines, so the two sides don't false share
+	alignas( 64 ) std::atomic< size_t > writeIndex{ 0 };
+	alignas( 64 ) std::atomic< size_t > readIndex{ 0 };
+};
+
+#endif
@@ -0,0 +1,147 @@
+#pragma once
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// persistent worker threads for the CPU side image / raster work
+	// - one job at a time: the calling thread hands out work and participates, then blocks until all workers are done
+	// - ParallelFor called from inside a job runs serially on that thread, so nested use is safe, just not parallel
+	// - workers sleep on a condition variable between jobs, so an idle pool costs nothing
+	// - long running background work ( bloom, local tonemap ) goes to a second pool, through a Redirect on its thread -
+	//   a job holds its pool for its whole run, and the frame loop's own ParallelFor calls shouldn't queue up behind it
+class ThreadPool {
+public:
+	// the pool for the calling thread - the main one, unless a Redirect on this thread says otherwise
+	static ThreadPool & Get () {
+		if ( redirected ) return *redirected;
+		static ThreadPool instance( std::max( int( std::thread::hardware_concurrency() ), 1 ) - 1 );
+		return instance;
+	}
+
+	// the pool for background work - half the workers, so a frame that overlaps it still has threads to go around
+	static ThreadPool & Background () {
+		static ThreadPool instance( std::max( int( std::thread::hardware_concurrency() ) / 2, 1 ) );
+		return instance;
+	}
+
+	// while in scope, Get() on this thread returns pool - put one at the top of a background job
+	class Redirect {
+	public:
+		Redirect ( ThreadPool & pool ) : previous( redirected ) { redirected = &pool; }
+		~Redirect () { redirected = previous; }
+		Redirect ( const Redirect & ) = delete;
+		Redirect & operator = ( const Redirect & ) = delete;
+	private:
+		ThreadPool * previous;
+	};
+
+	// number of threads that participate in a job, including the caller
+	int NumThreads () const { return int( workers.size() ) + 1; }
+
+	// calls func( i ) for every i in [ begin, end ), handing out chunks of grain indices at a time
+	template < typename F >
+	void ParallelFor ( int begin, int end, F && func, int grain = 1 ) {
+		if ( end <= begin ) return;
+		grain = std::max( grain, 1 );
+		if ( insideJob || workers.empty() || ( end - begin ) <= grain ) {
+			for ( int i = begin; i < end; i++ ) func( i );
+			return;
+		}
+		std::atomic< int > next( begin );
+		RunOnAll( [ & ] ( int ) {
+			int chunkStart;
+			while ( ( chunkStart = next.fetch_add( grain ) ) < end ) {
+				const int chunkEnd = std::min( chunkStart + grain, end );
+				for ( int i = chunkStart; i < chunkEnd; i++ ) func( i );
+			}
+		} );
+	}
+
+	// calls func( threadIndex ) exactly once on each participating thread, threadIndex in [ 0, NumThreads() )
+	void RunOnAll ( const std::function< void( int ) > & func ) {
+		if ( insideJob || workers.empty() ) {
+			func( 0 );
+			return;
+		}
+		std::lock_guard< std::mutex > jobLock( submitMutex ); // one job at a time from multiple submitting threads
+		{
+			std::lock_guard< std::mutex > lock( stateMutex );
+			job = &func;
+			pending = int( workers.size() );
+			generation++;
+		}
+		wake.notify_all();
+
+		insideJob = true;
+		func( 0 );
+		insideJob = false;
+
+		std::unique_lock< std::mutex > lock( stateMutex );
+		done.wait( lock, [ this ] { return pending == 0; } );
+		job = nullptr;
+	}
+
+	~ThreadPool () {
+		{
+			std::lock_guard< std::mutex > lock( stateMutex );
+			quit = true;
+		}
+		wake.notify_all();
+		for ( auto & worker : workers ) worker.join();
+	}
+
+private:
+	ThreadPool ( int count ) {
+		for ( int i = 0; i < count; i++ ) {
+			workers.emplace_back( [ this, i ] { WorkerLoop( i + 1 ); } );
+		}
+	}
+
+	void WorkerLoop ( int threadIndex ) {
+		insideJob = true;
+		uint64_t seenGeneration = 0;
+		while ( true ) {
+			const std::function< void( int ) > * current;
+			{
+				std::unique_lock< std::mutex > lock( stateMutex );
+				wake.wait( lock, [ & ] { return quit || generation != seenGeneration; } );
+				if ( quit ) return;
+				seenGeneration = generation;
+				current = job;
+			}
+			( *current )( threadIndex );
+			{
+				std::lock_guard< std::mutex > lock( stateMutex );
+				if ( --pending == 0 ) done.notify_one();
+			}
+		}
+	}
+
+	std::vector< std::thread > workers;
+	std::mutex submitMutex;
+	std::mutex stateMutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function< void( int ) > * job = nullptr;
+	uint64_t generation = 0;
+	int pending = 0;
+	bool quit = false;
+
+	static inline thread_local bool insideJob = false;
+	static inline thread_local ThreadPool * redirected = nullptr;
+};
+
+// shorthand for the common case
+template < typename F >
+inline void ParallelFor ( int begin, int end, F && func, int grain = 1 ) {
+	ThreadPool::Get().ParallelFor( begin, end, std::forward< F >( func ), grain );
+}
+
+#endif
@@ -4,11 +4,14 @@
 
 class engine {
 public:
-	engine()  { Init(); }
+	engine()  { std::random_device r; rng.seed( r() ); Init(); }
 	~engine() { Quit(); }
 
 	bool MainLoop (); // called from main
 
+	// renders the configurations listed in the file, scoring against the reference - see src/engine/benchmark.json
+	void StartBenchmark ( string configPath, bool quitWhenDone = false );
+
 private:
 	// application handles + basic data
 	// windowHandler w; // this was partially implemented in Voraldo13, consider bringing that over
@@ -27,12 +30,50 @@ private:
 	lensParameters lens;
 	sceneParameters scene;
 	postParameters post;
+	benchmarkState bench;
+
+	// frame sequence recording - display texture goes through two PBOs, so the readback is picked up a frame later
+	FrameCapture capture;
+	GLuint capturePBO[ 2 ] = { 0, 0 };
+	bool capturePending[ 2 ] = { false, false };
+	uint64_t captureFrameNumber[ 2 ] = { 0, 0 };
+	int captureSlot = 0;
+
+	// white balance + gamma + tonemap, baked when those change, sampled by postprocess.cs.glsl
+	ColorGradeLUT colorGrade;
+
+	// FFT bloom - the accumulator is convolved on the CPU in the background, the result goes to the GPU when it finishes
+	FFTBloom bloom;
+	ImageF bloomResult;					// last finished convolution, what bloomTexture holds
+	std::future< ImageF > bloomJob;
+	GLuint bloomReadbackBuffer = 0;		// PBO the accumulator is read back through, so the readback never stalls a frame
+	GLsync bloomReadbackFence = nullptr;	// set while a readback is in flight
+	bool bloomKernelDirty = true;		// kernel settings changed, rebuilt when no convolution is in flight
+	int bloomFramesUntilRefresh = 0;
+
+	// local tonemap - bilateral grid built on the CPU in the background, sliced by postprocess.cs.glsl
+	LocalTonemapGrid localTonemap;
+	std::future< LocalTonemapGrid > localTonemapJob;
+	int localTonemapFramesUntilRefresh = 0;
+
+	// palettes from paletteList.png, for the dithered screenshot - loaded the first time the Post tab asks for them
+	std::vector< Palette > palettes;
+
+	// glitch effects - graph runs on a captured copy of the accumulator, results are written back over it
+	GlitchGraph glitch;
+	bool glitchLive = false;			// reapply whenever a node changes
+
+	// all the host side randomness ( wang seed, noise offsets, tile order ) - reseeded for benchmark runs
+	std::mt19937_64 rng;
 
 	// OpenGL data handles
 		// render
 	GLuint colorAccumulatorTexture;
 	GLuint normalAccumulatorTexture;
 	GLuint blueNoiseTexture;
+	GLuint colorGradeTexture;
+	GLuint bloomTexture;
+	GLuint localTonemapTexture;
 	GLuint pathtraceShader;
 	GLuint postprocessShader;
 		// present
@@ -78,11 +119,33 @@ private:
 	// rendering functions
 	void Render(); 				// swichable functionality
 	void Postprocess();			// tonemap, dither
+	void UpdateBloom();			// picks up finished bloom convolutions, starts new ones
+	void BuildBloomKernel();	// starburst or PSF, per post settings
+	void UpdateLocalTonemap();	// picks up finished bilateral grids, starts new ones
+	void ApplyGlitch();			// runs the glitch graph, result replaces the color accumulator contents
 	glm::ivec2 GetTile();		// tile renderer offset
 
 	// screenshot functions
 	void BasicScreenShot();		// pull render target from texture memory
 	void EXRScreenshot();		// pull accumulator data directly and save 32-bit float RGBA EXR
+	ImageF GrabAccumulator( bool normalAndDepth = false );	// color ( or normal / depth ) accumulator contents, top row first
+	void DitheredScreenShot();	// accumulator through the CPU postprocess and dither stage, saved as PNG
+
+	// CPU port of the postprocess shader
+	postprocessSettings CPUPostprocessSettings();	// current post parameters, in the form Postprocess.h takes
+	void CheckCPUPostprocess();						// compares against the GPU result in the display texture
+	void CheckColorGradeLUT();						// reports how far the baked LUT is from the analytic curves
+
+	// frame capture
+	void StartCapture();
+	void StopCapture();
+	void CaptureFrame();		// called every frame, after postprocess
+
+	// benchmark harness
+	void BenchmarkUpdate();						// checks time budgets, takes snapshots, advances configurations
+	void BenchmarkBeginConfiguration();			// applies parameters, reseeds, and resets accumulation
+	void BenchmarkApplyConfiguration( const benchmarkConfiguration &c );
+	void BenchmarkFinish();
 
 	// large screenshot
 	// void offlineScreenShot();	// render out with prescribed sample count + resolution
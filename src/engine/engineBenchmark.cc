@@ -0,0 +1,195 @@
+#include "engine.h"
+
+// benchmark harness - for each configuration in the json, render the same view with the same seed, and at each
+//  checkpoint ( seconds of accumulated render time ) save the accumulator and score it against a reference image
+//  - results are written to <outputDirectory>/<name>.csv, one row per checkpoint, for plotting error against time
+//  - the reference is loaded from referencePath if it exists, otherwise rendered first with referenceConfiguration
+//  - time is the sum of the tile loop times, so readback, scoring, and the ui don't count against a configuration
+
+static benchmarkConfiguration ParseBenchmarkConfiguration ( const json &j, benchmarkConfiguration c ) {
+	// anything not specified keeps the value passed in
+	if ( j.contains( "name" ) )			c.name = j[ "name" ];
+	if ( j.contains( "understep" ) )	c.understep = j[ "understep" ];
+	if ( j.contains( "epsilon" ) )		c.epsilon = j[ "epsilon" ];
+	if ( j.contains( "maxSteps" ) )		c.maxSteps = j[ "maxSteps" ];
+	if ( j.contains( "tileSize" ) )		c.tileSize = j[ "tileSize" ];
+	if ( j.contains( "normalMethod" ) )	c.normalMethod = j[ "normalMethod" ];
+	return c;
+}
+
+static glm::vec3 ParseVec3 ( const json &j ) {
+	return glm::vec3( j[ 0 ], j[ 1 ], j[ 2 ] );
+}
+
+void engine::StartBenchmark ( string configPath, bool quitWhenDone ) {
+	ifstream i( configPath );
+	if ( !i.is_open() ) {
+		cout << T_RED << "Benchmark config " << configPath << " could not be opened" << RESET << newline;
+		return;
+	}
+	json j;
+	i >> j; i.close();
+
+	// the parameters from the ui are the defaults for anything a configuration doesn't specify
+	benchmarkConfiguration defaults;
+	defaults.understep = core.understep;
+	defaults.epsilon = core.epsilon;
+	defaults.maxSteps = core.maxSteps;
+	defaults.tileSize = host.tileSize;
+	defaults.normalMethod = core.normalMethod;
+
+	bench.seed = j.value( "seed", uint64_t( 0 ) );
+	bench.viewerPosition = j.contains( "viewerPosition" ) ? ParseVec3( j[ "viewerPosition" ] ) : core.viewerPosition;
+	bench.basisX = j.contains( "basisX" ) ? ParseVec3( j[ "basisX" ] ) : core.basisX;
+	bench.basisY = j.contains( "basisY" ) ? ParseVec3( j[ "basisY" ] ) : core.basisY;
+	bench.basisZ = j.contains( "basisZ" ) ? ParseVec3( j[ "basisZ" ] ) : core.basisZ;
+	bench.outputDirectory = j.value( "outputDirectory", string( "benchmark/" ) );
+	if ( bench.outputDirectory.back() != '/' ) bench.outputDirectory += '/';
+
+	const json reference = j.value( "reference", json::object() );
+	bench.referencePath = reference.value( "path", bench.outputDirectory + "reference.exr" );
+	bench.referenceSeconds = reference.value( "seconds", 300.0f );
+	bench.referenceConfiguration = ParseBenchmarkConfiguration( reference, defaults );
+	bench.referenceConfiguration.name = "reference";
+
+	bench.checkpointSeconds = j.value( "checkpointSeconds", std::vector< float >() );
+	std::sort( bench.checkpointSeconds.begin(), bench.checkpointSeconds.end() );
+	bench.configurations.clear();
+	for ( auto &c : j.value( "configurations", json::array() ) ) {
+		bench.configurations.push_back( ParseBenchmarkConfiguration( c, defaults ) );
+	}
+	if ( bench.checkpointSeconds.empty() || bench.configurations.empty() ) {
+		cout << T_RED << "Benchmark config " << configPath << " has no checkpoints or no configurations" << RESET << newline;
+		return;
+	}
+
+	std::error_code ec;
+	std::filesystem::create_directories( bench.outputDirectory, ec );
+
+	// keep the current state, to put back when we're done
+	bench.savedCore = core;
+	bench.savedTileSize = host.tileSize;
+	bench.quitWhenDone = quitWhenDone;
+	bench.active = true;
+	bench.currentConfiguration = 0;
+	host.currentMode = renderMode::pathtrace;
+
+	cout << T_YELLOW << BOLD << "Benchmark" << RESET << " - " << bench.configurations.size() << " configurations, "
+		<< bench.checkpointSeconds.size() << " checkpoints up to " << bench.checkpointSeconds.back() << "s" << newline;
+
+	bench.reference = ImageF();
+	if ( std::filesystem::exists( bench.referencePath ) ) {
+		bench.reference.loadEXR( bench.referencePath.c_str() );
+	}
+	if ( bench.reference.width == uint32_t( config.width ) && bench.reference.height == uint32_t( config.height ) ) {
+		cout << T_RED << "      Reference : " << T_CYAN << bench.referencePath << RESET << " loaded" << newline;
+		bench.renderingReference = false;
+	} else {
+		cout << T_RED << "      Reference : " << T_CYAN << bench.referencePath << RESET << " rendering for "
+			<< bench.referenceSeconds << "s" << newline;
+		bench.renderingReference = true;
+	}
+	BenchmarkBeginConfiguration();
+}
+
+void engine::BenchmarkApplyConfiguration ( const benchmarkConfiguration &c ) {
+	core.understep = c.understep;
+	core.epsilon = c.epsilon;
+	core.maxSteps = c.maxSteps;
+	core.normalMethod = c.normalMethod;
+	host.tileSize = c.tileSize;
+	host.tileSizeUpdated = true; // also restarts the tile order, so it replays from the seed
+
+	core.viewerPosition = bench.viewerPosition;
+	core.basisX = bench.basisX;
+	core.basisY = bench.basisY;
+	core.basisZ = bench.basisZ;
+}
+
+void engine::BenchmarkBeginConfiguration () {
+	const benchmarkConfiguration &c = bench.renderingReference ? bench.referenceConfiguration : bench.configurations[ bench.currentConfiguration ];
+	BenchmarkApplyConfiguration( c );
+
+	// same seed for every configuration - same wang seeds, noise offsets, and tile order, frame for frame
+	rng.seed( bench.seed );
+	bench.nextCheckpoint = 0;
+	bench.renderMilliseconds = 0.0f;
+	host.rendererRequiresUpdate = true; // accumulators are cleared at the top of the next Render()
+
+	if ( !bench.renderingReference ) {
+		bench.curve.close();
+		bench.curve.open( bench.outputDirectory + c.name + ".csv" );
+		bench.curve << "seconds,samples,MSE,relMSE,PSNR,SSIM,FLIP" << newline;
+		cout << T_BLUE << "    " << c.name << RESET << " ( understep " << c.understep << ", epsilon " << c.epsilon
+			<< ", maxSteps " << c.maxSteps << ", tileSize " << c.tileSize << ", normalMethod " << c.normalMethod << " )" << newline;
+	}
+}
+
+void engine::BenchmarkUpdate () {
+	if ( !bench.active ) return;
+	ZoneScoped;
+
+	const float seconds = bench.renderMilliseconds / 1000.0f;
+	if ( bench.renderingReference ) {
+		if ( seconds >= bench.referenceSeconds ) {
+			bench.reference = GrabAccumulator();
+			bench.reference.saveEXR( bench.referencePath.c_str() );
+			cout << T_RED << "      Reference : " << T_CYAN << bench.referencePath << RESET << " saved, "
+				<< host.fullscreenPasses << " samples" << newline;
+			bench.renderingReference = false;
+			BenchmarkBeginConfiguration();
+		}
+		return;
+	}
+
+	// checkpoints land on frame boundaries, so the recorded time is the actual time, slightly past the target
+	if ( seconds >= bench.checkpointSeconds[ bench.nextCheckpoint ] ) {
+		const benchmarkConfiguration &c = bench.configurations[ bench.currentConfiguration ];
+		ImageF snapshot = GrabAccumulator();
+
+		std::stringstream ss;
+		ss << bench.outputDirectory << c.name << "_" << bench.checkpointSeconds[ bench.nextCheckpoint ] << "s.exr";
+		snapshot.saveEXR( ss.str().c_str() );
+
+		imageComparison result = CompareImages( snapshot, bench.reference );
+		if ( !result.valid ) {
+			cout << "      reference is " << bench.reference.width << "x" << bench.reference.height << ", snapshot is "
+				<< snapshot.width << "x" << snapshot.height << " - metrics not comparable" << newline;
+		}
+		bench.curve << seconds << "," << host.fullscreenPasses << "," << result.MSE << "," << result.relMSE << ","
+			<< result.PSNR << "," << result.SSIM << "," << result.FLIP << newline;
+		bench.curve.flush();
+		cout << "      " << std::fixed << std::setprecision( 2 ) << std::setw( 8 ) << seconds << "s " << std::setw( 6 ) << host.fullscreenPasses
+			<< " samples  relMSE " << std::scientific << std::setprecision( 4 ) << result.relMSE << std::fixed << std::setprecision( 4 )
+			<< "  SSIM " << result.SSIM << "  FLIP " << result.FLIP << newline;
+		cout.unsetf( std::ios_base::floatfield );
+
+		if ( ++bench.nextCheckpoint == int( bench.checkpointSeconds.size() ) ) {
+			if ( ++bench.currentConfiguration == int( bench.configurations.size() ) ) {
+				BenchmarkFinish();
+			} else {
+				BenchmarkBeginConfiguration();
+			}
+		}
+	}
+}
+
+void engine::BenchmarkFinish () {
+	bench.curve.close();
+	bench.active = false;
+	bench.renderingReference = false;
+	bench.reference = ImageF();
+
+	// back to the state from before the benchmark, with fresh randomness
+	core = bench.savedCore;
+	host.tileSize = bench.savedTileSize;
+	host.tileSizeUpdated = true;
+	host.rendererRequiresUpdate = true;
+	std::random_device r;
+	rng.seed( r() );
+
+	cout << T_YELLOW << BOLD << "Benchmark" << RESET << " - " << T_GREEN << "done." << RESET << " results in " << bench.outputDirectory << newline;
+	if ( bench.quitWhenDone ) {
+		pQuit = true;
+	}
+}
@@ -163,14 +163,46 @@ void engine::SetupTextureData () {
 	glBindImageTexture( 2, normalAccumulatorTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F );
 
 	// blue noise image on the GPU
-	Image blueNoiseImage{ "src/noise/blueNoise.png", LODEPNG };
+	std::shared_ptr< const Image > blueNoiseImage = AssetCache::Get().LoadImage( "src/noise/blueNoise.png" );
 	glGenTextures( 1, &blueNoiseTexture );
 	glActiveTexture( GL_TEXTURE3 );
 	glBindTexture( GL_TEXTURE_2D, blueNoiseTexture );
-	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, blueNoiseImage.width, blueNoiseImage.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &blueNoiseImage.data[ 0 ] );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, blueNoiseImage->width, blueNoiseImage->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &blueNoiseImage->data[ 0 ] );
 	glBindImageTexture( 3, blueNoiseTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8UI );
 
+	// color grade LUT, sampled with hardware trilinear - contents come from PostprocessUniformUpdate, first frame on
+	glGenTextures( 1, &colorGradeTexture );
+	glActiveTexture( GL_TEXTURE4 );
+	glBindTexture( GL_TEXTURE_3D, colorGradeTexture );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE );
+
+	// bloom, the accumulator convolved with the bloom kernel - black until the first convolution finishes
+	glGenTextures( 1, &bloomTexture );
+	glActiveTexture( GL_TEXTURE5 );
+	glBindTexture( GL_TEXTURE_2D, bloomTexture );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA32F, config.width, config.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &initial.data[ 0 ] );
+
+	// local tonemap bilateral grid - ( sum, count ) pairs, sized when the first grid comes back
+	glGenTextures( 1, &localTonemapTexture );
+	glActiveTexture( GL_TEXTURE6 );
+	glBindTexture( GL_TEXTURE_3D, localTonemapTexture );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE );
+	glActiveTexture( GL_TEXTURE0 );
+
 	cout << T_GREEN << "done." << RESET << newline;
+
+	// load times for anything that went through the asset cache
+	AssetCache::Get().Report();
 }
 
 void engine::ShaderCompile () {
@@ -5,10 +5,12 @@ bool engine::MainLoop () {
 
 	Render();						// update display texture and show it
 	Postprocess();					// gamma, tonemapping, etc
+	CaptureFrame();					// frame sequence recording, if active
 	BlitToScreen();					// fullscreen triangle copying the displayTexture to the screen
 	ImguiPass();					// do all the gui stuff
 	SDL_GL_SwapWindow( window );	// show what has just been drawn to the back buffer ( displayTexture + ImGui )
 	HandleEvents();					// handle keyboard / mouse events
+	BenchmarkUpdate();				// snapshots + configuration changes, when a benchmark is running
 	FrameMark;						// tells tracy that this is the end of a frame
 	return pQuit;					// break main loop when pQuit turns true
 }
@@ -23,12 +25,9 @@ void engine::Render () {
 	// send the uniforms
 	PathtraceUniformUpdate();
 
-	// used for the wang hash seeding
-	static std::default_random_engine gen;
-	static std::uniform_int_distribution< int > dist( 0, std::numeric_limits< int >::max() / 4 );
-
 	// seeding the wang rng in the shader - shader uses both the screen location and this value
-	int value = dist( gen );
+	std::uniform_int_distribution< int > dist( 0, std::numeric_limits< int >::max() / 4 );
+	int value = dist( rng );
 	glUniform1i( glGetUniformLocation( pathtraceShader, "wangSeed" ), value );
 
 	int mode = 0;
@@ -88,6 +87,9 @@ void engine::Render () {
 				break;
 			}
 		}
+		if ( bench.active ) {
+			bench.renderMilliseconds += looptime; // benchmark budgets count render time only, not readback / scoring
+		}
 		fpsHistory.push_back( 1000.0f / looptime );
 		fpsHistory.pop_front();
 
@@ -112,12 +114,9 @@ void engine::Render () {
 void engine::UpdateNoiseOffsets () {
 	ZoneScoped;
 
-	std::random_device r;
-	std::seed_seq s{ r(), r(), r(), r(), r(), r(), r(), r(), r() };
-	auto gen = std::mt19937_64( s );
 	std::uniform_int_distribution< int > dist( 0, 512 );
-	core.noiseOffset.x = dist( gen );
-	core.noiseOffset.y = dist( gen );
+	core.noiseOffset.x = dist( rng );
+	core.noiseOffset.y = dist( rng );
 }
 
 void engine::PathtraceUniformUpdate() {
@@ -172,11 +171,192 @@ void engine::PostprocessUniformUpdate () {
 	glUniform1f( glGetUniformLocation( postprocessShader, "maxDistance" ), core.maxDistance );
 	glUniform1f( glGetUniformLocation( postprocessShader, "gamma" ), post.gamma );
 	glUniform1i( glGetUniformLocation( postprocessShader, "displayType" ), post.displayType );
+
+	// rebake the color grade LUT, if the tonemap, gamma or color temperature moved since last frame
+	const postprocessSettings s = CPUPostprocessSettings();
+	if ( colorGrade.Update( s ) ) {
+		glActiveTexture( GL_TEXTURE4 );
+		glBindTexture( GL_TEXTURE_3D, colorGradeTexture );
+		glTexImage3D( GL_TEXTURE_3D, 0, GL_RGBA16F, ColorGradeLUT::size, ColorGradeLUT::size, ColorGradeLUT::size, 0, GL_RGBA, GL_FLOAT, colorGrade.Data() );
+		glActiveTexture( GL_TEXTURE0 );
+	}
+	glUniform1i( glGetUniformLocation( postprocessShader, "colorGradeLUT" ), 4 );
+	glUniform1i( glGetUniformLocation( postprocessShader, "useColorGradeLUT" ), ColorGradeLUT::Bakeable( post.tonemapMode, post.gamma ) );
+	glUniform1f( glGetUniformLocation( postprocessShader, "lutShaperRange" ), colorGrade.ShaperRange() );
+	glUniform3fv( glGetUniformLocation( postprocessShader, "whiteBalance" ), 1, s.whiteBalance );
+
+	// nothing to mix until the first convolution comes back
+	glUniform1i( glGetUniformLocation( postprocessShader, "bloomTexture" ), 5 );
+	glUniform1f( glGetUniformLocation( postprocessShader, "bloomIntensity" ), ( post.bloomEnable && bloomResult.width > 0 ) ? post.bloomIntensity : 0.0f );
+
+	// local tonemap, once a grid has come back - until then that mode shows the tonemap input unchanged
+	const bool useLocalTonemap = post.tonemapMode == localTonemapMode && localTonemap.Valid();
+	glUniform1i( glGetUniformLocation( postprocessShader, "localTonemapGrid" ), 6 );
+	glUniform1i( glGetUniformLocation( postprocessShader, "useLocalTonemap" ), useLocalTonemap );
+	if ( useLocalTonemap ) {
+		float scale[ 3 ], offset[ 3 ];
+		localTonemap.TextureTransform( scale, offset );
+		glUniform3fv( glGetUniformLocation( postprocessShader, "localGridScale" ), 1, scale );
+		glUniform3fv( glGetUniformLocation( postprocessShader, "localGridOffset" ), 1, offset );
+		glUniform1f( glGetUniformLocation( postprocessShader, "localBaseMax" ), localTonemap.BaseMax() );
+		glUniform1f( glGetUniformLocation( postprocessShader, "localCompression" ), localTonemap.Compression() );
+		glUniform1f( glGetUniformLocation( postprocessShader, "localDetail" ), localTonemap.Detail() );
+	}
+}
+
+void engine::UpdateBloom () {
+	ZoneScoped;
+
+	// a finished convolution goes to the GPU - flipped, GrabAccumulator hands it over top row first
+	if ( bloomJob.valid() && bloomJob.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready ) {
+		bloomResult = bloomJob.get();
+		std::vector< float > flipped( bloomResult.data.size() );
+		ConvertImage< pixelFormat::RGBA32F, pixelFormat::RGBA32F >( bloomResult.data.data(), flipped.data(), bloomResult.width, bloomResult.height, true );
+		glActiveTexture( GL_TEXTURE5 );
+		glBindTexture( GL_TEXTURE_2D, bloomTexture );
+		glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, bloomResult.width, bloomResult.height, GL_RGBA, GL_FLOAT, flipped.data() );
+		glActiveTexture( GL_TEXTURE0 );
+	}
+
+	if ( !post.bloomEnable || bloomJob.valid() ) return;
+
+	// the kernel spectra are cached in bloom, so it's only touched while no convolution is running
+	if ( bloomKernelDirty ) {
+		BuildBloomKernel();
+		bloomKernelDirty = false;
+		bloomFramesUntilRefresh = 0;
+	}
+
+	// a readback started on an earlier frame - once the fence says it's landed, the accumulator contents go to a
+	// background thread, and the convolution runs on the background pool from there
+	if ( bloomReadbackFence ) {
+		if ( glClientWaitSync( bloomReadbackFence, 0, 0 ) == GL_TIMEOUT_EXPIRED ) return;
+		glDeleteSync( bloomReadbackFence );
+		bloomReadbackFence = nullptr;
+
+		ImageF color( config.width, config.height );
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, bloomReadbackBuffer );
+		const float * pixels = ( const float * ) glMapBuffer( GL_PIXEL_PACK_BUFFER, GL_READ_ONLY );
+		if ( pixels ) {
+			ConvertImage< pixelFormat::RGBA32F, pixelFormat::RGBA32F >( pixels, color.data.data(), config.width, config.height, true );
+			glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+		}
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+		if ( !pixels ) return; // try again next interval
+
+		bloomJob = std::async( std::launch::async, [ this, color = std::move( color ) ] () {
+			ThreadPool::Redirect background( ThreadPool::Background() );
+			ImageF convolved;
+			bloom.Convolve( color, convolved );
+			return convolved;
+		} );
+		return;
+	}
+
+	// start the readback into a PBO - returns immediately, and it's picked up once the fence passes, a frame or more later
+	if ( --bloomFramesUntilRefresh <= 0 ) {
+		bloomFramesUntilRefresh = post.bloomInterval;
+		if ( !bloomReadbackBuffer ) glGenBuffers( 1, &bloomReadbackBuffer );
+		glMemoryBarrier( GL_PIXEL_BUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT );
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, bloomReadbackBuffer );
+		glBufferData( GL_PIXEL_PACK_BUFFER, GLsizeiptr( config.width ) * config.height * 4 * sizeof( float ), nullptr, GL_STREAM_READ );
+		glBindTexture( GL_TEXTURE_2D, colorAccumulatorTexture );
+		glGetTexImage( GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, nullptr );
+		glBindTexture( GL_TEXTURE_2D, displayTexture ); // restore state
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+		bloomReadbackFence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		glFlush(); // so the fence is actually submitted, and can signal before next frame's check
+	}
+}
+
+void engine::UpdateLocalTonemap () {
+	ZoneScoped;
+
+	// a finished grid goes to the GPU - the size follows the image range and the sigmas, so it's reallocated each time
+	if ( localTonemapJob.valid() && localTonemapJob.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready ) {
+		localTonemap = localTonemapJob.get();
+		if ( localTonemap.Valid() ) {
+			glActiveTexture( GL_TEXTURE6 );
+			glBindTexture( GL_TEXTURE_3D, localTonemapTexture );
+			glTexImage3D( GL_TEXTURE_3D, 0, GL_RG32F, localTonemap.Width(), localTonemap.Height(), localTonemap.Depth(), 0, GL_RG, GL_FLOAT, localTonemap.Data() );
+			glActiveTexture( GL_TEXTURE0 );
+		}
+	}
+
+	// switching to the local tonemap builds a grid right away
+	if ( post.tonemapMode != localTonemapMode ) {
+		localTonemapFramesUntilRefresh = 0;
+		return;
+	}
+	if ( localTonemapJob.valid() ) return;
+
+	// the grid is built from what the tonemap would see - same bloom mix, fog, white balance and gamma as the shader
+	if ( --localTonemapFramesUntilRefresh <= 0 ) {
+		localTonemapFramesUntilRefresh = post.localTonemapInterval;
+		postprocessSettings s = CPUPostprocessSettings();
+		s.tonemapMode = 0;
+		localTonemapJob = std::async( std::launch::async, [ s, color = GrabAccumulator(), normalDepth = GrabAccumulator( true ),
+			bloomed = post.bloomEnable ? bloomResult : ImageF(), intensity = post.bloomIntensity, settings = post.localTonemap ] () mutable {
+			ThreadPool::Redirect background( ThreadPool::Background() );
+			FFTBloom::Mix( color, bloomed, intensity ); // no-op without a convolution
+			LocalTonemapGrid grid;
+			grid.Build( PostprocessImageF( color, &normalDepth, s ), settings );
+			return grid;
+		} );
+	}
+}
+
+void engine::ApplyGlitch () {
+	ZoneScoped;
+
+	// nothing captured, or captured at a different size
+	if ( glitch.Input().width != uint32_t( config.width ) || glitch.Input().height != uint32_t( config.height ) ) return;
+
+	Tick();
+	const ImageF & result = glitch.Run();
+	const float runTime = Tock();
+
+	// same flip as the bloom upload, the graph works top row first
+	std::vector< float > flipped( result.data.size() );
+	ConvertImage< pixelFormat::RGBA32F, pixelFormat::RGBA32F >( result.data.data(), flipped.data(), result.width, result.height, true );
+	glActiveTexture( GL_TEXTURE1 );
+	glBindTexture( GL_TEXTURE_2D, colorAccumulatorTexture );
+	glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, result.width, result.height, GL_RGBA, GL_FLOAT, flipped.data() );
+	glActiveTexture( GL_TEXTURE0 );
+	glBindTexture( GL_TEXTURE_2D, displayTexture ); // restore state
+
+	cout << "Glitch graph evaluated " << glitch.Evaluated() << " nodes in " << runTime / 1000.0f << "ms";
+	if ( glitch.NonFinite() ) cout << ", zeroed " << glitch.NonFinite() << " NaN / Inf values";
+	cout << newline;
+}
+
+void engine::BuildBloomKernel () {
+	ZoneScoped;
+
+	if ( post.bloomKernel == 1 ) {
+		const string path( post.bloomPSFPath );
+		ImageF psf;
+		if ( path.size() > 4 && path.substr( path.size() - 4 ) == ".exr" ) {
+			psf.loadEXR( path.c_str() );
+		} else if ( std::filesystem::exists( path ) ) {
+			psf = ImageF( path );
+		}
+		if ( psf.width > 0 && psf.height > 0 ) {
+			bloom.SetKernel( psf );
+			return;
+		}
+		cout << "Bloom PSF " << path << " failed to load, using the starburst" << newline;
+	}
+	bloom.SetKernel( FFTBloom::Starburst( post.starburst ) );
 }
 
 void engine::Postprocess () {
 	ZoneScoped;
 
+	// bloom texture and local tonemap grid first, if either finished since last frame
+	UpdateBloom();
+	UpdateLocalTonemap();
+
 	// tonemapping and dithering, as configured in the GUI
 	glUseProgram( postprocessShader );
 
@@ -272,11 +452,30 @@ void engine::ImguiPass () {
 				case 4: host.currentMode = renderMode::previewShaded; break;
 				default: break;
 			}
+			if ( bench.active ) host.currentMode = renderMode::pathtrace; // benchmark owns the mode until it finishes
 
 			if ( ImGui::SmallButton( "Framebuffer Screenshot" ) ) {
 				BasicScreenShot();
 			}
 
+			if ( ImGui::SmallButton( "Dithered Screenshot ( CPU )" ) ) {
+				DitheredScreenShot();
+			}
+			ImGui::SameLine();
+			HelpMarker( "Reads back the accumulators and runs depth fog, gamma and tonemapping, then the dither or palette settings from the Post tab on the CPU, using all cores. Error diffusion is exact, rows run as a wavefront." );
+
+			if ( ImGui::SmallButton( "Check CPU Postprocess" ) ) {
+				CheckCPUPostprocess();
+			}
+			ImGui::SameLine();
+			HelpMarker( "Runs the CPU port of the postprocess shader on the accumulators, and compares it against the display texture the GPU produced. Prints the largest per channel difference and how many channels are off by more than one step." );
+
+			if ( ImGui::SmallButton( "Check Color Grade LUT" ) ) {
+				CheckColorGradeLUT();
+			}
+			ImGui::SameLine();
+			HelpMarker( "White balance, gamma and the tonemap curve are baked into a 65x65x65 LUT, so the shader does one texture fetch per pixel. This samples a million colors across the range the LUT covers and prints the largest difference from evaluating the curves directly, in 8-bit steps." );
+
 			if ( ImGui::SmallButton( "Accumulator Screenshot ( 32-bit per channel EXR )" ) ) {
 				EXRScreenshot();
 			}
@@ -287,6 +486,40 @@ void engine::ImguiPass () {
 				ResetAccumulators(); // also triggered by 'r'
 			}
 
+			ImGui::Separator();
+			if ( !capture.Active() ) {
+				ImGui::RadioButton( "QOI", &host.captureFormat, 0 );
+				ImGui::SameLine();
+				ImGui::RadioButton( "Raw RGBA", &host.captureFormat, 1 );
+				ImGui::SliderInt( "Capture Every Nth Frame", &host.captureInterval, 1, 60 );
+				if ( ImGui::SmallButton( "Start Frame Capture" ) ) {
+					StartCapture();
+				}
+				ImGui::SameLine();
+				HelpMarker( "Records the postprocessed display texture every Nth frame, to a timestamped folder under capture/, with an index.csv of frame numbers and times. Frames are written on background threads - if they fall behind, frames are dropped rather than slowing down rendering." );
+			} else {
+				if ( ImGui::SmallButton( "Stop Frame Capture" ) ) {
+					StopCapture();
+				}
+			}
+			ImGui::Text( "  Captured: %llu  Dropped: %llu  Queue: %d / %d", ( unsigned long long ) capture.Captured(),
+				( unsigned long long ) capture.Dropped(), capture.QueueDepth(), capture.QueueCapacity() );
+
+			ImGui::Separator();
+			if ( !bench.active ) {
+				if ( ImGui::SmallButton( "Run Benchmark" ) ) {
+					StartBenchmark( "src/engine/benchmark.json" );
+				}
+				ImGui::SameLine();
+				HelpMarker( "Renders each configuration in src/engine/benchmark.json from the same view with the same seed, saving EXR snapshots at each checkpoint time and scoring them against a reference render. Results go to benchmark/<name>.csv, as error against render time." );
+			} else {
+				const int configurationCount = int( bench.configurations.size() );
+				ImGui::Text( "Benchmark: %s ( %d / %d ) %.1fs", bench.renderingReference ? "reference" : bench.configurations[ bench.currentConfiguration ].name.c_str(),
+					bench.renderingReference ? 0 : bench.currentConfiguration + 1, configurationCount, bench.renderMilliseconds / 1000.0f );
+				if ( ImGui::SmallButton( "Stop Benchmark" ) ) {
+					BenchmarkFinish();
+				}
+			}
 
 			ImGui::EndTabItem();
 		}
@@ -339,16 +572,69 @@ void engine::ImguiPass () {
 		}
 		if ( ImGui::BeginTabItem( " Post " ) ) {
 			// postprocessing parameters
-			ImGui::SliderInt( "Dither Mode", &post.ditherMode, 0, 10 ); // however many there are - maybe use a dropdown for this
-			ImGui::SliderInt( "Dither Method", &post.ditherMethod, 0, 10 ); // however many there are - maybe use a dropdown for this
-			ImGui::SliderInt( "Dither Pattern", &post.ditherPattern, 0, 10 ); // however many there are - maybe use a dropdown for this
+			ImGui::Combo( "Dither Colorspace", &post.ditherMode, ditherColorspaceNames, IM_ARRAYSIZE( ditherColorspaceNames ) );
+			ImGui::SliderInt( "Dither Bits", &post.ditherMethod, 1, 8 );
+			ImGui::Combo( "Dither Pattern", &post.ditherPattern, ditherPatternNames, IM_ARRAYSIZE( ditherPatternNames ) );
+			ImGui::Checkbox( "Palette", &post.paletteEnable );
+			ImGui::SameLine();
+			HelpMarker( "Only applies to the dithered screenshot. Instead of bitcrushing, every pixel goes to the nearest color of one palette from paletteList.png, in Oklab, with its own dither settings." );
+			if ( post.paletteEnable ) {
+				if ( palettes.empty() ) palettes = LoadPaletteList();
+				if ( !palettes.empty() ) {
+					ImGui::SliderInt( "Palette Index", &post.paletteIndex, 0, int( palettes.size() ) - 1 );
+					post.paletteIndex = std::clamp( post.paletteIndex, 0, int( palettes.size() ) - 1 );
+					const Palette & p = palettes[ post.paletteIndex ];
+					for ( size_t i = 0; i < p.Size(); i++ ) {
+						if ( i % 32 != 0 ) ImGui::SameLine( 0.0f, 1.0f );
+						ImGui::PushID( int( i ) );
+						const rgba & c = p.Color( int( i ) );
+						ImGui::ColorButton( "##swatch", ImVec4( c.r / 255.0f, c.g / 255.0f, c.b / 255.0f, 1.0f ), ImGuiColorEditFlags_NoTooltip, ImVec2( 8, 8 ) );
+						ImGui::PopID();
+					}
+					ImGui::Combo( "Palette Dither", &post.paletteDitherMode, paletteDitherNames, IM_ARRAYSIZE( paletteDitherNames ) );
+					ImGui::SliderFloat( "Palette Dither Strength", &post.paletteDitherStrength, 0.0f, 2.0f );
+				}
+			}
 			ImGui::Separator();
-			ImGui::SliderInt( "Tonemap Mode", &post.tonemapMode, 0, 8 ); // whatever the range ends up being
+			ImGui::Combo( "Tonemap Mode", &post.tonemapMode, tonemapModeNames, IM_ARRAYSIZE( tonemapModeNames ) );
+			if ( post.tonemapMode == localTonemapMode ) {
+				bool gridChanged = false;
+				gridChanged |= ImGui::SliderFloat( "Local Spatial Sigma", &post.localTonemap.spatialSigma, 4.0f, 256.0f, "%.1f", ImGuiSliderFlags_Logarithmic );
+				ImGui::SameLine();
+				HelpMarker( "Splits log luminance into an edge preserving base layer and detail, with a bilateral grid built on the CPU in the background. The base is compressed into the contrast range, detail is kept. Spatial sigma is in pixels, range sigma in stops - larger spatial sigma makes the grid smaller, so it gets cheaper, not more expensive." );
+				gridChanged |= ImGui::SliderFloat( "Local Range Sigma", &post.localTonemap.rangeSigma, 0.1f, 2.0f );
+				gridChanged |= ImGui::SliderFloat( "Local Contrast ( Stops )", &post.localTonemap.contrast, 1.0f, 12.0f );
+				gridChanged |= ImGui::SliderFloat( "Local Detail", &post.localTonemap.detail, 0.0f, 3.0f );
+				ImGui::SliderInt( "Local Refresh Interval", &post.localTonemapInterval, 1, 240 );
+				if ( gridChanged ) localTonemapFramesUntilRefresh = 0;
+			}
 			ImGui::Separator();
 			ImGui::ColorEdit3( "Depth Fog Color", ( float * ) &post.fogColor, ImGuiColorEditFlags_PickerHueWheel );
 			ImGui::SliderInt( "Depth Fog Mode", &post.depthMode, 0, 12 );
 			ImGui::SliderFloat( "Fog Depth Scalar", &post.depthScale, 0.01f, 10.0f );
 			ImGui::SliderFloat( "Gamma Correction", &post.gamma, 0.01f, 3.0f );
+			ImGui::SliderFloat( "Color Temperature", &post.colorTemp, 1000.0f, 40000.0f );
+			ImGui::Separator();
+			ImGui::Checkbox( "Bloom", &post.bloomEnable );
+			ImGui::SameLine();
+			HelpMarker( "Convolves the accumulator with a large kernel through an FFT on the CPU, in the background, and mixes the result in ahead of the fog and tonemap. Intensity only changes the mix, the kernel and the last convolution are kept." );
+			ImGui::SliderFloat( "Bloom Intensity", &post.bloomIntensity, 0.0f, 1.0f );
+			ImGui::SliderInt( "Bloom Refresh Interval", &post.bloomInterval, 1, 240 );
+			bool kernelChanged = ImGui::Combo( "Bloom Kernel", &post.bloomKernel, "Starburst\0Loaded PSF\0" );
+			if ( post.bloomKernel == 0 ) {
+				kernelChanged |= ImGui::SliderInt( "Starburst Radius", &post.starburst.radius, 8, 1024 );
+				kernelChanged |= ImGui::SliderInt( "Starburst Spikes", &post.starburst.spikes, 0, 16 );
+				kernelChanged |= ImGui::SliderFloat( "Starburst Rotation", &post.starburst.rotation, 0.0f, 6.2831853f );
+				kernelChanged |= ImGui::SliderFloat( "Starburst Sharpness", &post.starburst.sharpness, 1.0f, 512.0f, "%.1f", ImGuiSliderFlags_Logarithmic );
+				kernelChanged |= ImGui::SliderFloat( "Starburst Core Width", &post.starburst.coreWidth, 0.5f, 8.0f );
+				kernelChanged |= ImGui::SliderFloat( "Starburst Glow", &post.starburst.glow, 0.0f, 0.2f );
+				kernelChanged |= ImGui::SliderFloat( "Starburst Dispersion", &post.starburst.dispersion, 0.0f, 0.3f );
+			} else {
+				ImGui::InputText( "PSF Path", post.bloomPSFPath, IM_ARRAYSIZE( post.bloomPSFPath ) );
+				ImGui::SameLine();
+				kernelChanged |= ImGui::SmallButton( "Load" );
+			}
+			if ( kernelChanged ) bloomKernelDirty = true;
 			ImGui::SliderInt( "Display Type", &post.displayType, 0, 2 );
 			ImGui::SameLine();
 			switch ( post.displayType ) {
@@ -359,6 +645,72 @@ void engine::ImguiPass () {
 			}
 			ImGui::EndTabItem();
 		}
+		if ( ImGui::BeginTabItem( " Glitch " ) ) {
+			if ( ImGui::Button( "Capture Accumulator" ) ) {
+				glitch.SetInput( GrabAccumulator() );
+				glitch.SetGlyphs( AssetCache::Get().LoadImage( "src/fonts/fontRenderer/whiteOnClear.png" ) );
+				if ( glitch.Size() == 0 ) glitch.Add( glitchNode() ); // the input node
+			}
+			ImGui::SameLine();
+			if ( ImGui::Button( "Apply" ) ) ApplyGlitch();
+			ImGui::SameLine();
+			ImGui::Checkbox( "Live", &glitchLive );
+			ImGui::SameLine();
+			HelpMarker( "Effects run on a captured copy of the accumulator, the result of the last node replaces the accumulator contents. Nodes work on the output of an earlier node, masked by another node's red channel. With Live set, changes are applied as they're made - only nodes that changed, and the ones after them, are evaluated again." );
+			ImGui::SliderInt( "Tile Size", &glitch.tileSize, 8, 256 );
+
+			for ( int i = 0; i < glitch.Size(); i++ ) {
+				glitchNode & n = glitch.Node( i );
+				ImGui::PushID( i );
+				ImGui::Separator();
+				ImGui::Text( "Node %d: %s", i, glitchOpNames[ int( n.op ) ] );
+				int op = int( n.op );
+				if ( ImGui::Combo( "Op", &op, glitchOpNames, IM_ARRAYSIZE( glitchOpNames ) ) ) n.op = glitchOp( op );
+				if ( n.op != glitchOp::input ) {
+					ImGui::SliderInt( "Input", &n.input, -1, i - 1 );
+					if ( n.op != glitchOp::mask ) ImGui::SliderInt( "Mask", &n.mask, -1, i - 1 );
+					switch ( n.op ) {
+						case glitchOp::mask:
+						case glitchOp::clear: {
+							int pattern = int( n.pattern );
+							if ( ImGui::Combo( "Pattern", &pattern, glitchPatternNames, IM_ARRAYSIZE( glitchPatternNames ) ) ) n.pattern = glitchPattern( pattern );
+							ImGui::SliderInt( "Cell Size", &n.size, 1, 64 );
+							ImGui::SliderFloat( "Probability", &n.amount, 0.0f, 1.0f );
+							ImGui::Checkbox( "Invert", &n.invert );
+							break;
+						}
+						case glitchOp::glyphStamp:
+							ImGui::SliderInt( "Scale", &n.size, 1, 8 );
+							ImGui::SliderFloat( "Glyphs Per Tile", &n.amount, 0.0f, 16.0f );
+							ImGui::ColorEdit3( "Color", n.color, ImGuiColorEditFlags_Float | ImGuiColorEditFlags_HDR );
+							ImGui::Combo( "Stamp", &n.stampMode, "Additive\0Subtractive\0Random\0" );
+							break;
+						case glitchOp::blur: ImGui::SliderInt( "Radius", &n.size, 1, 32 ); break;
+						case glitchOp::dither: ImGui::SliderInt( "Bits", &n.size, 1, 8 ); break;
+						case glitchOp::resetSamples: ImGui::SliderFloat( "Sample Count", &n.amount, 0.0f, 64.0f ); break;
+						case glitchOp::byteShuffle:
+							ImGui::SliderInt( "Span ( bytes )", &n.size, 2, 64 );
+							ImGui::SliderFloat( "Probability", &n.amount, 0.0f, 1.0f );
+							break;
+						default: break;
+					}
+					int seed = int( n.seed );
+					if ( ImGui::InputInt( "Seed", &seed ) ) n.seed = uint32_t( seed );
+				}
+				ImGui::PopID();
+			}
+			if ( ImGui::Button( "Add Node" ) ) {
+				glitchNode n;
+				n.op = glitchOp::clear;
+				n.input = glitch.Size() - 1;
+				glitch.Add( n );
+			}
+			ImGui::SameLine();
+			if ( ImGui::Button( "Remove Node" ) ) glitch.RemoveLast();
+
+			if ( glitchLive && glitch.Changed() ) ApplyGlitch();
+			ImGui::EndTabItem();
+		}
 		ImGui::EndTabBar();
 	}
 
@@ -429,7 +781,7 @@ void engine::HandleEvents () {
 	const float scalar = SDL_GetModState() & KMOD_SHIFT ? 0.02f : 0.0005f;
 
 	ImGuiIO &io = ImGui::GetIO();
-	if ( !io.WantCaptureKeyboard ) {
+	if ( !io.WantCaptureKeyboard && !bench.active ) { // camera is fixed while benchmarking
 
 		if ( state[ SDL_SCANCODE_P ] ) {
 			cout << to_string( core.viewerPosition ) << newline;	// show current position of the viewer
@@ -542,11 +894,11 @@ ivec2 engine::GetTile () {
 
 	static std::vector< ivec2 > offsets;
 	static int listOffset = 0;
-	std::random_device rd;
-	std::mt19937 rngen( rd() );
 
 	if ( host.tileSizeUpdated == true ) { // construct the tile list ( runs at frame 0 and again any time the value changes )
 		host.tileSizeUpdated = false;
+		offsets.clear();
+		listOffset = 0;
 		for ( int x = 0; x <= config.width; x += host.tileSize ) {
 			for ( int y = 0; y <= config.height; y += host.tileSize ) {
 				offsets.push_back( ivec2( x, y ) );
@@ -558,7 +910,7 @@ ivec2 engine::GetTile () {
 		}
 	}
 	// shuffle when listOffset is zero ( first iteration, and any subsequent resets )
-	if ( !listOffset ) std::shuffle( offsets.begin(), offsets.end(), rngen );
+	if ( !listOffset ) std::shuffle( offsets.begin(), offsets.end(), rng );
 	return offsets[ listOffset ];
 }
 
@@ -578,7 +930,7 @@ void engine::BasicScreenShot () {
 	// is it desirable to be able to save the floating point format color accumulator, or the normal/depth accumulator? tbd
 
 	std::vector< unsigned char > imageAsBytes;
-	imageAsBytes.reserve( config.width * config.height * 4 );
+	imageAsBytes.resize( config.width * config.height * 4 );
 
 	glBindTexture( GL_TEXTURE_2D, displayTexture );
 	glGetTexImage( GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &imageAsBytes[ 0 ] );
@@ -586,13 +938,7 @@ void engine::BasicScreenShot () {
 	// reorder the pixels, as the image coming from the GPU will be upside down
 	std::vector< unsigned char > outputBytes;
 	outputBytes.resize( config.width * config.height * 4 );
-	for ( int x = 0; x < config.width; x++ ) {
-		for ( int y = 0; y < config.height; y++ ) {
-			for ( int c = 0; c < 4; c++ ) {
-				outputBytes[ ( ( x + y * config.width ) * 4 ) + c ] = imageAsBytes[ ( x + ( config.height - y - 1 ) * config.width ) * 4 + c ];
-			}
-		}
-	}
+	ConvertImage< pixelFormat::RGBA8, pixelFormat::RGBA8 >( imageAsBytes.data(), outputBytes.data(), config.width, config.height, true );
 
 	// get timestamp and save
 	auto now = std::chrono::system_clock::now();
@@ -602,26 +948,212 @@ void engine::BasicScreenShot () {
 	ss << std::put_time( std::localtime( &in_time_t ), "Screenshot-%Y-%m-%d %X" ) << ".png";
 	std::string filename = ss.str();
 
-	unsigned error;
-	if ( ( error = lodepng::encode( filename.c_str(), outputBytes, config.width, config.height ) ) ) {
-		std::cout << "encode error during save( \"" + filename + "\" ) " << error << ": " << lodepng_error_text( error ) << std::endl;
+	if ( !WritePNGFile( filename, EncodePNG( outputBytes.data(), config.width, config.height ) ) ) {
+		std::cout << "encode error during save( \"" + filename + "\" )" << std::endl;
+	}
+}
+
+void engine::DitheredScreenShot () {
+	ZoneScoped;
+
+	// same bloom, fog, gamma and tonemap as the postprocess shader, then the dither stage on the display referred result
+	ImageF color = GrabAccumulator();
+	ImageF normalDepth = GrabAccumulator( true );
+	if ( post.bloomEnable ) {
+		// fresh convolution of what's being saved, rather than the last one from the background
+		if ( bloomJob.valid() ) bloomJob.wait(); // left for UpdateBloom to pick up
+		if ( bloomKernelDirty ) {
+			BuildBloomKernel();
+			bloomKernelDirty = false;
+		}
+		bloom.Apply( color, post.bloomIntensity );
+	}
+	ImageF display = PostprocessImageF( color, &normalDepth, CPUPostprocessSettings() );
+
+	std::shared_ptr< const Image > blueNoise = AssetCache::Get().LoadImage( "src/noise/blueNoise.png" );
+	Image result;
+	if ( post.paletteEnable && palettes.empty() ) palettes = LoadPaletteList();
+	if ( post.paletteEnable && !palettes.empty() ) {
+		// palette matching works on linear values, display ones have the sRGB curve applied
+		ParallelFor( 0, int( display.height ), [ & ] ( int y ) {
+			float * row = &display.data[ size_t( y ) * display.width * 4 ];
+			for ( uint32_t x = 0; x < display.width; x++ ) {
+				for ( int c = 0; c < 3; c++ ) {
+					const float v = row[ x * 4 + c ]; // NaN fails the compare and goes to zero, std::clamp would keep it
+					row[ x * 4 + c ] = SRGBToLinear( ( v > 0.0f ) ? std::min( v, 1.0f ) : 0.0f );
+				}
+			}
+		}, 8 );
+		paletteMapParameters parameters;
+		parameters.dither = paletteDither( std::clamp( post.paletteDitherMode, 0, int( IM_ARRAYSIZE( paletteDitherNames ) ) - 1 ) );
+		parameters.strength = post.paletteDitherStrength;
+		parameters.blueNoise = blueNoise.get();
+		result = palettes[ std::clamp( post.paletteIndex, 0, int( palettes.size() ) - 1 ) ].Map( display, parameters );
+	} else {
+		ditherParameters parameters;
+		parameters.colorspace = ditherColorspace( std::clamp( post.ditherMode, 0, int( IM_ARRAYSIZE( ditherColorspaceNames ) ) - 1 ) );
+		parameters.pattern = ditherPattern( std::clamp( post.ditherPattern, 0, int( IM_ARRAYSIZE( ditherPatternNames ) ) - 1 ) );
+		parameters.bits = post.ditherMethod;
+		parameters.blueNoise = blueNoise.get();
+		result = DitherImage( display, parameters );
 	}
+
+	// get timestamp and save
+	auto now = std::chrono::system_clock::now();
+	auto in_time_t = std::chrono::system_clock::to_time_t( now );
+
+	std::stringstream ss;
+	ss << std::put_time( std::localtime( &in_time_t ), "Dithered-%Y-%m-%d %X" ) << ".png";
+	result.Save( ss.str() );
 }
 
 void engine::EXRScreenshot () {
 	ZoneScoped;
+	GrabAccumulator().saveEXR( "test.exr" );
+}
+
+ImageF engine::GrabAccumulator ( bool normalAndDepth ) {
+	ZoneScoped;
 
 	std::vector< GLfloat > imageAsFloats;
 	imageAsFloats.resize( config.width * config.height * 4, 0 );
 
-	glBindTexture( GL_TEXTURE_2D, colorAccumulatorTexture );
+	glMemoryBarrier( GL_ALL_BARRIER_BITS );
+	glBindTexture( GL_TEXTURE_2D, normalAndDepth ? normalAccumulatorTexture : colorAccumulatorTexture );
 	glGetTexImage( GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &imageAsFloats[ 0 ] );
 	glBindTexture( GL_TEXTURE_2D, displayTexture ); // restore state
 
-	ImageF ssImage( config.width, config.height );
+	ImageF result( config.width, config.height );
+
+	// copy with correction for how it comes out of the buffer
+	ConvertImage< pixelFormat::RGBA32F, pixelFormat::RGBA32F >( imageAsFloats.data(), result.data.data(), config.width, config.height, true );
+	return result;
+}
+
+postprocessSettings engine::CPUPostprocessSettings () {
+	postprocessSettings s;
+	s.tonemapMode = post.tonemapMode;
+	s.depthMode = post.depthMode;
+	s.depthScale = post.depthScale;
+	s.maxDistance = core.maxDistance;
+	s.fogColor[ 0 ] = post.fogColor.x;
+	s.fogColor[ 1 ] = post.fogColor.y;
+	s.fogColor[ 2 ] = post.fogColor.z;
+	s.gamma = post.gamma;
+	const vec3 whiteBalance = GetColorForTemperature( post.colorTemp ) / GetColorForTemperature( 6500.0f );
+	s.whiteBalance[ 0 ] = whiteBalance.x;
+	s.whiteBalance[ 1 ] = whiteBalance.y;
+	s.whiteBalance[ 2 ] = whiteBalance.z;
+	s.displayType = post.displayType;
+	s.local = post.localTonemap;
+	return s;
+}
+
+void engine::CheckCPUPostprocess () {
+	ZoneScoped;
+
+	// run the shader once more on the current accumulator contents, so the display texture is up to date
+	Postprocess();
+	glMemoryBarrier( GL_ALL_BARRIER_BITS );
+
+	std::vector< uint8_t > gpuBytes( size_t( config.width ) * config.height * 4 );
+	glBindTexture( GL_TEXTURE_2D, displayTexture );
+	glGetTexImage( GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, gpuBytes.data() );
+	Image gpu( config.width, config.height );
+	ConvertImage< pixelFormat::RGBA8, pixelFormat::RGBA8 >( gpuBytes.data(), gpu.data.data(), config.width, config.height, true );
+
+	ImageF color = GrabAccumulator();
+	ImageF normalDepth = GrabAccumulator( true );
+	if ( post.bloomEnable ) {
+		// the convolution the shader is using, not a fresh one
+		FFTBloom::Mix( color, bloomResult, post.bloomIntensity );
+	}
+	postprocessSettings s = CPUPostprocessSettings();
+	s.lut = &colorGrade; // same path as the shader - Postprocess() above already brought the LUT up to date
+	s.localGrid = localTonemap.Valid() ? &localTonemap : nullptr; // and the same grid, not a fresh one
+	Tick();
+	Image cpu = PostprocessImage( color, &normalDepth, s );
+	const float milliseconds = Tock() / 1000.0f;
+
+	int maxDifference = 0;
+	size_t overOne = 0;
+	for ( size_t i = 0; i < cpu.data.size(); i++ ) {
+		if ( i % 4 == 3 ) continue;
+		const int difference = std::abs( int( cpu.data[ i ] ) - int( gpu.data[ i ] ) );
+		maxDifference = std::max( maxDifference, difference );
+		overOne += ( difference > 1 );
+	}
+	cout << "CPU postprocess ( " << tonemapModeNames[ std::clamp( post.tonemapMode, 0, int( IM_ARRAYSIZE( tonemapModeNames ) ) - 1 ) ] << " ) in "
+		<< milliseconds << "ms - max difference from GPU " << maxDifference << ", " << overOne << " channels off by more than 1" << newline;
+}
+
+void engine::CheckColorGradeLUT () {
+	ZoneScoped;
+
+	const postprocessSettings s = CPUPostprocessSettings();
+	const char * name = tonemapModeNames[ std::clamp( post.tonemapMode, 0, int( IM_ARRAYSIZE( tonemapModeNames ) ) - 1 ) ];
+	if ( !ColorGradeLUT::Bakeable( post.tonemapMode, post.gamma ) ) {
+		cout << "Color grade LUT ( " << name << " ) - not baked, this tonemap / gamma runs analytic" << newline;
+		return;
+	}
+	colorGrade.Update( s );
+	Tick();
+	const float error = colorGrade.MaxError( s );
+	const float milliseconds = Tock() / 1000.0f;
+	cout << "Color grade LUT ( " << name << ", gamma " << post.gamma << ", " << post.colorTemp << "k ) - max error "
+		<< error * 255.0f << "/255 against the analytic curves, checked in " << milliseconds << "ms" << newline;
+}
+
+void engine::StartCapture () {
+	ZoneScoped;
+
+	const GLsizeiptr frameBytes = GLsizeiptr( config.width ) * config.height * 4;
+	glGenBuffers( 2, capturePBO );
+	for ( int i = 0; i < 2; i++ ) {
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, capturePBO[ i ] );
+		glBufferData( GL_PIXEL_PACK_BUFFER, frameBytes, nullptr, GL_STREAM_READ );
+		capturePending[ i ] = false;
+	}
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	captureSlot = 0;
+
+	capture.Start( config.width, config.height, host.captureFormat == 0 ? captureFormat::QOI : captureFormat::RAW, host.captureInterval );
+	cout << "Frame capture started, writing to " << capture.Directory() << newline;
+}
+
+void engine::StopCapture () {
+	ZoneScoped;
+
+	capture.Stop(); // a readback still in flight is dropped
+	glDeleteBuffers( 2, capturePBO );
+	capturePBO[ 0 ] = capturePBO[ 1 ] = 0;
+	cout << "Frame capture stopped, " << capture.Captured() << " frames written, " << capture.Dropped() << " dropped" << newline;
+}
+
+void engine::CaptureFrame () {
+	if ( !capture.Active() ) return;
+	ZoneScoped;
 
-	std::copy( imageAsFloats.begin(), imageAsFloats.end(), ssImage.data.begin() );
-	ssImage.FlipVertical(); // correction for how it comes out of the buffer
+	// start this frame's readback into one PBO - returns immediately, the copy happens on the GPU's schedule
+	if ( capture.WantsFrame() ) {
+		glMemoryBarrier( GL_PIXEL_BUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT );
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, capturePBO[ captureSlot ] );
+		glBindTexture( GL_TEXTURE_2D, displayTexture );
+		glGetTexImage( GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+		capturePending[ captureSlot ] = true;
+		captureFrameNumber[ captureSlot ] = capture.FrameNumber();
+	}
 
-	ssImage.saveEXR( "test.exr" );
+	// and pick up last frame's from the other, which has had a whole frame to land
+	captureSlot ^= 1;
+	if ( capturePending[ captureSlot ] ) {
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, capturePBO[ captureSlot ] );
+		const uint8_t * pixels = ( const uint8_t * ) glMapBuffer( GL_PIXEL_PACK_BUFFER, GL_READ_ONLY );
+		if ( pixels ) {
+			capture.Submit( pixels, config.width, config.height, captureFrameNumber[ captureSlot ], true ); // GL rows are bottom up
+			glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+		}
+		capturePending[ captureSlot ] = false;
+	}
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
 }
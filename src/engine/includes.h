@@ -11,7 +11,9 @@
 #include <cstdlib>
 #include <ctime>
 #include <deque>
+#include <filesystem>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
@@ -73,6 +75,30 @@ using glm::mat4;
 // image load/save/resize/access/manipulation wrapper
 #include "../ImageHandling/Image.h"
 
+// decoded image cache, shared across the process and persisted to disk
+#include "../ImageHandling/AssetCache.h"
+
+// error metrics against a reference image, used by the benchmark harness
+#include "../ImageHandling/ImageMetrics.h"
+
+// frame sequence recording, on writer threads
+#include "../ImageHandling/FrameCapture.h"
+
+// CPU port of the postprocess shader - depth fog, gamma, tonemap
+#include "../ImageHandling/Postprocess.h"
+
+// FFT convolution bloom on the float accumulator, with a generated starburst or loaded PSF kernel
+#include "../ImageHandling/Bloom.h"
+
+// CPU bitcrush / ordered / error diffusion dithering, in a few color spaces
+#include "../ImageHandling/Dither.h"
+
+// nearest color palette mapping with dithering, palettes from paletteList.png
+#include "../ImageHandling/Palette.h"
+
+// glitch effect graph over the float accumulator - masks, glyph stamps, clears, byte shuffles, evaluated per tile
+#include "../ImageHandling/Glitch.h"
+
 // simple std::chrono wrapper
 #include "Timer.h"
 
@@ -153,6 +179,9 @@ struct hostParameters {
 	bool tileSizeUpdated = true;					// (re)builds the tile list
 	int tileSize = 512;								// size of one rendering tile ( square )
 
+	int captureInterval = 1;						// frame capture keeps every Nth presented frame
+	int captureFormat = 0;							// 0 is QOI, 1 is raw RGBA8
+
 	// this stuff is still WIP
 	// int screenshotDim = WIDTH; 					// width of the screenshot - the code maintains the aspect ratio of HEIGHT/WIDTH
 	// int numSamplesScreenshot = 128; 				// how many samples to take when rendering the screenshot
@@ -197,17 +226,70 @@ struct sceneParameters {
 	glm::vec3 metallicDiffuse	= glm::vec3( 0.618f, 0.362f, 0.04f );
 };
 
+// benchmark harness - renders a fixed view with a fixed seed per configuration, scoring snapshots against a reference
+struct benchmarkConfiguration {
+	string name = string( "default" );
+	float understep = 0.618f;
+	float epsilon = 0.0001f;
+	int maxSteps = 250;
+	int tileSize = 512;
+	int normalMethod = 1;
+};
+
+struct benchmarkState {
+	bool active = false;
+	bool quitWhenDone = false;						// exit the application after the last configuration ( command line runs )
+	bool renderingReference = false;				// currently accumulating the reference image, rather than a configuration
+
+	uint64_t seed = 0;								// rng is reseeded with this at the start of every configuration
+	glm::vec3 viewerPosition = glm::vec3( 0.0f );
+	glm::vec3 basisX = glm::vec3( 1.0f, 0.0f, 0.0f );
+	glm::vec3 basisY = glm::vec3( 0.0f, 1.0f, 0.0f );
+	glm::vec3 basisZ = glm::vec3( 0.0f, 0.0f, 1.0f );
+
+	string outputDirectory = string( "benchmark/" );
+	string referencePath;							// loaded if present, otherwise rendered and saved here
+	float referenceSeconds = 300.0f;				// render time budget for the reference
+	benchmarkConfiguration referenceConfiguration;
+	std::vector< float > checkpointSeconds;			// increasing render time budgets to snapshot at
+	std::vector< benchmarkConfiguration > configurations;
+
+	int currentConfiguration = 0;
+	int nextCheckpoint = 0;
+	float renderMilliseconds = 0.0f;				// time spent in the tile loop, for the current configuration
+	ImageF reference;
+	std::ofstream curve;							// time-to-quality csv for the current configuration
+
+	// parameters as they were before the benchmark started, restored at the end
+	coreParameters savedCore;
+	int savedTileSize = 512;
+};
+
 struct postParameters {
-	int ditherMode = 0;								// colorspace
-	int ditherMethod = 0;							// bitcrush bitcount or exponential scalar
-	int ditherPattern = 0;							// pattern used to dither the output
-	int tonemapMode = 0;							// tonemap curve to use
+	int ditherMode = 0;								// colorspace, see ditherColorspace in Dither.h
+	int ditherMethod = 8;							// bitcrush bitcount, per channel
+	int ditherPattern = 0;							// pattern used to dither the output, see ditherPattern in Dither.h
+	bool paletteEnable = false;						// dithered screenshot maps to a palette instead of bitcrushing
+	int paletteIndex = 0;							// row of paletteList.png
+	int paletteDitherMode = 1;						// see paletteDither in Palette.h
+	float paletteDitherStrength = 1.0f;
+	int tonemapMode = 0;							// tonemap curve to use, see tonemapModeNames in Postprocess.h
 	int depthMode = 11;								// depth fog method
 	float depthScale = 0.0f;						// scalar for depth term, when computing depth effects ( fog )
 	vec3 fogColor = vec3( 1.0f );					// changes the color on the depth fog
 	float gamma = 1.6f;								// gamma correction term for the color result
 	float colorTemp = 6500.0f;						// warmer or cooler colored image, 6500k neutral by default
 	int displayType = 0;							// mode selector - show normals, show depth, show color, show postprocessed version
+
+	bool bloomEnable = false;						// mixes in the accumulator convolved with the bloom kernel, before fog / tonemap
+	float bloomIntensity = 0.1f;					// mix amount - the kernel is normalized, so this doesn't change overall brightness
+	int bloomInterval = 30;							// frames between convolutions of the accumulator, they run in the background
+	int bloomKernel = 0;							// 0 generated starburst, 1 PSF image loaded from bloomPSFPath
+	starburstSettings starburst;
+	char bloomPSFPath[ 256 ] = "";					// PNG or EXR, centered on the middle pixel
+
+	localTonemapSettings localTonemap;				// bilateral grid tonemap, when tonemapMode is localTonemapMode
+	int localTonemapInterval = 30;					// frames between grid rebuilds from the accumulator, in the background
 };
 
 
@@ -2,6 +2,10 @@
 
 int main ( int argc, char *argv[] ) {
 	engine engineInstance;
+	// "-benchmark [config.json]" runs the benchmark harness, then exits
+	if ( argc > 1 && string( argv[ 1 ] ) == "-benchmark" ) {
+		engineInstance.StartBenchmark( argc > 2 ? argv[ 2 ] : "src/engine/benchmark.json", true );
+	}
 	while( !engineInstance.MainLoop() );
 	return 0;
 }
@@ -4,6 +4,9 @@ layout( local_size_x = 32, local_size_y = 32, local_size_z = 1 ) in;
 layout( binding = 0, rgba8ui ) uniform uimage2D display;
 layout( binding = 1, rgba32f ) uniform image2D accumulatorColor;
 layout( binding = 2, rgba32f ) uniform image2D accumulatorNormal;
+layout( binding = 4 ) uniform sampler3D colorGradeLUT; // white balance, gamma and tonemap, baked on the CPU - see ColorGradeLUT in Postprocess.h
+layout( binding = 5 ) uniform sampler2D bloomTexture; // accumulator convolved with the bloom kernel, on the CPU - see Bloom.h
+layout( binding = 6 ) uniform sampler3D localTonemapGrid; // bilateral grid over log luminance, on the CPU - see LocalTonemapGrid in Postprocess.h
 
 uniform int ditherMode; 	// colorspace to do the dithering in
 uniform int ditherMethod; 	// bitcrush bitcount or exponential scalar
@@ -14,6 +17,16 @@ uniform int depthMode; 		// depth fog method
 uniform float depthScale; 	// scalar for depth term, when computing depth effects ( fog )
 uniform float maxDistance;	// maximum depth on the raymarch, used for some of the depth curves
 uniform float gamma; 		// gamma correction term for the color result
+uniform vec3 whiteBalance;	// scale from the color temperature, relative to 6500k
+uniform bool useColorGradeLUT;	// false for the tonemaps that don't bake well, those stay analytic
+uniform float lutShaperRange;	// shaper value at the top of the LUT's input range, to normalize it to [ 0, 1 ]
+uniform float bloomIntensity;	// mix toward the bloom texture, 0 when bloom is off
+uniform bool useLocalTonemap;	// tonemapMode is the local tonemap, and a grid has been built
+uniform vec3 localGridScale;	// ( x, y from the top, log2 luminance ) * scale + offset is the grid texture coordinate
+uniform vec3 localGridOffset;
+uniform float localBaseMax;		// brightest base layer value, maps to 1.0
+uniform float localCompression;	// scale on the base layer, to fit it in the target contrast
+uniform float localDetail;		// scale on the detail layer
 uniform int displayType; 	// mode selector - show normals, show depth, show color, show postprocessed version
 
 #define COLOR	0
@@ -23,6 +36,28 @@ uniform int displayType; 	// mode selector - show normals, show depth, show colo
 #include "tonemap.glsl"
 #include "depthCurves.glsl"
 
+// same shaper the LUT was baked against - pow( 1 / gamma ) then a log curve, so the lattice is spaced evenly in
+// what the tonemaps see, and the dark end gets most of the entries
+vec3 colorGrade ( vec3 col ) {
+	const float lutSize = 65.0f;
+	const float shaperEpsilon = 1.0f / 32.0f;
+	vec3 t = pow( max( col, vec3( 0.0f ) ), vec3( 1.0f / gamma ) );
+	vec3 u = clamp( log2( 1.0f + t / shaperEpsilon ) / lutShaperRange, 0.0f, 1.0f );
+	return texture( colorGradeLUT, ( u * ( lutSize - 1.0f ) + 0.5f ) / lutSize ).rgb;
+}
+
+// slice the grid at this pixel - the linear filter does the trilinear interpolation of ( sum, count ), and the
+// divide gives the base layer. Base is compressed, detail is kept, and the color follows the change in luminance
+vec3 localTonemap ( vec3 col, ivec2 location ) {
+	float luma = max( dot( col, vec3( 0.2126f, 0.7152f, 0.0722f ) ), 1.0f / 65536.0f );
+	float L = log2( luma );
+	vec2 pixel = vec2( location.x, imageSize( accumulatorColor ).y - 1 - location.y );
+	vec2 cell = texture( localTonemapGrid, vec3( pixel, L ) * localGridScale + localGridOffset ).rg;
+	float base = cell.r / max( cell.g, 1e-20f );
+	float result = ( base - localBaseMax ) * localCompression + localDetail * ( L - base );
+	return col * exp2( result - L );
+}
+
 void main() {
 	// this isn't done in tiles - it may need to be, for when rendering larger resolution screenshots - tbd
 	ivec2 location = ivec2( gl_GlobalInvocationID.xy );
@@ -34,10 +69,14 @@ void main() {
 	// color, normal, depth values come in at 32-bit per channel precision
 	switch ( displayType ) {
 		case COLOR:
-			toStore.rgb = color.rgb;
+			toStore.rgb = mix( color.rgb, texelFetch( bloomTexture, location, 0 ).rgb, bloomIntensity );
 			addDepthFog( toStore.rgb, normalAndDepth.a );
-			toStore.rgb = gammaCorrect( toStore.rgb );
-			toStore.rgb = tonemap( tonemapMode, toStore.rgb );
+			if ( useColorGradeLUT ) {
+				toStore.rgb = colorGrade( toStore.rgb );
+			} else {
+				toStore.rgb = gammaCorrect( toStore.rgb * whiteBalance );
+				toStore.rgb = useLocalTonemap ? localTonemap( toStore.rgb, location ) : tonemap( tonemapMode, toStore.rgb );
+			}
 			// do any other postprocessing work
 			//	this is things like:
 			//		- denoising? tbd
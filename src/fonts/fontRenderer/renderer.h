@@ -265,14 +265,18 @@ public:
 		fontWriteShader = shader;
 
 		// generate the altas texture - only ever needed in the context of layerManager
-		Image fontAtlas( "src/fonts/fontRenderer/whiteOnClear.png", LODEPNG );
-		fontAtlas.FlipVertical(); // for some reason loading upside down
+		std::shared_ptr< const Image > fontAtlas = AssetCache::Get().LoadImage( "src/fonts/fontRenderer/whiteOnClear.png" );
 
 		// font atlas GPU setup
 		glGenTextures( 1, &atlasTexture );
 		glActiveTexture( GL_TEXTURE1 );
 		glBindTexture( GL_TEXTURE_2D, atlasTexture );
-		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, fontAtlas.width, fontAtlas.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &fontAtlas.data.data()[ 0 ] );
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, fontAtlas->width, fontAtlas->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+		// for some reason loading upside down - rows go up bottom first, straight from the cached pixels, instead of flipping a copy
+		for ( uint32_t y = 0; y < fontAtlas->height; y++ ) {
+			glTexSubImage2D( GL_TEXTURE_2D, 0, 0, y, fontAtlas->width, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+				&fontAtlas->data[ size_t( fontAtlas->height - 1 - y ) * fontAtlas->width * 4 ] );
+		}
 	}
 
 	void Update ( float seconds ) {
@@ -0,0 +1,127 @@
+// imageCompare - error against wall clock time, for a series of checkpoint EXRs vs a reference
+	// usage: imageCompare [-maps] reference.exr checkpoint0.exr checkpoint1.exr ...
+	//   - a checkpoint can be given as path@seconds to specify its time, otherwise the file modification time
+	//     relative to the oldest checkpoint is used
+	//   - -maps writes <checkpoint>.squaredError.exr, .relMSE.exr, .SSIM.exr, .FLIP.exr next to each checkpoint
+
+#include "../ImageHandling/ImageMetrics.h"
+#include "../fonts/colors.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct checkpoint {
+	std::string path;
+	double seconds = -1.0; // negative means use the file modification time
+};
+
+int main ( int argc, char *argv[] ) {
+	bool writeMaps = false;
+	std::vector< std::string > arguments;
+	for ( int i = 1; i < argc; i++ ) {
+		std::string argument( argv[ i ] );
+		if ( argument == "-maps" ) {
+			writeMaps = true;
+		} else {
+			arguments.push_back( argument );
+		}
+	}
+
+	const char * usage = "usage: imageCompare [-maps] reference.exr checkpoint.exr[@seconds] ...";
+	if ( arguments.size() < 2 ) {
+		std::cout << usage << std::endl;
+		return 1;
+	}
+
+	ImageF reference;
+	reference.loadEXR( arguments[ 0 ].c_str() );
+	if ( reference.data.empty() ) {
+		std::cout << "failed to load reference " << arguments[ 0 ] << std::endl;
+		return 1;
+	}
+
+	// resolve checkpoint times
+	std::vector< checkpoint > checkpoints;
+	for ( size_t i = 1; i < arguments.size(); i++ ) {
+		checkpoint c;
+		const size_t at = arguments[ i ].find_last_of( '@' );
+		if ( at != std::string::npos ) {
+			c.path = arguments[ i ].substr( 0, at );
+			const std::string time = arguments[ i ].substr( at + 1 );
+			size_t parsed = 0;
+			try {
+				c.seconds = std::stod( time, &parsed );
+			} catch ( const std::exception & ) {
+				parsed = 0;
+			}
+			if ( parsed == 0 || parsed != time.size() || !( c.seconds >= 0.0 ) ) {
+				std::cout << "bad checkpoint time \"" << time << "\" in " << arguments[ i ] << std::endl << usage << std::endl;
+				return 1;
+			}
+		} else {
+			c.path = arguments[ i ];
+		}
+		checkpoints.push_back( c );
+	}
+
+	std::filesystem::file_time_type earliest = std::filesystem::file_time_type::max();
+	for ( auto & c : checkpoints ) {
+		std::error_code ec;
+		auto t = std::filesystem::last_write_time( c.path, ec );
+		if ( !ec ) earliest = std::min( earliest, t );
+	}
+	for ( auto & c : checkpoints ) {
+		if ( c.seconds < 0.0 ) {
+			std::error_code ec;
+			auto t = std::filesystem::last_write_time( c.path, ec );
+			c.seconds = ec ? 0.0 : std::chrono::duration< double >( t - earliest ).count();
+		}
+	}
+	std::stable_sort( checkpoints.begin(), checkpoints.end(), [] ( const checkpoint & a, const checkpoint & b ) {
+		return a.seconds < b.seconds;
+	} );
+
+	std::cout << T_YELLOW << BOLD << "imageCompare" << RESET << " - reference " << arguments[ 0 ] << " ( "
+		<< reference.width << "x" << reference.height << ", " << ThreadPool::Get().NumThreads() << " threads )" << std::endl;
+	std::cout << T_BLUE << std::setw( 12 ) << "time (s)" << std::setw( 14 ) << "MSE" << std::setw( 14 ) << "relMSE"
+		<< std::setw( 10 ) << "PSNR" << std::setw( 10 ) << "SSIM" << std::setw( 10 ) << "FLIP" << "   file" << RESET << std::endl;
+
+	int status = 0; // nonzero if any checkpoint couldn't be compared
+	for ( auto & c : checkpoints ) {
+		ImageF test;
+		test.loadEXR( c.path.c_str() );
+		if ( test.data.empty() ) {
+			std::cout << "  failed to load " << c.path << std::endl;
+			status = 1;
+			continue;
+		}
+
+		imageErrorMaps maps;
+		imageComparison result = CompareImages( test, reference, writeMaps ? &maps : nullptr );
+		if ( !result.valid ) {
+			std::cout << T_RED << "  size mismatch - " << c.path << " is " << test.width << "x" << test.height
+				<< ", reference is " << reference.width << "x" << reference.height << RESET << std::endl;
+			status = 1;
+			continue;
+		}
+
+		std::cout << std::fixed << std::setprecision( 3 ) << std::setw( 12 ) << c.seconds
+			<< std::scientific << std::setprecision( 4 ) << std::setw( 14 ) << result.MSE << std::setw( 14 ) << result.relMSE
+			<< std::fixed << std::setprecision( 3 ) << std::setw( 10 ) << result.PSNR << std::setw( 10 ) << result.SSIM
+			<< std::setw( 10 ) << result.FLIP << "   " << c.path << std::endl;
+
+		if ( writeMaps && !maps.FLIP.data.empty() ) {
+			maps.squaredError.saveEXR( ( c.path + ".squaredError.exr" ).c_str() );
+			maps.relativeSquaredError.saveEXR( ( c.path + ".relMSE.exr" ).c_str() );
+			maps.SSIM.saveEXR( ( c.path + ".SSIM.exr" ).c_str() );
+			maps.FLIP.saveEXR( ( c.path + ".FLIP.exr" ).c_str() );
+		}
+	}
+	return status;
+}